@@ -89,9 +89,25 @@ endmacro()
 #   specified.
 # API_VERSION Which version of the Sandboxed API to generate. Currently, only
 #   version "1" is defined.
+# ANNOTATIONS File with buffer annotations for the interface generator, one
+#   "function:buffer:length[:out_length]" per line. Only used with the Clang
+#   based generator (SAPI_ENABLE_CLANG_TOOL).
+# STATIC_PIE Link the sandboxed binary as a static position-independent
+#   executable. This skips the dynamic loader when the sandboxee starts and
+#   reduces the number of mappings copied on each fork. Only the FUNCTIONS are
+#   exported, so the list must not be empty. The LIBRARY and its dependencies
+#   must be available as position-independent static libraries.
+#   BenchmarkSumSandboxStartup in sandboxed_api/sapi_test.cc measures sandbox
+#   startup plus one call. It is built into sapi_test against the dynamically
+#   linked sum library, and into sapi_static_pie_test against the STATIC_PIE
+#   one, so running it in both binaries on the target machine compares the
+#   two modes. Library mounts are the same in both modes: the forkserver maps
+#   the binary and its libraries before the sandbox is applied, so neither
+#   needs library mounts.
 function(add_sapi_library)
-  set(_sapi_opts NOEMBED)
-  set(_sapi_one_value HEADER LIBRARY LIBRARY_NAME NAMESPACE API_VERSION)
+  set(_sapi_opts NOEMBED STATIC_PIE)
+  set(_sapi_one_value HEADER LIBRARY LIBRARY_NAME NAMESPACE API_VERSION
+                      ANNOTATIONS)
   set(_sapi_multi_value SOURCES FUNCTIONS INPUTS)
   cmake_parse_arguments(PARSE_ARGV 0 _sapi "${_sapi_opts}"
                         "${_sapi_one_value}" "${_sapi_multi_value}")
@@ -105,6 +121,9 @@ function(add_sapi_library)
   foreach(func IN LISTS _sapi_FUNCTIONS)
     list(APPEND _sapi_exported_funcs "LINKER:--export-dynamic-symbol,${func}")
   endforeach()
+  if(_sapi_STATIC_PIE AND NOT _sapi_exported_funcs)
+    message(FATAL_ERROR "STATIC_PIE requires an explicit list of FUNCTIONS")
+  endif()
   if(NOT _sapi_exported_funcs)
     set(_sapi_exported_funcs LINKER:--allow-multiple-definition)
   endif()
@@ -114,18 +133,36 @@ function(add_sapi_library)
   add_executable("${_sapi_bin}"
     "${SAPI_BINARY_DIR}/sapi_force_cxx_linkage.cc"
   )
-  target_link_libraries("${_sapi_bin}" PRIVATE
-    -fuse-ld=gold
-    -Wl,--whole-archive "${_sapi_LIBRARY}" -Wl,--no-whole-archive
-    # Needs to be whole-archive due to how it Abseil registers flags
-    -Wl,--whole-archive absl::log_flags -Wl,--no-whole-archive
-    sapi::client
-    ${CMAKE_DL_LIBS}
-  )
-  target_link_options("${_sapi_bin}" PRIVATE
-    LINKER:-E
-    ${_sapi_exported_funcs}
-  )
+  if(_sapi_STATIC_PIE)
+    set_target_properties("${_sapi_bin}" PROPERTIES
+      POSITION_INDEPENDENT_CODE ON
+    )
+    # Exporting all symbols (-E) breaks the static libc startup code, so only
+    # the FUNCTIONS are exported. The client resolves them without the dynamic
+    # loader.
+    target_link_libraries("${_sapi_bin}" PRIVATE
+      -Wl,--whole-archive "${_sapi_LIBRARY}" -Wl,--no-whole-archive
+      -Wl,--whole-archive absl::log_flags -Wl,--no-whole-archive
+      sapi::client
+    )
+    target_link_options("${_sapi_bin}" PRIVATE
+      -static-pie
+      ${_sapi_exported_funcs}
+    )
+  else()
+    target_link_libraries("${_sapi_bin}" PRIVATE
+      -fuse-ld=gold
+      -Wl,--whole-archive "${_sapi_LIBRARY}" -Wl,--no-whole-archive
+      # Needs to be whole-archive due to how it Abseil registers flags
+      -Wl,--whole-archive absl::log_flags -Wl,--no-whole-archive
+      sapi::client
+      ${CMAKE_DL_LIBS}
+    )
+    target_link_options("${_sapi_bin}" PRIVATE
+      LINKER:-E
+      ${_sapi_exported_funcs}
+    )
+  endif()
 
   if(NOT _sapi_NOEMBED)
     set(_sapi_embed "${_sapi_NAME}_embed")
@@ -162,6 +199,12 @@ function(add_sapi_library)
     else()
       list(APPEND _sapi_generator_command sapi_generator_tool)
     endif()
+    if(_sapi_ANNOTATIONS)
+      get_filename_component(_sapi_ANNOTATIONS "${_sapi_ANNOTATIONS}" ABSOLUTE)
+      list(APPEND _sapi_generator_args
+        "--sapi_annotations=${_sapi_ANNOTATIONS}"
+      )
+    endif()
     list(APPEND _sapi_generator_command
       -p "${CMAKE_CURRENT_BINARY_DIR}"
       ${_sapi_generator_args}
@@ -172,7 +215,7 @@ function(add_sapi_library)
       OUTPUT "${_sapi_gen_header}"
       COMMAND ${_sapi_generator_command}
       COMMENT "Generating interface"
-      DEPENDS ${_sapi_INPUTS}
+      DEPENDS ${_sapi_INPUTS} ${_sapi_ANNOTATIONS}
       VERBATIM
     )
   else()
@@ -208,6 +251,7 @@ function(add_sapi_library)
     ${_sapi_SOURCES}
   )
   target_link_libraries("${_sapi_NAME}" PUBLIC
+    absl::span
     absl::status
     absl::statusor
     sapi::sapi
@@ -219,6 +263,121 @@ function(add_sapi_library)
       "${_sapi_embed}"
     )
   endif()
+  # Used by add_sapi_composite_library()
+  set_target_properties("${_sapi_NAME}" PROPERTIES
+    SAPI_LIBRARY "${_sapi_LIBRARY}"
+    SAPI_FUNCTIONS "${_sapi_FUNCTIONS}"
+  )
+endfunction()
+
+# Adds a library target for a sandboxee that links several Sandboxed API
+# libraries, so that they can be called from one sandbox. Buffers can then be
+# passed between the libraries as remote pointers, without copying them to the
+# host and back. This function implements the same functionality as
+# sapi_composite_library() in sandboxed_api/bazel/sapi.bzl.
+#
+# The generated header "<name>.sapi.h" defines a <LIBRARY_NAME>Sandbox class,
+# derived from ::sapi::CompositeSandbox, that takes the policy fragments of
+# the component libraries. Use the Api classes from the headers of the
+# components with it.
+#
+# COMPONENTS The add_sapi_library() targets to combine (required). Their
+#   LIBRARY targets are linked into one sandboxed binary.
+# LIBRARY_NAME Prefix of the sandbox class name (required).
+# NAMESPACE C++ namespace identifier to place the sandbox class into.
+# SOURCES Any additional sources to include with the library.
+function(add_sapi_composite_library)
+  set(_sapi_one_value LIBRARY_NAME NAMESPACE)
+  set(_sapi_multi_value COMPONENTS SOURCES)
+  cmake_parse_arguments(PARSE_ARGV 0 _sapi "" "${_sapi_one_value}"
+                        "${_sapi_multi_value}")
+  set(_sapi_NAME "${ARGV0}")
+
+  if(NOT _sapi_COMPONENTS OR NOT _sapi_LIBRARY_NAME)
+    message(FATAL_ERROR "COMPONENTS and LIBRARY_NAME are required")
+  endif()
+
+  # Functions of all components. If any component exports all of its
+  # functions, so does the composite.
+  set(_sapi_export_all FALSE)
+  foreach(component IN LISTS _sapi_COMPONENTS)
+    get_target_property(_sapi_lib "${component}" SAPI_LIBRARY)
+    if(NOT _sapi_lib)
+      message(FATAL_ERROR
+              "${component} is not a target added by add_sapi_library()")
+    endif()
+    list(APPEND _sapi_libs
+      -Wl,--whole-archive "${_sapi_lib}" -Wl,--no-whole-archive
+    )
+    get_target_property(_sapi_funcs "${component}" SAPI_FUNCTIONS)
+    if(_sapi_funcs)
+      foreach(func IN LISTS _sapi_funcs)
+        list(APPEND _sapi_exported_funcs
+          "LINKER:--export-dynamic-symbol,${func}"
+        )
+      endforeach()
+    else()
+      set(_sapi_export_all TRUE)
+    endif()
+  endforeach()
+  if(_sapi_export_all)
+    set(_sapi_exported_funcs LINKER:--allow-multiple-definition)
+  endif()
+
+  # The sandboxed binary
+  set(_sapi_bin "${_sapi_NAME}.bin")
+  add_executable("${_sapi_bin}"
+    "${SAPI_BINARY_DIR}/sapi_force_cxx_linkage.cc"
+  )
+  target_link_libraries("${_sapi_bin}" PRIVATE
+    -fuse-ld=gold
+    ${_sapi_libs}
+    # Needs to be whole-archive due to how it Abseil registers flags
+    -Wl,--whole-archive absl::log_flags -Wl,--no-whole-archive
+    sapi::client
+    ${CMAKE_DL_LIBS}
+  )
+  target_link_options("${_sapi_bin}" PRIVATE
+    LINKER:-E
+    ${_sapi_exported_funcs}
+  )
+
+  set(_sapi_embed "${_sapi_NAME}_embed")
+  sapi_cc_embed_data(NAME "${_sapi_embed}"
+    NAMESPACE "${_sapi_NAMESPACE}"
+    SOURCES "${_sapi_bin}"
+  )
+
+  # Interface
+  set(_sapi_gen_header "${CMAKE_CURRENT_BINARY_DIR}/${_sapi_NAME}.sapi.h")
+  set(_sapi_embed_header "${CMAKE_CURRENT_BINARY_DIR}/${_sapi_embed}.h")
+  string(REPLACE "-" "_" _sapi_embed_ident "${_sapi_embed}")
+  file(RELATIVE_PATH _sapi_include_guard
+                     "${PROJECT_BINARY_DIR}" "${_sapi_gen_header}")
+  string(MAKE_C_IDENTIFIER "${_sapi_include_guard}" _sapi_include_guard)
+  string(TOUPPER "${_sapi_include_guard}_" _sapi_include_guard)
+  if(_sapi_NAMESPACE)
+    set(_sapi_namespace_begin "\nnamespace ${_sapi_NAMESPACE} {\n")
+    set(_sapi_namespace_end "\n}  // namespace ${_sapi_NAMESPACE}\n")
+  endif()
+  configure_file("${SAPI_SOURCE_DIR}/cmake/sapi_composite.sapi.h.in"
+                 "${_sapi_gen_header}" @ONLY)
+
+  # Library with the interface
+  if(NOT _sapi_SOURCES)
+    list(APPEND _sapi_SOURCES
+      "${SAPI_BINARY_DIR}/sapi_force_cxx_linkage.cc"
+    )
+  endif()
+  add_library("${_sapi_NAME}" STATIC
+    "${_sapi_gen_header}"
+    ${_sapi_SOURCES}
+  )
+  target_link_libraries("${_sapi_NAME}" PUBLIC
+    ${_sapi_COMPONENTS}
+    "${_sapi_embed}"
+    sapi::sapi
+  )
 endfunction()
 
 # Wrapper for gtest_discover_tests to exclude tests discover when cross compiling.
@@ -0,0 +1,198 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "contrib/codec_benchmark/benchmark.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "contrib/codec_benchmark/codec.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace codec_benchmark {
+namespace {
+
+// Collects the measurements of one operation.
+class Recorder {
+ public:
+  void Add(int64_t bytes, absl::Duration latency, absl::Duration transfer) {
+    bytes_ += bytes;
+    latencies_.push_back(latency);
+    transfer_ += transfer;
+  }
+
+  Result Finish(const Codec& codec, const std::string& op) {
+    Result result;
+    result.codec = codec.name();
+    result.mode = codec.mode();
+    result.op = op;
+    result.bytes = bytes_;
+    result.operations = latencies_.size();
+    result.transfer = transfer_;
+    for (absl::Duration latency : latencies_) {
+      result.total += latency;
+    }
+    std::sort(latencies_.begin(), latencies_.end());
+    if (!latencies_.empty()) {
+      result.p50 = Percentile(50);
+      result.p99 = Percentile(99);
+    }
+    return result;
+  }
+
+ private:
+  absl::Duration Percentile(int percentile) const {
+    const size_t index = (latencies_.size() - 1) * percentile / 100;
+    return latencies_[index];
+  }
+
+  int64_t bytes_ = 0;
+  absl::Duration transfer_;
+  std::vector<absl::Duration> latencies_;
+};
+
+absl::Status CheckDecoded(const Sample& sample,
+                          const std::vector<uint8_t>& decoded) {
+  if (sample.is_image() && decoded.size() != sample.data.size()) {
+    return absl::DataLossError(
+        absl::StrCat("Decoding ", sample.name, " yielded ", decoded.size(),
+                     " bytes, expected ", sample.data.size()));
+  }
+  return absl::OkStatus();
+}
+
+double Percent(absl::Duration part, absl::Duration total) {
+  return total > absl::ZeroDuration() ? 100 * (part / total) : 0;
+}
+
+}  // namespace
+
+absl::StatusOr<std::vector<Result>> RunBenchmark(
+    Codec& codec, absl::Span<const Sample> samples,
+    absl::Span<const std::vector<uint8_t>> encoded, int iterations) {
+  if (encoded.size() != samples.size()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Got ", encoded.size(), " encoded inputs for ",
+                     samples.size(), " samples"));
+  }
+  Recorder encodes;
+  Recorder decodes;
+  // The first pass warms up caches and the sandboxee's heap and is not timed.
+  for (int i = -1; i < iterations; ++i) {
+    const bool timed = i >= 0;
+    for (size_t j = 0; j < samples.size(); ++j) {
+      const Sample& sample = samples[j];
+      if (!codec.Accepts(sample)) {
+        continue;
+      }
+      absl::Time start = absl::Now();
+      SAPI_RETURN_IF_ERROR(codec.Encode(sample).status());
+      absl::Duration latency = absl::Now() - start;
+      absl::Duration transfer = codec.TakeTransferTime();
+      if (timed) {
+        encodes.Add(sample.data.size(), latency, transfer);
+      }
+
+      start = absl::Now();
+      SAPI_ASSIGN_OR_RETURN(std::vector<uint8_t> decoded,
+                            codec.Decode(sample, encoded[j]));
+      latency = absl::Now() - start;
+      transfer = codec.TakeTransferTime();
+      SAPI_RETURN_IF_ERROR(CheckDecoded(sample, decoded));
+      if (timed) {
+        decodes.Add(decoded.size(), latency, transfer);
+      }
+    }
+  }
+  return std::vector<Result>{encodes.Finish(codec, "encode"),
+                             decodes.Finish(codec, "decode")};
+}
+
+absl::StatusOr<std::vector<Result>> RunBenchmarks(
+    absl::Span<const std::unique_ptr<Codec>> codecs,
+    absl::Span<const Sample> samples, int iterations) {
+  std::vector<Result> results;
+  std::string library;
+  std::vector<std::vector<uint8_t>> encoded;
+  for (const std::unique_ptr<Codec>& codec : codecs) {
+    if (codec->name() != library) {
+      if (codec->mode() != "native") {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "The first codec of ", codec->name(), " is not native"));
+      }
+      library = codec->name();
+      encoded.assign(samples.size(), {});
+      for (size_t i = 0; i < samples.size(); ++i) {
+        if (codec->Accepts(samples[i])) {
+          SAPI_ASSIGN_OR_RETURN(encoded[i], codec->Encode(samples[i]));
+        }
+      }
+    }
+    SAPI_ASSIGN_OR_RETURN(std::vector<Result> codec_results,
+                          RunBenchmark(*codec, samples, encoded, iterations));
+    std::move(codec_results.begin(), codec_results.end(),
+              std::back_inserter(results));
+  }
+  return results;
+}
+
+std::string FormatResults(absl::Span<const Result> results) {
+  std::string table = absl::StrFormat(
+      "%-10s %-14s %-6s %10s %10s %10s %9s %9s\n", "codec", "mode", "op",
+      "MB/s", "p50 us", "p99 us", "transfer", "overhead");
+  for (const Result& result : results) {
+    const double seconds = absl::ToDoubleSeconds(result.total);
+    const double throughput = seconds > 0 ? result.bytes / seconds / 1e6 : 0;
+    absl::StrAppendFormat(&table, "%-10s %-14s %-6s %10.1f %10.0f %10.0f",
+                          result.codec, result.mode, result.op, throughput,
+                          absl::ToDoubleMicroseconds(result.p50),
+                          absl::ToDoubleMicroseconds(result.p99));
+    auto native = std::find_if(
+        results.begin(), results.end(), [&result](const Result& other) {
+          return other.codec == result.codec && other.op == result.op &&
+                 other.mode == "native";
+        });
+    if (result.mode == "native" || native == results.end()) {
+      absl::StrAppend(&table, "\n");
+      continue;
+    }
+    // Normalize the native time to the work done by this result, in case the
+    // iteration counts differ.
+    absl::Duration native_total = native->total;
+    if (native->bytes > 0) {
+      native_total = native_total * (static_cast<double>(result.bytes) /
+                                     native->bytes);
+    }
+    const absl::Duration overhead = std::max(
+        result.total - result.transfer - native_total, absl::ZeroDuration());
+    absl::StrAppendFormat(&table, " %8.1f%% %8.1f%%\n",
+                          Percent(result.transfer, result.total),
+                          Percent(overhead, result.total));
+  }
+  return table;
+}
+
+}  // namespace codec_benchmark
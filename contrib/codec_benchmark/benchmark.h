@@ -0,0 +1,72 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CONTRIB_CODEC_BENCHMARK_BENCHMARK_H_
+#define CONTRIB_CODEC_BENCHMARK_BENCHMARK_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "contrib/codec_benchmark/codec.h"
+
+namespace codec_benchmark {
+
+// Measurements of one operation of a codec over the samples it accepts.
+struct Result {
+  std::string codec;
+  std::string mode;
+  // "encode" or "decode".
+  std::string op;
+  // Decoded bytes processed, summed over all iterations.
+  int64_t bytes = 0;
+  int64_t operations = 0;
+  absl::Duration total;
+  // Part of total spent moving buffers between host and sandboxee.
+  absl::Duration transfer;
+  // Latency percentiles of single operations.
+  absl::Duration p50;
+  absl::Duration p99;
+};
+
+// Encodes and decodes the samples accepted by codec iterations times, after
+// one untimed warmup pass. encoded must hold, for each sample, the output of
+// the native codec of the same library; entries of samples the codec does not
+// accept are ignored. Returns the encode and the decode result. Fails if a
+// decoded image does not have the size of its sample.
+absl::StatusOr<std::vector<Result>> RunBenchmark(
+    Codec& codec, absl::Span<const Sample> samples,
+    absl::Span<const std::vector<uint8_t>> encoded, int iterations);
+
+// Runs RunBenchmark() for codecs as returned by CreateAllCodecs(). The encoded
+// inputs of each library are produced by its native codec, which has to come
+// first.
+absl::StatusOr<std::vector<Result>> RunBenchmarks(
+    absl::Span<const std::unique_ptr<Codec>> codecs,
+    absl::Span<const Sample> samples, int iterations);
+
+// Formats results as a table with throughput in MB/s of decoded data, the
+// latency percentiles and, for sandboxed codecs, the share of the time spent
+// in buffer transfers and in the remaining sandboxing overhead (mostly RPCs).
+// The overhead is relative to the native result of the same codec and
+// operation, so that has to be part of results as well.
+std::string FormatResults(absl::Span<const Result> results);
+
+}  // namespace codec_benchmark
+
+#endif  // CONTRIB_CODEC_BENCHMARK_BENCHMARK_H_
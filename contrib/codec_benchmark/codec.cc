@@ -0,0 +1,123 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "contrib/codec_benchmark/codec.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/vars.h"
+
+namespace codec_benchmark {
+namespace {
+
+// Adds the time until it goes out of scope to a duration.
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(absl::Duration* elapsed)
+      : elapsed_(elapsed), start_(absl::Now()) {}
+  ~ScopedTimer() { *elapsed_ += absl::Now() - start_; }
+
+ private:
+  absl::Duration* elapsed_;
+  absl::Time start_;
+};
+
+}  // namespace
+
+absl::string_view TransferStrategyName(TransferStrategy strategy) {
+  switch (strategy) {
+    case TransferStrategy::kBoth:
+      return "both";
+    case TransferStrategy::kDirected:
+      return "directed";
+  }
+  return "unknown";
+}
+
+absl::Status Transfers::CopyIn(sapi::v::Var* var) {
+  ScopedTimer timer(&elapsed_);
+  SAPI_RETURN_IF_ERROR(sandbox_->Allocate(var, /*automatic_free=*/true));
+  return sandbox_->TransferToSandboxee(var);
+}
+
+absl::Status Transfers::Reserve(sapi::v::Var* var) {
+  ScopedTimer timer(&elapsed_);
+  SAPI_RETURN_IF_ERROR(sandbox_->Allocate(var, /*automatic_free=*/true));
+  if (strategy_ == TransferStrategy::kBoth) {
+    return sandbox_->TransferToSandboxee(var);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Transfers::Release(const sapi::v::Var& var) {
+  if (strategy_ != TransferStrategy::kBoth) {
+    return absl::OkStatus();
+  }
+  ScopedTimer timer(&elapsed_);
+  sapi::v::Array<uint8_t> scratch(var.GetSize());
+  scratch.SetRemote(var.GetRemote());
+  return sandbox_->TransferFromSandboxee(&scratch);
+}
+
+absl::Status Transfers::CopyOut(sapi::v::Array<uint8_t>* array, size_t used) {
+  ScopedTimer timer(&elapsed_);
+  if (strategy_ == TransferStrategy::kBoth) {
+    return sandbox_->TransferFromSandboxee(array);
+  }
+  if (used > array->GetSize()) {
+    return absl::OutOfRangeError(
+        absl::StrCat("Used size ", used, " exceeds buffer of ",
+                     array->GetSize(), " bytes"));
+  }
+  if (used == 0) {
+    return absl::OkStatus();
+  }
+  sapi::v::Array<uint8_t> head(array->GetData(), used);
+  head.SetRemote(array->GetRemote());
+  return sandbox_->TransferFromSandboxee(&head);
+}
+
+absl::StatusOr<std::vector<uint8_t>> Transfers::CopyRemote(void* remote,
+                                                           size_t size) {
+  ScopedTimer timer(&elapsed_);
+  std::vector<uint8_t> result(size);
+  if (size > 0) {
+    sapi::v::Array<uint8_t> array(result.data(), result.size());
+    array.SetRemote(remote);
+    SAPI_RETURN_IF_ERROR(sandbox_->TransferFromSandboxee(&array));
+  }
+  return result;
+}
+
+absl::Duration Transfers::TakeElapsed() {
+  absl::Duration elapsed = elapsed_;
+  elapsed_ = absl::ZeroDuration();
+  return elapsed;
+}
+
+std::string SandboxedCodec::mode() const {
+  return absl::StrCat("sapi/", TransferStrategyName(strategy_));
+}
+
+}  // namespace codec_benchmark
@@ -0,0 +1,146 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CONTRIB_CODEC_BENCHMARK_CODEC_H_
+#define CONTRIB_CODEC_BENCHMARK_CODEC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/vars.h"
+
+namespace codec_benchmark {
+
+// A corpus entry in its decoded form.
+struct Sample {
+  std::string name;
+  // Dimensions of an 8-bit RGB image, 0 for other kinds of data.
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> data;
+
+  bool is_image() const { return width > 0 && height > 0; }
+};
+
+// How buffers are moved between the host and a sandboxee.
+enum class TransferStrategy {
+  // Like v::Var::PtrBoth() on full-size buffers: inputs are copied back after
+  // the call and outputs are copied in before it.
+  kBoth,
+  // Inputs are only copied in, and only the used part of outputs is copied
+  // back.
+  kDirected,
+};
+
+absl::string_view TransferStrategyName(TransferStrategy strategy);
+
+// A codec of one library, either called directly or through a sandbox.
+class Codec {
+ public:
+  virtual ~Codec() = default;
+
+  // Name of the library, like "turbojpeg".
+  virtual std::string name() const = 0;
+
+  // How the library is called: "native" or "sapi/<strategy>".
+  virtual std::string mode() const = 0;
+
+  // Whether the codec can process the sample, e.g. images vs. fonts.
+  virtual bool Accepts(const Sample& sample) const = 0;
+
+  virtual absl::StatusOr<std::vector<uint8_t>> Encode(
+      const Sample& sample) = 0;
+
+  // Decodes data produced by Encode() of the same library. The sample is the
+  // one that was encoded.
+  virtual absl::StatusOr<std::vector<uint8_t>> Decode(
+      const Sample& sample, absl::Span<const uint8_t> encoded) = 0;
+
+  // Returns the time spent moving data between host and sandboxee since the
+  // last call.
+  virtual absl::Duration TakeTransferTime() { return absl::ZeroDuration(); }
+};
+
+// Moves buffers between the host and a sandboxee according to a
+// TransferStrategy and records the time it takes.
+class Transfers {
+ public:
+  Transfers(sapi::Sandbox* sandbox, TransferStrategy strategy)
+      : sandbox_(sandbox), strategy_(strategy) {}
+
+  // Allocates an input buffer in the sandboxee and copies it there.
+  absl::Status CopyIn(sapi::v::Var* var);
+
+  // Allocates an output buffer in the sandboxee. With kBoth, its host contents
+  // are copied in as well.
+  absl::Status Reserve(sapi::v::Var* var);
+
+  // Called after the sandboxee is done with an input buffer. With kBoth, the
+  // buffer is copied back, but to scratch memory as the host copy is const.
+  absl::Status Release(const sapi::v::Var& var);
+
+  // Copies the first used bytes of an output buffer back to the host. With
+  // kBoth, the whole buffer is copied.
+  absl::Status CopyOut(sapi::v::Array<uint8_t>* array, size_t used);
+
+  // Copies size bytes at remote, which the sandboxee allocated itself, to the
+  // host.
+  absl::StatusOr<std::vector<uint8_t>> CopyRemote(void* remote, size_t size);
+
+  // Returns the time spent since the last call.
+  absl::Duration TakeElapsed();
+
+ private:
+  sapi::Sandbox* sandbox_;
+  TransferStrategy strategy_;
+  absl::Duration elapsed_;
+};
+
+// Base class for codecs that call a library through a sandbox.
+class SandboxedCodec : public Codec {
+ public:
+  std::string mode() const override;
+  absl::Duration TakeTransferTime() override {
+    return transfers_.TakeElapsed();
+  }
+
+ protected:
+  SandboxedCodec(std::unique_ptr<sapi::Sandbox> sandbox,
+                 TransferStrategy strategy)
+      : sandbox_(std::move(sandbox)),
+        strategy_(strategy),
+        transfers_(sandbox_.get(), strategy) {}
+
+  sapi::Sandbox* sandbox() const { return sandbox_.get(); }
+  Transfers& transfers() { return transfers_; }
+
+ private:
+  std::unique_ptr<sapi::Sandbox> sandbox_;
+  TransferStrategy strategy_;
+  Transfers transfers_;
+};
+
+}  // namespace codec_benchmark
+
+#endif  // CONTRIB_CODEC_BENCHMARK_CODEC_H_
@@ -0,0 +1,75 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares the throughput of the contributed image and font codecs when called
+// directly and through their sandboxes.
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/log/globals.h"
+#include "absl/log/initialize.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "contrib/codec_benchmark/benchmark.h"
+#include "contrib/codec_benchmark/codec.h"
+#include "contrib/codec_benchmark/codecs.h"
+#include "contrib/codec_benchmark/corpus.h"
+#include "sandboxed_api/util/status_macros.h"
+
+ABSL_FLAG(int, iterations, 5, "timed passes over the corpus");
+ABSL_FLAG(int, max_image_width, 1024, "width of the largest generated image");
+ABSL_FLAG(std::vector<std::string>, fonts, {},
+          "comma-separated TrueType fonts to add to the corpus");
+
+namespace {
+
+absl::Status Run() {
+  std::vector<codec_benchmark::Sample> samples =
+      codec_benchmark::GenerateImages(absl::GetFlag(FLAGS_max_image_width));
+  SAPI_ASSIGN_OR_RETURN(
+      std::vector<codec_benchmark::Sample> fonts,
+      codec_benchmark::ReadFiles(absl::GetFlag(FLAGS_fonts)));
+  samples.insert(samples.end(), fonts.begin(), fonts.end());
+
+  SAPI_ASSIGN_OR_RETURN(
+      std::vector<std::unique_ptr<codec_benchmark::Codec>> codecs,
+      codec_benchmark::CreateAllCodecs());
+  SAPI_ASSIGN_OR_RETURN(
+      std::vector<codec_benchmark::Result> results,
+      codec_benchmark::RunBenchmarks(codecs, samples,
+                                     absl::GetFlag(FLAGS_iterations)));
+  std::cout << codec_benchmark::FormatResults(results);
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::SetStderrThreshold(absl::LogSeverityAtLeast::kInfo);
+  absl::ParseCommandLine(argc, argv);
+  absl::InitializeLog();
+
+  if (absl::Status status = Run(); !status.ok()) {
+    LOG(ERROR) << "Benchmark failed: " << status;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,78 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "contrib/codec_benchmark/benchmark.h"
+#include "contrib/codec_benchmark/codec.h"
+#include "contrib/codec_benchmark/codecs.h"
+#include "contrib/codec_benchmark/corpus.h"
+#include "sandboxed_api/util/path.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace codec_benchmark {
+namespace {
+
+using ::testing::Each;
+using ::testing::Eq;
+using ::testing::Field;
+using ::testing::Gt;
+using ::testing::HasSubstr;
+using ::testing::IsNull;
+using ::testing::Not;
+using ::testing::SizeIs;
+
+TEST(CodecBenchmarkTest, GeneratesDeterministicImages) {
+  std::vector<Sample> images = GenerateImages(256);
+  // Three kinds of images at 64 and 256 pixels in width.
+  ASSERT_THAT(images, SizeIs(6));
+  for (const Sample& image : images) {
+    EXPECT_TRUE(image.is_image());
+    EXPECT_THAT(image.data, SizeIs(image.width * image.height * 3));
+  }
+  std::vector<Sample> again = GenerateImages(256);
+  for (size_t i = 0; i < images.size(); ++i) {
+    EXPECT_THAT(again[i].data, Eq(images[i].data)) << images[i].name;
+  }
+}
+
+TEST(CodecBenchmarkTest, RunsAllCodecs) {
+  const char* test_data_dir = getenv("TEST_DATA_DIR");
+  ASSERT_THAT(test_data_dir, Not(IsNull()));
+  std::vector<Sample> samples = GenerateImages(64);
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::vector<Sample> fonts,
+      ReadFiles({sapi::file::JoinPath(test_data_dir, "Roboto-Regular.ttf")}));
+  samples.insert(samples.end(), fonts.begin(), fonts.end());
+
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<std::unique_ptr<Codec>> codecs,
+                            CreateAllCodecs());
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<Result> results,
+                            RunBenchmarks(codecs, samples, /*iterations=*/1));
+  // An encode and a decode result per codec.
+  ASSERT_THAT(results, SizeIs(codecs.size() * 2));
+  EXPECT_THAT(results, Each(Field(&Result::operations, Gt(0))));
+
+  std::string table = FormatResults(results);
+  EXPECT_THAT(table, HasSubstr("sapi/directed"));
+  EXPECT_THAT(table, HasSubstr("woff2"));
+}
+
+}  // namespace
+}  // namespace codec_benchmark
@@ -0,0 +1,53 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "contrib/codec_benchmark/codecs.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "contrib/codec_benchmark/codec.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace codec_benchmark {
+
+absl::StatusOr<std::vector<std::unique_ptr<Codec>>> CreateAllCodecs() {
+  using Factory = absl::StatusOr<std::unique_ptr<Codec>> (*)();
+  using SandboxedFactory =
+      absl::StatusOr<std::unique_ptr<Codec>> (*)(TransferStrategy);
+  struct Library {
+    Factory native;
+    SandboxedFactory sandboxed;
+  };
+  std::vector<std::unique_ptr<Codec>> codecs;
+  for (const Library& library : {
+           Library{CreateNativeTurboJpegCodec, CreateSandboxedTurboJpegCodec},
+           Library{CreateNativeLodepngCodec, CreateSandboxedLodepngCodec},
+           Library{CreateNativeWoff2Codec, CreateSandboxedWoff2Codec},
+       }) {
+    SAPI_ASSIGN_OR_RETURN(std::unique_ptr<Codec> native, library.native());
+    codecs.push_back(std::move(native));
+    for (TransferStrategy strategy :
+         {TransferStrategy::kBoth, TransferStrategy::kDirected}) {
+      SAPI_ASSIGN_OR_RETURN(std::unique_ptr<Codec> sandboxed,
+                            library.sandboxed(strategy));
+      codecs.push_back(std::move(sandboxed));
+    }
+  }
+  return codecs;
+}
+
+}  // namespace codec_benchmark
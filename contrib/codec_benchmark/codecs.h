@@ -0,0 +1,47 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CONTRIB_CODEC_BENCHMARK_CODECS_H_
+#define CONTRIB_CODEC_BENCHMARK_CODECS_H_
+
+#include <memory>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "contrib/codec_benchmark/codec.h"
+
+namespace codec_benchmark {
+
+// JPEG, through the TurboJPEG API of libjpeg-turbo. Lossy, 4:2:0 subsampling.
+absl::StatusOr<std::unique_ptr<Codec>> CreateNativeTurboJpegCodec();
+absl::StatusOr<std::unique_ptr<Codec>> CreateSandboxedTurboJpegCodec(
+    TransferStrategy strategy);
+
+// PNG, through lodepng.
+absl::StatusOr<std::unique_ptr<Codec>> CreateNativeLodepngCodec();
+absl::StatusOr<std::unique_ptr<Codec>> CreateSandboxedLodepngCodec(
+    TransferStrategy strategy);
+
+// WOFF2 font compression. Only accepts samples that are not images.
+absl::StatusOr<std::unique_ptr<Codec>> CreateNativeWoff2Codec();
+absl::StatusOr<std::unique_ptr<Codec>> CreateSandboxedWoff2Codec(
+    TransferStrategy strategy);
+
+// Creates the codecs of all libraries. Each native codec is followed by its
+// sandboxed variants, one per TransferStrategy.
+absl::StatusOr<std::vector<std::unique_ptr<Codec>>> CreateAllCodecs();
+
+}  // namespace codec_benchmark
+
+#endif  // CONTRIB_CODEC_BENCHMARK_CODECS_H_
@@ -0,0 +1,94 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "contrib/codec_benchmark/corpus.h"
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/util/file_helpers.h"
+#include "sandboxed_api/util/path.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace codec_benchmark {
+namespace {
+
+constexpr int kMinWidth = 64;
+
+Sample MakeImage(absl::string_view kind, int width, int height) {
+  Sample sample;
+  sample.name = absl::StrCat(kind, "_", width, "x", height);
+  sample.width = width;
+  sample.height = height;
+  sample.data.resize(static_cast<size_t>(width) * height * 3);
+  return sample;
+}
+
+}  // namespace
+
+std::vector<Sample> GenerateImages(int max_width) {
+  std::vector<Sample> images;
+  std::mt19937 random(/*seed=*/42);
+  for (int width = kMinWidth; width <= max_width; width *= 4) {
+    const int height = width * 3 / 4;
+
+    Sample gradient = MakeImage("gradient", width, height);
+    Sample checkers = MakeImage("checkers", width, height);
+    Sample noise = MakeImage("noise", width, height);
+    size_t i = 0;
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x, i += 3) {
+        gradient.data[i] = x * 255 / width;
+        gradient.data[i + 1] = y * 255 / height;
+        gradient.data[i + 2] = (x + y) * 255 / (width + height);
+        const uint8_t square = ((x / 8 + y / 8) % 2) ? 0xff : 0x00;
+        checkers.data[i] = square;
+        checkers.data[i + 1] = square;
+        checkers.data[i + 2] = ~square;
+        // Using the raw engine output, as distributions differ between
+        // standard libraries.
+        noise.data[i] = random() & 0xff;
+        noise.data[i + 1] = random() & 0xff;
+        noise.data[i + 2] = random() & 0xff;
+      }
+    }
+    images.push_back(std::move(gradient));
+    images.push_back(std::move(checkers));
+    images.push_back(std::move(noise));
+  }
+  return images;
+}
+
+absl::StatusOr<std::vector<Sample>> ReadFiles(
+    absl::Span<const std::string> paths) {
+  std::vector<Sample> samples;
+  for (const std::string& path : paths) {
+    std::string contents;
+    SAPI_RETURN_IF_ERROR(
+        sapi::file::GetContents(path, &contents, sapi::file::Defaults()));
+    Sample& sample = samples.emplace_back();
+    sample.name = std::string(sapi::file::SplitPath(path).second);
+    sample.data.assign(contents.begin(), contents.end());
+  }
+  return samples;
+}
+
+}  // namespace codec_benchmark
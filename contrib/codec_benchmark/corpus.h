@@ -0,0 +1,39 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CONTRIB_CODEC_BENCHMARK_CORPUS_H_
+#define CONTRIB_CODEC_BENCHMARK_CORPUS_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "contrib/codec_benchmark/codec.h"
+
+namespace codec_benchmark {
+
+// Returns synthetic RGB images of up to max_width pixels in width, with a 4:3
+// aspect ratio. Each size has a smooth gradient, which compresses well, a
+// checkerboard with hard edges and uniform noise, which does not compress at
+// all. The images are the same on every call.
+std::vector<Sample> GenerateImages(int max_width);
+
+// Reads files into samples that are not images, like fonts.
+absl::StatusOr<std::vector<Sample>> ReadFiles(
+    absl::Span<const std::string> paths);
+
+}  // namespace codec_benchmark
+
+#endif  // CONTRIB_CODEC_BENCHMARK_CORPUS_H_
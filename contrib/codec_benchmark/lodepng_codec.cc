@@ -0,0 +1,165 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "contrib/codec_benchmark/codec.h"
+#include "contrib/codec_benchmark/codecs.h"
+#include "lodepng.gen.h"      // NOLINT(build/include)
+#include "lodepng_sapi.sapi.h"  // NOLINT(build/include)
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/vars.h"
+
+namespace codec_benchmark {
+namespace {
+
+absl::Status LodepngError(absl::string_view function, unsigned int error) {
+  return absl::InternalError(
+      absl::StrCat(function, "() failed with error ", error));
+}
+
+class NativeLodepngCodec : public Codec {
+ public:
+  std::string name() const override { return "lodepng"; }
+  std::string mode() const override { return "native"; }
+  bool Accepts(const Sample& sample) const override {
+    return sample.is_image();
+  }
+
+  absl::StatusOr<std::vector<uint8_t>> Encode(const Sample& sample) override {
+    unsigned char* png = nullptr;
+    size_t size = 0;
+    if (unsigned int error = lodepng_encode24(
+            &png, &size, sample.data.data(), sample.width, sample.height);
+        error != 0) {
+      return LodepngError("lodepng_encode24", error);
+    }
+    std::vector<uint8_t> result(png, png + size);
+    free(png);
+    return result;
+  }
+
+  absl::StatusOr<std::vector<uint8_t>> Decode(
+      const Sample& sample, absl::Span<const uint8_t> encoded) override {
+    unsigned char* rgb = nullptr;
+    unsigned int width = 0;
+    unsigned int height = 0;
+    if (unsigned int error = lodepng_decode24(&rgb, &width, &height,
+                                              encoded.data(), encoded.size());
+        error != 0) {
+      return LodepngError("lodepng_decode24", error);
+    }
+    std::vector<uint8_t> result(rgb, rgb + width * height * 3);
+    free(rgb);
+    return result;
+  }
+};
+
+// lodepng allocates its outputs itself, so the strategy only applies to the
+// inputs.
+class SandboxedLodepngCodec : public SandboxedCodec {
+ public:
+  static absl::StatusOr<std::unique_ptr<Codec>> Create(
+      TransferStrategy strategy) {
+    auto sandbox = std::make_unique<LodepngSandbox>();
+    SAPI_RETURN_IF_ERROR(sandbox->Init());
+    // Using `new` to access a non-public constructor.
+    return absl::WrapUnique(
+        new SandboxedLodepngCodec(std::move(sandbox), strategy));
+  }
+
+  std::string name() const override { return "lodepng"; }
+  bool Accepts(const Sample& sample) const override {
+    return sample.is_image();
+  }
+
+  absl::StatusOr<std::vector<uint8_t>> Encode(const Sample& sample) override {
+    LodepngApi api(sandbox());
+    sapi::v::Array<const uint8_t> rgb(sample.data.data(), sample.data.size());
+    SAPI_RETURN_IF_ERROR(transfers().CopyIn(&rgb));
+
+    sapi::v::GenericPtr png;
+    sapi::v::IntBase<size_t> size;
+    SAPI_ASSIGN_OR_RETURN(
+        unsigned int error,
+        api.lodepng_encode24(png.PtrAfter(), size.PtrAfter(), rgb.PtrNone(),
+                             sample.width, sample.height));
+    if (error != 0) {
+      return LodepngError("lodepng_encode24", error);
+    }
+    SAPI_RETURN_IF_ERROR(transfers().Release(rgb));
+    return TakeRemote(png, size.GetValue());
+  }
+
+  absl::StatusOr<std::vector<uint8_t>> Decode(
+      const Sample& sample, absl::Span<const uint8_t> encoded) override {
+    LodepngApi api(sandbox());
+    sapi::v::Array<const uint8_t> png(encoded.data(), encoded.size());
+    SAPI_RETURN_IF_ERROR(transfers().CopyIn(&png));
+
+    sapi::v::GenericPtr rgb;
+    sapi::v::UInt width;
+    sapi::v::UInt height;
+    SAPI_ASSIGN_OR_RETURN(
+        unsigned int error,
+        api.lodepng_decode24(rgb.PtrAfter(), width.PtrAfter(),
+                             height.PtrAfter(), png.PtrNone(),
+                             encoded.size()));
+    if (error != 0) {
+      return LodepngError("lodepng_decode24", error);
+    }
+    SAPI_RETURN_IF_ERROR(transfers().Release(png));
+    return TakeRemote(rgb, static_cast<size_t>(width.GetValue()) *
+                               height.GetValue() * 3);
+  }
+
+ private:
+  SandboxedLodepngCodec(std::unique_ptr<sapi::Sandbox> sandbox,
+                        TransferStrategy strategy)
+      : SandboxedCodec(std::move(sandbox), strategy) {}
+
+  // Copies an output of lodepng to the host and frees it in the sandboxee.
+  absl::StatusOr<std::vector<uint8_t>> TakeRemote(
+      const sapi::v::GenericPtr& ptr, size_t size) {
+    void* remote = reinterpret_cast<void*>(ptr.GetValue());
+    SAPI_ASSIGN_OR_RETURN(std::vector<uint8_t> result,
+                          transfers().CopyRemote(remote, size));
+    SAPI_RETURN_IF_ERROR(sandbox()->rpc_channel()->Free(remote));
+    return result;
+  }
+};
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<Codec>> CreateNativeLodepngCodec() {
+  return std::make_unique<NativeLodepngCodec>();
+}
+
+absl::StatusOr<std::unique_ptr<Codec>> CreateSandboxedLodepngCodec(
+    TransferStrategy strategy) {
+  return SandboxedLodepngCodec::Create(strategy);
+}
+
+}  // namespace codec_benchmark
@@ -0,0 +1,209 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <turbojpeg.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "contrib/codec_benchmark/codec.h"
+#include "contrib/codec_benchmark/codecs.h"
+#include "contrib/turbojpeg/turbojpeg_sapi.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/vars.h"
+
+namespace codec_benchmark {
+namespace {
+
+constexpr int kQuality = 90;
+constexpr int kSubsampling = TJSAMP_420;
+
+class NativeTurboJpegCodec : public Codec {
+ public:
+  ~NativeTurboJpegCodec() override {
+    if (compressor_) {
+      tjDestroy(compressor_);
+    }
+    if (decompressor_) {
+      tjDestroy(decompressor_);
+    }
+  }
+
+  static absl::StatusOr<std::unique_ptr<Codec>> Create() {
+    // Using `new` to access a non-public constructor.
+    auto codec = absl::WrapUnique(new NativeTurboJpegCodec());
+    codec->compressor_ = tjInitCompress();
+    codec->decompressor_ = tjInitDecompress();
+    if (!codec->compressor_ || !codec->decompressor_) {
+      return absl::InternalError("Failed to initialize TurboJPEG");
+    }
+    return codec;
+  }
+
+  std::string name() const override { return "turbojpeg"; }
+  std::string mode() const override { return "native"; }
+  bool Accepts(const Sample& sample) const override {
+    return sample.is_image();
+  }
+
+  absl::StatusOr<std::vector<uint8_t>> Encode(const Sample& sample) override {
+    std::vector<uint8_t> jpeg(
+        tjBufSize(sample.width, sample.height, kSubsampling));
+    unsigned char* buffer = jpeg.data();
+    unsigned long size = jpeg.size();  // NOLINT(runtime/int)
+    if (tjCompress2(compressor_, sample.data.data(), sample.width,
+                    /*pitch=*/0, sample.height, TJPF_RGB, &buffer, &size,
+                    kSubsampling, kQuality, TJFLAG_NOREALLOC) != 0) {
+      return absl::InternalError(
+          absl::StrCat("tjCompress2() failed: ", tjGetErrorStr2(compressor_)));
+    }
+    jpeg.resize(size);
+    return jpeg;
+  }
+
+  absl::StatusOr<std::vector<uint8_t>> Decode(
+      const Sample& sample, absl::Span<const uint8_t> encoded) override {
+    std::vector<uint8_t> rgb(sample.data.size());
+    if (tjDecompress2(decompressor_, encoded.data(), encoded.size(),
+                      rgb.data(), sample.width, /*pitch=*/0, sample.height,
+                      TJPF_RGB, /*flags=*/0) != 0) {
+      return absl::InternalError(absl::StrCat(
+          "tjDecompress2() failed: ", tjGetErrorStr2(decompressor_)));
+    }
+    return rgb;
+  }
+
+ private:
+  NativeTurboJpegCodec() = default;
+
+  tjhandle compressor_ = nullptr;
+  tjhandle decompressor_ = nullptr;
+};
+
+class SandboxedTurboJpegCodec : public SandboxedCodec {
+ public:
+  ~SandboxedTurboJpegCodec() override {
+    turbojpeg_sapi::TurboJPEGApi api(sandbox());
+    if (compressor_) {
+      api.tjDestroy(compressor_.get()).IgnoreError();
+    }
+    if (decompressor_) {
+      api.tjDestroy(decompressor_.get()).IgnoreError();
+    }
+  }
+
+  static absl::StatusOr<std::unique_ptr<Codec>> Create(
+      TransferStrategy strategy) {
+    auto sandbox = std::make_unique<TurboJpegSapiSandbox>();
+    SAPI_RETURN_IF_ERROR(sandbox->Init());
+    // Using `new` to access a non-public constructor.
+    auto codec = absl::WrapUnique(
+        new SandboxedTurboJpegCodec(std::move(sandbox), strategy));
+    turbojpeg_sapi::TurboJPEGApi api(codec->sandbox());
+    SAPI_ASSIGN_OR_RETURN(void* compressor, api.tjInitCompress());
+    SAPI_ASSIGN_OR_RETURN(void* decompressor, api.tjInitDecompress());
+    if (!compressor || !decompressor) {
+      return absl::InternalError("Failed to initialize TurboJPEG");
+    }
+    codec->compressor_ = std::make_unique<sapi::v::RemotePtr>(compressor);
+    codec->decompressor_ = std::make_unique<sapi::v::RemotePtr>(decompressor);
+    return codec;
+  }
+
+  std::string name() const override { return "turbojpeg"; }
+  bool Accepts(const Sample& sample) const override {
+    return sample.is_image();
+  }
+
+  absl::StatusOr<std::vector<uint8_t>> Encode(const Sample& sample) override {
+    turbojpeg_sapi::TurboJPEGApi api(sandbox());
+    sapi::v::Array<const uint8_t> rgb(sample.data.data(), sample.data.size());
+    SAPI_RETURN_IF_ERROR(transfers().CopyIn(&rgb));
+
+    std::vector<uint8_t> jpeg(
+        tjBufSize(sample.width, sample.height, kSubsampling));
+    sapi::v::Array<uint8_t> buffer(jpeg.data(), jpeg.size());
+    SAPI_RETURN_IF_ERROR(transfers().Reserve(&buffer));
+    // With TJFLAG_NOREALLOC, the library writes to the buffer in place.
+    sapi::v::GenericPtr buffer_ptr(buffer.GetRemote());
+    sapi::v::ULong size(jpeg.size());
+
+    SAPI_ASSIGN_OR_RETURN(
+        int result,
+        api.tjCompress2(compressor_.get(), rgb.PtrNone(), sample.width,
+                        /*pitch=*/0, sample.height, TJPF_RGB,
+                        buffer_ptr.PtrBefore(), size.PtrBoth(), kSubsampling,
+                        kQuality, TJFLAG_NOREALLOC));
+    if (result != 0) {
+      return absl::InternalError("tjCompress2() failed");
+    }
+    SAPI_RETURN_IF_ERROR(transfers().Release(rgb));
+    SAPI_RETURN_IF_ERROR(transfers().CopyOut(&buffer, size.GetValue()));
+    jpeg.resize(size.GetValue());
+    return jpeg;
+  }
+
+  absl::StatusOr<std::vector<uint8_t>> Decode(
+      const Sample& sample, absl::Span<const uint8_t> encoded) override {
+    turbojpeg_sapi::TurboJPEGApi api(sandbox());
+    sapi::v::Array<const uint8_t> jpeg(encoded.data(), encoded.size());
+    SAPI_RETURN_IF_ERROR(transfers().CopyIn(&jpeg));
+
+    std::vector<uint8_t> rgb(sample.data.size());
+    sapi::v::Array<uint8_t> buffer(rgb.data(), rgb.size());
+    SAPI_RETURN_IF_ERROR(transfers().Reserve(&buffer));
+
+    SAPI_ASSIGN_OR_RETURN(
+        int result,
+        api.tjDecompress2(decompressor_.get(), jpeg.PtrNone(), encoded.size(),
+                          buffer.PtrNone(), sample.width, /*pitch=*/0,
+                          sample.height, TJPF_RGB, /*flags=*/0));
+    if (result != 0) {
+      return absl::InternalError("tjDecompress2() failed");
+    }
+    SAPI_RETURN_IF_ERROR(transfers().Release(jpeg));
+    SAPI_RETURN_IF_ERROR(transfers().CopyOut(&buffer, rgb.size()));
+    return rgb;
+  }
+
+ private:
+  SandboxedTurboJpegCodec(std::unique_ptr<sapi::Sandbox> sandbox,
+                          TransferStrategy strategy)
+      : SandboxedCodec(std::move(sandbox), strategy) {}
+
+  // Handles in the sandboxee.
+  std::unique_ptr<sapi::v::RemotePtr> compressor_;
+  std::unique_ptr<sapi::v::RemotePtr> decompressor_;
+};
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<Codec>> CreateNativeTurboJpegCodec() {
+  return NativeTurboJpegCodec::Create();
+}
+
+absl::StatusOr<std::unique_ptr<Codec>> CreateSandboxedTurboJpegCodec(
+    TransferStrategy strategy) {
+  return SandboxedTurboJpegCodec::Create(strategy);
+}
+
+}  // namespace codec_benchmark
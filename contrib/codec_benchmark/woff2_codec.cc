@@ -0,0 +1,154 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "contrib/codec_benchmark/codec.h"
+#include "contrib/codec_benchmark/codecs.h"
+#include "contrib/woff2/woff2_sapi.h"
+#include "contrib/woff2/woff2_wrapper.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/vars.h"
+
+namespace codec_benchmark {
+namespace {
+
+class NativeWoff2Codec : public Codec {
+ public:
+  std::string name() const override { return "woff2"; }
+  std::string mode() const override { return "native"; }
+  bool Accepts(const Sample& sample) const override {
+    return !sample.is_image();
+  }
+
+  absl::StatusOr<std::vector<uint8_t>> Encode(const Sample& sample) override {
+    uint8_t* woff2 = nullptr;
+    size_t size = 0;
+    if (!WOFF2_ConvertTTFToWOFF2(sample.data.data(), sample.data.size(),
+                                 &woff2, &size)) {
+      return absl::InternalError("WOFF2_ConvertTTFToWOFF2() failed");
+    }
+    std::vector<uint8_t> result(woff2, woff2 + size);
+    WOFF2_Free(woff2);
+    return result;
+  }
+
+  absl::StatusOr<std::vector<uint8_t>> Decode(
+      const Sample& sample, absl::Span<const uint8_t> encoded) override {
+    uint8_t* ttf = nullptr;
+    size_t size = 0;
+    if (!WOFF2_ConvertWOFF2ToTTF(encoded.data(), encoded.size(), &ttf, &size,
+                                 /*max_size=*/0)) {
+      return absl::InternalError("WOFF2_ConvertWOFF2ToTTF() failed");
+    }
+    std::vector<uint8_t> result(ttf, ttf + size);
+    WOFF2_Free(ttf);
+    return result;
+  }
+};
+
+// The WOFF2 wrapper allocates its outputs itself, so the strategy only applies
+// to the inputs.
+class SandboxedWoff2Codec : public SandboxedCodec {
+ public:
+  static absl::StatusOr<std::unique_ptr<Codec>> Create(
+      TransferStrategy strategy) {
+    auto sandbox = std::make_unique<sapi_woff2::Woff2SapiSandbox>();
+    SAPI_RETURN_IF_ERROR(sandbox->Init());
+    // Using `new` to access a non-public constructor.
+    return absl::WrapUnique(
+        new SandboxedWoff2Codec(std::move(sandbox), strategy));
+  }
+
+  std::string name() const override { return "woff2"; }
+  bool Accepts(const Sample& sample) const override {
+    return !sample.is_image();
+  }
+
+  absl::StatusOr<std::vector<uint8_t>> Encode(const Sample& sample) override {
+    sapi_woff2::WOFF2Api api(sandbox());
+    sapi::v::Array<const uint8_t> ttf(sample.data.data(), sample.data.size());
+    SAPI_RETURN_IF_ERROR(transfers().CopyIn(&ttf));
+
+    sapi::v::GenericPtr woff2;
+    sapi::v::IntBase<size_t> size;
+    SAPI_ASSIGN_OR_RETURN(
+        bool success,
+        api.WOFF2_ConvertTTFToWOFF2(ttf.PtrNone(), sample.data.size(),
+                                    woff2.PtrAfter(), size.PtrAfter()));
+    if (!success) {
+      return absl::InternalError("WOFF2_ConvertTTFToWOFF2() failed");
+    }
+    SAPI_RETURN_IF_ERROR(transfers().Release(ttf));
+    return TakeRemote(woff2, size.GetValue());
+  }
+
+  absl::StatusOr<std::vector<uint8_t>> Decode(
+      const Sample& sample, absl::Span<const uint8_t> encoded) override {
+    sapi_woff2::WOFF2Api api(sandbox());
+    sapi::v::Array<const uint8_t> woff2(encoded.data(), encoded.size());
+    SAPI_RETURN_IF_ERROR(transfers().CopyIn(&woff2));
+
+    sapi::v::GenericPtr ttf;
+    sapi::v::IntBase<size_t> size;
+    SAPI_ASSIGN_OR_RETURN(
+        bool success,
+        api.WOFF2_ConvertWOFF2ToTTF(woff2.PtrNone(), encoded.size(),
+                                    ttf.PtrAfter(), size.PtrAfter(),
+                                    /*max_size=*/0));
+    if (!success) {
+      return absl::InternalError("WOFF2_ConvertWOFF2ToTTF() failed");
+    }
+    SAPI_RETURN_IF_ERROR(transfers().Release(woff2));
+    return TakeRemote(ttf, size.GetValue());
+  }
+
+ private:
+  SandboxedWoff2Codec(std::unique_ptr<sapi::Sandbox> sandbox,
+                      TransferStrategy strategy)
+      : SandboxedCodec(std::move(sandbox), strategy) {}
+
+  // Copies an output of the wrapper to the host and frees it in the sandboxee.
+  absl::StatusOr<std::vector<uint8_t>> TakeRemote(
+      const sapi::v::GenericPtr& ptr, size_t size) {
+    void* remote = reinterpret_cast<void*>(ptr.GetValue());
+    SAPI_ASSIGN_OR_RETURN(std::vector<uint8_t> result,
+                          transfers().CopyRemote(remote, size));
+    sapi::v::RemotePtr remote_ptr(remote);
+    SAPI_RETURN_IF_ERROR(
+        sapi_woff2::WOFF2Api(sandbox()).WOFF2_Free(&remote_ptr));
+    return result;
+  }
+};
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<Codec>> CreateNativeWoff2Codec() {
+  return std::make_unique<NativeWoff2Codec>();
+}
+
+absl::StatusOr<std::unique_ptr<Codec>> CreateSandboxedWoff2Codec(
+    TransferStrategy strategy) {
+  return SandboxedWoff2Codec::Create(strategy);
+}
+
+}  // namespace codec_benchmark
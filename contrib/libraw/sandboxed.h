@@ -37,6 +37,8 @@ class LibRawSapiSandbox : public LibRawSandbox {
         .AllowRead()
         .AllowWrite()
         .AllowSystemMalloc()
+        // Used to map the shared memory that images are exported through.
+        .AllowMmap()
         .AllowExit()
         .AllowSyscalls({__NR_recvmsg})
         .AddFile(file_name_, /*is_ro=*/true)
@@ -12,8 +12,15 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
 #include "contrib/libraw/sandboxed.h"
 #include "contrib/libraw/utils/utils_libraw.h"
+#include "sandboxed_api/sandbox2/buffer.h"
 #include "sandboxed_api/util/path.h"
 #include "sandboxed_api/util/status_matchers.h"
 #include "sandboxed_api/util/temp_file.h"
@@ -181,6 +188,80 @@ TEST_P(LibRawTestFiles, TestSubtractBlack) {
   }
 }
 
+TEST_P(LibRawTestFiles, TestCFAPattern) {
+  const TestVariant& tv = GetParam();
+  std::string test_file_path = GetTestFilePath(tv.filename);
+
+  LibRawSapiSandbox sandbox(test_file_path);
+  SAPI_ASSERT_OK(sandbox.Init());
+
+  LibRaw lr(&sandbox, test_file_path);
+  SAPI_ASSERT_OK(lr.CheckIsInit());
+  SAPI_ASSERT_OK(lr.OpenFile());
+  SAPI_ASSERT_OK(lr.Unpack());
+
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<int> pattern, lr.GetCFAPattern());
+  ASSERT_EQ(pattern.size(), kCfaPatternSize * kCfaPatternSize);
+  for (int row = 0; row < 4; ++row) {
+    for (int col = 0; col < 4; ++col) {
+      EXPECT_EQ(pattern[row * kCfaPatternSize + col],
+                tv.COLOR[row][col]);
+    }
+  }
+  // The pattern repeats over the whole sensor.
+  SAPI_ASSERT_OK_AND_ASSIGN(int color, lr.COLOR(tv.raw_height - 1, 1));
+  EXPECT_EQ(color, tv.COLOR[(tv.raw_height - 1) % 4][1]);
+}
+
+TEST_P(LibRawTestFiles, TestExportRawImage) {
+  const TestVariant& tv = GetParam();
+  std::string test_file_path = GetTestFilePath(tv.filename);
+
+  LibRawSapiSandbox sandbox(test_file_path);
+  SAPI_ASSERT_OK(sandbox.Init());
+
+  LibRaw lr(&sandbox, test_file_path);
+  SAPI_ASSERT_OK(lr.CheckIsInit());
+  SAPI_ASSERT_OK(lr.OpenFile());
+  SAPI_ASSERT_OK(lr.Unpack());
+
+  SAPI_ASSERT_OK_AND_ASSIGN(std::unique_ptr<sandbox2::Buffer> buffer,
+                            lr.ExportRawImage());
+  const libraw_image_sizes_t& sizes = lr.GetImgData().sizes;
+  EXPECT_EQ(sizes.raw_height, tv.raw_height);
+  ASSERT_EQ(buffer->size(), static_cast<size_t>(sizes.raw_height) *
+                                sizes.raw_pitch);
+
+  // Same pixels as copying the raw image from the sandboxee.
+  std::vector<uint16_t> copied(buffer->size() / sizeof(uint16_t));
+  sapi::v::Array<uint16_t> rawdata(copied.data(), copied.size());
+  rawdata.SetRemote(lr.GetImgData().rawdata.raw_image);
+  SAPI_ASSERT_OK(sandbox.TransferFromSandboxee(&rawdata));
+  EXPECT_EQ(memcmp(buffer->data(), copied.data(), buffer->size()), 0);
+}
+
+TEST_P(LibRawTestFiles, TestExportProcessedImage) {
+  const TestVariant& tv = GetParam();
+  std::string test_file_path = GetTestFilePath(tv.filename);
+
+  LibRawSapiSandbox sandbox(test_file_path);
+  SAPI_ASSERT_OK(sandbox.Init());
+
+  LibRaw lr(&sandbox, test_file_path);
+  SAPI_ASSERT_OK(lr.CheckIsInit());
+  SAPI_ASSERT_OK(lr.OpenFile());
+  SAPI_ASSERT_OK(lr.Unpack());
+  SAPI_ASSERT_OK(lr.DcrawProcess());
+
+  SAPI_ASSERT_OK_AND_ASSIGN(LibRawProcessedImage image,
+                            lr.ExportProcessedImage());
+  EXPECT_GT(image.width, 0);
+  EXPECT_GT(image.height, 0);
+  EXPECT_EQ(image.buffer->size(),
+            static_cast<size_t>(image.width) * image.height * image.colors *
+                (image.bits / 8));
+}
+
 INSTANTIATE_TEST_SUITE_P(LibRawBase, LibRawTestFiles,
                          testing::ValuesIn(kTestData));
 
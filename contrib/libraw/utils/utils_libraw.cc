@@ -14,8 +14,17 @@
 
 #include "contrib/libraw/utils/utils_libraw.h"
 
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
 #include "absl/strings/str_cat.h"
 #include "contrib/libraw/sandboxed.h"
+#include "sandboxed_api/sandbox2/buffer.h"
 
 absl::Status LibRaw::InitLibRaw() {
   SAPI_ASSIGN_OR_RETURN(libraw_data_t * lr_data, api_.libraw_init(0));
@@ -36,15 +45,40 @@ absl::Status LibRaw::CheckIsInit() { return init_status_; }
 
 bool LibRaw::IsInit() { return CheckIsInit().ok(); }
 
-libraw_data_t LibRaw::GetImgData() { return sapi_libraw_data_t_.data(); }
+const libraw_data_t& LibRaw::GetImgData() {
+  return sapi_libraw_data_t_.data();
+}
+
+absl::Status LibRaw::FetchImgData(void* member, size_t size) {
+  size_t offset = reinterpret_cast<uint8_t*>(member) -
+                  reinterpret_cast<uint8_t*>(sapi_libraw_data_t_.mutable_data());
+  sapi::v::Array<uint8_t> remote_member(reinterpret_cast<uint8_t*>(member),
+                                        size);
+  remote_member.SetRemote(
+      reinterpret_cast<uint8_t*>(sapi_libraw_data_t_.GetRemote()) + offset);
+  return sandbox_->TransferFromSandboxee(&remote_member);
+}
+
+absl::Status LibRaw::SyncImgData() {
+  libraw_data_t* data = sapi_libraw_data_t_.mutable_data();
+  SAPI_RETURN_IF_ERROR(FetchImgData(&data->sizes, sizeof(data->sizes)));
+  SAPI_RETURN_IF_ERROR(FetchImgData(&data->idata, sizeof(data->idata)));
+  SAPI_RETURN_IF_ERROR(
+      FetchImgData(&data->color.black, sizeof(data->color.black)));
+  SAPI_RETURN_IF_ERROR(
+      FetchImgData(&data->color.cblack, sizeof(data->color.cblack)));
+  return FetchImgData(&data->rawdata.raw_image,
+                      sizeof(data->rawdata.raw_image));
+}
 
 absl::Status LibRaw::OpenFile() {
   SAPI_RETURN_IF_ERROR(CheckIsInit());
 
   sapi::v::CStr file_name(file_name_.c_str());
 
+  cfa_pattern_.reset();
   SAPI_ASSIGN_OR_RETURN(int error_code,
-                        api_.libraw_open_file(sapi_libraw_data_t_.PtrAfter(),
+                        api_.libraw_open_file(sapi_libraw_data_t_.PtrNone(),
                                               file_name.PtrBefore()));
 
   if (error_code != LIBRAW_SUCCESS) {
@@ -52,26 +86,43 @@ absl::Status LibRaw::OpenFile() {
         absl::string_view(std::to_string(error_code)));
   }
 
-  return absl::OkStatus();
+  return SyncImgData();
 }
 
 absl::Status LibRaw::Unpack() {
   SAPI_RETURN_IF_ERROR(CheckIsInit());
 
+  cfa_pattern_.reset();
   SAPI_ASSIGN_OR_RETURN(int error_code,
-                        api_.libraw_unpack(sapi_libraw_data_t_.PtrAfter()));
+                        api_.libraw_unpack(sapi_libraw_data_t_.PtrNone()));
   if (error_code != LIBRAW_SUCCESS) {
     return absl::UnavailableError(
         absl::string_view(std::to_string(error_code)));
   }
 
-  return absl::OkStatus();
+  return SyncImgData();
 }
 
 absl::Status LibRaw::SubtractBlack() {
   SAPI_RETURN_IF_ERROR(CheckIsInit());
 
-  return api_.libraw_subtract_black(sapi_libraw_data_t_.PtrAfter());
+  SAPI_RETURN_IF_ERROR(
+      api_.libraw_subtract_black(sapi_libraw_data_t_.PtrNone()));
+  return SyncImgData();
+}
+
+absl::Status LibRaw::DcrawProcess() {
+  SAPI_RETURN_IF_ERROR(CheckIsInit());
+
+  SAPI_ASSIGN_OR_RETURN(
+      int error_code,
+      api_.libraw_dcraw_process(sapi_libraw_data_t_.PtrNone()));
+  if (error_code != LIBRAW_SUCCESS) {
+    return absl::UnavailableError(
+        absl::string_view(std::to_string(error_code)));
+  }
+
+  return SyncImgData();
 }
 
 absl::StatusOr<std::vector<char*>> LibRaw::GetCameraList() {
@@ -92,9 +143,44 @@ absl::StatusOr<std::vector<char*>> LibRaw::GetCameraList() {
   return buf;
 }
 
+absl::StatusOr<std::vector<int>> LibRaw::GetCFAPattern() {
+  SAPI_RETURN_IF_ERROR(CheckIsInit());
+
+  std::vector<int> pattern(kCfaPatternSize * kCfaPatternSize);
+  sapi::v::Array<int> sapi_pattern(pattern.data(), pattern.size());
+  SAPI_ASSIGN_OR_RETURN(
+      int error_code,
+      api_.libraw_GetCFAPattern(sapi_libraw_data_t_.PtrNone(),
+                                sapi_pattern.PtrAfter()));
+  if (error_code == LIBRAW_NOT_IMPLEMENTED) {
+    return absl::UnimplementedError("The CFA layout is not periodic");
+  }
+  if (error_code != LIBRAW_SUCCESS) {
+    return absl::UnavailableError(
+        absl::string_view(std::to_string(error_code)));
+  }
+
+  return pattern;
+}
+
 absl::StatusOr<int> LibRaw::COLOR(int row, int col) {
   SAPI_RETURN_IF_ERROR(CheckIsInit());
 
+  if (!cfa_pattern_.has_value()) {
+    absl::StatusOr<std::vector<int>> pattern = GetCFAPattern();
+    if (pattern.ok()) {
+      cfa_pattern_ = *std::move(pattern);
+    } else if (absl::IsUnimplemented(pattern.status())) {
+      cfa_pattern_.emplace();
+    } else {
+      return pattern.status();
+    }
+  }
+  if (!cfa_pattern_->empty() && row >= 0 && col >= 0) {
+    return (*cfa_pattern_)[(row % kCfaPatternSize) * kCfaPatternSize +
+                           col % kCfaPatternSize];
+  }
+
   int color;
   SAPI_ASSIGN_OR_RETURN(
       color, api_.libraw_COLOR(sapi_libraw_data_t_.PtrNone(), row, col));
@@ -144,16 +230,76 @@ int LibRaw::GetColorCount() { return GetImgData().idata.colors; }
 absl::StatusOr<std::vector<uint16_t>> LibRaw::RawData() {
   SAPI_RETURN_IF_ERROR(CheckIsInit());
 
-  int raw_height;
-  int raw_width;
-  SAPI_ASSIGN_OR_RETURN(raw_height, GetRawHeight());
-  SAPI_ASSIGN_OR_RETURN(raw_width, GetRawWidth());
-  int size = raw_height * raw_width;
-  std::vector<uint16_t> buf(size);
-  sapi::v::Array<uint16_t> rawdata(buf.data(), buf.size());
-
-  rawdata.SetRemote(sapi_libraw_data_t_.data().rawdata.raw_image);
-  SAPI_RETURN_IF_ERROR(sandbox_->TransferFromSandboxee(&rawdata));
+  SAPI_ASSIGN_OR_RETURN(std::unique_ptr<sandbox2::Buffer> buffer,
+                        ExportRawImage());
+  std::vector<uint16_t> buf(buffer->size() / sizeof(uint16_t));
+  memcpy(buf.data(), buffer->data(), buf.size() * sizeof(uint16_t));
 
   return buf;
 }
+
+absl::StatusOr<std::unique_ptr<sandbox2::Buffer>> LibRaw::ExportImage(
+    bool processed, size_t size) {
+  SAPI_ASSIGN_OR_RETURN(std::unique_ptr<sandbox2::Buffer> buffer,
+                        sandbox2::Buffer::CreateWithSize(size));
+  sapi::v::Fd fd(dup(buffer->fd()));
+  if (fd.GetValue() < 0) {
+    return absl::InternalError("Could not duplicate the buffer fd");
+  }
+  SAPI_RETURN_IF_ERROR(sandbox_->TransferToSandboxee(&fd));
+
+  absl::StatusOr<int> error_code =
+      processed ? api_.libraw_ExportProcessedImage(
+                      sapi_libraw_data_t_.PtrNone(), fd.GetRemoteFd(), size)
+                : api_.libraw_ExportRawImage(sapi_libraw_data_t_.PtrNone(),
+                                             fd.GetRemoteFd(), size);
+  fd.CloseRemoteFd(sandbox_->rpc_channel()).IgnoreError();
+  if (!error_code.ok()) {
+    return error_code.status();
+  }
+  if (*error_code != LIBRAW_SUCCESS) {
+    return absl::UnavailableError(
+        absl::string_view(std::to_string(*error_code)));
+  }
+
+  return buffer;
+}
+
+absl::StatusOr<std::unique_ptr<sandbox2::Buffer>> LibRaw::ExportRawImage() {
+  SAPI_RETURN_IF_ERROR(CheckIsInit());
+
+  const libraw_data_t& data = GetImgData();
+  if (data.rawdata.raw_image == nullptr) {
+    return absl::FailedPreconditionError("No unpacked raw image");
+  }
+  const libraw_image_sizes_t& sizes = data.sizes;
+  return ExportImage(/*processed=*/false,
+                     static_cast<size_t>(sizes.raw_height) * sizes.raw_pitch);
+}
+
+absl::StatusOr<LibRawProcessedImage> LibRaw::ExportProcessedImage() {
+  SAPI_RETURN_IF_ERROR(CheckIsInit());
+
+  sapi::v::Int width;
+  sapi::v::Int height;
+  sapi::v::Int colors;
+  sapi::v::Int bits;
+  SAPI_RETURN_IF_ERROR(api_.libraw_get_mem_image_format(
+      sapi_libraw_data_t_.PtrNone(), width.PtrAfter(), height.PtrAfter(),
+      colors.PtrAfter(), bits.PtrAfter()));
+
+  LibRawProcessedImage image;
+  image.width = width.GetValue();
+  image.height = height.GetValue();
+  image.colors = colors.GetValue();
+  image.bits = bits.GetValue();
+  if (image.width <= 0 || image.height <= 0 || image.colors <= 0 ||
+      image.bits <= 0) {
+    return absl::FailedPreconditionError("No processed image");
+  }
+  size_t size = static_cast<size_t>(image.width) * image.height *
+                image.colors * (image.bits / 8);
+  SAPI_ASSIGN_OR_RETURN(image.buffer, ExportImage(/*processed=*/true, size));
+
+  return image;
+}
@@ -15,10 +15,14 @@
 #ifndef CONTRIB_LIBRAW_UTILS_UTILS_LIBRAW_H_
 #define CONTRIB_LIBRAW_UTILS_UTILS_LIBRAW_H_
 
+#include <cstddef>
+#include <memory>
+#include <optional>
 #include <vector>
 
 #include "absl/log/die_if_null.h"
 #include "contrib/libraw/sandboxed.h"
+#include "sandboxed_api/sandbox2/buffer.h"
 
 enum LibRaw_errors {
   LIBRAW_SUCCESS = 0,
@@ -39,6 +43,21 @@ enum LibRaw_errors {
   LIBRAW_MEMPOOL_OVERFLOW = -100013
 };
 
+// Side of the square CFA tile returned by LibRaw::GetCFAPattern(), same as
+// LIBRAW_CFA_PATTERN_SIZE in the sandboxee.
+inline constexpr int kCfaPatternSize = 48;
+
+// Image produced by dcraw_process(), in the layout of
+// libraw_processed_image_t::data.
+struct LibRawProcessedImage {
+  int width;
+  int height;
+  int colors;
+  int bits;
+  // Shared with the sandboxee, which filled it.
+  std::unique_ptr<sandbox2::Buffer> buffer;
+};
+
 class LibRaw {
  public:
   LibRaw(LibRawSapiSandbox* sandbox, const std::string& file_name)
@@ -53,22 +72,51 @@ class LibRaw {
   absl::Status CheckIsInit();
   bool IsInit();
 
-  libraw_data_t GetImgData();
+  // Returns the local copy of libraw_data_t. After the initial transfer, only
+  // sizes, idata, color.black, color.cblack and rawdata.raw_image are kept in
+  // sync with the sandboxee.
+  const libraw_data_t& GetImgData();
   absl::StatusOr<std::vector<uint16_t>> RawData();
 
   absl::Status OpenFile();
   absl::Status Unpack();
   absl::Status SubtractBlack();
+  absl::Status DcrawProcess();
   absl::StatusOr<std::vector<char*>> GetCameraList();
+  // Looks up the color in the CFA pattern, only falling back to one RPC per
+  // pixel for sensor layouts that do not repeat.
   absl::StatusOr<int> COLOR(int row, int col);
   absl::StatusOr<int> GetRawHeight();
   absl::StatusOr<int> GetRawWidth();
   absl::StatusOr<unsigned int> GetCBlack(int channel);
   int GetColorCount();
 
+  // Returns the colors of the kCfaPatternSize square tile that repeats over
+  // the whole sensor, indexed by row * kCfaPatternSize + col.
+  // Fails with kUnimplemented if the sensor layout is not periodic.
+  absl::StatusOr<std::vector<int>> GetCFAPattern();
+
+  // Exports the unpacked raw image (raw_height rows of raw_pitch bytes)
+  // through shared memory, without copying it over the comms channel.
+  absl::StatusOr<std::unique_ptr<sandbox2::Buffer>> ExportRawImage();
+
+  // Exports the result of DcrawProcess() through shared memory.
+  absl::StatusOr<LibRawProcessedImage> ExportProcessedImage();
+
  private:
   absl::Status InitLibRaw();
 
+  // Copies the members of libraw_data_t used by this class from the sandboxee,
+  // instead of transferring the whole structure.
+  absl::Status SyncImgData();
+  // Copies one member of the local libraw_data_t from the sandboxee.
+  absl::Status FetchImgData(void* member, size_t size);
+
+  // Creates a shared memory buffer of the given size and has the sandboxee
+  // fill it with the raw or processed image.
+  absl::StatusOr<std::unique_ptr<sandbox2::Buffer>> ExportImage(bool processed,
+                                                                size_t size);
+
   LibRawSapiSandbox* sandbox_;
   LibRawApi api_;
   absl::Status init_status_;
@@ -76,6 +124,9 @@ class LibRaw {
   std::string file_name_;
 
   sapi::v::Struct<libraw_data_t> sapi_libraw_data_t_;
+
+  // Cached result of GetCFAPattern(), empty if the layout is not periodic.
+  std::optional<std::vector<int>> cfa_pattern_;
 };
 
 #endif  // CONTRIB_LIBRAW_UTILS_UTILS_LIBRAW_H_
@@ -0,0 +1,71 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "contrib/libraw/wrapper/wrapper_libraw.h"
+
+#include <sys/mman.h>
+
+#include <cstddef>
+#include <cstring>
+
+namespace {
+
+// Maps fd, copies len bytes from src to it and unmaps it again.
+int CopyToSharedMemory(int fd, size_t size, const void* src, size_t len) {
+  if (src == nullptr || len > size) {
+    return LIBRAW_UNSPECIFIED_ERROR;
+  }
+  void* dst = mmap(nullptr, size, PROT_WRITE, MAP_SHARED, fd, 0);
+  if (dst == MAP_FAILED) {
+    return LIBRAW_IO_ERROR;
+  }
+  memcpy(dst, src, len);
+  munmap(dst, size);
+  return LIBRAW_SUCCESS;
+}
+
+}  // namespace
+
+int libraw_GetCFAPattern(libraw_data_t* lr, int* pattern) {
+  constexpr int kSize = LIBRAW_CFA_PATTERN_SIZE;
+  for (int row = 0; row < kSize; ++row) {
+    for (int col = 0; col < kSize; ++col) {
+      int color = libraw_COLOR(lr, row, col);
+      if (libraw_COLOR(lr, row + kSize, col) != color ||
+          libraw_COLOR(lr, row, col + kSize) != color) {
+        return LIBRAW_NOT_IMPLEMENTED;
+      }
+      pattern[row * kSize + col] = color;
+    }
+  }
+  return LIBRAW_SUCCESS;
+}
+
+int libraw_ExportRawImage(libraw_data_t* lr, int fd, size_t size) {
+  return CopyToSharedMemory(
+      fd, size, lr->rawdata.raw_image,
+      static_cast<size_t>(lr->sizes.raw_height) * lr->sizes.raw_pitch);
+}
+
+int libraw_ExportProcessedImage(libraw_data_t* lr, int fd, size_t size) {
+  int error_code = LIBRAW_SUCCESS;
+  libraw_processed_image_t* image =
+      libraw_dcraw_make_mem_image(lr, &error_code);
+  if (image == nullptr) {
+    return error_code;
+  }
+  error_code = CopyToSharedMemory(fd, size, image->data, image->data_size);
+  libraw_dcraw_clear_mem(image);
+  return error_code;
+}
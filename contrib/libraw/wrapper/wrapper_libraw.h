@@ -0,0 +1,43 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CONTRIB_LIBRAW_WRAPPER_WRAPPER_LIBRAW_H_
+#define CONTRIB_LIBRAW_WRAPPER_WRAPPER_LIBRAW_H_
+
+#include <cstddef>
+
+#include "libraw/libraw.h"  // NOLINT(build/include)
+
+// COLOR() repeats every 48 rows and columns for all periodic sensor layouts
+// (Bayer: 8x2, Leaf: 16x16, X-Trans: 6x6).
+#define LIBRAW_CFA_PATTERN_SIZE 48
+
+extern "C" {
+// Fills pattern with the LIBRAW_CFA_PATTERN_SIZE x LIBRAW_CFA_PATTERN_SIZE
+// colors returned by COLOR() for the top-left corner of the sensor, in
+// row-major order. Returns LIBRAW_NOT_IMPLEMENTED if the layout is not
+// periodic (e.g. Fuji SuperCCD), in which case COLOR() has to be used.
+int libraw_GetCFAPattern(libraw_data_t* lr, int* pattern);
+
+// Copies the unpacked raw image (raw_height rows of raw_pitch bytes) into the
+// shared memory backed by fd, which has to be at least size bytes long.
+int libraw_ExportRawImage(libraw_data_t* lr, int fd, size_t size);
+
+// Copies the image produced by libraw_dcraw_process() into the shared memory
+// backed by fd. The layout is the one of libraw_processed_image_t::data, its
+// format can be queried with libraw_get_mem_image_format().
+int libraw_ExportProcessedImage(libraw_data_t* lr, int fd, size_t size);
+};
+
+#endif  // CONTRIB_LIBRAW_WRAPPER_WRAPPER_LIBRAW_H_
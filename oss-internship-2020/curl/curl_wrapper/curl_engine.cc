@@ -0,0 +1,289 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "curl_engine.h"  // NOLINT(build/include)
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Transfer {
+  uint64_t id;
+  CURL* easy = nullptr;
+  curl_slist* headers = nullptr;
+  std::string body;
+
+  ~Transfer() {
+    curl_easy_cleanup(easy);
+    curl_slist_free_all(headers);
+  }
+};
+
+struct Finished {
+  std::unique_ptr<Transfer> transfer;
+  CURLcode result;
+  long response_code;
+};
+
+struct Engine {
+  CURLM* multi = nullptr;
+  uint8_t* shared = nullptr;
+  uint64_t request_size;
+  uint64_t response_size;
+  uint64_t max_transfers;
+  std::vector<std::unique_ptr<Transfer>> running;
+  std::deque<Finished> finished;
+  // Bodies handed out by address, freed on the next run.
+  std::vector<std::unique_ptr<Transfer>> handed_out;
+};
+
+size_t AppendToBody(char* data, size_t size, size_t num, void* userp) {
+  static_cast<std::string*>(userp)->append(data, size * num);
+  return size * num;
+}
+
+// Returns the given part of the request area, or nullptr if it is out of
+// bounds.
+const char* RequestPart(const Engine& engine, uint64_t offset, uint64_t size) {
+  if (offset > engine.request_size || size > engine.request_size - offset) {
+    return nullptr;
+  }
+  return reinterpret_cast<const char*>(engine.shared) + offset;
+}
+
+CURLcode SetUp(const Engine& engine, const curl_engine_request_t& request,
+               Transfer& transfer) {
+  const char* url = RequestPart(engine, request.url_offset, request.url_size);
+  const char* method =
+      RequestPart(engine, request.method_offset, request.method_size);
+  const char* headers =
+      RequestPart(engine, request.headers_offset, request.headers_size);
+  const char* body =
+      RequestPart(engine, request.body_offset, request.body_size);
+  if (!url || !method || !headers || !body) {
+    return CURLE_BAD_FUNCTION_ARGUMENT;
+  }
+
+  // curl copies all strings set as options.
+  std::string string(url, request.url_size);
+  CURLcode code = curl_easy_setopt(transfer.easy, CURLOPT_URL, string.c_str());
+  if (code != CURLE_OK) {
+    return code;
+  }
+  string.assign(method, request.method_size);
+  if (string == "HEAD") {
+    code = curl_easy_setopt(transfer.easy, CURLOPT_NOBODY, 1L);
+  } else if (!string.empty() && string != "GET" && string != "POST") {
+    code =
+        curl_easy_setopt(transfer.easy, CURLOPT_CUSTOMREQUEST, string.c_str());
+  }
+  if (code != CURLE_OK) {
+    return code;
+  }
+  if (request.body_size > 0 || string == "POST") {
+    code = curl_easy_setopt(transfer.easy, CURLOPT_POSTFIELDSIZE_LARGE,
+                            static_cast<curl_off_t>(request.body_size));
+    if (code == CURLE_OK) {
+      code = curl_easy_setopt(transfer.easy, CURLOPT_COPYPOSTFIELDS, body);
+    }
+    if (code != CURLE_OK) {
+      return code;
+    }
+  }
+
+  const char* end = headers + request.headers_size;
+  while (headers != end) {
+    const char* line_end = std::find(headers, end, '\n');
+    string.assign(headers, line_end);
+    curl_slist* list = curl_slist_append(transfer.headers, string.c_str());
+    if (!list) {
+      return CURLE_OUT_OF_MEMORY;
+    }
+    transfer.headers = list;
+    headers = line_end == end ? end : line_end + 1;
+  }
+  if (transfer.headers) {
+    code = curl_easy_setopt(transfer.easy, CURLOPT_HTTPHEADER,
+                            transfer.headers);
+    if (code != CURLE_OK) {
+      return code;
+    }
+  }
+
+  code = curl_easy_setopt(transfer.easy, CURLOPT_WRITEFUNCTION, AppendToBody);
+  if (code == CURLE_OK) {
+    code = curl_easy_setopt(transfer.easy, CURLOPT_WRITEDATA, &transfer.body);
+  }
+  if (code == CURLE_OK) {
+    code = curl_easy_setopt(transfer.easy, CURLOPT_PRIVATE, &transfer);
+  }
+  return code;
+}
+
+// Moves the transfers that curl reports as done to engine.finished.
+void CollectFinished(Engine& engine) {
+  int queued;
+  while (CURLMsg* msg = curl_multi_info_read(engine.multi, &queued)) {
+    if (msg->msg != CURLMSG_DONE) {
+      continue;
+    }
+    Transfer* transfer = nullptr;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &transfer);
+    long response_code = 0;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE,
+                      &response_code);
+    CURLcode result = msg->data.result;
+    curl_multi_remove_handle(engine.multi, msg->easy_handle);
+
+    auto it = std::find_if(
+        engine.running.begin(), engine.running.end(),
+        [transfer](const auto& running) { return running.get() == transfer; });
+    if (it == engine.running.end()) {
+      continue;
+    }
+    engine.finished.push_back({std::move(*it), result, response_code});
+    *it = std::move(engine.running.back());
+    engine.running.pop_back();
+  }
+}
+
+}  // namespace
+
+void* curl_engine_create(int fd, uint64_t request_size, uint64_t response_size,
+                         long max_connections, uint64_t max_transfers) {
+  auto engine = std::make_unique<Engine>();
+  engine->request_size = request_size;
+  engine->response_size = response_size;
+  engine->max_transfers = max_transfers;
+  void* shared = mmap(nullptr, request_size + response_size,
+                      PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (shared == MAP_FAILED) {
+    return nullptr;
+  }
+  engine->shared = static_cast<uint8_t*>(shared);
+  engine->multi = curl_multi_init();
+  if (!engine->multi) {
+    munmap(shared, request_size + response_size);
+    return nullptr;
+  }
+  curl_multi_setopt(engine->multi, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                    max_connections);
+  return engine.release();
+}
+
+void curl_engine_destroy(void* engine_ptr) {
+  auto* engine = static_cast<Engine*>(engine_ptr);
+  for (const auto& transfer : engine->running) {
+    curl_multi_remove_handle(engine->multi, transfer->easy);
+  }
+  engine->running.clear();
+  engine->finished.clear();
+  engine->handed_out.clear();
+  curl_multi_cleanup(engine->multi);
+  munmap(engine->shared, engine->request_size + engine->response_size);
+  delete engine;
+}
+
+uint64_t curl_engine_submit(void* engine_ptr,
+                            const curl_engine_request_t* requests,
+                            uint64_t num_requests) {
+  auto* engine = static_cast<Engine*>(engine_ptr);
+  for (uint64_t i = 0; i != num_requests; ++i) {
+    if (engine->max_transfers != 0 &&
+        engine->running.size() + engine->finished.size() >=
+            engine->max_transfers) {
+      return i;
+    }
+    auto transfer = std::make_unique<Transfer>();
+    transfer->id = requests[i].id;
+    transfer->easy = curl_easy_init();
+    if (!transfer->easy) {
+      return i;
+    }
+    // Transfers that cannot be set up still complete, reporting the error.
+    if (CURLcode code = SetUp(*engine, requests[i], *transfer);
+        code != CURLE_OK) {
+      engine->finished.push_back({std::move(transfer), code, 0});
+      continue;
+    }
+    if (curl_multi_add_handle(engine->multi, transfer->easy) != CURLM_OK) {
+      return i;
+    }
+    engine->running.push_back(std::move(transfer));
+  }
+  return num_requests;
+}
+
+int64_t curl_engine_run(void* engine_ptr, int timeout_ms,
+                        curl_engine_completion_t* completions,
+                        uint64_t max_completions) {
+  auto* engine = static_cast<Engine*>(engine_ptr);
+  engine->handed_out.clear();
+
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(timeout_ms);
+  while (engine->finished.empty() && !engine->running.empty()) {
+    int still_running;
+    if (curl_multi_perform(engine->multi, &still_running) != CURLM_OK) {
+      return -1;
+    }
+    CollectFinished(*engine);
+    if (!engine->finished.empty()) {
+      break;
+    }
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (remaining.count() <= 0) {
+      break;
+    }
+    if (curl_multi_poll(engine->multi, nullptr, 0,
+                        static_cast<int>(remaining.count()),
+                        nullptr) != CURLM_OK) {
+      return -1;
+    }
+  }
+
+  uint8_t* response_area = engine->shared + engine->request_size;
+  uint64_t response_used = 0;
+  uint64_t count = 0;
+  for (; count != max_completions && !engine->finished.empty(); ++count) {
+    Finished& finished = engine->finished.front();
+    std::string& body = finished.transfer->body;
+    curl_engine_completion_t& completion = completions[count];
+    completion.id = finished.transfer->id;
+    completion.result = finished.result;
+    completion.response_code = finished.response_code;
+    completion.body_size = body.size();
+    if (body.size() <= engine->response_size - response_used) {
+      memcpy(response_area + response_used, body.data(), body.size());
+      completion.body_offset = response_used;
+      completion.body_data = nullptr;
+      response_used += body.size();
+    } else {
+      completion.body_offset = CURL_ENGINE_BODY_NOT_SHARED;
+      completion.body_data = body.data();
+      engine->handed_out.push_back(std::move(finished.transfer));
+    }
+    engine->finished.pop_front();
+  }
+  return count;
+}
@@ -0,0 +1,85 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Transfer engine running a curl multi handle inside the sandboxee, so that
+// the host only needs one call per batch of requests or completions.
+
+#ifndef CURL_ENGINE_H_
+#define CURL_ENGINE_H_
+
+#include <curl/curl.h>
+#include <stdint.h>
+
+extern "C" {
+
+// Describes a transfer. The strings and the body live in the request area of
+// the shared buffer, given as offsets and sizes into it. headers holds one
+// header line per '\n' terminated line. An empty method means GET.
+typedef struct curl_engine_request {
+  uint64_t id;
+  uint64_t url_offset;
+  uint64_t url_size;
+  uint64_t method_offset;
+  uint64_t method_size;
+  uint64_t headers_offset;
+  uint64_t headers_size;
+  uint64_t body_offset;
+  uint64_t body_size;
+} curl_engine_request_t;
+
+// Describes a finished transfer. If body_offset is not
+// CURL_ENGINE_BODY_NOT_SHARED, the response body is in the response area of
+// the shared buffer. Otherwise it was too large and is at body_data in the
+// sandboxee, where it stays until the next call to curl_engine_run().
+typedef struct curl_engine_completion {
+  uint64_t id;
+  int32_t result;
+  int32_t response_code;
+  uint64_t body_offset;
+  uint64_t body_size;
+  void* body_data;
+} curl_engine_completion_t;
+
+#define CURL_ENGINE_BODY_NOT_SHARED UINT64_MAX
+
+// Creates an engine with at most max_connections connections open at once
+// and at most max_transfers transfers submitted but not yet reported by
+// curl_engine_run(), 0 for no limit. fd refers to the shared buffer, made of
+// a request area of request_size bytes followed by a response area of
+// response_size bytes.
+void* curl_engine_create(int fd, uint64_t request_size, uint64_t response_size,
+                         long max_connections, uint64_t max_transfers);
+
+// Aborts all transfers and frees the engine.
+void curl_engine_destroy(void* engine);
+
+// Starts the num_requests transfers described by requests, in order, until
+// one cannot be started because of an error or the max_transfers limit.
+// Everything they refer to is copied, so the request area may be reused as
+// soon as this returns. Returns the number of requests accepted, each of which
+// is reported by curl_engine_run() once finished. The others were not started.
+uint64_t curl_engine_submit(void* engine, const curl_engine_request_t* requests,
+                            uint64_t num_requests);
+
+// Runs the transfers until at least one has finished or timeout_ms have
+// passed, and reports up to max_completions finished transfers. Bodies are
+// copied to the response area as long as they fit. Returns the number of
+// completions, or -1 on error.
+int64_t curl_engine_run(void* engine, int timeout_ms,
+                        curl_engine_completion_t* completions,
+                        uint64_t max_completions);
+
+}  // extern "C"
+
+#endif  // CURL_ENGINE_H_
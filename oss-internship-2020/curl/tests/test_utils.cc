@@ -179,8 +179,8 @@ std::string ReadExact(int socket, size_t content_bytes) {
 void ServerLoop(int listening_socket, sockaddr_in socket_address) {
   socklen_t socket_address_size = sizeof(socket_address);
 
-  // Listen on the socket (maximum 1 connection)
-  if (listen(listening_socket, 1) == -1) {
+  // Listen on the socket, queueing up connections made in parallel
+  if (listen(listening_socket, SOMAXCONN) == -1) {
     return;
   }
 
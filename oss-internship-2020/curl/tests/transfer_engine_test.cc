@@ -0,0 +1,239 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../transfer_engine.h"  // NOLINT(build/include)
+#include "test_utils.h"          // NOLINT(build/include)
+#include "absl/container/flat_hash_map.h"
+#include "absl/log/check.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "benchmark/benchmark.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace curl::tests {
+namespace {
+
+using ::sapi::IsOk;
+using ::sapi::StatusIs;
+using ::testing::Eq;
+using ::testing::IsTrue;
+using ::testing::SizeIs;
+
+class TransferEngineTest : public CurlTestUtils, public ::testing::Test {
+ public:
+  // Polls until all submitted transfers have finished.
+  static absl::StatusOr<absl::flat_hash_map<uint64_t, TransferResult>> WaitAll(
+      TransferEngine& engine) {
+    absl::flat_hash_map<uint64_t, TransferResult> results;
+    while (engine.in_flight() > 0) {
+      SAPI_ASSIGN_OR_RETURN(std::vector<TransferResult> batch,
+                            engine.Poll(absl::Seconds(10)));
+      if (batch.empty()) {
+        return absl::DeadlineExceededError("Transfers did not finish");
+      }
+      for (TransferResult& result : batch) {
+        results[result.id] = std::move(result);
+      }
+    }
+    return results;
+  }
+
+  static std::string Url() {
+    return absl::StrCat("http://127.0.0.1:", port_, "/");
+  }
+
+  // Starts the mock server unless it is running already, for the benchmarks.
+  static void StartServer() {
+    if (!server_thread_.joinable()) {
+      StartMockServer();
+    }
+  }
+
+ protected:
+  static void SetUpTestSuite() {
+    StartServer();
+    ASSERT_THAT(server_thread_.joinable(), IsTrue());
+  }
+
+  static void TearDownTestSuite() { server_thread_.detach(); }
+
+  void SetUp() override {
+    sandbox_ = std::make_unique<curl::CurlSapiSandbox>();
+    ASSERT_THAT(sandbox_->Init(), IsOk());
+    api_ = std::make_unique<curl::CurlApi>(sandbox_.get());
+  }
+};
+
+TEST_F(TransferEngineTest, GetBatch) {
+  SAPI_ASSERT_OK_AND_ASSIGN(std::unique_ptr<TransferEngine> engine,
+                            TransferEngine::Create(api_.get()));
+
+  std::vector<TransferRequest> requests(50, TransferRequest{Url()});
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<uint64_t> ids,
+                            engine->Submit(requests));
+  ASSERT_THAT(ids, SizeIs(requests.size()));
+  EXPECT_THAT(engine->in_flight(), Eq(requests.size()));
+
+  SAPI_ASSERT_OK_AND_ASSIGN(auto results, WaitAll(*engine));
+  ASSERT_THAT(results, SizeIs(requests.size()));
+  for (uint64_t id : ids) {
+    ASSERT_THAT(results.contains(id), IsTrue()) << id;
+    const TransferResult& result = results[id];
+    EXPECT_THAT(result.curl_code, Eq(curl::CURLE_OK));
+    EXPECT_THAT(result.response_code, Eq(200));
+    EXPECT_THAT(result.body, Eq("OK"));
+  }
+}
+
+TEST_F(TransferEngineTest, PostBodiesAcrossBatches) {
+  TransferEngine::Options options;
+  // Forces splitting the requests into several batches and fetching some of
+  // the bodies separately.
+  options.request_buffer_size = 256;
+  options.response_buffer_size = 64;
+  options.max_completions = 3;
+  SAPI_ASSERT_OK_AND_ASSIGN(std::unique_ptr<TransferEngine> engine,
+                            TransferEngine::Create(api_.get(), options));
+
+  std::vector<TransferRequest> requests;
+  for (int i = 0; i < 20; ++i) {
+    requests.push_back({Url(),
+                        "POST",
+                        {"Content-Type: text/plain"},
+                        absl::StrCat("body number ", i)});
+  }
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<uint64_t> ids,
+                            engine->Submit(requests));
+
+  SAPI_ASSERT_OK_AND_ASSIGN(auto results, WaitAll(*engine));
+  ASSERT_THAT(results, SizeIs(requests.size()));
+  for (size_t i = 0; i < ids.size(); ++i) {
+    const TransferResult& result = results[ids[i]];
+    EXPECT_THAT(result.curl_code, Eq(curl::CURLE_OK));
+    EXPECT_THAT(result.body, Eq(requests[i].body));
+  }
+}
+
+TEST_F(TransferEngineTest, ReportsFailedTransfers) {
+  SAPI_ASSERT_OK_AND_ASSIGN(std::unique_ptr<TransferEngine> engine,
+                            TransferEngine::Create(api_.get()));
+
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::vector<uint64_t> ids,
+      engine->Submit({TransferRequest{"unsupported://127.0.0.1/"}}));
+  SAPI_ASSERT_OK_AND_ASSIGN(auto results, WaitAll(*engine));
+  ASSERT_THAT(results, SizeIs(1));
+  EXPECT_THAT(results[ids[0]].curl_code, Eq(curl::CURLE_UNSUPPORTED_PROTOCOL));
+}
+
+TEST_F(TransferEngineTest, RejectsOversizedRequests) {
+  TransferEngine::Options options;
+  options.request_buffer_size = 16;
+  SAPI_ASSERT_OK_AND_ASSIGN(std::unique_ptr<TransferEngine> engine,
+                            TransferEngine::Create(api_.get(), options));
+
+  EXPECT_THAT(engine->Submit({TransferRequest{Url(), "POST", {},
+                                              std::string(100, 'x')}}),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(engine->in_flight(), Eq(0));
+}
+
+TEST_F(TransferEngineTest, PartialSubmitKeepsAcceptedTransfers) {
+  TransferEngine::Options options;
+  // The sandboxee accepts only part of the batch.
+  options.max_transfers = 4;
+  SAPI_ASSERT_OK_AND_ASSIGN(std::unique_ptr<TransferEngine> engine,
+                            TransferEngine::Create(api_.get(), options));
+
+  std::vector<TransferRequest> requests(10, TransferRequest{Url()});
+  EXPECT_THAT(engine->Submit(requests),
+              StatusIs(absl::StatusCode::kResourceExhausted));
+  EXPECT_THAT(engine->in_flight(), Eq(options.max_transfers));
+
+  // Only the accepted transfers complete, and afterwards there is room again.
+  SAPI_ASSERT_OK_AND_ASSIGN(auto results, WaitAll(*engine));
+  ASSERT_THAT(results, SizeIs(options.max_transfers));
+  for (uint64_t id = 0; id < options.max_transfers; ++id) {
+    ASSERT_THAT(results.contains(id), IsTrue()) << id;
+    EXPECT_THAT(results[id].curl_code, Eq(curl::CURLE_OK));
+  }
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::vector<uint64_t> ids,
+      engine->Submit(absl::MakeConstSpan(requests).first(4)));
+  SAPI_ASSERT_OK_AND_ASSIGN(results, WaitAll(*engine));
+  EXPECT_THAT(results, SizeIs(ids.size()));
+}
+
+// Fetches state.range(0) URLs at once through the engine.
+void BM_TransferEngine(benchmark::State& state) {
+  TransferEngineTest::StartServer();
+  curl::CurlSapiSandbox sandbox;
+  CHECK_OK(sandbox.Init());
+  curl::CurlApi api(&sandbox);
+  absl::StatusOr<std::unique_ptr<TransferEngine>> engine =
+      TransferEngine::Create(&api);
+  CHECK_OK(engine.status());
+
+  std::vector<TransferRequest> requests(state.range(0),
+                                        {TransferEngineTest::Url()});
+  for (auto _ : state) {
+    CHECK_OK((*engine)->Submit(requests).status());
+    CHECK_OK(TransferEngineTest::WaitAll(**engine).status());
+  }
+  state.SetItemsProcessed(state.iterations() * requests.size());
+}
+BENCHMARK(BM_TransferEngine)->Arg(1)->Arg(16)->Arg(64)->Arg(256);
+
+// Baseline: the same number of transfers, one curl_easy_perform() call each.
+void BM_EasyPerform(benchmark::State& state) {
+  TransferEngineTest::StartServer();
+  curl::CurlSapiSandbox sandbox;
+  CHECK_OK(sandbox.Init());
+  curl::CurlApi api(&sandbox);
+  absl::StatusOr<curl::CURL*> handle = api.curl_easy_init();
+  CHECK_OK(handle.status());
+  sapi::v::RemotePtr curl(*handle);
+  sapi::v::ConstCStr url(TransferEngineTest::Url().c_str());
+  CHECK_OK(api.curl_easy_setopt_ptr(&curl, curl::CURLOPT_URL, url.PtrBefore())
+               .status());
+  void* write_function;
+  CHECK_OK(sandbox.rpc_channel()->Symbol("WriteToMemory", &write_function));
+  sapi::v::RemotePtr remote_write_function(write_function);
+  CHECK_OK(api.curl_easy_setopt_ptr(&curl, curl::CURLOPT_WRITEFUNCTION,
+                                    &remote_write_function)
+               .status());
+
+  for (auto _ : state) {
+    for (int64_t i = 0; i < state.range(0); ++i) {
+      sapi::v::LenVal chunk(0);
+      CHECK_OK(api.curl_easy_setopt_ptr(&curl, curl::CURLOPT_WRITEDATA,
+                                        chunk.PtrBoth())
+                   .status());
+      absl::StatusOr<int> curl_code = api.curl_easy_perform(&curl);
+      CHECK_OK(curl_code.status());
+      CHECK_EQ(*curl_code, curl::CURLE_OK);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  CHECK_OK(api.curl_easy_cleanup(&curl));
+}
+BENCHMARK(BM_EasyPerform)->Arg(1)->Arg(16)->Arg(64)->Arg(256);
+
+}  // namespace
+}  // namespace curl::tests
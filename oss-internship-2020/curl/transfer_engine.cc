@@ -0,0 +1,194 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "transfer_engine.h"  // NOLINT(build/include)
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace curl {
+namespace {
+
+// Marks completions whose body is not in the shared buffer, see
+// CURL_ENGINE_BODY_NOT_SHARED.
+constexpr uint64_t kBodyNotShared = std::numeric_limits<uint64_t>::max();
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<TransferEngine>> TransferEngine::Create(
+    CurlApi* api, const Options& options) {
+  if (options.request_buffer_size == 0 || options.max_completions == 0) {
+    return absl::InvalidArgumentError(
+        "Request buffer and completion batches must not be empty");
+  }
+  // Using `new` to access a non-public constructor.
+  auto engine = absl::WrapUnique(new TransferEngine(api, options));
+  SAPI_ASSIGN_OR_RETURN(
+      engine->buffer_,
+      sandbox2::Buffer::CreateWithSize(options.request_buffer_size +
+                                       options.response_buffer_size));
+  sapi::v::Fd fd(dup(engine->buffer_->fd()));
+  if (fd.GetValue() < 0) {
+    return absl::InternalError("Could not duplicate the buffer fd");
+  }
+  SAPI_RETURN_IF_ERROR(api->sandbox()->TransferToSandboxee(&fd));
+
+  absl::StatusOr<void*> remote_engine = api->curl_engine_create(
+      fd.GetRemoteFd(), options.request_buffer_size,
+      options.response_buffer_size, options.max_connections,
+      options.max_transfers);
+  fd.CloseRemoteFd(api->sandbox()->rpc_channel()).IgnoreError();
+  if (!remote_engine.ok()) {
+    return remote_engine.status();
+  }
+  if (!*remote_engine) {
+    return absl::UnavailableError("curl_engine_create failed");
+  }
+  engine->engine_ = *remote_engine;
+  return engine;
+}
+
+TransferEngine::~TransferEngine() {
+  if (engine_) {
+    sapi::v::RemotePtr engine(engine_);
+    api_->curl_engine_destroy(&engine).IgnoreError();
+  }
+}
+
+absl::StatusOr<std::vector<uint64_t>> TransferEngine::Submit(
+    absl::Span<const TransferRequest> requests) {
+  std::vector<uint64_t> ids;
+  ids.reserve(requests.size());
+  std::vector<curl_engine_request_t> batch;
+  uint8_t* area = buffer_->data();
+  uint64_t used = 0;
+  auto append = [area, &used](absl::string_view data) {
+    memcpy(area + used, data.data(), data.size());
+    used += data.size();
+  };
+
+  for (const TransferRequest& request : requests) {
+    size_t size = request.url.size() + request.method.size() +
+                  request.body.size();
+    for (const std::string& header : request.headers) {
+      size += header.size() + 1;
+    }
+    if (size > options_.request_buffer_size) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Request to ", request.url,
+                       " does not fit into the request buffer"));
+    }
+    if (used + size > options_.request_buffer_size) {
+      SAPI_RETURN_IF_ERROR(SubmitBatch(batch));
+      used = 0;
+    }
+
+    curl_engine_request_t& descriptor = batch.emplace_back();
+    descriptor.id = next_id_++;
+    descriptor.url_offset = used;
+    descriptor.url_size = request.url.size();
+    append(request.url);
+    descriptor.method_offset = used;
+    descriptor.method_size = request.method.size();
+    append(request.method);
+    descriptor.headers_offset = used;
+    for (const std::string& header : request.headers) {
+      append(header);
+      append("\n");
+    }
+    descriptor.headers_size = used - descriptor.headers_offset;
+    descriptor.body_offset = used;
+    descriptor.body_size = request.body.size();
+    append(request.body);
+    ids.push_back(descriptor.id);
+  }
+  if (!batch.empty()) {
+    SAPI_RETURN_IF_ERROR(SubmitBatch(batch));
+  }
+  return ids;
+}
+
+absl::Status TransferEngine::SubmitBatch(
+    std::vector<curl_engine_request_t>& batch) {
+  sapi::v::RemotePtr engine(engine_);
+  sapi::v::Array<curl_engine_request_t> requests(batch.data(), batch.size());
+  SAPI_ASSIGN_OR_RETURN(uint64_t accepted,
+                        api_->curl_engine_submit(&engine, requests.PtrBefore(),
+                                                 batch.size()));
+  accepted = std::min<uint64_t>(accepted, batch.size());
+  in_flight_ += accepted;
+  if (accepted == batch.size()) {
+    batch.clear();
+    return absl::OkStatus();
+  }
+  const std::string message = absl::StrCat(
+      "Transfer ", batch[accepted].id,
+      " and the ones submitted after it were not started");
+  batch.clear();
+  if (options_.max_transfers != 0 && in_flight_ >= options_.max_transfers) {
+    return absl::ResourceExhaustedError(
+        absl::StrCat(message, ", ", in_flight_, " transfers are in flight"));
+  }
+  return absl::UnavailableError(message);
+}
+
+absl::StatusOr<std::vector<TransferResult>> TransferEngine::Poll(
+    absl::Duration timeout) {
+  int timeout_ms = static_cast<int>(std::clamp<int64_t>(
+      absl::ToInt64Milliseconds(timeout), 0, std::numeric_limits<int>::max()));
+  sapi::v::RemotePtr engine(engine_);
+  sapi::v::Array<curl_engine_completion_t> completions(
+      options_.max_completions);
+  SAPI_ASSIGN_OR_RETURN(
+      int64_t count,
+      api_->curl_engine_run(&engine, timeout_ms, completions.PtrAfter(),
+                            options_.max_completions));
+  if (count < 0) {
+    return absl::UnavailableError("curl_engine_run failed");
+  }
+  in_flight_ -= count;
+
+  const char* response_area = reinterpret_cast<const char*>(
+      buffer_->data() + options_.request_buffer_size);
+  std::vector<TransferResult> results;
+  results.reserve(count);
+  for (int64_t i = 0; i != count; ++i) {
+    const curl_engine_completion_t& completion = completions[i];
+    TransferResult& result = results.emplace_back();
+    result.id = completion.id;
+    result.curl_code = completion.result;
+    result.response_code = completion.response_code;
+    if (completion.body_offset != kBodyNotShared) {
+      result.body.assign(response_area + completion.body_offset,
+                         completion.body_size);
+      continue;
+    }
+    // Too large for the shared buffer, fetch it separately.
+    result.body.resize(completion.body_size);
+    sapi::v::Array<char> body(result.body.data(), result.body.size());
+    body.SetRemote(completion.body_data);
+    SAPI_RETURN_IF_ERROR(api_->sandbox()->TransferFromSandboxee(&body));
+  }
+  return results;
+}
+
+}  // namespace curl
@@ -0,0 +1,112 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TRANSFER_ENGINE_H_
+#define TRANSFER_ENGINE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "curl_sapi.sapi.h"  // NOLINT(build/include)
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox2/buffer.h"
+
+namespace curl {
+
+struct TransferRequest {
+  std::string url;
+  std::string method;                // Empty for GET
+  std::vector<std::string> headers;  // E.g. "Content-Type: text/plain"
+  std::string body;
+};
+
+struct TransferResult {
+  uint64_t id;
+  int curl_code;
+  long response_code;  // NOLINT(runtime/int)
+  std::string body;
+};
+
+// Runs many transfers at once with a curl multi handle that lives in the
+// sandboxee. Submit() hands over a batch of requests and Poll() returns a
+// batch of completed transfers, one call into the sandbox each, while the
+// sandboxee drives the transfers on its own. Request data and response bodies
+// go through a buffer shared with the sandboxee.
+//
+// Not thread-safe.
+class TransferEngine {
+ public:
+  struct Options {
+    // Maximum number of connections open at once. Further transfers wait.
+    long max_connections = 64;  // NOLINT(runtime/int)
+    // Size of the shared area for request data. Larger batches are split.
+    size_t request_buffer_size = 1 << 20;
+    // Size of the shared area for response bodies. Bodies that do not fit
+    // are copied out separately.
+    size_t response_buffer_size = 4 << 20;
+    // Maximum number of completions returned by one Poll().
+    size_t max_completions = 256;
+    // Maximum number of transfers in flight, 0 for no limit. Submit() fails
+    // for requests beyond it.
+    size_t max_transfers = 0;
+  };
+
+  static absl::StatusOr<std::unique_ptr<TransferEngine>> Create(
+      CurlApi* api, const Options& options);
+  static absl::StatusOr<std::unique_ptr<TransferEngine>> Create(CurlApi* api) {
+    return Create(api, Options());
+  }
+
+  ~TransferEngine();
+
+  // Starts the transfers and returns their ids, in order. Stops at the first
+  // request that cannot be started and returns an error naming it. The
+  // transfers started before it are in flight and are returned by Poll() as
+  // usual; the ones from it on are not started.
+  absl::StatusOr<std::vector<uint64_t>> Submit(
+      absl::Span<const TransferRequest> requests);
+
+  // Waits up to timeout for transfers to finish and returns the ones that
+  // did. Returns as soon as at least one transfer has finished.
+  absl::StatusOr<std::vector<TransferResult>> Poll(absl::Duration timeout);
+
+  // Number of submitted transfers that Poll() has not returned yet.
+  size_t in_flight() const { return in_flight_; }
+
+ private:
+  TransferEngine(CurlApi* api, const Options& options)
+      : api_(api), options_(options) {}
+
+  // Sends the requests laid out at the start of the shared buffer. Counts the
+  // ones the sandboxee accepted as in flight and fails if it did not accept
+  // all of them.
+  absl::Status SubmitBatch(std::vector<curl_engine_request_t>& batch);
+
+  CurlApi* api_;
+  Options options_;
+  std::unique_ptr<sandbox2::Buffer> buffer_;
+  void* engine_ = nullptr;
+  uint64_t next_id_ = 0;
+  size_t in_flight_ = 0;
+};
+
+}  // namespace curl
+
+#endif  // TRANSFER_ENGINE_H_
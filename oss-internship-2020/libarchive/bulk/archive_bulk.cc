@@ -0,0 +1,225 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "archive_bulk.h"  // NOLINT(build/include)
+
+#include <archive.h>
+#include <archive_entry.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox2/stream_channel.h"
+
+namespace {
+
+constexpr size_t kRecordAlignment = 8;
+
+// An entry whose record did not fit into the buffer of the last call. The
+// sandboxee serves one call at a time, so a single slot is enough.
+struct PendingEntry {
+  struct archive* a = nullptr;
+  struct archive_entry* entry = nullptr;
+};
+PendingEntry pending;
+
+// Returns the pending entry of a, if any, or reads the next one.
+int NextEntry(struct archive* a, struct archive_entry** entry) {
+  if (pending.a == a && pending.entry != nullptr) {
+    *entry = pending.entry;
+    pending = {};
+    return ARCHIVE_OK;
+  }
+  pending = {};
+  return archive_read_next_header(a, entry);
+}
+
+size_t PathnameSize(struct archive_entry* entry) {
+  const char* pathname = archive_entry_pathname(entry);
+  return pathname != nullptr ? strlen(pathname) : 0;
+}
+
+size_t RecordSize(struct archive_entry* entry) {
+  return (sizeof(sapi_archive_record) + PathnameSize(entry) +
+          kRecordAlignment - 1) /
+         kRecordAlignment * kRecordAlignment;
+}
+
+// Writes the record of entry to out, which holds RecordSize(entry) bytes.
+void WriteRecord(struct archive_entry* entry, int status, uint8_t* out) {
+  sapi_archive_record record = {};
+  record.record_size = RecordSize(entry);
+  record.pathname_size = PathnameSize(entry);
+  record.size =
+      archive_entry_size_is_set(entry) ? archive_entry_size(entry) : -1;
+  record.mtime = archive_entry_mtime(entry);
+  record.mode = archive_entry_mode(entry);
+  record.status = status;
+  memset(out, 0, record.record_size);
+  memcpy(out, &record, sizeof(record));
+  memcpy(out + sizeof(record), archive_entry_pathname(entry),
+         record.pathname_size);
+}
+
+// Appends the records of the next entries of a to buf. process is called for
+// each entry that fits, before its record is written. It sets the status of
+// the record and whether to stop after it, and returns ARCHIVE_OK or an error
+// that ends the batch.
+template <typename ProcessFn>
+int ReadEntries(struct archive* a, uint8_t* buf, size_t size, size_t* used,
+                size_t* count, ProcessFn process) {
+  *used = 0;
+  *count = 0;
+  while (true) {
+    struct archive_entry* entry;
+    if (int rc = NextEntry(a, &entry); rc != ARCHIVE_OK) {
+      return rc;
+    }
+    const size_t record_size = RecordSize(entry);
+    if (record_size > size - *used) {
+      pending = {a, entry};
+      if (*count == 0) {
+        *used = record_size;
+        return ARCHIVE_RETRY;
+      }
+      return ARCHIVE_OK;
+    }
+    int status = ARCHIVE_OK;
+    bool stop = false;
+    const int rc = process(entry, &status, &stop);
+    WriteRecord(entry, status, buf + *used);
+    *used += record_size;
+    ++*count;
+    if (rc != ARCHIVE_OK || stop) {
+      return rc;
+    }
+  }
+}
+
+int CopyData(struct archive* ar, struct archive* aw) {
+  while (true) {
+    const void* block;
+    size_t size;
+    la_int64_t offset;
+    int rc = archive_read_data_block(ar, &block, &size, &offset);
+    if (rc == ARCHIVE_EOF) {
+      return ARCHIVE_OK;
+    }
+    if (rc != ARCHIVE_OK) {
+      return rc;
+    }
+    rc = archive_write_data_block(aw, block, size, offset);
+    if (rc != ARCHIVE_OK) {
+      return rc;
+    }
+  }
+}
+
+bool WriteFrame(sandbox2::StreamChannel* channel, uint32_t type,
+                int64_t offset, absl::Span<const uint8_t> payload) {
+  sapi_archive_frame frame = {};
+  frame.type = type;
+  frame.offset = offset;
+  frame.size = payload.size();
+  return channel
+             ->Write(absl::MakeConstSpan(
+                 reinterpret_cast<const uint8_t*>(&frame), sizeof(frame)))
+             .ok() &&
+         channel->Write(payload).ok();
+}
+
+int StreamEntries(struct archive* a, sandbox2::StreamChannel* channel,
+                  bool with_data) {
+  std::vector<uint8_t> record;
+  while (true) {
+    struct archive_entry* entry;
+    if (int rc = NextEntry(a, &entry); rc != ARCHIVE_OK) {
+      return rc == ARCHIVE_EOF ? ARCHIVE_OK : rc;
+    }
+    record.resize(RecordSize(entry));
+    WriteRecord(entry, ARCHIVE_OK, record.data());
+    if (!WriteFrame(channel, SAPI_ARCHIVE_FRAME_ENTRY, 0, record)) {
+      return ARCHIVE_FATAL;
+    }
+    while (with_data) {
+      const void* block;
+      size_t size;
+      la_int64_t offset;
+      const int rc = archive_read_data_block(a, &block, &size, &offset);
+      if (rc == ARCHIVE_EOF) {
+        break;
+      }
+      if (rc != ARCHIVE_OK) {
+        return rc;
+      }
+      if (!WriteFrame(channel, SAPI_ARCHIVE_FRAME_DATA, offset,
+                      absl::MakeConstSpan(static_cast<const uint8_t*>(block),
+                                          size))) {
+        return ARCHIVE_FATAL;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int sapi_archive_read_next_headers(struct archive* a, uint8_t* buf,
+                                   size_t size, size_t* used, size_t* count) {
+  return ReadEntries(a, buf, size, used, count,
+                     [](struct archive_entry*, int*, bool*) {
+                       return ARCHIVE_OK;
+                     });
+}
+
+int sapi_archive_extract_entries(struct archive* a, struct archive* ext,
+                                 uint8_t* buf, size_t size, size_t* used,
+                                 size_t* count) {
+  return ReadEntries(a, buf, size, used, count,
+                     [a, ext](struct archive_entry* entry, int* status,
+                              bool* stop) {
+                       *status = archive_write_header(ext, entry);
+                       if (*status != ARCHIVE_OK) {
+                         *stop = true;
+                         return ARCHIVE_OK;
+                       }
+                       return CopyData(a, ext);
+                     });
+}
+
+void* sapi_archive_stream_open(int fd) {
+  const int stream_fd = dup(fd);
+  if (stream_fd < 0) {
+    return nullptr;
+  }
+  auto channel = sandbox2::StreamChannel::CreateFromFd(stream_fd);
+  return channel.ok() ? channel->release() : nullptr;
+}
+
+void sapi_archive_stream_close(void* stream) {
+  delete static_cast<sandbox2::StreamChannel*>(stream);
+}
+
+int sapi_archive_read_entries_to_stream(struct archive* a, void* stream,
+                                        int with_data) {
+  auto* channel = static_cast<sandbox2::StreamChannel*>(stream);
+  const int rc = StreamEntries(a, channel, with_data != 0);
+  // Nothing more can be reported if the end frame cannot be written either.
+  WriteFrame(channel, SAPI_ARCHIVE_FRAME_END, rc, {});
+  channel->CloseWrite();
+  return rc;
+}
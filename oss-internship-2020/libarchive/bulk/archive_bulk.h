@@ -0,0 +1,105 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Sandboxee-side helpers that walk many archive entries per call. Entry
+// metadata is packed into caller-provided buffers as records, and entry data
+// can be streamed out through a sandbox2::StreamChannel. These save the
+// several RPCs per entry (and per data block) that walking an archive with
+// the plain libarchive API takes.
+//
+// The layouts below are shared with the host, which must validate everything
+// it reads from them.
+
+#ifndef LIBARCHIVE_BULK_ARCHIVE_BULK_H_
+#define LIBARCHIVE_BULK_ARCHIVE_BULK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct archive;
+
+// Metadata of one entry, followed by pathname_size bytes of the pathname
+// (without a NUL terminator) and padding up to record_size.
+struct sapi_archive_record {
+  // Size of the record including the pathname and padding, a multiple of 8.
+  uint32_t record_size;
+  uint32_t pathname_size;
+  // Size of the entry data, -1 if the archive does not store it.
+  int64_t size;
+  int64_t mtime;
+  // File type and permissions, as returned by archive_entry_mode().
+  uint32_t mode;
+  // Result of archive_write_header() for extracted entries, ARCHIVE_OK
+  // otherwise.
+  int32_t status;
+};
+
+enum sapi_archive_frame_type {
+  // The payload is a sapi_archive_record.
+  SAPI_ARCHIVE_FRAME_ENTRY = 1,
+  // The payload is a block of data of the last entry at the given offset.
+  SAPI_ARCHIVE_FRAME_DATA = 2,
+  // Last frame of a stream, without payload. offset holds the final result.
+  SAPI_ARCHIVE_FRAME_END = 3,
+};
+
+// Header of a frame written by sapi_archive_read_entries_to_stream().
+struct sapi_archive_frame {
+  uint32_t type;
+  uint32_t reserved;
+  int64_t offset;
+  // Size of the payload following the header.
+  uint64_t size;
+};
+
+// Reads the headers of the next entries of a and appends their records to
+// buf, skipping the entry data. Stores the number of bytes and records written
+// in *used and *count.
+// Returns ARCHIVE_OK if more entries may follow, ARCHIVE_EOF once the end of
+// the archive was reached, or the error of archive_read_next_header(), in
+// which case the records written so far are still valid. If the next record
+// does not even fit into an empty buf, returns ARCHIVE_RETRY and stores the
+// size it needs in *used. An entry whose record did not fit is kept and
+// returned first by the next call for the same archive.
+int sapi_archive_read_next_headers(struct archive* a, uint8_t* buf,
+                                   size_t size, size_t* used, size_t* count);
+
+// Like sapi_archive_read_next_headers(), but also writes each entry including
+// its data to ext, an archive_write_disk handle. Stops after an entry whose
+// header was not written, so that the caller can fetch the error string of
+// ext. Returns the error of copying the data if that fails.
+int sapi_archive_extract_entries(struct archive* a, struct archive* ext,
+                                 uint8_t* buf, size_t size, size_t* used,
+                                 size_t* count);
+
+// Maps the stream channel backed by fd, which is duplicated. Returns NULL on
+// failure.
+void* sapi_archive_stream_open(int fd);
+void sapi_archive_stream_close(void* stream);
+
+// Writes an entry frame for each remaining entry of a, each followed by data
+// frames if with_data is set, then an end frame, and closes the stream for
+// writing. Returns the result that the end frame holds as well.
+int sapi_archive_read_entries_to_stream(struct archive* a, void* stream,
+                                        int with_data);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // LIBARCHIVE_BULK_ARCHIVE_BULK_H_
@@ -0,0 +1,320 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "entry_reader.h"  // NOLINT(build/include)
+
+#include <archive.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "archive_bulk.h"  // NOLINT(build/include)
+#include "sandboxed_api/util/status_macros.h"
+
+namespace {
+
+// Upper bound for buffers and frames sized by the sandboxee.
+constexpr size_t kMaxSize = 64 << 20;
+
+// How often a stream reader checks whether the sandboxee is still writing.
+constexpr absl::Duration kPollInterval = absl::Milliseconds(100);
+
+absl::Status ArchiveError(LibarchiveApi* api, void* archive,
+                          absl::string_view what) {
+  sapi::v::RemotePtr remote(archive);
+  absl::StatusOr<char*> str = api->archive_error_string(&remote);
+  if (!str.ok() || *str == nullptr) {
+    return absl::FailedPreconditionError(what);
+  }
+  SAPI_ASSIGN_OR_RETURN(std::string msg,
+                        api->sandbox()->GetCString(sapi::v::RemotePtr(*str)));
+  return absl::FailedPreconditionError(absl::StrCat(what, ": ", msg));
+}
+
+// Reads exactly data.size() bytes from channel. Returns false if the stream
+// ended cleanly before the first byte. done tells whether the sandboxee
+// returned from writing, so that a dead writer does not block forever.
+absl::StatusOr<bool> ReadFully(sandbox2::StreamChannel* channel,
+                               absl::Span<uint8_t> data,
+                               const std::atomic<bool>& done) {
+  size_t read = 0;
+  while (read < data.size()) {
+    const bool was_done = done.load();
+    absl::StatusOr<size_t> n =
+        channel->Read(data.subspan(read), absl::Now() + kPollInterval);
+    if (absl::IsDeadlineExceeded(n.status())) {
+      if (was_done) {
+        return absl::UnavailableError("The sandboxee stopped streaming");
+      }
+      continue;
+    }
+    SAPI_RETURN_IF_ERROR(n.status());
+    if (*n == 0) {
+      if (read == 0) {
+        return false;
+      }
+      return absl::DataLossError("Truncated stream frame");
+    }
+    read += *n;
+  }
+  return true;
+}
+
+}  // namespace
+
+absl::StatusOr<std::vector<ArchiveEntryInfo>> ParseArchiveRecords(
+    absl::Span<const uint8_t> data, size_t count) {
+  std::vector<ArchiveEntryInfo> entries;
+  entries.reserve(std::min(count, data.size() / sizeof(sapi_archive_record)));
+  for (size_t i = 0; i < count; ++i) {
+    sapi_archive_record record;
+    if (data.size() < sizeof(record)) {
+      return absl::DataLossError("Truncated entry record");
+    }
+    memcpy(&record, data.data(), sizeof(record));
+    if (record.record_size < sizeof(record) ||
+        record.record_size > data.size() ||
+        record.pathname_size > record.record_size - sizeof(record)) {
+      return absl::DataLossError("Invalid entry record");
+    }
+    ArchiveEntryInfo& entry = entries.emplace_back();
+    entry.pathname.assign(
+        reinterpret_cast<const char*>(data.data()) + sizeof(record),
+        record.pathname_size);
+    entry.size = record.size;
+    entry.mtime = record.mtime;
+    entry.mode = record.mode;
+    entry.status = record.status;
+    data.remove_prefix(record.record_size);
+  }
+  return entries;
+}
+
+absl::StatusOr<std::unique_ptr<ArchiveEntryBatchReader>>
+ArchiveEntryBatchReader::Create(LibarchiveApi* api,
+                                sapi::v::RemotePtr* archive,
+                                size_t buffer_size) {
+  if (buffer_size < sizeof(sapi_archive_record) || buffer_size > kMaxSize) {
+    return absl::InvalidArgumentError("Invalid buffer size");
+  }
+  // Using `new` to access a non-public constructor.
+  auto reader =
+      absl::WrapUnique(new ArchiveEntryBatchReader(api, archive->GetValue()));
+  SAPI_RETURN_IF_ERROR(reader->AllocateBuffer(buffer_size));
+  return reader;
+}
+
+absl::StatusOr<std::vector<ArchiveEntryInfo>> ArchiveEntryBatchReader::Next() {
+  return NextBatch(nullptr);
+}
+
+absl::StatusOr<std::vector<ArchiveEntryInfo>>
+ArchiveEntryBatchReader::NextExtracted(sapi::v::RemotePtr* ext) {
+  return NextBatch(ext->GetValue());
+}
+
+absl::Status ArchiveEntryBatchReader::AllocateBuffer(size_t size) {
+  auto buffer = std::make_unique<sapi::v::Array<uint8_t>>(size);
+  SAPI_RETURN_IF_ERROR(
+      api_->sandbox()->Allocate(buffer.get(), /*automatic_free=*/true));
+  buffer_ = std::move(buffer);
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::vector<ArchiveEntryInfo>>
+ArchiveEntryBatchReader::NextBatch(void* ext) {
+  if (done_) {
+    return std::vector<ArchiveEntryInfo>();
+  }
+  sapi::v::RemotePtr archive(archive_);
+  sapi::v::RemotePtr ext_ptr(ext);
+  sapi::v::IntBase<size_t> used;
+  sapi::v::IntBase<size_t> count;
+  int rc;
+  while (true) {
+    SAPI_ASSIGN_OR_RETURN(
+        rc, ext != nullptr
+                ? api_->sapi_archive_extract_entries(
+                      &archive, &ext_ptr, buffer_->PtrNone(),
+                      buffer_->GetSize(), used.PtrAfter(), count.PtrAfter())
+                : api_->sapi_archive_read_next_headers(
+                      &archive, buffer_->PtrNone(), buffer_->GetSize(),
+                      used.PtrAfter(), count.PtrAfter()));
+    if (rc != ARCHIVE_RETRY) {
+      break;
+    }
+    // A single record did not fit, typically because of a long pathname.
+    if (used.GetValue() <= buffer_->GetSize() || used.GetValue() > kMaxSize) {
+      return absl::DataLossError("Invalid record size");
+    }
+    SAPI_RETURN_IF_ERROR(AllocateBuffer(used.GetValue()));
+  }
+  if (rc != ARCHIVE_OK && rc != ARCHIVE_EOF) {
+    done_ = true;
+    return ArchiveError(api_, archive_,
+                        ext != nullptr ? "Could not extract entries"
+                                       : "Could not read entry headers");
+  }
+  done_ = rc == ARCHIVE_EOF;
+  if (used.GetValue() > buffer_->GetSize()) {
+    return absl::DataLossError("Invalid batch size");
+  }
+  if (used.GetValue() == 0) {
+    return std::vector<ArchiveEntryInfo>();
+  }
+  // Only transfer the used part of the buffer.
+  sapi::v::Array<uint8_t> batch(used.GetValue());
+  batch.SetRemote(buffer_->GetRemote());
+  SAPI_RETURN_IF_ERROR(api_->sandbox()->TransferFromSandboxee(&batch));
+  return ParseArchiveRecords(
+      absl::MakeConstSpan(batch.GetData(), batch.GetSize()), count.GetValue());
+}
+
+absl::StatusOr<std::unique_ptr<ArchiveEntryStreamReader>>
+ArchiveEntryStreamReader::Create(LibarchiveApi* api,
+                                 sapi::v::RemotePtr* archive,
+                                 size_t capacity) {
+  // Using `new` to access a non-public constructor.
+  auto reader =
+      absl::WrapUnique(new ArchiveEntryStreamReader(api, archive->GetValue()));
+  SAPI_ASSIGN_OR_RETURN(reader->channel_,
+                        sandbox2::StreamChannel::Create(capacity));
+  sapi::v::Fd fd(dup(reader->channel_->fd()));
+  if (fd.GetValue() < 0) {
+    return absl::InternalError("Could not duplicate the stream fd");
+  }
+  SAPI_RETURN_IF_ERROR(api->sandbox()->TransferToSandboxee(&fd));
+
+  absl::StatusOr<void*> stream =
+      api->sapi_archive_stream_open(fd.GetRemoteFd());
+  fd.CloseRemoteFd(api->sandbox()->rpc_channel()).IgnoreError();
+  SAPI_RETURN_IF_ERROR(stream.status());
+  if (*stream == nullptr) {
+    return absl::InternalError("sapi_archive_stream_open failed");
+  }
+  reader->remote_stream_ = *stream;
+  return reader;
+}
+
+ArchiveEntryStreamReader::~ArchiveEntryStreamReader() {
+  if (remote_stream_ != nullptr) {
+    sapi::v::RemotePtr stream(remote_stream_);
+    api_->sapi_archive_stream_close(&stream).IgnoreError();
+  }
+}
+
+absl::Status ArchiveEntryStreamReader::ReadAll(EntryCallback on_entry,
+                                               DataCallback on_data) {
+  return Read(on_entry, &on_data);
+}
+
+absl::Status ArchiveEntryStreamReader::ReadEntries(EntryCallback on_entry) {
+  return Read(on_entry, nullptr);
+}
+
+absl::Status ArchiveEntryStreamReader::Read(EntryCallback on_entry,
+                                            DataCallback* on_data) {
+  if (used_) {
+    return absl::FailedPreconditionError("The stream was read already");
+  }
+  used_ = true;
+
+  std::atomic<bool> done = false;
+  absl::StatusOr<int> result;
+  std::thread worker([this, on_data, &done, &result] {
+    sapi::v::RemotePtr archive(archive_);
+    sapi::v::RemotePtr stream(remote_stream_);
+    result = api_->sapi_archive_read_entries_to_stream(&archive, &stream,
+                                                       on_data != nullptr);
+    done = true;
+  });
+
+  // Errors of the callbacks are only returned once the stream is drained, so
+  // that the sandboxee does not block on a full ring.
+  absl::Status callback_status;
+  auto consume = [&]() -> absl::Status {
+    std::vector<uint8_t> payload;
+    while (true) {
+      sapi_archive_frame frame;
+      SAPI_ASSIGN_OR_RETURN(
+          bool more,
+          ReadFully(channel_.get(),
+                    absl::MakeSpan(reinterpret_cast<uint8_t*>(&frame),
+                                   sizeof(frame)),
+                    done));
+      if (!more) {
+        return absl::DataLossError("Stream ended without an end frame");
+      }
+      if (frame.size > kMaxSize) {
+        return absl::DataLossError("Invalid stream frame size");
+      }
+      payload.resize(frame.size);
+      SAPI_ASSIGN_OR_RETURN(
+          more, ReadFully(channel_.get(), absl::MakeSpan(payload), done));
+      if (!more && !payload.empty()) {
+        return absl::DataLossError("Truncated stream frame");
+      }
+      switch (frame.type) {
+        case SAPI_ARCHIVE_FRAME_ENTRY: {
+          SAPI_ASSIGN_OR_RETURN(std::vector<ArchiveEntryInfo> entries,
+                                ParseArchiveRecords(payload, 1));
+          if (callback_status.ok()) {
+            callback_status = on_entry(entries.front());
+          }
+          break;
+        }
+        case SAPI_ARCHIVE_FRAME_DATA:
+          if (on_data == nullptr) {
+            return absl::DataLossError("Unexpected data frame");
+          }
+          if (callback_status.ok()) {
+            callback_status = (*on_data)(frame.offset, payload);
+          }
+          break;
+        case SAPI_ARCHIVE_FRAME_END:
+          return absl::OkStatus();
+        default:
+          return absl::DataLossError("Invalid stream frame type");
+      }
+    }
+  };
+  absl::Status status = consume();
+  if (!status.ok() && !done) {
+    // The stream cannot be trusted anymore, and the sandboxee might wait for
+    // room in the ring forever.
+    api_->sandbox()->Kill();
+  }
+  worker.join();
+  SAPI_RETURN_IF_ERROR(status);
+  SAPI_RETURN_IF_ERROR(result.status());
+  if (*result != ARCHIVE_OK) {
+    return ArchiveError(api_, archive_, "Could not stream entries");
+  }
+  return callback_status;
+}
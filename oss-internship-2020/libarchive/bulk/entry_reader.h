@@ -0,0 +1,133 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef LIBARCHIVE_BULK_ENTRY_READER_H_
+#define LIBARCHIVE_BULK_ENTRY_READER_H_
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "libarchive_sapi.sapi.h"  // NOLINT(build/include)
+#include "sandboxed_api/sandbox2/stream_channel.h"
+#include "sandboxed_api/vars.h"
+
+// Metadata of an archive entry, as reported by the helpers in archive_bulk.h.
+struct ArchiveEntryInfo {
+  std::string pathname;
+  // Size of the entry data, -1 if the archive does not store it.
+  int64_t size = -1;
+  int64_t mtime = 0;
+  mode_t mode = 0;
+  // Result of archive_write_header() for extracted entries.
+  int status = 0;
+};
+
+// Parses count records that the sandboxee packed into data.
+absl::StatusOr<std::vector<ArchiveEntryInfo>> ParseArchiveRecords(
+    absl::Span<const uint8_t> data, size_t count);
+
+// Walks the entries of a read archive in the sandboxee in batches. Each batch
+// takes a single call and a single transfer of the used part of a buffer in
+// the sandboxee, instead of several calls per entry plus one per pathname.
+//
+// The archive must not be used by anything else while the reader is in use.
+class ArchiveEntryBatchReader {
+ public:
+  static constexpr size_t kDefaultBufferSize = 64 << 10;
+
+  static absl::StatusOr<std::unique_ptr<ArchiveEntryBatchReader>> Create(
+      LibarchiveApi* api, sapi::v::RemotePtr* archive,
+      size_t buffer_size = kDefaultBufferSize);
+
+  // Reads the headers of the next entries, skipping their data. Returns an
+  // empty batch once all entries have been read.
+  absl::StatusOr<std::vector<ArchiveEntryInfo>> Next();
+
+  // Like Next(), but also writes the entries including their data to ext, an
+  // archive_write_disk handle. A batch ends after an entry whose status is
+  // not ARCHIVE_OK, so archive_error_string() of ext still describes it.
+  absl::StatusOr<std::vector<ArchiveEntryInfo>> NextExtracted(
+      sapi::v::RemotePtr* ext);
+
+ private:
+  ArchiveEntryBatchReader(LibarchiveApi* api, void* archive)
+      : api_(api), archive_(archive) {}
+
+  // Allocates a buffer of size bytes in the sandboxee.
+  absl::Status AllocateBuffer(size_t size);
+
+  // Reads the next batch, extracting the entries to ext unless it is nullptr.
+  absl::StatusOr<std::vector<ArchiveEntryInfo>> NextBatch(void* ext);
+
+  LibarchiveApi* api_;
+  void* archive_;
+  std::unique_ptr<sapi::v::Array<uint8_t>> buffer_;
+  bool done_ = false;
+};
+
+// Streams the remaining entries of a read archive in the sandboxee, including
+// their data, through a ring buffer in shared memory. The sandboxee walks the
+// whole archive in a single call while the host consumes the stream, so data
+// moves at the speed of the slower side and without going through the RPC
+// channel. The sandbox policy needs to allow mmap() and futex().
+class ArchiveEntryStreamReader {
+ public:
+  static constexpr size_t kDefaultCapacity = 1 << 20;
+
+  using EntryCallback =
+      absl::FunctionRef<absl::Status(const ArchiveEntryInfo&)>;
+  // Gets a block of data of the last entry and its offset in the entry.
+  using DataCallback =
+      absl::FunctionRef<absl::Status(int64_t, absl::Span<const uint8_t>)>;
+
+  static absl::StatusOr<std::unique_ptr<ArchiveEntryStreamReader>> Create(
+      LibarchiveApi* api, sapi::v::RemotePtr* archive,
+      size_t capacity = kDefaultCapacity);
+
+  ArchiveEntryStreamReader(const ArchiveEntryStreamReader&) = delete;
+  ArchiveEntryStreamReader& operator=(const ArchiveEntryStreamReader&) = delete;
+
+  ~ArchiveEntryStreamReader();
+
+  // Reads all remaining entries and calls on_entry for each of them, followed
+  // by on_data for each block of its data. If a callback fails, the rest of
+  // the stream is drained and its error returned. Can only be called once.
+  absl::Status ReadAll(EntryCallback on_entry, DataCallback on_data);
+
+  // Like ReadAll(), but only reads the entries, not their data.
+  absl::Status ReadEntries(EntryCallback on_entry);
+
+ private:
+  ArchiveEntryStreamReader(LibarchiveApi* api, void* archive)
+      : api_(api), archive_(archive) {}
+
+  absl::Status Read(EntryCallback on_entry, DataCallback* on_data);
+
+  LibarchiveApi* api_;
+  void* archive_;
+  std::unique_ptr<sandbox2::StreamChannel> channel_;
+  void* remote_stream_ = nullptr;
+  bool used_ = false;
+};
+
+#endif  // LIBARCHIVE_BULK_ENTRY_READER_H_
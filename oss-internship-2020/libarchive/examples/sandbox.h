@@ -124,6 +124,8 @@ class SapiLibarchiveSandboxExtract : public LibarchiveSandbox {
                                          .AllowSyscall(__NR_utimensat)
                                          .AllowUnlink()
                                          .AllowMkdir()
+                                         // For ArchiveEntryStreamReader.
+                                         .AllowMmap()
                                          .AddFile(archive_path_);
 
     if (do_extract_) {
@@ -405,48 +405,37 @@ absl::Status ExtractArchive(const char* filename, int do_extract, int flags,
     return absl::FailedPreconditionError(msg);
   }
 
+  // The entries are read (and extracted) in batches, which takes a single call
+  // for many entries instead of several calls per entry and data block.
+  SAPI_ASSIGN_OR_RETURN(std::unique_ptr<ArchiveEntryBatchReader> reader,
+                        ArchiveEntryBatchReader::Create(&api, &a));
   while (true) {
-    sapi::v::IntBase<archive_entry*> entry_ptr_tmp(0);
-
-    SAPI_ASSIGN_OR_RETURN(
-        rc, api.archive_read_next_header(&a, entry_ptr_tmp.PtrAfter()));
-
-    if (rc == ARCHIVE_EOF) {
-      break;
-    }
-
-    if (rc != ARCHIVE_OK) {
-      SAPI_ASSIGN_OR_RETURN(
-          msg, CheckStatusAndGetString(api.archive_error_string(&a), sandbox));
-      return absl::FailedPreconditionError(msg);
+    std::vector<ArchiveEntryInfo> entries;
+    if (do_extract) {
+      SAPI_ASSIGN_OR_RETURN(entries, reader->NextExtracted(&ext));
+    } else {
+      SAPI_ASSIGN_OR_RETURN(entries, reader->Next());
     }
-
-    sapi::v::RemotePtr entry(entry_ptr_tmp.GetValue());
-
-    if (verbose && do_extract) {
-      std::cout << "x ";
+    if (entries.empty()) {
+      break;
     }
 
-    if (verbose || !do_extract) {
-      SAPI_ASSIGN_OR_RETURN(
-          msg,
-          CheckStatusAndGetString(api.archive_entry_pathname(&entry), sandbox));
-      std::cout << msg << std::endl;
-    }
+    for (const ArchiveEntryInfo& entry : entries) {
+      if (verbose && do_extract) {
+        std::cout << "x ";
+      }
 
-    if (do_extract) {
-      SAPI_ASSIGN_OR_RETURN(rc, api.archive_write_header(&ext, &entry));
+      if (verbose || !do_extract) {
+        std::cout << entry.pathname << std::endl;
+      }
 
-      if (rc != ARCHIVE_OK) {
-        SAPI_ASSIGN_OR_RETURN(msg, CheckStatusAndGetString(
-                                       api.archive_error_string(&a), sandbox));
+      // A batch ends after an entry that could not be written, so the error
+      // string still belongs to it.
+      if (do_extract && entry.status != ARCHIVE_OK) {
+        SAPI_ASSIGN_OR_RETURN(
+            msg,
+            CheckStatusAndGetString(api.archive_error_string(&ext), sandbox));
         std::cout << msg << std::endl;
-      } else {
-        SAPI_ASSIGN_OR_RETURN(rc, CopyData(&a, &ext, api, sandbox));
-        if (rc != ARCHIVE_OK) {
-          return absl::FailedPreconditionError(
-              "Failed to copy data between archive structs.");
-        }
       }
     }
   }
@@ -478,46 +467,6 @@ absl::Status ExtractArchive(const char* filename, int do_extract, int flags,
   return absl::OkStatus();
 }
 
-absl::StatusOr<int> CopyData(sapi::v::RemotePtr* ar, sapi::v::RemotePtr* aw,
-                             LibarchiveApi& api,
-                             SapiLibarchiveSandboxExtract& sandbox) {
-  int rc;
-  std::string msg;
-
-  sapi::v::IntBase<archive_entry*> buff_ptr_tmp(0);
-  sapi::v::ULLong size;
-  sapi::v::SLLong offset;
-
-  while (true) {
-    SAPI_ASSIGN_OR_RETURN(
-        rc, api.archive_read_data_block(ar, buff_ptr_tmp.PtrAfter(),
-                                        size.PtrAfter(), offset.PtrAfter()));
-
-    if (rc == ARCHIVE_EOF) {
-      return ARCHIVE_OK;
-    }
-    if (rc != ARCHIVE_OK) {
-      SAPI_ASSIGN_OR_RETURN(
-          msg, CheckStatusAndGetString(api.archive_error_string(ar), sandbox));
-      std::cout << msg << std::endl;
-      return rc;
-    }
-
-    sapi::v::RemotePtr buff(buff_ptr_tmp.GetValue());
-
-    SAPI_ASSIGN_OR_RETURN(
-        rc, api.archive_write_data_block(aw, &buff, size.GetValue(),
-                                         offset.GetValue()));
-
-    if (rc != ARCHIVE_OK) {
-      SAPI_ASSIGN_OR_RETURN(
-          msg, CheckStatusAndGetString(api.archive_error_string(ar), sandbox));
-      std::cout << msg << std::endl;
-      return rc;
-    }
-  }
-}
-
 std::string MakeAbsolutePathAtCWD(const std::string& path) {
   std::string result = sandbox2::file_util::fileops::MakeAbsolute(
       path, sandbox2::file_util::fileops::GetCWD());
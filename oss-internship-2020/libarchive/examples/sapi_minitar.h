@@ -19,6 +19,7 @@
 #include <archive_entry.h>
 #include <fcntl.h>
 
+#include "entry_reader.h"          // NOLINT(build/include)
 #include "libarchive_sapi.sapi.h"  // NOLINT(build/include)
 #include "sandbox.h"               // NOLINT(build/include)
 #include "sandboxed_api/sandbox2/util.h"
@@ -35,12 +36,6 @@ absl::Status CreateArchive(const char* filename, int compress,
 absl::Status ExtractArchive(const char* filename, int do_extract, int flags,
                             bool verbose = true);
 
-// This function is only called from the "extract function". It is still
-// isolated in order to not modify the code structure as much.
-absl::StatusOr<int> CopyData(sapi::v::RemotePtr* ar, sapi::v::RemotePtr* aw,
-                             LibarchiveApi& api,
-                             SapiLibarchiveSandboxExtract& sandbox);
-
 inline constexpr size_t kBlockSize = 10240;
 inline constexpr size_t kBuffSize = 16384;
 
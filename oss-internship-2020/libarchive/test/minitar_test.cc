@@ -13,8 +13,11 @@
 // limitations under the License.
 
 #include <fstream>
+#include <map>
 
+#include "archive_bulk.h"  // NOLINT(build/include)
 #include "sapi_minitar.h"  // NOLINT(build/include)
+#include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "sandboxed_api/sandbox2/util.h"
 #include "sandboxed_api/util/fileops.h"
@@ -26,8 +29,10 @@ namespace {
 using ::sapi::IsOk;
 using ::sapi::file::JoinPath;
 using ::sapi::file_util::fileops::Exists;
+using ::testing::ElementsAre;
 using ::testing::Eq;
 using ::testing::IsTrue;
+using ::testing::Pair;
 using ::testing::StrEq;
 
 // We will use a fixture class for testing which allows us to override the
@@ -134,6 +139,27 @@ class MiniTarTest : public ::testing::Test {
     fin.close();
   }
 
+  // Opens the archive at path for reading in the sandbox of api.
+  static absl::StatusOr<archive*> OpenArchive(LibarchiveApi& api,
+                                              const std::string& path) {
+    SAPI_ASSIGN_OR_RETURN(archive * ret_archive, api.archive_read_new());
+    if (ret_archive == nullptr) {
+      return absl::FailedPreconditionError("Failed to create read archive");
+    }
+    sapi::v::RemotePtr a(ret_archive);
+    SAPI_ASSIGN_OR_RETURN(int rc, api.archive_read_support_format_tar(&a));
+    if (rc != ARCHIVE_OK) {
+      return absl::FailedPreconditionError("read_support_format_tar failed");
+    }
+    SAPI_ASSIGN_OR_RETURN(
+        rc, api.archive_read_open_filename(
+                &a, sapi::v::ConstCStr(path.c_str()).PtrBefore(), kBlockSize));
+    if (rc != ARCHIVE_OK) {
+      return absl::FailedPreconditionError("read_open_filename failed");
+    }
+    return ret_archive;
+  }
+
   static int test_count_;
   static std::string* data_dir_;
   static std::string* init_wd_;
@@ -294,4 +320,67 @@ TEST_F(MiniTarTest, TestPaths) {
   CheckFile(std::string(kFile3));
 }
 
+TEST_F(MiniTarTest, TestBatchReader) {
+  std::vector<std::string> v = {kFile1.data(), kFile2.data(), kFile3.data()};
+  ASSERT_THAT(CreateArchive(id_.data(), 0, v, false), IsOk());
+
+  std::string path = JoinPath(*data_dir_, id_);
+  SapiLibarchiveSandboxExtract sandbox(path, 0, "");
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  LibarchiveApi api(&sandbox);
+  SAPI_ASSERT_OK_AND_ASSIGN(archive * ret_archive, OpenArchive(api, path));
+  sapi::v::RemotePtr a(ret_archive);
+
+  // Start with a buffer that is too small for any entry, so that it has to be
+  // grown.
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ArchiveEntryBatchReader> reader,
+      ArchiveEntryBatchReader::Create(&api, &a, sizeof(sapi_archive_record)));
+  std::vector<std::string> pathnames;
+  while (true) {
+    SAPI_ASSERT_OK_AND_ASSIGN(std::vector<ArchiveEntryInfo> entries,
+                              reader->Next());
+    if (entries.empty()) {
+      break;
+    }
+    for (const ArchiveEntryInfo& entry : entries) {
+      EXPECT_THAT(entry.size, Eq(static_cast<int64_t>(entry.pathname.size())));
+      pathnames.push_back(entry.pathname);
+    }
+  }
+  EXPECT_THAT(pathnames, ElementsAre(kFile1, kFile2, kFile3));
+}
+
+TEST_F(MiniTarTest, TestStreamReader) {
+  std::vector<std::string> v = {kFile1.data(), kFile2.data(), kFile3.data()};
+  ASSERT_THAT(CreateArchive(id_.data(), 0, v, false), IsOk());
+
+  std::string path = JoinPath(*data_dir_, id_);
+  SapiLibarchiveSandboxExtract sandbox(path, 0, "");
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  LibarchiveApi api(&sandbox);
+  SAPI_ASSERT_OK_AND_ASSIGN(archive * ret_archive, OpenArchive(api, path));
+  sapi::v::RemotePtr a(ret_archive);
+
+  // A ring smaller than a frame makes the sandboxee wait for the host.
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ArchiveEntryStreamReader> reader,
+      ArchiveEntryStreamReader::Create(&api, &a, /*capacity=*/16));
+  std::map<std::string, std::string> contents;
+  std::string* current = nullptr;
+  ASSERT_THAT(reader->ReadAll(
+                  [&](const ArchiveEntryInfo& entry) {
+                    current = &contents[entry.pathname];
+                    return absl::OkStatus();
+                  },
+                  [&](int64_t offset, absl::Span<const uint8_t> data) {
+                    current->resize(offset);
+                    current->append(data.begin(), data.end());
+                    return absl::OkStatus();
+                  }),
+              IsOk());
+  EXPECT_THAT(contents, ElementsAre(Pair(kFile3, kFile3), Pair(kFile2, kFile2),
+                                    Pair(kFile1, kFile1)));
+}
+
 }  // namespace
@@ -15,6 +15,11 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+#include "../row_stream.h"    // NOLINT(build/include)
 #include "../sandboxed.h"     // NOLINT(build/include)
 #include "../tests/libpng.h"  // NOLINT(build/include)
 
@@ -25,10 +30,19 @@ struct Data {
   uint8_t bit_depth;
   int number_of_passes;
   size_t rowbytes;
-  std::unique_ptr<sapi::v::Array<uint8_t>> row_pointers;
 };
 
-absl::StatusOr<Data> ReadPng(LibPNGApi& api, absl::string_view infile) {
+// An open PNG file in the sandboxee along with its libpng state.
+struct PngFile {
+  std::unique_ptr<sapi::v::RemotePtr> file;
+  std::unique_ptr<sapi::v::RemotePtr> struct_ptr;
+  std::unique_ptr<sapi::v::RemotePtr> info_ptr;
+};
+
+// Reads the header of infile, leaving png ready for reading the rows.
+absl::StatusOr<Data> OpenPngForReading(LibPNGApi& api,
+                                       absl::string_view infile,
+                                       PngFile& png) {
   sapi::v::Fd fd(open(infile.data(), O_RDONLY));
 
   if (fd.GetValue() < 0) {
@@ -46,7 +60,8 @@ absl::StatusOr<Data> ReadPng(LibPNGApi& api, absl::string_view infile) {
   SAPI_ASSIGN_OR_RETURN(status_or_file,
                         api.png_fdopen(fd.GetRemoteFd(), rb_var.PtrBefore()));
 
-  sapi::v::RemotePtr file(status_or_file.value());
+  png.file = std::make_unique<sapi::v::RemotePtr>(status_or_file.value());
+  sapi::v::RemotePtr& file = *png.file;
   if (!file.GetValue()) {
     return absl::InternalError(absl::StrCat("Could not open ", infile));
   }
@@ -68,7 +83,9 @@ absl::StatusOr<Data> ReadPng(LibPNGApi& api, absl::string_view infile) {
       status_or_png_structp,
       api.png_create_read_struct_wrapper(ver_string_var.PtrBefore(), &null));
 
-  sapi::v::RemotePtr struct_ptr(status_or_png_structp.value());
+  png.struct_ptr = std::make_unique<sapi::v::RemotePtr>(
+      status_or_png_structp.value());
+  sapi::v::RemotePtr& struct_ptr = *png.struct_ptr;
   if (!struct_ptr.GetValue()) {
     return absl::InternalError("png_create_read_struct_wrapper failed");
   }
@@ -77,7 +94,9 @@ absl::StatusOr<Data> ReadPng(LibPNGApi& api, absl::string_view infile) {
   SAPI_ASSIGN_OR_RETURN(status_or_png_infop,
                         api.png_create_info_struct(&struct_ptr));
 
-  sapi::v::RemotePtr info_ptr(status_or_png_infop.value());
+  png.info_ptr = std::make_unique<sapi::v::RemotePtr>(
+      status_or_png_infop.value());
+  sapi::v::RemotePtr& info_ptr = *png.info_ptr;
   if (!info_ptr.GetValue()) {
     return absl::InternalError("png_create_info_struct failed");
   }
@@ -108,17 +127,12 @@ absl::StatusOr<Data> ReadPng(LibPNGApi& api, absl::string_view infile) {
 
   SAPI_ASSIGN_OR_RETURN(data.rowbytes,
                         api.png_get_rowbytes(&struct_ptr, &info_ptr));
-  data.row_pointers =
-      std::make_unique<sapi::v::Array<uint8_t>>(data.height * data.rowbytes);
-
-  SAPI_RETURN_IF_ERROR(api.png_read_image_wrapper(
-      &struct_ptr, data.row_pointers->PtrAfter(), data.height, data.rowbytes));
-
-  SAPI_RETURN_IF_ERROR(api.png_fclose(&file));
   return data;
 }
 
-absl::Status WritePng(LibPNGApi& api, absl::string_view outfile, Data& data) {
+// Writes the header of outfile, leaving png ready for writing the rows.
+absl::Status OpenPngForWriting(LibPNGApi& api, absl::string_view outfile,
+                               const Data& data, PngFile& png) {
   sapi::v::Fd fd(open(outfile.data(), O_WRONLY));
   if (fd.GetValue() < 0) {
     return absl::InternalError("Error opening output file");
@@ -134,7 +148,8 @@ absl::Status WritePng(LibPNGApi& api, absl::string_view outfile, Data& data) {
   SAPI_ASSIGN_OR_RETURN(status_or_file,
                         api.png_fdopen(fd.GetRemoteFd(), wb_var.PtrBefore()));
 
-  sapi::v::RemotePtr file(status_or_file.value());
+  png.file = std::make_unique<sapi::v::RemotePtr>(status_or_file.value());
+  sapi::v::RemotePtr& file = *png.file;
   if (!file.GetValue()) {
     return absl::InternalError(absl::StrCat("Could not open ", outfile));
   }
@@ -146,7 +161,9 @@ absl::Status WritePng(LibPNGApi& api, absl::string_view outfile, Data& data) {
       status_or_png_structp,
       api.png_create_write_struct_wrapper(ver_string_var.PtrBefore(), &null));
 
-  sapi::v::RemotePtr struct_ptr(status_or_png_structp.value());
+  png.struct_ptr = std::make_unique<sapi::v::RemotePtr>(
+      status_or_png_structp.value());
+  sapi::v::RemotePtr& struct_ptr = *png.struct_ptr;
   if (!struct_ptr.GetValue()) {
     return absl::InternalError("png_create_write_struct_wrapper failed");
   }
@@ -155,7 +172,9 @@ absl::Status WritePng(LibPNGApi& api, absl::string_view outfile, Data& data) {
   SAPI_ASSIGN_OR_RETURN(status_or_png_infop,
                         api.png_create_info_struct(&struct_ptr));
 
-  sapi::v::RemotePtr info_ptr(status_or_png_infop.value());
+  png.info_ptr = std::make_unique<sapi::v::RemotePtr>(
+      status_or_png_infop.value());
+  sapi::v::RemotePtr& info_ptr = *png.info_ptr;
   if (!info_ptr.GetValue()) {
     return absl::InternalError("png_create_info_struct failed");
   }
@@ -164,21 +183,74 @@ absl::Status WritePng(LibPNGApi& api, absl::string_view outfile, Data& data) {
   SAPI_RETURN_IF_ERROR(api.png_init_io_wrapper(&struct_ptr, &file));
 
   SAPI_RETURN_IF_ERROR(api.png_setjmp(&struct_ptr));
-  SAPI_RETURN_IF_ERROR(
-      api.png_set_IHDR(&struct_ptr, &info_ptr, data.width, data.height,
-                       data.bit_depth, data.color_type, PNG_INTERLACE_NONE,
-                       PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE));
+  SAPI_RETURN_IF_ERROR(api.png_set_IHDR(
+      &struct_ptr, &info_ptr, data.width, data.height, data.bit_depth,
+      data.color_type, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE,
+      PNG_FILTER_TYPE_BASE));
 
   SAPI_RETURN_IF_ERROR(api.png_write_info(&struct_ptr, &info_ptr));
+  return absl::OkStatus();
+}
 
-  SAPI_RETURN_IF_ERROR(api.png_setjmp(&struct_ptr));
-  SAPI_RETURN_IF_ERROR(api.png_write_image_wrapper(
-      &struct_ptr, data.row_pointers->PtrBefore(), data.height, data.rowbytes));
+absl::Status FinishWriting(LibPNGApi& api, PngFile& png) {
+  sapi::v::NullPtr null = sapi::v::NullPtr();
+  SAPI_RETURN_IF_ERROR(api.png_setjmp(png.struct_ptr.get()));
+  SAPI_RETURN_IF_ERROR(api.png_write_end(png.struct_ptr.get(), &null));
 
-  SAPI_RETURN_IF_ERROR(api.png_setjmp(&struct_ptr));
-  SAPI_RETURN_IF_ERROR(api.png_write_end(&struct_ptr, &null));
+  SAPI_RETURN_IF_ERROR(api.png_fclose(png.file.get()));
+  return absl::OkStatus();
+}
 
-  SAPI_RETURN_IF_ERROR(api.png_fclose(&file));
+// RGB to BGR
+void SwapRedAndBlue(uint8_t* rows, size_t num_rows, const Data& data,
+                    size_t channel_count) {
+  for (size_t i = 0; i != num_rows; ++i) {
+    uint8_t* row = rows + i * data.rowbytes;
+    for (size_t j = 0; j != data.width; ++j) {
+      std::swap(row[j * channel_count], row[j * channel_count + 2]);
+    }
+  }
+}
+
+// Converts the image one band of rows at a time, so that neither process
+// holds more than two bands of it in memory.
+absl::Status ConvertStreaming(LibPNGApi& api, const Data& data,
+                              size_t channel_count, PngFile& in,
+                              PngFile& out) {
+  SAPI_ASSIGN_OR_RETURN(std::unique_ptr<PngRowReader> reader,
+                        PngRowReader::Create(&api, in.struct_ptr.get(),
+                                             data.height, data.rowbytes));
+  SAPI_ASSIGN_OR_RETURN(
+      std::unique_ptr<PngRowWriter> writer,
+      PngRowWriter::Create(&api, out.struct_ptr.get(), data.rowbytes));
+
+  for (;;) {
+    SAPI_ASSIGN_OR_RETURN(absl::Span<uint8_t> band, reader->NextBand());
+    if (band.empty()) {
+      break;
+    }
+    size_t num_rows = band.size() / data.rowbytes;
+    SwapRedAndBlue(band.data(), num_rows, data, channel_count);
+    std::copy(band.begin(), band.end(), writer->band().begin());
+    SAPI_RETURN_IF_ERROR(writer->Commit(num_rows));
+  }
+  return writer->Flush();
+}
+
+// Interlaced images need all passes before any row is complete, so they are
+// converted as a whole.
+absl::Status ConvertWholeImage(LibPNGApi& api, const Data& data,
+                               size_t channel_count, PngFile& in,
+                               PngFile& out) {
+  sapi::v::Array<uint8_t> image(data.height * data.rowbytes);
+  SAPI_RETURN_IF_ERROR(api.png_read_image_wrapper(
+      in.struct_ptr.get(), image.PtrAfter(), data.height, data.rowbytes));
+
+  SwapRedAndBlue(image.GetData(), data.height, data, channel_count);
+
+  SAPI_RETURN_IF_ERROR(api.png_setjmp(out.struct_ptr.get()));
+  SAPI_RETURN_IF_ERROR(api.png_write_image_wrapper(
+      out.struct_ptr.get(), image.PtrBefore(), data.height, data.rowbytes));
   return absl::OkStatus();
 }
 
@@ -190,7 +262,8 @@ absl::Status LibPNGMain(const std::string& infile, const std::string& outfile) {
   SAPI_RETURN_IF_ERROR(sandbox.Init());
   LibPNGApi api(&sandbox);
 
-  SAPI_ASSIGN_OR_RETURN(Data data, ReadPng(api, infile));
+  PngFile in;
+  SAPI_ASSIGN_OR_RETURN(Data data, OpenPngForReading(api, infile, in));
 
   if (data.color_type != PNG_COLOR_TYPE_RGBA &&
       data.color_type != PNG_COLOR_TYPE_RGB) {
@@ -203,20 +276,17 @@ absl::Status LibPNGMain(const std::string& infile, const std::string& outfile) {
     channel_count = 4;
   }
 
-  // RGB to BGR
-  for (size_t i = 0; i != data.height; ++i) {
-    for (size_t j = 0; j != data.width; ++j) {
-      uint8_t r = (*data.row_pointers)[i * data.rowbytes + j * channel_count];
-      uint8_t g =
-          (*data.row_pointers)[i * data.rowbytes + j * channel_count + 1];
-      uint8_t b =
-          (*data.row_pointers)[i * data.rowbytes + j * channel_count + 2];
-      (*data.row_pointers)[i * data.rowbytes + j * channel_count] = b;
-      (*data.row_pointers)[i * data.rowbytes + j * channel_count + 2] = r;
-    }
+  PngFile out;
+  SAPI_RETURN_IF_ERROR(OpenPngForWriting(api, outfile, data, out));
+
+  if (data.number_of_passes == 1) {
+    SAPI_RETURN_IF_ERROR(ConvertStreaming(api, data, channel_count, in, out));
+  } else {
+    SAPI_RETURN_IF_ERROR(ConvertWholeImage(api, data, channel_count, in, out));
   }
 
-  SAPI_RETURN_IF_ERROR(WritePng(api, outfile, data));
+  SAPI_RETURN_IF_ERROR(api.png_fclose(in.file.get()));
+  SAPI_RETURN_IF_ERROR(FinishWriting(api, out));
   return absl::OkStatus();
 }
 
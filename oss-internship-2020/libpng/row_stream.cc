@@ -0,0 +1,141 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "row_stream.h"  // NOLINT(build/include)
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "sandboxed_api/util/status_macros.h"
+
+PngRowStream::~PngRowStream() {
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+  if (remote_data_) {
+    sapi::v::RemotePtr remote(remote_data_);
+    api_->png_unmap_shared(&remote, buffer_->size()).IgnoreError();
+  }
+}
+
+absl::Status PngRowStream::Init() {
+  SAPI_ASSIGN_OR_RETURN(
+      buffer_, sandbox2::Buffer::CreateWithSize(2 * band_rows_ * rowbytes_));
+  sapi::v::Fd fd(dup(buffer_->fd()));
+  if (fd.GetValue() < 0) {
+    return absl::InternalError("Could not duplicate the buffer fd");
+  }
+  SAPI_RETURN_IF_ERROR(api_->sandbox()->TransferToSandboxee(&fd));
+
+  absl::StatusOr<void*> remote_data =
+      api_->png_map_shared(fd.GetRemoteFd(), buffer_->size());
+  fd.CloseRemoteFd(api_->sandbox()->rpc_channel()).IgnoreError();
+  if (!remote_data.ok()) {
+    return remote_data.status();
+  }
+  if (!*remote_data) {
+    return absl::InternalError("png_map_shared failed");
+  }
+  remote_data_ = static_cast<uint8_t*>(*remote_data);
+  return absl::OkStatus();
+}
+
+void PngRowStream::StartTransfer(bool read, int half, size_t num_rows) {
+  worker_ = std::thread([this, read, half, num_rows] {
+    sapi::v::RemotePtr png(struct_ptr_);
+    sapi::v::RemotePtr rows(RemoteBand(half));
+    worker_status_ =
+        read ? api_->png_read_rows_wrapper(&png, &rows, num_rows, rowbytes_)
+             : api_->png_write_rows_wrapper(&png, &rows, num_rows, rowbytes_);
+  });
+}
+
+absl::Status PngRowStream::WaitForTransfer() {
+  if (!worker_.joinable()) {
+    return absl::OkStatus();
+  }
+  worker_.join();
+  return std::exchange(worker_status_, absl::OkStatus());
+}
+
+absl::StatusOr<std::unique_ptr<PngRowReader>> PngRowReader::Create(
+    LibPNGApi* api, sapi::v::RemotePtr* struct_ptr, size_t height,
+    size_t rowbytes, size_t band_rows) {
+  if (band_rows == 0 || rowbytes == 0) {
+    return absl::InvalidArgumentError("Bands must not be empty");
+  }
+  // Using `new` to access a non-public constructor.
+  auto reader = absl::WrapUnique(new PngRowReader(
+      api, struct_ptr->GetValue(), height, rowbytes, band_rows));
+  SAPI_RETURN_IF_ERROR(reader->Init());
+  reader->ReadAhead();
+  return reader;
+}
+
+void PngRowReader::ReadAhead() {
+  pending_rows_ = std::min(band_rows(), height_ - rows_requested_);
+  if (pending_rows_ == 0) {
+    return;
+  }
+  StartTransfer(/*read=*/true, pending_half_, pending_rows_);
+  rows_requested_ += pending_rows_;
+}
+
+absl::StatusOr<absl::Span<uint8_t>> PngRowReader::NextBand() {
+  if (absl::Status status = WaitForTransfer(); !status.ok()) {
+    // The png_struct is in an unknown state, do not touch it again.
+    pending_rows_ = 0;
+    rows_requested_ = height_;
+    return status;
+  }
+  if (pending_rows_ == 0) {
+    return absl::Span<uint8_t>();
+  }
+  int half = pending_half_;
+  size_t num_rows = pending_rows_;
+  // Decode the next band while the caller works on this one.
+  pending_half_ = 1 - half;
+  ReadAhead();
+  return absl::MakeSpan(LocalBand(half), num_rows * rowbytes());
+}
+
+absl::StatusOr<std::unique_ptr<PngRowWriter>> PngRowWriter::Create(
+    LibPNGApi* api, sapi::v::RemotePtr* struct_ptr, size_t rowbytes,
+    size_t band_rows) {
+  if (band_rows == 0 || rowbytes == 0) {
+    return absl::InvalidArgumentError("Bands must not be empty");
+  }
+  // Using `new` to access a non-public constructor.
+  auto writer = absl::WrapUnique(
+      new PngRowWriter(api, struct_ptr->GetValue(), rowbytes, band_rows));
+  SAPI_RETURN_IF_ERROR(writer->Init());
+  return writer;
+}
+
+absl::Status PngRowWriter::Commit(size_t num_rows) {
+  if (num_rows > band_rows()) {
+    return absl::InvalidArgumentError("Too many rows for a band");
+  }
+  // Rows must reach libpng in order, so only one band is encoded at a time.
+  SAPI_RETURN_IF_ERROR(WaitForTransfer());
+  if (num_rows == 0) {
+    return absl::OkStatus();
+  }
+  StartTransfer(/*read=*/false, half_, num_rows);
+  half_ = 1 - half_;
+  return absl::OkStatus();
+}
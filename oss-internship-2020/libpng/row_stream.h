@@ -0,0 +1,140 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef LIBPNG_ROW_STREAM_H_
+#define LIBPNG_ROW_STREAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "libpng_sapi.sapi.h"  // NOLINT(build/include)
+#include "sandboxed_api/sandbox2/buffer.h"
+
+// Moves the rows of a non-interlaced image between the host and a png_struct
+// in the sandboxee in bands of a fixed number of rows. The bands live in two
+// halves of a buffer that is shared with the sandboxee, so memory use does not
+// depend on the image height and no row data goes through the RPC channel.
+// While the caller works on one half, the sandboxee reads or writes the other
+// one on a background thread.
+//
+// The png_struct must not be used by anything else while a stream is active.
+class PngRowStream {
+ public:
+  static constexpr size_t kDefaultBandRows = 64;
+
+  PngRowStream(const PngRowStream&) = delete;
+  PngRowStream& operator=(const PngRowStream&) = delete;
+
+  virtual ~PngRowStream();
+
+  size_t band_rows() const { return band_rows_; }
+  size_t rowbytes() const { return rowbytes_; }
+
+ protected:
+  PngRowStream(LibPNGApi* api, void* struct_ptr, size_t rowbytes,
+               size_t band_rows)
+      : api_(api),
+        struct_ptr_(struct_ptr),
+        rowbytes_(rowbytes),
+        band_rows_(band_rows) {}
+
+  // Allocates the shared buffer and maps it in the sandboxee.
+  absl::Status Init();
+
+  uint8_t* LocalBand(int half) const {
+    return buffer_->data() + half * band_rows_ * rowbytes_;
+  }
+  uint8_t* RemoteBand(int half) const {
+    return remote_data_ + half * band_rows_ * rowbytes_;
+  }
+
+  // Starts reading (or writing) num_rows rows into (from) the given half of
+  // the buffer on the worker thread.
+  void StartTransfer(bool read, int half, size_t num_rows);
+
+  // Waits for the transfer started last, if any, and returns its result.
+  absl::Status WaitForTransfer();
+
+ private:
+  LibPNGApi* api_;
+  void* struct_ptr_;
+  size_t rowbytes_;
+  size_t band_rows_;
+  std::unique_ptr<sandbox2::Buffer> buffer_;
+  uint8_t* remote_data_ = nullptr;
+  std::thread worker_;
+  absl::Status worker_status_;
+};
+
+// Decodes the rows of an image band by band. The caller must have called
+// png_read_info() and png_read_update_info() already.
+class PngRowReader : public PngRowStream {
+ public:
+  static absl::StatusOr<std::unique_ptr<PngRowReader>> Create(
+      LibPNGApi* api, sapi::v::RemotePtr* struct_ptr, size_t height,
+      size_t rowbytes, size_t band_rows = kDefaultBandRows);
+
+  // Returns the next band of up to band_rows() rows, or an empty span once
+  // all rows have been read. The band may be modified in place and stays
+  // valid until the next call.
+  absl::StatusOr<absl::Span<uint8_t>> NextBand();
+
+ private:
+  PngRowReader(LibPNGApi* api, void* struct_ptr, size_t height,
+               size_t rowbytes, size_t band_rows)
+      : PngRowStream(api, struct_ptr, rowbytes, band_rows), height_(height) {}
+
+  // Starts decoding the band after the last requested one, if there is one.
+  void ReadAhead();
+
+  size_t height_;
+  size_t rows_requested_ = 0;  // Rows handed to the worker so far
+  size_t pending_rows_ = 0;    // Rows in the band being decoded
+  int pending_half_ = 0;
+};
+
+// Encodes the rows of an image band by band. The caller must have called
+// png_write_info() already and calls png_write_end() after Flush().
+class PngRowWriter : public PngRowStream {
+ public:
+  static absl::StatusOr<std::unique_ptr<PngRowWriter>> Create(
+      LibPNGApi* api, sapi::v::RemotePtr* struct_ptr, size_t rowbytes,
+      size_t band_rows = kDefaultBandRows);
+
+  // Returns room for band_rows() rows for the caller to fill in.
+  absl::Span<uint8_t> band() const {
+    return absl::MakeSpan(LocalBand(half_), band_rows() * rowbytes());
+  }
+
+  // Queues the first num_rows rows of band() for encoding and hands out the
+  // other half of the buffer as the next band().
+  absl::Status Commit(size_t num_rows);
+
+  // Waits until all committed rows have been encoded.
+  absl::Status Flush() { return WaitForTransfer(); }
+
+ private:
+  PngRowWriter(LibPNGApi* api, void* struct_ptr, size_t rowbytes,
+               size_t band_rows)
+      : PngRowStream(api, struct_ptr, rowbytes, band_rows) {}
+
+  int half_ = 0;
+};
+
+#endif  // LIBPNG_ROW_STREAM_H_
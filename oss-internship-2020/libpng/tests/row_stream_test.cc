@@ -0,0 +1,326 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../row_stream.h"  // NOLINT(build/include)
+#include "../sandboxed.h"   // NOLINT(build/include)
+#include "libpng.h"         // NOLINT(build/include)
+#include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+#include "gtest/gtest.h"
+#include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/path.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/util/status_matchers.h"
+#include "sandboxed_api/util/temp_file.h"
+
+namespace {
+
+using ::sapi::IsOk;
+using ::testing::ContainerEq;
+using ::testing::Eq;
+
+constexpr size_t kChannelCount = 3;
+
+// Returns the rows of an RGB image that does not compress too well.
+std::vector<uint8_t> MakeImage(size_t width, size_t height) {
+  std::vector<uint8_t> image(width * height * kChannelCount);
+  uint32_t state = 1;
+  for (uint8_t& value : image) {
+    state = state * 1103515245 + 12345;
+    value = (state >> 16) & 0x0f;
+  }
+  return image;
+}
+
+absl::StatusOr<std::string> CreateOutputFile(absl::string_view name) {
+  SAPI_ASSIGN_OR_RETURN(std::string path,
+                        sapi::CreateNamedTempFileAndClose(name));
+  return sapi::file::JoinPath(sapi::file_util::fileops::GetCWD(), path);
+}
+
+// Writes the image as a whole using the simplified API.
+absl::Status WriteImage(LibPNGApi& api, const std::string& path,
+                        std::vector<uint8_t>& image, size_t width,
+                        size_t height) {
+  sapi::v::Struct<png_image> png;
+  png.mutable_data()->version = PNG_IMAGE_VERSION;
+  png.mutable_data()->width = width;
+  png.mutable_data()->height = height;
+  png.mutable_data()->format = PNG_FORMAT_RGB;
+
+  sapi::v::ConstCStr path_var(path.c_str());
+  sapi::v::Array<uint8_t> buffer(image.data(), image.size());
+  sapi::v::NullPtr null = sapi::v::NullPtr();
+  SAPI_ASSIGN_OR_RETURN(
+      int result,
+      api.png_image_write_to_file(png.PtrBoth(), path_var.PtrBefore(), 0,
+                                  buffer.PtrBefore(), 0, &null));
+  if (!result) {
+    return absl::InternalError(png.mutable_data()->message);
+  }
+  return absl::OkStatus();
+}
+
+// A PNG file opened with the low-level API.
+struct PngFile {
+  std::unique_ptr<sapi::v::RemotePtr> file;
+  std::unique_ptr<sapi::v::RemotePtr> struct_ptr;
+  std::unique_ptr<sapi::v::RemotePtr> info_ptr;
+  size_t height;
+  size_t rowbytes;
+};
+
+absl::Status OpenFile(LibPNGApi& api, const std::string& path, bool write,
+                      PngFile& png) {
+  sapi::v::Fd fd(open(path.c_str(), write ? O_WRONLY : O_RDONLY));
+  if (fd.GetValue() < 0) {
+    return absl::InternalError(absl::StrCat("Could not open ", path));
+  }
+  SAPI_RETURN_IF_ERROR(api.sandbox()->TransferToSandboxee(&fd));
+
+  sapi::v::ConstCStr mode_var(write ? "wb" : "rb");
+  SAPI_ASSIGN_OR_RETURN(void* file,
+                        api.png_fdopen(fd.GetRemoteFd(), mode_var.PtrBefore()));
+  if (!file) {
+    return absl::InternalError("png_fdopen failed");
+  }
+  png.file = std::make_unique<sapi::v::RemotePtr>(file);
+
+  sapi::v::ConstCStr ver_string_var(PNG_LIBPNG_VER_STRING);
+  sapi::v::NullPtr null = sapi::v::NullPtr();
+  SAPI_ASSIGN_OR_RETURN(
+      png_structp struct_ptr,
+      write ? api.png_create_write_struct_wrapper(ver_string_var.PtrBefore(),
+                                                  &null)
+            : api.png_create_read_struct_wrapper(ver_string_var.PtrBefore(),
+                                                 &null));
+  if (!struct_ptr) {
+    return absl::InternalError("Could not create png_struct");
+  }
+  png.struct_ptr = std::make_unique<sapi::v::RemotePtr>(struct_ptr);
+
+  SAPI_ASSIGN_OR_RETURN(png_infop info_ptr,
+                        api.png_create_info_struct(png.struct_ptr.get()));
+  if (!info_ptr) {
+    return absl::InternalError("png_create_info_struct failed");
+  }
+  png.info_ptr = std::make_unique<sapi::v::RemotePtr>(info_ptr);
+
+  SAPI_RETURN_IF_ERROR(api.png_setjmp(png.struct_ptr.get()));
+  return api.png_init_io_wrapper(png.struct_ptr.get(), png.file.get());
+}
+
+absl::Status OpenForReading(LibPNGApi& api, const std::string& path,
+                            PngFile& png) {
+  SAPI_RETURN_IF_ERROR(OpenFile(api, path, /*write=*/false, png));
+  SAPI_RETURN_IF_ERROR(
+      api.png_read_info(png.struct_ptr.get(), png.info_ptr.get()));
+  SAPI_ASSIGN_OR_RETURN(
+      png.height,
+      api.png_get_image_height(png.struct_ptr.get(), png.info_ptr.get()));
+  SAPI_RETURN_IF_ERROR(
+      api.png_read_update_info(png.struct_ptr.get(), png.info_ptr.get()));
+  SAPI_ASSIGN_OR_RETURN(
+      png.rowbytes,
+      api.png_get_rowbytes(png.struct_ptr.get(), png.info_ptr.get()));
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::vector<uint8_t>> ReadWholeImage(LibPNGApi& api,
+                                                    const std::string& path) {
+  PngFile png;
+  SAPI_RETURN_IF_ERROR(OpenForReading(api, path, png));
+
+  sapi::v::Array<uint8_t> image(png.height * png.rowbytes);
+  SAPI_RETURN_IF_ERROR(api.png_read_image_wrapper(
+      png.struct_ptr.get(), image.PtrAfter(), png.height, png.rowbytes));
+  SAPI_RETURN_IF_ERROR(api.png_fclose(png.file.get()));
+  return std::vector<uint8_t>(image.GetData(),
+                              image.GetData() + image.GetSize());
+}
+
+absl::StatusOr<std::vector<uint8_t>> ReadStreaming(LibPNGApi& api,
+                                                   const std::string& path,
+                                                   size_t band_rows) {
+  PngFile png;
+  SAPI_RETURN_IF_ERROR(OpenForReading(api, path, png));
+
+  std::vector<uint8_t> image;
+  image.reserve(png.height * png.rowbytes);
+  {
+    SAPI_ASSIGN_OR_RETURN(
+        std::unique_ptr<PngRowReader> reader,
+        PngRowReader::Create(&api, png.struct_ptr.get(), png.height,
+                             png.rowbytes, band_rows));
+    for (;;) {
+      SAPI_ASSIGN_OR_RETURN(absl::Span<uint8_t> band, reader->NextBand());
+      if (band.empty()) {
+        break;
+      }
+      image.insert(image.end(), band.begin(), band.end());
+    }
+  }
+  SAPI_RETURN_IF_ERROR(api.png_fclose(png.file.get()));
+  return image;
+}
+
+absl::Status WriteStreaming(LibPNGApi& api, const std::string& path,
+                            const std::vector<uint8_t>& image, size_t width,
+                            size_t height, size_t band_rows) {
+  PngFile png;
+  SAPI_RETURN_IF_ERROR(OpenFile(api, path, /*write=*/true, png));
+  SAPI_RETURN_IF_ERROR(api.png_set_IHDR(
+      png.struct_ptr.get(), png.info_ptr.get(), width, height, 8,
+      PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE,
+      PNG_FILTER_TYPE_BASE));
+  SAPI_RETURN_IF_ERROR(
+      api.png_write_info(png.struct_ptr.get(), png.info_ptr.get()));
+
+  size_t rowbytes = width * kChannelCount;
+  {
+    SAPI_ASSIGN_OR_RETURN(std::unique_ptr<PngRowWriter> writer,
+                          PngRowWriter::Create(&api, png.struct_ptr.get(),
+                                               rowbytes, band_rows));
+    for (size_t row = 0; row < height; row += band_rows) {
+      size_t num_rows = std::min(band_rows, height - row);
+      std::copy_n(image.begin() + row * rowbytes, num_rows * rowbytes,
+                  writer->band().begin());
+      SAPI_RETURN_IF_ERROR(writer->Commit(num_rows));
+    }
+    SAPI_RETURN_IF_ERROR(writer->Flush());
+  }
+
+  sapi::v::NullPtr null = sapi::v::NullPtr();
+  SAPI_RETURN_IF_ERROR(api.png_write_end(png.struct_ptr.get(), &null));
+  return api.png_fclose(png.file.get());
+}
+
+TEST(RowStreamTest, ReadMatchesWholeImage) {
+  // Neither dimension is a multiple of the band size.
+  constexpr size_t kWidth = 333;
+  constexpr size_t kHeight = 257;
+  absl::StatusOr<std::string> path = CreateOutputFile("stream_read.png");
+  ASSERT_THAT(path, IsOk());
+
+  LibPNGSapiSandbox sandbox;
+  sandbox.AddFile(*path);
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  LibPNGApi api(&sandbox);
+
+  std::vector<uint8_t> image = MakeImage(kWidth, kHeight);
+  ASSERT_THAT(WriteImage(api, *path, image, kWidth, kHeight), IsOk());
+
+  absl::StatusOr<std::vector<uint8_t>> whole = ReadWholeImage(api, *path);
+  ASSERT_THAT(whole, IsOk());
+  EXPECT_THAT(*whole, ContainerEq(image));
+
+  for (size_t band_rows : {1, 64, 1000}) {
+    absl::StatusOr<std::vector<uint8_t>> streamed =
+        ReadStreaming(api, *path, band_rows);
+    ASSERT_THAT(streamed, IsOk()) << "band_rows: " << band_rows;
+    EXPECT_THAT(*streamed, ContainerEq(*whole)) << "band_rows: " << band_rows;
+  }
+}
+
+TEST(RowStreamTest, WriteRoundTrips) {
+  constexpr size_t kWidth = 201;
+  constexpr size_t kHeight = 130;
+  absl::StatusOr<std::string> path = CreateOutputFile("stream_write.png");
+  ASSERT_THAT(path, IsOk());
+
+  LibPNGSapiSandbox sandbox;
+  sandbox.AddFile(*path);
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  LibPNGApi api(&sandbox);
+
+  std::vector<uint8_t> image = MakeImage(kWidth, kHeight);
+  ASSERT_THAT(WriteStreaming(api, *path, image, kWidth, kHeight,
+                             /*band_rows=*/16),
+              IsOk());
+
+  absl::StatusOr<std::vector<uint8_t>> result = ReadWholeImage(api, *path);
+  ASSERT_THAT(result, IsOk());
+  EXPECT_THAT(result->size(), Eq(image.size()));
+  EXPECT_THAT(*result, ContainerEq(image));
+}
+
+TEST(RowStreamTest, RejectsEmptyBands) {
+  LibPNGSapiSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  LibPNGApi api(&sandbox);
+
+  sapi::v::RemotePtr struct_ptr(nullptr);
+  EXPECT_THAT(PngRowReader::Create(&api, &struct_ptr, /*height=*/1,
+                                   /*rowbytes=*/3, /*band_rows=*/0)
+                  .status()
+                  .code(),
+              Eq(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(PngRowWriter::Create(&api, &struct_ptr, /*rowbytes=*/0)
+                  .status()
+                  .code(),
+              Eq(absl::StatusCode::kInvalidArgument));
+}
+
+// Decodes a large image either as a whole or in bands of state.range(0) rows.
+void BenchmarkRead(benchmark::State& state, bool streaming) {
+  constexpr size_t kWidth = 4096;
+  constexpr size_t kHeight = 4096;
+  absl::StatusOr<std::string> path = CreateOutputFile("stream_bench.png");
+  CHECK_OK(path.status());
+
+  LibPNGSapiSandbox sandbox;
+  sandbox.AddFile(*path);
+  CHECK_OK(sandbox.Init());
+  LibPNGApi api(&sandbox);
+
+  std::vector<uint8_t> image = MakeImage(kWidth, kHeight);
+  CHECK_OK(WriteImage(api, *path, image, kWidth, kHeight));
+
+  for (auto _ : state) {
+    absl::StatusOr<std::vector<uint8_t>> result =
+        streaming ? ReadStreaming(api, *path, state.range(0))
+                  : ReadWholeImage(api, *path);
+    CHECK_OK(result.status());
+    benchmark::DoNotOptimize(*result);
+  }
+  state.SetBytesProcessed(state.iterations() * image.size());
+}
+
+void BM_ReadWholeImage(benchmark::State& state) {
+  BenchmarkRead(state, /*streaming=*/false);
+}
+BENCHMARK(BM_ReadWholeImage)->Unit(benchmark::kMillisecond);
+
+void BM_ReadStreaming(benchmark::State& state) {
+  BenchmarkRead(state, /*streaming=*/true);
+}
+BENCHMARK(BM_ReadStreaming)
+    ->Arg(16)
+    ->Arg(64)
+    ->Arg(256)
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
@@ -12,6 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "func.h"  // NOLINT(build/include)
+
+#include <sys/mman.h>
+
 #include <cstdlib>
 
 void png_setjmp(png_structrp ptr) { setjmp(png_jmpbuf(ptr)); }
@@ -62,3 +66,38 @@ void png_write_image_wrapper(png_structrp png_ptr, png_bytep image,
   png_write_image(png_ptr, ptrs);
   free(ptrs);
 }
+
+namespace {
+
+// Points ptrs at the num_rows consecutive rows starting at rows.
+void FillRowPointers(png_bytep rows, size_t num_rows, size_t rowbytes,
+                     png_bytep* ptrs) {
+  for (size_t i = 0; i != num_rows; ++i) {
+    ptrs[i] = rows + (i * rowbytes);
+  }
+}
+
+}  // namespace
+
+void png_read_rows_wrapper(png_structrp png_ptr, png_bytep rows,
+                           size_t num_rows, size_t rowbytes) {
+  png_bytep* ptrs = (png_bytep*)malloc(num_rows * sizeof(png_bytep));
+  FillRowPointers(rows, num_rows, rowbytes, ptrs);
+  png_read_rows(png_ptr, ptrs, NULL, num_rows);
+  free(ptrs);
+}
+
+void png_write_rows_wrapper(png_structrp png_ptr, png_bytep rows,
+                            size_t num_rows, size_t rowbytes) {
+  png_bytep* ptrs = (png_bytep*)malloc(num_rows * sizeof(png_bytep));
+  FillRowPointers(rows, num_rows, rowbytes, ptrs);
+  png_write_rows(png_ptr, ptrs, num_rows);
+  free(ptrs);
+}
+
+void* png_map_shared(int fd, size_t size) {
+  void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  return addr == MAP_FAILED ? NULL : addr;
+}
+
+void png_unmap_shared(void* addr, size_t size) { munmap(addr, size); }
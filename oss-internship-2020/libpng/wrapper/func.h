@@ -34,6 +34,17 @@ void png_read_image_wrapper(png_structrp png_ptr, png_bytep image,
 void png_write_image_wrapper(png_structrp png_ptr, png_bytep image,
                              size_t height, size_t rowbytes);
 
+// Reads/writes the next num_rows rows of a non-interlaced image from/to the
+// consecutive rows of a band buffer.
+void png_read_rows_wrapper(png_structrp png_ptr, png_bytep rows,
+                           size_t num_rows, size_t rowbytes);
+void png_write_rows_wrapper(png_structrp png_ptr, png_bytep rows,
+                            size_t num_rows, size_t rowbytes);
+
+// Maps/unmaps the shared memory that the band buffers live in.
+void* png_map_shared(int fd, size_t size);
+void png_unmap_shared(void* addr, size_t size);
+
 }  // extern "C"
 
 #endif  // LIBPNG_WRAPPER_FUNC_H_
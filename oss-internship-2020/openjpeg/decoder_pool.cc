@@ -0,0 +1,389 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder_pool.h"  // NOLINT(build/include)
+
+#include <syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+
+#include "absl/cleanup/cleanup.h"
+#include "absl/memory/memory.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace {
+
+// Only reads from the file descriptors it is given.
+class Openjp2FdSandbox : public Openjp2Sandbox {
+ public:
+  std::unique_ptr<sandbox2::Policy> ModifyPolicy(
+      sandbox2::PolicyBuilder*) override {
+    return sandbox2::PolicyBuilder()
+        .AllowStaticStartup()
+        .AllowRead()
+        .AllowWrite()
+        .AllowStat()
+        .AllowSystemMalloc()
+        .AllowExit()
+        .AllowSyscalls({
+            __NR_futex,
+            __NR_close,
+            __NR_pread64,
+        })
+        .BuildOrDie();
+  }
+};
+
+// A half-open range on one axis of the reference grid.
+struct Range {
+  OPJ_UINT32 begin;
+  OPJ_UINT32 end;
+};
+
+// Cuts range at the boundaries of the tiles that start at origin and are size
+// apart, into at most max_parts ranges of whole tiles.
+std::vector<Range> SplitAtTiles(Range range, OPJ_UINT32 origin,
+                                OPJ_UINT32 size, size_t max_parts) {
+  uint64_t first = (range.begin - origin) / size;
+  uint64_t num_tiles = (range.end - 1 - origin) / size - first + 1;
+  uint64_t num_parts = std::min<uint64_t>(num_tiles, max_parts);
+
+  std::vector<Range> parts;
+  parts.reserve(num_parts);
+  for (uint64_t i = 0; i != num_parts; ++i) {
+    uint64_t from = origin + (first + num_tiles * i / num_parts) * size;
+    uint64_t to = origin + (first + num_tiles * (i + 1) / num_parts) * size;
+    parts.push_back(
+        {static_cast<OPJ_UINT32>(std::max<uint64_t>(range.begin, from)),
+         static_cast<OPJ_UINT32>(std::min<uint64_t>(range.end, to))});
+  }
+  return parts;
+}
+
+// Divides a by 2^factor, rounding up, as OpenJPEG does for reduced
+// resolutions.
+OPJ_UINT32 CeilDivPow2(OPJ_UINT32 a, OPJ_UINT32 factor) {
+  return static_cast<OPJ_UINT32>(
+      (static_cast<uint64_t>(a) + (uint64_t{1} << factor) - 1) >> factor);
+}
+
+// Copies the samples of part into the matching place of whole.
+absl::Status Paste(const Openjp2Component& part, Openjp2Component& whole) {
+  // The origins are on the full resolution component grid, while the widths
+  // and heights are at the decoded resolution.
+  OPJ_UINT32 part_x0 = CeilDivPow2(part.x0, part.factor);
+  OPJ_UINT32 part_y0 = CeilDivPow2(part.y0, part.factor);
+  OPJ_UINT32 whole_x0 = CeilDivPow2(whole.x0, whole.factor);
+  OPJ_UINT32 whole_y0 = CeilDivPow2(whole.y0, whole.factor);
+  OPJ_UINT32 offset_x = part_x0 - whole_x0;
+  OPJ_UINT32 offset_y = part_y0 - whole_y0;
+  if (part.factor != whole.factor || part_x0 < whole_x0 ||
+      part_y0 < whole_y0 || offset_x + part.w > whole.w ||
+      offset_y + part.h > whole.h) {
+    return absl::InternalError("Decoded strips do not line up");
+  }
+  for (OPJ_UINT32 row = 0; row != part.h; ++row) {
+    std::copy_n(part.data.begin() + static_cast<size_t>(row) * part.w, part.w,
+                whole.data.begin() +
+                    static_cast<size_t>(offset_y + row) * whole.w + offset_x);
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+// A sandbox with its own copy of the input file descriptor.
+class Openjp2DecoderPool::Worker {
+ public:
+  absl::Status Init(int fd) {
+    SAPI_RETURN_IF_ERROR(sandbox_.Init());
+    fd_ = std::make_unique<sapi::v::Fd>(dup(fd));
+    if (fd_->GetValue() < 0) {
+      return absl::InternalError("Could not duplicate the input fd");
+    }
+    return sandbox_.TransferToSandboxee(fd_.get());
+  }
+
+  absl::StatusOr<opj_header_info_t> ReadHeader(OPJ_CODEC_FORMAT format) {
+    sapi::v::Struct<opj_dparameters_t> parameters;
+    SAPI_RETURN_IF_ERROR(
+        api_.opj_set_default_decoder_parameters(parameters.PtrBoth()));
+    SAPI_ASSIGN_OR_RETURN(Codec codec, OpenCodec(format, parameters));
+    absl::Cleanup close_codec = [this, &codec] { CloseCodec(codec); };
+
+    sapi::v::Struct<opj_header_info_t> info;
+    SAPI_ASSIGN_OR_RETURN(
+        OPJ_BOOL ok, api_.opj_read_header_info(codec.stream.get(),
+                                               codec.codec.get(),
+                                               info.PtrAfter()));
+    if (!ok) {
+      return absl::InternalError("Reading image header failed");
+    }
+    return info.data();
+  }
+
+  // Decodes the given area at the given reduce factor and copies out the
+  // given components.
+  absl::StatusOr<Openjp2DecodedImage> Decode(
+      OPJ_CODEC_FORMAT format, OPJ_UINT32 reduce, Range x, Range y,
+      const std::vector<OPJ_UINT32>& components) {
+    sapi::v::Struct<opj_dparameters_t> parameters;
+    SAPI_RETURN_IF_ERROR(
+        api_.opj_set_default_decoder_parameters(parameters.PtrBoth()));
+    parameters.mutable_data()->cp_reduce = reduce;
+    SAPI_ASSIGN_OR_RETURN(Codec codec, OpenCodec(format, parameters));
+    absl::Cleanup close_codec = [this, &codec] { CloseCodec(codec); };
+
+    sapi::v::GenericPtr image_pointer;
+    SAPI_ASSIGN_OR_RETURN(
+        OPJ_BOOL ok,
+        api_.opj_read_header(codec.stream.get(), codec.codec.get(),
+                             image_pointer.PtrAfter()));
+    if (!ok) {
+      return absl::InternalError("Reading image header failed");
+    }
+    sapi::v::RemotePtr image_ptr(
+        reinterpret_cast<void*>(image_pointer.GetValue()));
+    absl::Cleanup destroy_image = [this, &image_ptr] {
+      api_.opj_image_destroy(&image_ptr).IgnoreError();
+    };
+
+    SAPI_ASSIGN_OR_RETURN(
+        ok, api_.opj_set_decode_area(codec.codec.get(), &image_ptr, x.begin,
+                                     y.begin, x.end, y.end));
+    if (!ok) {
+      return absl::InvalidArgumentError("Setting the decode area failed");
+    }
+    SAPI_ASSIGN_OR_RETURN(ok, api_.opj_decode(codec.codec.get(),
+                                              codec.stream.get(), &image_ptr));
+    if (!ok) {
+      return absl::InternalError("Decoding failed");
+    }
+    SAPI_ASSIGN_OR_RETURN(ok, api_.opj_end_decompress(codec.codec.get(),
+                                                      codec.stream.get()));
+    if (!ok) {
+      return absl::InternalError("Ending decompress failed");
+    }
+
+    sapi::v::Struct<opj_image_t> image;
+    image.SetRemote(image_ptr.GetValue());
+    SAPI_RETURN_IF_ERROR(sandbox_.TransferFromSandboxee(&image));
+    sapi::v::Array<opj_image_comp_t> comps(image.data().numcomps);
+    comps.SetRemote(image.data().comps);
+    SAPI_RETURN_IF_ERROR(sandbox_.TransferFromSandboxee(&comps));
+
+    Openjp2DecodedImage result;
+    result.x0 = x.begin;
+    result.y0 = y.begin;
+    result.x1 = x.end;
+    result.y1 = y.end;
+    result.color_space = image.data().color_space;
+    result.components.reserve(components.size());
+    for (OPJ_UINT32 index : components) {
+      const opj_image_comp_t& comp = comps[index];
+      Openjp2Component& component = result.components.emplace_back();
+      component.index = index;
+      component.x0 = comp.x0;
+      component.y0 = comp.y0;
+      component.w = comp.w;
+      component.h = comp.h;
+      component.dx = comp.dx;
+      component.dy = comp.dy;
+      component.prec = comp.prec;
+      component.sgnd = comp.sgnd;
+      component.factor = comp.factor;
+      component.data.resize(static_cast<size_t>(comp.w) * comp.h);
+      if (component.data.empty()) {
+        continue;
+      }
+      // Copy straight into the result, only this component is transferred.
+      sapi::v::Array<OPJ_INT32> data(component.data.data(),
+                                     component.data.size());
+      data.SetRemote(comp.data);
+      SAPI_RETURN_IF_ERROR(sandbox_.TransferFromSandboxee(&data));
+    }
+    return result;
+  }
+
+ private:
+  struct Codec {
+    std::unique_ptr<sapi::v::RemotePtr> stream;
+    std::unique_ptr<sapi::v::RemotePtr> codec;
+  };
+
+  // Opens a stream over the input file and a codec set up for decoding it.
+  absl::StatusOr<Codec> OpenCodec(
+      OPJ_CODEC_FORMAT format,
+      sapi::v::Struct<opj_dparameters_t>& parameters) {
+    Codec codec;
+    SAPI_ASSIGN_OR_RETURN(
+        opj_stream_t* stream,
+        api_.opj_stream_create_fd_stream(fd_->GetRemoteFd()));
+    if (!stream) {
+      return absl::InternalError("Stream initialization failed");
+    }
+    codec.stream = std::make_unique<sapi::v::RemotePtr>(stream);
+
+    absl::StatusOr<opj_codec_t*> decompress =
+        api_.opj_create_decompress(format);
+    if (!decompress.ok() || !*decompress) {
+      CloseCodec(codec);
+      return absl::InternalError("Codec initialization failed");
+    }
+    codec.codec = std::make_unique<sapi::v::RemotePtr>(*decompress);
+
+    absl::StatusOr<OPJ_BOOL> ok =
+        api_.opj_setup_decoder(codec.codec.get(), parameters.PtrBefore());
+    if (!ok.ok() || !*ok) {
+      CloseCodec(codec);
+      return absl::InternalError("Decoder setup failed");
+    }
+    return codec;
+  }
+
+  void CloseCodec(Codec& codec) {
+    if (codec.codec) {
+      api_.opj_destroy_codec(codec.codec.get()).IgnoreError();
+    }
+    if (codec.stream) {
+      api_.opj_stream_destroy(codec.stream.get()).IgnoreError();
+    }
+  }
+
+  Openjp2FdSandbox sandbox_;
+  Openjp2Api api_{&sandbox_};
+  std::unique_ptr<sapi::v::Fd> fd_;
+};
+
+absl::StatusOr<std::unique_ptr<Openjp2DecoderPool>> Openjp2DecoderPool::Create(
+    int fd, OPJ_CODEC_FORMAT format, int num_sandboxes) {
+  if (num_sandboxes < 1) {
+    return absl::InvalidArgumentError("At least one sandbox is needed");
+  }
+  // Using `new` to access a non-public constructor.
+  auto pool = absl::WrapUnique(new Openjp2DecoderPool(format));
+  for (int i = 0; i != num_sandboxes; ++i) {
+    auto worker = std::make_unique<Worker>();
+    SAPI_RETURN_IF_ERROR(worker->Init(fd));
+    pool->workers_.push_back(std::move(worker));
+  }
+  SAPI_ASSIGN_OR_RETURN(pool->header_, pool->workers_[0]->ReadHeader(format));
+  if (pool->header_.tdx == 0 || pool->header_.tdy == 0 ||
+      pool->header_.x0 >= pool->header_.x1 ||
+      pool->header_.y0 >= pool->header_.y1) {
+    return absl::InternalError("Invalid image header");
+  }
+  return pool;
+}
+
+Openjp2DecoderPool::Openjp2DecoderPool(OPJ_CODEC_FORMAT format)
+    : format_(format) {}
+
+Openjp2DecoderPool::~Openjp2DecoderPool() = default;
+
+absl::StatusOr<Openjp2DecodedImage> Openjp2DecoderPool::Decode(
+    const Openjp2DecodeOptions& options) {
+  if (options.reduce >= header_.numresolutions) {
+    return absl::InvalidArgumentError(
+        "Reduce factor must be lower than the number of resolutions");
+  }
+
+  Range x{header_.x0, header_.x1};
+  Range y{header_.y0, header_.y1};
+  if (options.x0 < options.x1 && options.y0 < options.y1) {
+    x = {std::max(x.begin, static_cast<OPJ_UINT32>(std::max(options.x0, 0))),
+         std::min(x.end, static_cast<OPJ_UINT32>(std::max(options.x1, 0)))};
+    y = {std::max(y.begin, static_cast<OPJ_UINT32>(std::max(options.y0, 0))),
+         std::min(y.end, static_cast<OPJ_UINT32>(std::max(options.y1, 0)))};
+    if (x.begin >= x.end || y.begin >= y.end) {
+      return absl::InvalidArgumentError("Area is outside of the image");
+    }
+  }
+
+  std::vector<OPJ_UINT32> components = options.components;
+  if (components.empty()) {
+    for (OPJ_UINT32 i = 0; i != header_.numcomps; ++i) {
+      components.push_back(i);
+    }
+  }
+  for (OPJ_UINT32 index : components) {
+    if (index >= header_.numcomps) {
+      return absl::InvalidArgumentError("Component index out of range");
+    }
+  }
+
+  // Cut across the axis with more tiles, to keep as many sandboxes busy as
+  // possible.
+  std::vector<Range> columns =
+      SplitAtTiles(x, header_.tx0, header_.tdx, workers_.size());
+  std::vector<Range> rows =
+      SplitAtTiles(y, header_.ty0, header_.tdy, workers_.size());
+  bool split_rows = rows.size() >= columns.size();
+  size_t num_strips = split_rows ? rows.size() : columns.size();
+
+  std::vector<absl::StatusOr<Openjp2DecodedImage>> strips(num_strips);
+  {
+    std::vector<std::thread> threads;
+    threads.reserve(num_strips);
+    for (size_t i = 0; i != num_strips; ++i) {
+      threads.emplace_back([&, i] {
+        strips[i] = workers_[i]->Decode(format_, options.reduce,
+                                        split_rows ? x : columns[i],
+                                        split_rows ? rows[i] : y, components);
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  }
+  for (const absl::StatusOr<Openjp2DecodedImage>& strip : strips) {
+    SAPI_RETURN_IF_ERROR(strip.status());
+  }
+  if (num_strips == 1) {
+    return std::move(*strips[0]);
+  }
+
+  Openjp2DecodedImage result;
+  result.x0 = x.begin;
+  result.y0 = y.begin;
+  result.x1 = x.end;
+  result.y1 = y.end;
+  result.color_space = strips[0]->color_space;
+  result.components.reserve(components.size());
+  for (size_t c = 0; c != components.size(); ++c) {
+    Openjp2Component& component = result.components.emplace_back();
+    const Openjp2Component& first = strips[0]->components[c];
+    component = {first.index, first.x0,     first.y0,   first.w,
+                 first.h,     first.dx,     first.dy,   first.prec,
+                 first.sgnd,  first.factor, /*data=*/{}};
+    // The strips line up along one axis and add up along the other.
+    for (size_t i = 1; i != num_strips; ++i) {
+      const Openjp2Component& part = strips[i]->components[c];
+      if (split_rows) {
+        component.h += part.h;
+      } else {
+        component.w += part.w;
+      }
+    }
+    component.data.resize(static_cast<size_t>(component.w) * component.h);
+    for (size_t i = 0; i != num_strips; ++i) {
+      SAPI_RETURN_IF_ERROR(Paste(strips[i]->components[c], component));
+    }
+  }
+  return result;
+}
@@ -0,0 +1,99 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef OPENJPEG_DECODER_POOL_H_
+#define OPENJPEG_DECODER_POOL_H_
+
+#include <memory>
+#include <vector>
+
+#include "openjp2_sapi.sapi.h"  // NOLINT(build/include)
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+// What to decode. Coordinates are on the reference grid of the full
+// resolution image, as for opj_set_decode_area().
+struct Openjp2DecodeOptions {
+  // Number of highest resolution levels to discard. Each level halves the
+  // width and height of the result.
+  OPJ_UINT32 reduce = 0;
+
+  // Area to decode. An empty area selects the whole image.
+  OPJ_INT32 x0 = 0;
+  OPJ_INT32 y0 = 0;
+  OPJ_INT32 x1 = 0;
+  OPJ_INT32 y1 = 0;
+
+  // Indices of the components to return. Empty selects all of them.
+  std::vector<OPJ_UINT32> components;
+};
+
+// A component of the decoded area at the decoded resolution.
+struct Openjp2Component {
+  OPJ_UINT32 index;
+  OPJ_UINT32 x0;
+  OPJ_UINT32 y0;
+  OPJ_UINT32 w;
+  OPJ_UINT32 h;
+  OPJ_UINT32 dx;
+  OPJ_UINT32 dy;
+  OPJ_UINT32 prec;
+  OPJ_UINT32 sgnd;
+  OPJ_UINT32 factor;
+  std::vector<OPJ_INT32> data;  // w * h samples, row by row
+};
+
+struct Openjp2DecodedImage {
+  // The decoded area on the reference grid.
+  OPJ_UINT32 x0;
+  OPJ_UINT32 y0;
+  OPJ_UINT32 x1;
+  OPJ_UINT32 y1;
+  OPJ_COLOR_SPACE color_space;
+  std::vector<Openjp2Component> components;
+};
+
+// Decodes areas of a JPEG 2000 file with a pool of sandboxes. All sandboxes
+// get a copy of the same file descriptor. A request is cut into strips along
+// tile boundaries, so that no tile is decoded twice, and every sandbox
+// decodes one strip with opj_set_decode_area(). Only the requested components
+// of each strip are copied out of the sandboxes.
+//
+// Decode() must not be called from several threads at once.
+class Openjp2DecoderPool {
+ public:
+  // Starts num_sandboxes sandboxes for the file open at fd and reads its
+  // header. Does not take ownership of fd.
+  static absl::StatusOr<std::unique_ptr<Openjp2DecoderPool>> Create(
+      int fd, OPJ_CODEC_FORMAT format, int num_sandboxes);
+
+  ~Openjp2DecoderPool();
+
+  // The image header, with the image area and tiles on the reference grid.
+  const opj_header_info_t& header() const { return header_; }
+
+  absl::StatusOr<Openjp2DecodedImage> Decode(
+      const Openjp2DecodeOptions& options);
+
+ private:
+  class Worker;
+
+  explicit Openjp2DecoderPool(OPJ_CODEC_FORMAT format);
+
+  OPJ_CODEC_FORMAT format_;
+  opj_header_info_t header_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+#endif  // OPENJPEG_DECODER_POOL_H_
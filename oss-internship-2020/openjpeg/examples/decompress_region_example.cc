@@ -0,0 +1,89 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Perform decompression of a region of a *.jp2 image, optionally at a reduced
+// resolution, to *.pnm format using a pool of sandboxes
+
+#include <fcntl.h>
+#include <libgen.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../decoder_pool.h"    // NOLINT(build/include)
+#include "gen_files/convert.h"  // NOLINT(build/include)
+#include "absl/strings/numbers.h"
+
+constexpr int kNumSandboxes = 4;
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  sapi::InitLogging(argv[0]);
+
+  Openjp2DecodeOptions options;
+  if ((argc != 3 && argc != 4 && argc != 8) ||
+      (argc > 3 && !absl::SimpleAtoi(argv[3], &options.reduce)) ||
+      (argc > 4 && !(absl::SimpleAtoi(argv[4], &options.x0) &&
+                     absl::SimpleAtoi(argv[5], &options.y0) &&
+                     absl::SimpleAtoi(argv[6], &options.x1) &&
+                     absl::SimpleAtoi(argv[7], &options.y1)))) {
+    std::cerr << "Usage: " << basename(argv[0]) << " absolute/path/to/INPUT.jp2"
+              << " absolute/path/to/OUTPUT.pnm [REDUCE [X0 Y0 X1 Y1]]\n";
+    return EXIT_FAILURE;
+  }
+
+  int fd = open(argv[1], O_RDONLY);
+  CHECK(fd >= 0) << "Could not open " << argv[1];
+
+  absl::StatusOr<std::unique_ptr<Openjp2DecoderPool>> pool =
+      Openjp2DecoderPool::Create(fd, OPJ_CODEC_JP2, kNumSandboxes);
+  close(fd);
+  CHECK(pool.ok()) << "Sandbox pool initialization failed " << pool.status();
+
+  absl::StatusOr<Openjp2DecodedImage> decoded = (*pool)->Decode(options);
+  CHECK(decoded.ok()) << "Decoding failed " << decoded.status();
+
+  // Point an image on the host at the decoded samples.
+  std::vector<opj_image_comp_t> components(decoded->components.size());
+  for (size_t i = 0; i < components.size(); ++i) {
+    Openjp2Component& component = decoded->components[i];
+    components[i].dx = component.dx;
+    components[i].dy = component.dy;
+    components[i].w = component.w;
+    components[i].h = component.h;
+    components[i].x0 = component.x0;
+    components[i].y0 = component.y0;
+    components[i].prec = component.prec;
+    components[i].sgnd = component.sgnd;
+    components[i].factor = component.factor;
+    components[i].data = component.data.data();
+  }
+  opj_image_t image = {};
+  image.x0 = decoded->x0;
+  image.y0 = decoded->y0;
+  image.x1 = decoded->x1;
+  image.y1 = decoded->y1;
+  image.numcomps = components.size();
+  image.color_space = decoded->color_space;
+  image.comps = components.data();
+
+  // Convert the image to the desired format and save it to the file.
+  int error = imagetopnm(&image, argv[2], 0);
+  CHECK(!error) << "Image convert failed";
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "openjp2_wrapper.h"  // NOLINT(build/include)
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+
+namespace {
+
+struct FdStream {
+  int fd;
+  OPJ_OFF_T offset;
+  OPJ_OFF_T size;
+};
+
+OPJ_SIZE_T FdStreamRead(void* buffer, OPJ_SIZE_T nb_bytes, void* user_data) {
+  auto* stream = static_cast<FdStream*>(user_data);
+  ssize_t read = pread(stream->fd, buffer, nb_bytes, stream->offset);
+  if (read <= 0) {
+    return static_cast<OPJ_SIZE_T>(-1);
+  }
+  stream->offset += read;
+  return read;
+}
+
+OPJ_OFF_T FdStreamSkip(OPJ_OFF_T nb_bytes, void* user_data) {
+  auto* stream = static_cast<FdStream*>(user_data);
+  if (stream->offset + nb_bytes < 0) {
+    return -1;
+  }
+  stream->offset += nb_bytes;
+  return nb_bytes;
+}
+
+OPJ_BOOL FdStreamSeek(OPJ_OFF_T offset, void* user_data) {
+  auto* stream = static_cast<FdStream*>(user_data);
+  if (offset < 0 || offset > stream->size) {
+    return OPJ_FALSE;
+  }
+  stream->offset = offset;
+  return OPJ_TRUE;
+}
+
+void FdStreamFree(void* user_data) { free(user_data); }
+
+}  // namespace
+
+opj_stream_t* opj_stream_create_fd_stream(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return nullptr;
+  }
+  opj_stream_t* stream =
+      opj_stream_create(OPJ_J2K_STREAM_CHUNK_SIZE, /*p_is_input=*/OPJ_TRUE);
+  if (!stream) {
+    return nullptr;
+  }
+  auto* data = static_cast<FdStream*>(malloc(sizeof(FdStream)));
+  if (!data) {
+    opj_stream_destroy(stream);
+    return nullptr;
+  }
+  data->fd = fd;
+  data->offset = 0;
+  data->size = st.st_size;
+
+  opj_stream_set_user_data(stream, data, FdStreamFree);
+  opj_stream_set_user_data_length(stream, st.st_size);
+  opj_stream_set_read_function(stream, FdStreamRead);
+  opj_stream_set_skip_function(stream, FdStreamSkip);
+  opj_stream_set_seek_function(stream, FdStreamSeek);
+  return stream;
+}
+
+OPJ_BOOL opj_read_header_info(opj_stream_t* stream, opj_codec_t* codec,
+                              opj_header_info_t* info) {
+  opj_image_t* image = nullptr;
+  if (!opj_read_header(stream, codec, &image)) {
+    return OPJ_FALSE;
+  }
+  opj_codestream_info_v2_t* cstr_info = opj_get_cstr_info(codec);
+  if (!cstr_info) {
+    opj_image_destroy(image);
+    return OPJ_FALSE;
+  }
+
+  info->x0 = image->x0;
+  info->y0 = image->y0;
+  info->x1 = image->x1;
+  info->y1 = image->y1;
+  info->numcomps = image->numcomps;
+  info->numresolutions =
+      cstr_info->m_default_tile_info.tccp_info
+          ? cstr_info->m_default_tile_info.tccp_info[0].numresolutions
+          : 1;
+  info->tx0 = cstr_info->tx0;
+  info->ty0 = cstr_info->ty0;
+  info->tdx = cstr_info->tdx;
+  info->tdy = cstr_info->tdy;
+  info->tw = cstr_info->tw;
+  info->th = cstr_info->th;
+
+  opj_destroy_cstr_info(&cstr_info);
+  opj_image_destroy(image);
+  return OPJ_TRUE;
+}
@@ -0,0 +1,53 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Wrappers for the parts of openjp2 that Sandboxed API cannot call directly
+
+#ifndef OPENJPEG_OPENJP2_WRAPPER_OPENJP2_WRAPPER_H_
+#define OPENJPEG_OPENJP2_WRAPPER_OPENJP2_WRAPPER_H_
+
+#include "openjpeg.h"  // NOLINT(build/include)
+
+extern "C" {
+
+// Creates a read stream over an open file. The stream keeps its own offset
+// and reads with pread(), so several sandboxees can read through copies of
+// the same file description at once. The fd is not closed with the stream.
+opj_stream_t* opj_stream_create_fd_stream(int fd);
+
+// The parts of the header needed to split the decoding work. The image area
+// and the tiles are given on the reference grid.
+typedef struct opj_header_info {
+  OPJ_UINT32 x0;
+  OPJ_UINT32 y0;
+  OPJ_UINT32 x1;
+  OPJ_UINT32 y1;
+  OPJ_UINT32 numcomps;
+  OPJ_UINT32 numresolutions;
+  OPJ_UINT32 tx0;
+  OPJ_UINT32 ty0;
+  OPJ_UINT32 tdx;
+  OPJ_UINT32 tdy;
+  OPJ_UINT32 tw;
+  OPJ_UINT32 th;
+} opj_header_info_t;
+
+// Reads the header from the stream into info. The codec must have been set
+// up with opj_setup_decoder() already.
+OPJ_BOOL opj_read_header_info(opj_stream_t* stream, opj_codec_t* codec,
+                              opj_header_info_t* info);
+
+}  // extern "C"
+
+#endif  // OPENJPEG_OPENJP2_WRAPPER_OPENJP2_WRAPPER_H_
@@ -0,0 +1,240 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "../decoder_pool.h"  // NOLINT(build/include)
+#include "openjpeg.h"         // NOLINT(build/include)
+#include "absl/cleanup/cleanup.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "gtest/gtest.h"
+#include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/path.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/util/status_matchers.h"
+#include "sandboxed_api/util/temp_file.h"
+
+namespace {
+
+using ::sapi::IsOk;
+using ::testing::Combine;
+using ::testing::Values;
+
+// The image does not start on a tile boundary, so that the strips cut by the
+// pool have origins that do not divide evenly at reduced resolutions.
+constexpr OPJ_UINT32 kX0 = 3;
+constexpr OPJ_UINT32 kY0 = 5;
+constexpr OPJ_UINT32 kX1 = 303;
+constexpr OPJ_UINT32 kY1 = 205;
+constexpr OPJ_UINT32 kTileSize = 64;
+constexpr int kNumResolutions = 3;
+constexpr int kNumSandboxes = 3;
+
+OPJ_UINT32 CeilDiv(OPJ_UINT32 a, OPJ_UINT32 b) { return (a + b - 1) / b; }
+
+// Writes a lossless two component J2K codestream with 5x4 tiles. The second
+// component is subsampled by two in both directions.
+absl::Status WriteTiledImage(const std::string& path) {
+  opj_image_cmptparm_t component_parameters[2] = {};
+  for (OPJ_UINT32 c = 0; c != 2; ++c) {
+    opj_image_cmptparm_t& parameters = component_parameters[c];
+    parameters.dx = c + 1;
+    parameters.dy = c + 1;
+    parameters.x0 = CeilDiv(kX0, parameters.dx);
+    parameters.y0 = CeilDiv(kY0, parameters.dy);
+    parameters.w = CeilDiv(kX1, parameters.dx) - parameters.x0;
+    parameters.h = CeilDiv(kY1, parameters.dy) - parameters.y0;
+    parameters.prec = 8;
+    parameters.sgnd = 0;
+  }
+  opj_image_t* image =
+      opj_image_create(2, component_parameters, OPJ_CLRSPC_UNSPECIFIED);
+  if (!image) {
+    return absl::InternalError("Creating the image failed");
+  }
+  absl::Cleanup destroy_image = [image] { opj_image_destroy(image); };
+  image->x0 = kX0;
+  image->y0 = kY0;
+  image->x1 = kX1;
+  image->y1 = kY1;
+  for (OPJ_UINT32 c = 0; c != image->numcomps; ++c) {
+    const opj_image_comp_t& comp = image->comps[c];
+    for (OPJ_UINT32 y = 0; y != comp.h; ++y) {
+      for (OPJ_UINT32 x = 0; x != comp.w; ++x) {
+        comp.data[y * comp.w + x] = (x * 7 + y * 13 + c * 50) & 0xff;
+      }
+    }
+  }
+
+  opj_cparameters_t parameters;
+  opj_set_default_encoder_parameters(&parameters);
+  parameters.tile_size_on = OPJ_TRUE;
+  parameters.cp_tx0 = 0;
+  parameters.cp_ty0 = 0;
+  parameters.cp_tdx = kTileSize;
+  parameters.cp_tdy = kTileSize;
+  parameters.numresolution = kNumResolutions;
+  parameters.tcp_numlayers = 1;
+  parameters.tcp_rates[0] = 0;
+  parameters.cp_disto_alloc = 1;
+
+  opj_codec_t* codec = opj_create_compress(OPJ_CODEC_J2K);
+  if (!codec) {
+    return absl::InternalError("Creating the encoder failed");
+  }
+  absl::Cleanup destroy_codec = [codec] { opj_destroy_codec(codec); };
+  if (!opj_setup_encoder(codec, &parameters, image)) {
+    return absl::InternalError("Setting up the encoder failed");
+  }
+  opj_stream_t* stream =
+      opj_stream_create_default_file_stream(path.c_str(), OPJ_FALSE);
+  if (!stream) {
+    return absl::InternalError("Opening the output stream failed");
+  }
+  absl::Cleanup destroy_stream = [stream] { opj_stream_destroy(stream); };
+  if (!opj_start_compress(codec, image, stream) ||
+      !opj_encode(codec, stream) || !opj_end_compress(codec, stream)) {
+    return absl::InternalError("Encoding failed");
+  }
+  return absl::OkStatus();
+}
+
+// Decodes the area in one go with the unsandboxed library, for reference.
+absl::StatusOr<Openjp2DecodedImage> DecodeSingleShot(
+    const std::string& path, const Openjp2DecodeOptions& options) {
+  opj_dparameters_t parameters;
+  opj_set_default_decoder_parameters(&parameters);
+  parameters.cp_reduce = options.reduce;
+
+  opj_codec_t* codec = opj_create_decompress(OPJ_CODEC_J2K);
+  if (!codec) {
+    return absl::InternalError("Creating the decoder failed");
+  }
+  absl::Cleanup destroy_codec = [codec] { opj_destroy_codec(codec); };
+  if (!opj_setup_decoder(codec, &parameters)) {
+    return absl::InternalError("Setting up the decoder failed");
+  }
+  opj_stream_t* stream =
+      opj_stream_create_default_file_stream(path.c_str(), OPJ_TRUE);
+  if (!stream) {
+    return absl::InternalError("Opening the input stream failed");
+  }
+  absl::Cleanup destroy_stream = [stream] { opj_stream_destroy(stream); };
+  opj_image_t* image = nullptr;
+  if (!opj_read_header(stream, codec, &image)) {
+    return absl::InternalError("Reading the header failed");
+  }
+  absl::Cleanup destroy_image = [image] { opj_image_destroy(image); };
+  if (!opj_set_decode_area(codec, image, options.x0, options.y0, options.x1,
+                           options.y1) ||
+      !opj_decode(codec, stream, image) || !opj_end_decompress(codec, stream)) {
+    return absl::InternalError("Decoding failed");
+  }
+
+  Openjp2DecodedImage result;
+  result.x0 = image->x0;
+  result.y0 = image->y0;
+  result.x1 = image->x1;
+  result.y1 = image->y1;
+  result.color_space = image->color_space;
+  for (OPJ_UINT32 c = 0; c != image->numcomps; ++c) {
+    const opj_image_comp_t& comp = image->comps[c];
+    result.components.push_back(
+        {c, comp.x0, comp.y0, comp.w, comp.h, comp.dx, comp.dy, comp.prec,
+         comp.sgnd, comp.factor,
+         std::vector<OPJ_INT32>(
+             comp.data, comp.data + static_cast<size_t>(comp.w) * comp.h)});
+  }
+  return result;
+}
+
+// Reduce factor and area to decode. An empty area selects the whole image.
+using PoolParam = std::tuple<OPJ_UINT32, std::vector<OPJ_INT32>>;
+
+class DecoderPoolTest : public ::testing::TestWithParam<PoolParam> {
+ protected:
+  void SetUp() override {
+    SAPI_ASSERT_OK_AND_ASSIGN(path_,
+                              sapi::CreateNamedTempFileAndClose("tiled.j2k"));
+    path_ = sapi::file::JoinPath(sapi::file_util::fileops::GetCWD(), path_);
+    ASSERT_THAT(WriteTiledImage(path_), IsOk());
+  }
+
+  void TearDown() override {
+    if (!path_.empty()) {
+      unlink(path_.c_str());
+    }
+  }
+
+  std::string path_;
+};
+
+TEST_P(DecoderPoolTest, MatchesSingleShotDecode) {
+  const auto& [reduce, area] = GetParam();
+  Openjp2DecodeOptions options;
+  options.reduce = reduce;
+  if (!area.empty()) {
+    options.x0 = area[0];
+    options.y0 = area[1];
+    options.x1 = area[2];
+    options.y1 = area[3];
+  }
+
+  int fd = open(path_.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  absl::Cleanup close_fd = [fd] { close(fd); };
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<Openjp2DecoderPool> pool,
+      Openjp2DecoderPool::Create(fd, OPJ_CODEC_J2K, kNumSandboxes));
+  // Make sure the image is really cut into several strips.
+  ASSERT_GT(pool->header().tw, 1u);
+  ASSERT_GT(pool->header().th, 1u);
+
+  SAPI_ASSERT_OK_AND_ASSIGN(Openjp2DecodedImage pooled,
+                            pool->Decode(options));
+  SAPI_ASSERT_OK_AND_ASSIGN(Openjp2DecodedImage expected,
+                            DecodeSingleShot(path_, options));
+
+  EXPECT_EQ(pooled.x0, expected.x0);
+  EXPECT_EQ(pooled.y0, expected.y0);
+  EXPECT_EQ(pooled.x1, expected.x1);
+  EXPECT_EQ(pooled.y1, expected.y1);
+  ASSERT_EQ(pooled.components.size(), expected.components.size());
+  for (size_t c = 0; c != expected.components.size(); ++c) {
+    const Openjp2Component& got = pooled.components[c];
+    const Openjp2Component& want = expected.components[c];
+    EXPECT_EQ(got.x0, want.x0) << "component " << c;
+    EXPECT_EQ(got.y0, want.y0) << "component " << c;
+    EXPECT_EQ(got.factor, want.factor) << "component " << c;
+    ASSERT_EQ(got.w, want.w) << "component " << c;
+    ASSERT_EQ(got.h, want.h) << "component " << c;
+    EXPECT_TRUE(got.data == want.data) << "component " << c;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ReduceAndArea, DecoderPoolTest,
+    Combine(Values(0, 1, 2),
+            Values(std::vector<OPJ_INT32>{},
+                   std::vector<OPJ_INT32>{37, 71, 250, 190})));
+
+}  // namespace
@@ -118,6 +118,12 @@ def _sapi_interface_impl(ctx):
     if ctx.attr.limit_scan_depth:
         args.append("--sapi_limit_scan_depth")
 
+    if ctx.file.annotations:
+        if not use_clang_generator:
+            fail("annotations require generator_version = 2")
+        append_arg(args, "--sapi_annotations", ctx.file.annotations.path)
+        input_files.append(ctx.file.annotations)
+
     # Parse provided files.
 
     # The parser doesn't need the entire set of transitive headers
@@ -209,6 +215,7 @@ sapi_interface = rule(
         "lib_name": attr.string(mandatory = True),
         "namespace": attr.string(),
         "limit_scan_depth": attr.bool(default = False),
+        "annotations": attr.label(allow_single_file = True),
         "api_version": attr.int(
             default = 1,
             values = [1],  # Only a single version is defined right now
@@ -241,6 +248,7 @@ def sapi_library(
         embed = True,
         add_default_deps = True,
         limit_scan_depth = False,
+        annotations = None,
         srcs = [],
         data = [],
         hdrs = [],
@@ -254,7 +262,8 @@ def sapi_library(
         generator_version = 1,
         visibility = None,
         compatible_with = None,
-        default_copts = []):
+        default_copts = [],
+        static_pie = False):
     """Provides the implementation of a Sandboxed API library.
 
     Args:
@@ -267,6 +276,9 @@ def sapi_library(
       embed: Whether the SAPI library should be embedded inside the host code
       add_default_deps: Add SAPI dependencies to target (deprecated)
       limit_scan_depth: Limit include depth for header generator (deprecated)
+      annotations: File with buffer annotations for the interface generator,
+        one "function:buffer:length[:out_length]" per line. Requires
+        generator_version 2.
       api_version: Which version of the Sandboxed API to generate. Currently,
         only version 1 is defined.
       srcs: Any additional sources to include with the sandboxed library
@@ -294,6 +306,13 @@ def sapi_library(
         in addition to default-supported environments.
       default_copts: List of package level default copts, an additional
         attribute since copts already has default value.
+      static_pie: Link the sandboxed binary as a static position-independent
+        executable. This avoids the dynamic loader work (library lookups,
+        symbol relocation) when the sandboxee starts and reduces the number of
+        mappings that need to be copied on each fork. Only the symbols in
+        `functions` are exported, so the list must not be empty. All
+        dependencies must be available as position-independent static
+        libraries.
     """
 
     common = {
@@ -338,6 +357,7 @@ def sapi_library(
                 "@com_google_absl//absl/base:core_headers",
                 "@com_google_absl//absl/status",
                 "@com_google_absl//absl/status:statusor",
+                "@com_google_absl//absl/types:span",
                 "//sandboxed_api:sapi",
                 "//sandboxed_api/util:status",
                 "//sandboxed_api:vars",
@@ -348,13 +368,27 @@ def sapi_library(
         **common
     )
 
-    native.cc_binary(
-        name = name + ".bin",
-        linkopts = [
+    if static_pie:
+        if not functions:
+            fail("static_pie requires an explicit list of functions")
+
+        # Exporting all symbols (-Wl,-E) breaks the static libc startup code,
+        # so only export the sandboxed functions. The client resolves them
+        # without the dynamic loader.
+        bin_linkopts = ["-static-pie"] + exported_funcs + [
+            "-Wl,--export-dynamic-symbol=" + s
+            for s in functions
+        ]
+    else:
+        bin_linkopts = [
             "-ldl",  # For dlopen(), dlsym()
             # The sandboxing client must have access to all
             "-Wl,-E",  # symbols used in the sandboxed library, so these
-        ] + exported_funcs,  # must be both referenced, and exported
+        ] + exported_funcs  # must be both referenced, and exported
+
+    native.cc_binary(
+        name = name + ".bin",
+        linkopts = bin_linkopts,
         deps = [
             ":" + name + ".lib",
             "//sandboxed_api:client",
@@ -397,5 +431,166 @@ def sapi_library(
         api_version = api_version,
         generator_version = generator_version,
         limit_scan_depth = limit_scan_depth,
+        annotations = annotations,
+        **common
+    )
+
+def _sapi_composite_interface_impl(ctx):
+    out = ctx.outputs.out
+    include_guard = "".join([
+        c if c.isalnum() else "_"
+        for c in out.short_path.elems()
+    ]).upper() + "_"
+    namespace_begin = ""
+    namespace_end = ""
+    if ctx.attr.namespace:
+        namespace_begin = "\nnamespace {} {{\n".format(ctx.attr.namespace)
+        namespace_end = "\n}}  // namespace {}\n".format(ctx.attr.namespace)
+
+    # Keep in sync with cmake/sapi_composite.sapi.h.in
+    content = """// Generated by sapi_composite_library(). Do not edit.
+
+#ifndef {guard}
+#define {guard}
+
+#include <utility>
+#include <vector>
+
+#include "{embed_header}"
+#include "sandboxed_api/composite_sandbox.h"
+{namespace_begin}
+// Sandbox with the embedded composite sandboxee. The Api classes of the
+// component libraries can all be used with it.
+class {lib_name}Sandbox : public ::sapi::CompositeSandbox {{
+ public:
+  explicit {lib_name}Sandbox(
+      std::vector<PolicyFragment> policy_fragments = {{}})
+      : ::sapi::CompositeSandbox({embed_ident}_create(),
+                                 std::move(policy_fragments)) {{}}
+}};
+{namespace_end}
+#endif  // {guard}
+""".format(
+        guard = include_guard,
+        embed_header = ctx.attr.embed_header,
+        embed_ident = ctx.attr.embed_ident,
+        lib_name = ctx.attr.lib_name,
+        namespace_begin = namespace_begin,
+        namespace_end = namespace_end,
+    )
+    ctx.actions.write(out, content)
+
+# Build rule that generates the sandbox class of a composite SAPI library.
+_sapi_composite_interface = rule(
+    implementation = _sapi_composite_interface_impl,
+    attrs = {
+        "out": attr.output(mandatory = True),
+        "embed_header": attr.string(mandatory = True),
+        "embed_ident": attr.string(mandatory = True),
+        "lib_name": attr.string(mandatory = True),
+        "namespace": attr.string(),
+    },
+    output_to_genfiles = True,
+)
+
+def sapi_composite_library(
+        name,
+        libs,
+        lib_name,
+        namespace = "",
+        srcs = [],
+        hdrs = [],
+        copts = sapi_platform_copts(),
+        deps = [],
+        tags = [],
+        visibility = None,
+        compatible_with = None,
+        default_copts = []):
+    """Provides a sandboxee that links several Sandboxed API libraries.
+
+    All libraries can then be called from one sandbox, and buffers can be
+    passed between them as remote pointers, without copying them to the host
+    and back. The generated header defines a `<lib_name>Sandbox` class, derived
+    from ::sapi::CompositeSandbox, that takes the policy fragments of the
+    libraries. Use the Api classes from the headers of the libs with it.
+
+    Args:
+      name: Name of the composite library
+      libs: Labels of the sapi_library() targets to combine. Their names must
+        be spelled out, as the sandboxee links their ".lib" targets.
+      lib_name: Prefix of the sandbox class name
+      namespace: A C++ namespace identifier to place the sandbox class into
+      srcs: Any additional sources to include with the library
+      hdrs: Like srcs, any additional headers to include with the library
+      copts: Add these options to the C++ compilation command. See
+        cc_library.copts.
+      deps: Extra dependencies to add to the library
+      tags: Extra tags to associate with the target
+      visibility: Target visibility
+      compatible_with: The list of environments this target can be built for,
+        in addition to default-supported environments.
+      default_copts: List of package level default copts, an additional
+        attribute since copts already has default value.
+    """
+
+    common = {
+        "tags": tags,
+    }
+    if visibility:
+        common["visibility"] = visibility
+
+    if compatible_with != None:
+        common["compatible_with"] = compatible_with
+
+    generated_header = name + ".sapi.h"
+    embed_header = name + "_embed.h"
+    if get_embed_dir():
+        embed_header = get_embed_dir() + "/" + embed_header
+
+    native.cc_library(
+        name = name,
+        srcs = srcs,
+        data = [":" + name + ".bin"],
+        hdrs = hdrs + [generated_header],
+        copts = default_copts + copts,
+        deps = sort_deps(
+            [
+                ":" + name + "_embed",
+                "//sandboxed_api:sapi",
+            ] + libs + deps,
+        ),
+        **common
+    )
+
+    native.cc_binary(
+        name = name + ".bin",
+        linkopts = [
+            "-ldl",  # For dlopen(), dlsym()
+            # The sandboxing client must have access to all symbols used in
+            # the sandboxed libraries. The ".lib" targets are alwayslink, so
+            # all of them are linked and exported.
+            "-Wl,-E",
+        ],
+        deps = [lib + ".lib" for lib in libs] + [
+            "//sandboxed_api:client",
+        ],
+        copts = default_copts,
+        **common
+    )
+
+    sapi_cc_embed_data(
+        name = name + "_embed",
+        srcs = [name + ".bin"],
+        namespace = namespace,
+        **common
+    )
+
+    _sapi_composite_interface(
+        name = name + ".interface",
+        out = generated_header,
+        embed_header = embed_header,
+        embed_ident = (name + "_embed").replace("-", "_"),
+        lib_name = lib_name,
+        namespace = namespace,
         **common
     )
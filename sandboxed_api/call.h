@@ -17,6 +17,8 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <type_traits>
 
 #include "sandboxed_api/var_type.h"
 
@@ -40,6 +42,8 @@ constexpr uint32_t kMsgRecvFd = 0x107;
 constexpr uint32_t kMsgClose = 0x108;
 constexpr uint32_t kMsgReallocate = 0x109;
 constexpr uint32_t kMsgStrlen = 0x10A;
+constexpr uint32_t kMsgCallScalar = 0x10B;
+constexpr uint32_t kMsgFreeBatch = 0x10C;
 // Return:
 constexpr uint32_t kMsgReturn = 0x201;
 
@@ -77,6 +81,60 @@ struct FuncCall {
   size_t aux_size[kArgsMax];
 };
 
+// Compact encoding of a function call whose arguments and return value are
+// all register-sized (integers, enums and floating-point numbers). Sent with
+// comms::kMsgCallScalar as a ScalarCall, followed by argc ScalarCall::Arg
+// entries, followed by func_len bytes of the function name (without a
+// terminating NUL). The sandboxee expands it into a FuncCall.
+struct ScalarCall {
+  struct Arg {
+    v::Type type;
+    uint32_t size;
+    union {
+      uintptr_t arg_int;
+      long double arg_float;
+    } value;
+  };
+
+  v::Type ret_type;
+  uint32_t ret_size;
+  uint32_t argc;
+  uint32_t func_len;
+};
+
+static_assert(sizeof(ScalarCall) % alignof(ScalarCall::Arg) == 0,
+              "ScalarCall::Arg entries must be aligned after the header");
+
+namespace internal {
+
+// Returns the v::Type used to pass values of type T in a ScalarCall, or
+// kVoid if T cannot be passed that way.
+template <typename T>
+constexpr v::Type ScalarCallType() {
+  if constexpr ((std::is_integral_v<T> || std::is_enum_v<T>) &&
+                sizeof(T) <= sizeof(uintptr_t)) {
+    return v::Type::kInt;
+  } else if constexpr (std::is_floating_point_v<T>) {
+    return v::Type::kFloat;
+  } else {
+    return v::Type::kVoid;
+  }
+}
+
+// Stores value into arg, in the same representation v::Reg<T> would use.
+template <typename T>
+void PackScalarCallArg(T value, ScalarCall::Arg& arg) {
+  static_assert(ScalarCallType<T>() != v::Type::kVoid,
+                "Only integers, enums and floating-point numbers can be "
+                "passed to sapi::Sandbox::CallScalar()");
+  memset(&arg, 0, sizeof(arg));
+  arg.type = ScalarCallType<T>();
+  arg.size = sizeof(T);
+  memcpy(&arg.value, &value, sizeof(T));
+}
+
+}  // namespace internal
+
 struct FuncRet {
   // Return type:
   v::Type ret_type;
@@ -13,6 +13,9 @@
 // limitations under the License.
 
 #include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+#include <sys/auxv.h>
 #include <syscall.h>
 #include <unistd.h>
 
@@ -197,6 +200,144 @@ enum class Error : uintptr_t {
   kCall,
 };
 
+// Returns whether the sandboxee was started without an ELF interpreter, i.e.
+// it is a static(-PIE) binary. The dynamic loader is not available then, and
+// dlopen() must not be used.
+bool IsStaticallyLinked() {
+  static const bool is_static = getauxval(AT_BASE) == 0;
+  return is_static;
+}
+
+uint32_t GnuHash(const char* name) {
+  uint32_t h = 5381;
+  for (; *name != '\0'; ++name) {
+    h = h * 33 + static_cast<unsigned char>(*name);
+  }
+  return h;
+}
+
+uint32_t SysvHash(const char* name) {
+  uint32_t h = 0;
+  for (; *name != '\0'; ++name) {
+    h = (h << 4) + static_cast<unsigned char>(*name);
+    h ^= (h >> 24) & 0xf0;
+  }
+  return h & 0x0fffffff;
+}
+
+struct SymbolLookup {
+  const char* name;
+  void* address;
+};
+
+// Returns whether the C library has already added the load address to the
+// pointers in the dynamic section described by phdr. glibc does so for a
+// writable dynamic section, also when a static PIE relocates itself. Other C
+// libraries leave the link-time addresses in place.
+bool IsDynamicSectionRelocated(const ElfW(Phdr)& phdr) {
+#ifdef __GLIBC__
+  return (phdr.p_flags & PF_W) != 0;
+#else
+  return false;
+#endif
+}
+
+// dl_iterate_phdr() callback that searches the dynamic symbol table of the
+// first object reported, which is the main executable.
+int LookupInMainExecutable(dl_phdr_info* info, size_t /*size*/, void* data) {
+  auto* lookup = static_cast<SymbolLookup*>(data);
+  const ElfW(Phdr)* dynamic = nullptr;
+  for (int i = 0; i < info->dlpi_phnum; ++i) {
+    if (info->dlpi_phdr[i].p_type == PT_DYNAMIC) {
+      dynamic = &info->dlpi_phdr[i];
+      break;
+    }
+  }
+  if (dynamic == nullptr) {
+    return 1;
+  }
+  const auto* dyn = reinterpret_cast<const ElfW(Dyn)*>(info->dlpi_addr +
+                                                       dynamic->p_vaddr);
+  const ElfW(Addr) bias =
+      IsDynamicSectionRelocated(*dynamic) ? 0 : info->dlpi_addr;
+  auto resolve = [bias](ElfW(Addr) ptr) { return ptr + bias; };
+  const ElfW(Sym)* symtab = nullptr;
+  const char* strtab = nullptr;
+  const uint32_t* gnu_hash = nullptr;
+  const uint32_t* sysv_hash = nullptr;
+  for (; dyn->d_tag != DT_NULL; ++dyn) {
+    switch (dyn->d_tag) {
+      case DT_SYMTAB:
+        symtab = reinterpret_cast<const ElfW(Sym)*>(resolve(dyn->d_un.d_ptr));
+        break;
+      case DT_STRTAB:
+        strtab = reinterpret_cast<const char*>(resolve(dyn->d_un.d_ptr));
+        break;
+      case DT_GNU_HASH:
+        gnu_hash = reinterpret_cast<const uint32_t*>(resolve(dyn->d_un.d_ptr));
+        break;
+      case DT_HASH:
+        sysv_hash = reinterpret_cast<const uint32_t*>(resolve(dyn->d_un.d_ptr));
+        break;
+    }
+  }
+  if (symtab == nullptr || strtab == nullptr) {
+    return 1;
+  }
+  auto matches = [lookup, symtab, strtab](uint32_t idx) {
+    const ElfW(Sym)& sym = symtab[idx];
+    return sym.st_shndx != SHN_UNDEF &&
+           strcmp(strtab + sym.st_name, lookup->name) == 0;
+  };
+  auto found = [lookup, info, symtab](uint32_t idx) {
+    lookup->address =
+        reinterpret_cast<void*>(info->dlpi_addr + symtab[idx].st_value);
+    return 1;
+  };
+  if (gnu_hash != nullptr) {
+    const uint32_t nbuckets = gnu_hash[0];
+    const uint32_t symoffset = gnu_hash[1];
+    const uint32_t bloom_size = gnu_hash[2];
+    const uint32_t* buckets = gnu_hash + 4 + bloom_size * (sizeof(ElfW(Addr)) /
+                                                           sizeof(uint32_t));
+    const uint32_t* chain = buckets + nbuckets;
+    const uint32_t hash = GnuHash(lookup->name);
+    uint32_t idx = buckets[hash % nbuckets];
+    if (idx < symoffset) {
+      return 1;
+    }
+    for (;; ++idx) {
+      const uint32_t chain_hash = chain[idx - symoffset];
+      if ((hash | 1) == (chain_hash | 1) && matches(idx)) {
+        return found(idx);
+      }
+      if (chain_hash & 1) {
+        return 1;
+      }
+    }
+  }
+  if (sysv_hash != nullptr) {
+    const uint32_t nbuckets = sysv_hash[0];
+    const uint32_t* buckets = sysv_hash + 2;
+    const uint32_t* chain = buckets + nbuckets;
+    for (uint32_t idx = buckets[SysvHash(lookup->name) % nbuckets];
+         idx != STN_UNDEF; idx = chain[idx]) {
+      if (matches(idx)) {
+        return found(idx);
+      }
+    }
+  }
+  return 1;
+}
+
+// Replacement for dlsym() in statically linked sandboxees. Only finds symbols
+// exported by the executable (linked with -Wl,--export-dynamic-symbol).
+void* LookupExportedSymbol(const char* name) {
+  SymbolLookup lookup = {name, nullptr};
+  dl_iterate_phdr(LookupInMainExecutable, &lookup);
+  return lookup.address;
+}
+
 // Handles requests to make function calls.
 void HandleCallMsg(const FuncCall& call, FuncRet* ret) {
   VLOG(1) << "HandleMsgCall, func: '" << call.func
@@ -204,15 +345,19 @@ void HandleCallMsg(const FuncCall& call, FuncRet* ret) {
 
   ret->ret_type = call.ret_type;
 
-  void* handle = dlopen(nullptr, RTLD_NOW);
-  if (handle == nullptr) {
-    LOG(ERROR) << "dlopen(nullptr, RTLD_NOW)";
-    ret->success = false;
-    ret->int_val = static_cast<uintptr_t>(Error::kDlOpen);
-    return;
+  void* f;
+  if (IsStaticallyLinked()) {
+    f = LookupExportedSymbol(call.func);
+  } else {
+    void* handle = dlopen(nullptr, RTLD_NOW);
+    if (handle == nullptr) {
+      LOG(ERROR) << "dlopen(nullptr, RTLD_NOW)";
+      ret->success = false;
+      ret->int_val = static_cast<uintptr_t>(Error::kDlOpen);
+      return;
+    }
+    f = dlsym(handle, call.func);
   }
-
-  auto f = dlsym(handle, call.func);
   if (f == nullptr) {
     LOG(ERROR) << "Function '" << call.func << "' not found";
     ret->success = false;
@@ -237,6 +382,35 @@ void HandleCallMsg(const FuncCall& call, FuncRet* ret) {
   ret->success = true;
 }
 
+// Handles compact requests to make function calls with scalar arguments only.
+void HandleCallScalarMsg(const std::vector<uint8_t>& bytes, FuncRet* ret) {
+  CHECK_GE(bytes.size(), sizeof(ScalarCall));
+  ScalarCall header;
+  memcpy(&header, bytes.data(), sizeof(header));
+  CHECK_LE(header.argc, FuncCall::kArgsMax);
+  CHECK_LT(header.func_len, FuncCall::kFuncNameMax);
+  CHECK_EQ(bytes.size(), sizeof(ScalarCall) +
+                             header.argc * sizeof(ScalarCall::Arg) +
+                             header.func_len);
+
+  FuncCall call{};
+  call.ret_type = header.ret_type;
+  call.ret_size = header.ret_size;
+  call.argc = header.argc;
+  const uint8_t* pos = bytes.data() + sizeof(ScalarCall);
+  for (uint32_t i = 0; i < header.argc; ++i, pos += sizeof(ScalarCall::Arg)) {
+    ScalarCall::Arg arg;
+    memcpy(&arg, pos, sizeof(arg));
+    CHECK(arg.type == v::Type::kInt || arg.type == v::Type::kFloat)
+        << "Unexpected argument type: " << arg.type;
+    call.arg_type[i] = arg.type;
+    call.arg_size[i] = arg.size;
+    memcpy(&call.args[i], &arg.value, sizeof(call.args[i]));
+  }
+  memcpy(call.func, pos, header.func_len);
+  HandleCallMsg(call, ret);
+}
+
 // Handles requests to allocate memory inside the sandboxee.
 void HandleAllocMsg(const size_t size, FuncRet* ret) {
   VLOG(1) << "HandleAllocMsg: size=" << size;
@@ -279,10 +453,31 @@ void HandleFreeMsg(uintptr_t ptr, FuncRet* ret) {
   ret->int_val = 0ULL;
 }
 
+// Handles requests to free multiple blocks of memory at once.
+void HandleFreeBatchMsg(const std::vector<uint8_t>& bytes, FuncRet* ret) {
+  CHECK_EQ(bytes.size() % sizeof(uintptr_t), 0);
+  VLOG(1) << "HandleFreeBatchMsg: " << bytes.size() / sizeof(uintptr_t)
+          << " block(s)";
+  for (size_t pos = 0; pos < bytes.size(); pos += sizeof(uintptr_t)) {
+    uintptr_t ptr;
+    memcpy(&ptr, bytes.data() + pos, sizeof(ptr));
+    free(reinterpret_cast<void*>(ptr));
+  }
+  ret->ret_type = v::Type::kVoid;
+  ret->success = true;
+  ret->int_val = 0ULL;
+}
+
 // Handles requests to find a symbol value.
 void HandleSymbolMsg(const char* symname, FuncRet* ret) {
   ret->ret_type = v::Type::kPointer;
 
+  if (IsStaticallyLinked()) {
+    ret->int_val = reinterpret_cast<uintptr_t>(LookupExportedSymbol(symname));
+    ret->success = true;
+    return;
+  }
+
   void* handle = dlopen(nullptr, RTLD_NOW);
   if (handle == nullptr) {
     ret->success = false;
@@ -358,6 +553,10 @@ void ServeRequest(sandbox2::Comms* comms) {
       VLOG(1) << "Client::kMsgCall";
       HandleCallMsg(BytesAs<FuncCall>(bytes), &ret);
       break;
+    case comms::kMsgCallScalar:
+      VLOG(1) << "Client::kMsgCallScalar";
+      HandleCallScalarMsg(bytes, &ret);
+      break;
     case comms::kMsgAllocate:
       VLOG(1) << "Client::kMsgAllocate";
       HandleAllocMsg(BytesAs<size_t>(bytes), &ret);
@@ -373,6 +572,10 @@ void ServeRequest(sandbox2::Comms* comms) {
       VLOG(1) << "Client::kMsgFree";
       HandleFreeMsg(BytesAs<uintptr_t>(bytes), &ret);
       break;
+    case comms::kMsgFreeBatch:
+      VLOG(1) << "Client::kMsgFreeBatch";
+      HandleFreeBatchMsg(bytes, &ret);
+      break;
     case comms::kMsgSymbol:
       CHECK_EQ(bytes.size(),
                1 + std::distance(bytes.begin(),
@@ -0,0 +1,73 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_COMPOSITE_SANDBOX_H_
+#define SANDBOXED_API_COMPOSITE_SANDBOX_H_
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "sandboxed_api/file_toc.h"
+#include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/sandbox2/policy.h"
+#include "sandboxed_api/sandbox2/policybuilder.h"
+
+namespace sapi {
+
+// CompositeSandbox runs a sandboxee that links several SAPI libraries, as
+// built by add_sapi_composite_library() in CMake or sapi_composite_library()
+// in Bazel. The Api classes generated for each of the libraries work with it,
+// so that intermediate buffers can stay in the sandboxee and be passed from
+// one library to the next as v::RemotePtr. Only final results need to be
+// transferred back.
+//
+// The policy is the default one, extended by each of the policy fragments in
+// turn. As fragments only add to the builder, the merged policy allows what
+// any of the libraries needs. Fragments must not conflict, e.g. by mounting
+// different files at the same path.
+//
+// Example, with a composite library "pipeline-sapi" named "Pipeline":
+//
+//   PipelineSandbox sandbox({
+//       [](sandbox2::PolicyBuilder* builder) { builder->AllowMmap(); },
+//   });
+//   SAPI_RETURN_IF_ERROR(sandbox.Init());
+//   LodepngApi png(&sandbox);
+//   TurboJpegApi jpeg(&sandbox);
+class CompositeSandbox : public Sandbox {
+ public:
+  using PolicyFragment = std::function<void(sandbox2::PolicyBuilder*)>;
+
+  CompositeSandbox(const FileToc* embed_lib_toc,
+                   std::vector<PolicyFragment> policy_fragments)
+      : Sandbox(embed_lib_toc),
+        policy_fragments_(std::move(policy_fragments)) {}
+
+ private:
+  std::unique_ptr<sandbox2::Policy> ModifyPolicy(
+      sandbox2::PolicyBuilder* builder) override {
+    for (const PolicyFragment& fragment : policy_fragments_) {
+      fragment(builder);
+    }
+    return builder->BuildOrDie();
+  }
+
+  std::vector<PolicyFragment> policy_fragments_;
+};
+
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_COMPOSITE_SANDBOX_H_
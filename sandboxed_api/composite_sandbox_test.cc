@@ -0,0 +1,86 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/composite_sandbox.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "sandboxed_api/examples/composite/iota-sapi.sapi.h"
+#include "sandboxed_api/examples/composite/sum_iota-sapi.sapi.h"
+#include "sandboxed_api/examples/sum/sum-sapi.sapi.h"
+#include "sandboxed_api/sandbox2/policybuilder.h"
+#include "sandboxed_api/testing.h"
+#include "sandboxed_api/util/status_matchers.h"
+#include "sandboxed_api/vars.h"
+
+namespace sapi {
+namespace {
+
+using ::sapi::IsOk;
+using ::testing::Eq;
+using ::testing::NotNull;
+
+TEST(CompositeSandboxTest, CallsAllComponentLibraries) {
+  SKIP_SANITIZERS_AND_COVERAGE;
+  SumIotaSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi sum(&sandbox);
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, sum.sum(1, 2));
+  EXPECT_THAT(result, Eq(3));
+
+  IotaApi iota(&sandbox);
+  SAPI_ASSERT_OK_AND_ASSIGN(int* values, iota.iota_new(4));
+  ASSERT_THAT(values, NotNull());
+  EXPECT_THAT(sandbox.rpc_channel()->Free(values), IsOk());
+}
+
+TEST(CompositeSandboxTest, PassesRemoteBuffersBetweenLibraries) {
+  SKIP_SANITIZERS_AND_COVERAGE;
+  SumIotaSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  IotaApi iota(&sandbox);
+  SumApi sum(&sandbox);
+
+  // The array never leaves the sandboxee, only its sum does.
+  SAPI_ASSERT_OK_AND_ASSIGN(int* values, iota.iota_new(100));
+  ASSERT_THAT(values, NotNull());
+  v::RemotePtr remote_values(values);
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, sum.sumarr(&remote_values, 100));
+  EXPECT_THAT(result, Eq(4950));
+  EXPECT_THAT(sandbox.rpc_channel()->Free(values), IsOk());
+}
+
+TEST(CompositeSandboxTest, AppliesAllPolicyFragments) {
+  SKIP_SANITIZERS_AND_COVERAGE;
+  int applied = 0;
+  SumIotaSandbox sandbox({
+      [&applied](sandbox2::PolicyBuilder* builder) {
+        builder->AllowGetIDs();
+        ++applied;
+      },
+      [&applied](sandbox2::PolicyBuilder* builder) {
+        // Overlaps with the default policy and the other fragment.
+        builder->AllowGetIDs().AddFile("/etc/localtime");
+        ++applied;
+      },
+  });
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  EXPECT_THAT(applied, Eq(2));
+  SumApi sum(&sandbox);
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, sum.sum(2, 3));
+  EXPECT_THAT(result, Eq(5));
+}
+
+}  // namespace
+}  // namespace sapi
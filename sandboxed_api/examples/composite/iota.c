@@ -0,0 +1,31 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+
+// Returns a new array with the integers 0 to n-1, or NULL if it cannot be
+// allocated. The caller frees it.
+extern int* iota_new(int n) {
+  if (n < 0) {
+    return NULL;
+  }
+  int* values = malloc(sizeof(int) * (n > 0 ? n : 1));
+  if (values == NULL) {
+    return NULL;
+  }
+  for (int i = 0; i < n; ++i) {
+    values[i] = i;
+  }
+  return values;
+}
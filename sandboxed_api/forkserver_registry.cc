@@ -0,0 +1,102 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/forkserver_registry.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace sapi {
+
+ForkServerRegistry& ForkServerRegistry::Default() {
+  static auto* registry = new ForkServerRegistry();
+  return *registry;
+}
+
+void ForkServerRegistry::set_shards(size_t shards) {
+  absl::MutexLock lock(&mutex_);
+  shards_ = std::max<size_t>(shards, 1);
+}
+
+absl::StatusOr<std::shared_ptr<ForkServerRegistry::ForkServer>>
+ForkServerRegistry::Get(const Key& key, StartFn start) {
+  // Forkservers are started with the lock held, so that concurrent callers do
+  // not start more than one per shard. Starting one does not wait for it to
+  // be ready, so this is short.
+  absl::MutexLock lock(&mutex_);
+  EraseUnused();
+  Shards& shards = libraries_[key];
+  // Only ever grow the shards, so that running forkservers are not orphaned.
+  if (shards.forkservers.size() < shards_) {
+    shards.forkservers.resize(shards_);
+  }
+  std::weak_ptr<ForkServer>& slot =
+      shards.forkservers[shards.next++ % shards.forkservers.size()];
+  // A forkserver that has exited is dropped from its slot. Sandboxes that
+  // still hold it get the new one on their next Init().
+  if (std::shared_ptr<ForkServer> forkserver = slot.lock();
+      forkserver && forkserver->IsAlive()) {
+    return forkserver;
+  }
+  SAPI_ASSIGN_OR_RETURN(std::shared_ptr<ForkServer> forkserver, start());
+  slot = forkserver;
+  return forkserver;
+}
+
+size_t ForkServerRegistry::size() const {
+  absl::MutexLock lock(&mutex_);
+  size_t size = 0;
+  for (const auto& [key, shards] : libraries_) {
+    size += std::count_if(
+        shards.forkservers.begin(), shards.forkservers.end(),
+        [](const std::weak_ptr<ForkServer>& slot) { return !slot.expired(); });
+  }
+  return size;
+}
+
+std::vector<pid_t> ForkServerRegistry::pids() const {
+  absl::MutexLock lock(&mutex_);
+  std::vector<pid_t> pids;
+  for (const auto& [key, shards] : libraries_) {
+    for (const std::weak_ptr<ForkServer>& slot : shards.forkservers) {
+      if (std::shared_ptr<ForkServer> forkserver = slot.lock()) {
+        pids.push_back(forkserver->client()->pid());
+      }
+    }
+  }
+  return pids;
+}
+
+void ForkServerRegistry::EraseUnused() {
+  for (auto it = libraries_.begin(); it != libraries_.end();) {
+    // erase() does not invalidate the other iterators.
+    auto current = it++;
+    const std::vector<std::weak_ptr<ForkServer>>& slots =
+        current->second.forkservers;
+    if (std::all_of(slots.begin(), slots.end(),
+                    [](const std::weak_ptr<ForkServer>& slot) {
+                      return slot.expired();
+                    })) {
+      libraries_.erase(current);
+    }
+  }
+}
+
+}  // namespace sapi
@@ -0,0 +1,127 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_FORKSERVER_REGISTRY_H_
+#define SANDBOXED_API_FORKSERVER_REGISTRY_H_
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "sandboxed_api/file_toc.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/functional/function_ref.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "sandboxed_api/sandbox2/executor.h"
+#include "sandboxed_api/sandbox2/fork_client.h"
+
+namespace sapi {
+
+// ForkServerRegistry lets all sapi::Sandbox objects of the same library share
+// a library forkserver, instead of each one starting and keeping its own. A
+// library is identified by its embedded FileToc or path, plus the arguments
+// and environment it is started with. A forkserver exits once the last
+// sandbox using it is gone.
+//
+// A forkserver that has exited, e.g. because it was killed, is replaced on the
+// next request for its library.
+//
+// A forkserver handles one fork request at a time. To spread concurrent
+// spawns, a library can be served by several forkservers (shards), which are
+// handed out round-robin and started on first use.
+class ForkServerRegistry {
+ public:
+  struct Key {
+    // Embedded library, or nullptr if it is loaded from lib_path.
+    const FileToc* embed_lib_toc = nullptr;
+    std::string lib_path;
+    std::vector<std::string> args;
+    std::vector<std::string> envs;
+
+    bool operator==(const Key& other) const {
+      return embed_lib_toc == other.embed_lib_toc &&
+             lib_path == other.lib_path && args == other.args &&
+             envs == other.envs;
+    }
+
+    template <typename H>
+    friend H AbslHashValue(H h, const Key& key) {
+      return H::combine(std::move(h), key.embed_lib_toc, key.lib_path,
+                        key.args, key.envs);
+    }
+  };
+
+  // A running library forkserver.
+  class ForkServer {
+   public:
+    ForkServer(std::unique_ptr<sandbox2::Executor> executor,
+               std::unique_ptr<sandbox2::ForkClient> client)
+        : executor_(std::move(executor)), client_(std::move(client)) {}
+
+    // Thread-safe.
+    sandbox2::ForkClient* client() const { return client_.get(); }
+
+    // Returns whether the forkserver can still fork sandboxees. Thread-safe.
+    bool IsAlive() const { return client_->IsAlive(); }
+
+   private:
+    // Owns the comms that client_ uses, so it must outlive it.
+    std::unique_ptr<sandbox2::Executor> executor_;
+    std::unique_ptr<sandbox2::ForkClient> client_;
+  };
+
+  using StartFn =
+      absl::FunctionRef<absl::StatusOr<std::shared_ptr<ForkServer>>()>;
+
+  // Returns the process-wide registry, which sapi::Sandbox uses.
+  static ForkServerRegistry& Default();
+
+  // Sets the maximum number of forkservers per library, 1 by default. Lowering
+  // it only affects libraries without running forkservers.
+  void set_shards(size_t shards);
+
+  // Returns a forkserver for key, using start to start it if none is running
+  // in the next shard, or if the one there has exited. Thread-safe.
+  absl::StatusOr<std::shared_ptr<ForkServer>> Get(const Key& key,
+                                                  StartFn start);
+
+  // Returns the number of forkservers that are in use.
+  size_t size() const;
+
+  // Returns the pids of the forkservers that are in use.
+  std::vector<pid_t> pids() const;
+
+ private:
+  struct Shards {
+    std::vector<std::weak_ptr<ForkServer>> forkservers;
+    size_t next = 0;
+  };
+
+  // Forgets libraries whose forkservers have all exited.
+  void EraseUnused() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  mutable absl::Mutex mutex_;
+  size_t shards_ ABSL_GUARDED_BY(mutex_) = 1;
+  absl::flat_hash_map<Key, Shards> libraries_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_FORKSERVER_REGISTRY_H_
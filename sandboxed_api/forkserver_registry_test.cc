@@ -0,0 +1,252 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/forkserver_registry.h"
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <csignal>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/examples/sum/sum-sapi.sapi.h"
+#include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/sandbox2/comms.h"
+#include "sandboxed_api/sandbox2/fork_client.h"
+#include "sandboxed_api/testing.h"
+#include "sandboxed_api/util/file_helpers.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sapi {
+namespace {
+
+using ::sapi::IsOk;
+using ::sapi::StatusIs;
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::Ne;
+using ::testing::SizeIs;
+
+using ForkServer = ForkServerRegistry::ForkServer;
+
+ForkServerRegistry::Key TestKey() {
+  ForkServerRegistry::Key key;
+  key.lib_path = "/lib/test";
+  key.args = {key.lib_path};
+  return key;
+}
+
+class ForkServerRegistryTest : public ::testing::Test {
+ protected:
+  // Returns a start function that counts its calls. The forkservers it starts
+  // are only the client end of a socket pair, without a process.
+  auto CountingStart(int* starts) {
+    return [this, starts]() -> absl::StatusOr<std::shared_ptr<ForkServer>> {
+      ++*starts;
+      int fds[2];
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        return absl::InternalError("socketpair() failed");
+      }
+      Channel& channel = channels_.emplace_back();
+      channel.client = std::make_unique<sandbox2::Comms>(fds[0]);
+      channel.server = std::make_unique<sandbox2::Comms>(fds[1]);
+      return std::make_shared<ForkServer>(
+          nullptr, std::make_unique<sandbox2::ForkClient>(
+                       /*pid=*/-1, channel.client.get()));
+    };
+  }
+
+  // Makes the last forkserver started look like it exited.
+  void KillLastForkServer() { channels_.back().server->Terminate(); }
+
+ private:
+  struct Channel {
+    std::unique_ptr<sandbox2::Comms> client;
+    std::unique_ptr<sandbox2::Comms> server;
+  };
+
+  // Outlives the forkservers of each test, which use the client ends.
+  std::vector<Channel> channels_;
+};
+
+// Waits until the process has exited, but not necessarily been reaped.
+void WaitForExit(pid_t pid) {
+  for (;;) {
+    std::string stat;
+    if (!file::GetContents(absl::StrCat("/proc/", pid, "/stat"), &stat,
+                           file::Defaults())
+             .ok()) {
+      return;
+    }
+    // The state follows the parenthesized command name.
+    size_t state = stat.rfind(')') + 2;
+    if (state >= stat.size() || stat[state] == 'Z' || stat[state] == 'X') {
+      return;
+    }
+    absl::SleepFor(absl::Milliseconds(10));
+  }
+}
+
+TEST_F(ForkServerRegistryTest, SharesForkServerOfSameKey) {
+  ForkServerRegistry registry;
+  int starts = 0;
+  SAPI_ASSERT_OK_AND_ASSIGN(std::shared_ptr<ForkServer> first,
+                            registry.Get(TestKey(), CountingStart(&starts)));
+  SAPI_ASSERT_OK_AND_ASSIGN(std::shared_ptr<ForkServer> second,
+                            registry.Get(TestKey(), CountingStart(&starts)));
+  EXPECT_THAT(first, Eq(second));
+  EXPECT_THAT(starts, Eq(1));
+
+  ForkServerRegistry::Key other = TestKey();
+  other.envs = {"TEST=1"};
+  SAPI_ASSERT_OK_AND_ASSIGN(std::shared_ptr<ForkServer> third,
+                            registry.Get(other, CountingStart(&starts)));
+  EXPECT_THAT(third, Ne(first));
+  EXPECT_THAT(starts, Eq(2));
+  EXPECT_THAT(registry.size(), Eq(2));
+}
+
+TEST_F(ForkServerRegistryTest, RestartsReleasedForkServer) {
+  ForkServerRegistry registry;
+  int starts = 0;
+  SAPI_ASSERT_OK_AND_ASSIGN(std::shared_ptr<ForkServer> forkserver,
+                            registry.Get(TestKey(), CountingStart(&starts)));
+  forkserver.reset();
+  EXPECT_THAT(registry.size(), Eq(0));
+  SAPI_ASSERT_OK_AND_ASSIGN(forkserver,
+                            registry.Get(TestKey(), CountingStart(&starts)));
+  EXPECT_THAT(starts, Eq(2));
+}
+
+TEST_F(ForkServerRegistryTest, HandsOutShardsRoundRobin) {
+  ForkServerRegistry registry;
+  registry.set_shards(2);
+  int starts = 0;
+  std::vector<std::shared_ptr<ForkServer>> forkservers;
+  for (int i = 0; i < 4; ++i) {
+    SAPI_ASSERT_OK_AND_ASSIGN(forkservers.emplace_back(),
+                              registry.Get(TestKey(), CountingStart(&starts)));
+  }
+  EXPECT_THAT(starts, Eq(2));
+  EXPECT_THAT(forkservers[0], Ne(forkservers[1]));
+  EXPECT_THAT(forkservers[0], Eq(forkservers[2]));
+  EXPECT_THAT(forkservers[1], Eq(forkservers[3]));
+}
+
+TEST_F(ForkServerRegistryTest, DoesNotCacheFailedStart) {
+  ForkServerRegistry registry;
+  EXPECT_THAT(registry.Get(TestKey(),
+                           []() -> absl::StatusOr<std::shared_ptr<ForkServer>> {
+                             return absl::UnavailableError("No forkserver");
+                           })
+                  .status(),
+              StatusIs(absl::StatusCode::kUnavailable));
+  int starts = 0;
+  SAPI_ASSERT_OK_AND_ASSIGN(std::shared_ptr<ForkServer> forkserver,
+                            registry.Get(TestKey(), CountingStart(&starts)));
+  EXPECT_THAT(starts, Eq(1));
+}
+
+TEST_F(ForkServerRegistryTest, ReplacesDeadForkServer) {
+  ForkServerRegistry registry;
+  int starts = 0;
+  SAPI_ASSERT_OK_AND_ASSIGN(std::shared_ptr<ForkServer> first,
+                            registry.Get(TestKey(), CountingStart(&starts)));
+  EXPECT_TRUE(first->IsAlive());
+  KillLastForkServer();
+  EXPECT_FALSE(first->IsAlive());
+
+  SAPI_ASSERT_OK_AND_ASSIGN(std::shared_ptr<ForkServer> second,
+                            registry.Get(TestKey(), CountingStart(&starts)));
+  EXPECT_THAT(second, Ne(first));
+  EXPECT_TRUE(second->IsAlive());
+  EXPECT_THAT(starts, Eq(2));
+  // Only the running forkserver is still in use.
+  EXPECT_THAT(registry.size(), Eq(1));
+}
+
+TEST_F(ForkServerRegistryTest, SandboxesShareForkServer) {
+  SKIP_SANITIZERS_AND_COVERAGE;
+  ForkServerRegistry& registry = ForkServerRegistry::Default();
+  {
+    std::vector<std::unique_ptr<SumSandbox>> sandboxes;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+      sandboxes.push_back(std::make_unique<SumSandbox>());
+    }
+    for (const std::unique_ptr<SumSandbox>& sandbox : sandboxes) {
+      threads.emplace_back([&sandbox] {
+        ASSERT_THAT(sandbox->Init(), IsOk());
+        SumApi api(sandbox.get());
+        SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(1, 2));
+        EXPECT_THAT(result, Eq(3));
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    EXPECT_THAT(registry.size(), Eq(1));
+
+    // Sandboxes restarted from the shared forkserver work as well.
+    ASSERT_THAT(sandboxes[0]->Restart(false), IsOk());
+    SumApi api(sandboxes[0].get());
+    SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(2, 3));
+    EXPECT_THAT(result, Eq(5));
+  }
+  // The forkserver exits with the last sandbox using it.
+  EXPECT_THAT(registry.size(), Eq(0));
+}
+
+TEST_F(ForkServerRegistryTest, NewSandboxesSurviveKilledForkServer) {
+  SKIP_SANITIZERS_AND_COVERAGE;
+  ForkServerRegistry& registry = ForkServerRegistry::Default();
+  SumSandbox first;
+  ASSERT_THAT(first.Init(), IsOk());
+  std::vector<pid_t> pids = registry.pids();
+  ASSERT_THAT(pids, SizeIs(1));
+  const pid_t killed = pids[0];
+  ASSERT_THAT(kill(killed, SIGKILL), Eq(0));
+  WaitForExit(killed);
+
+  SumSandbox second;
+  ASSERT_THAT(second.Init(), IsOk());
+  SumApi api(&second);
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(1, 2));
+  EXPECT_THAT(result, Eq(3));
+  pids = registry.pids();
+  ASSERT_THAT(pids, SizeIs(1));
+  EXPECT_THAT(pids[0], Ne(killed));
+
+  // A sandbox started from the killed forkserver moves to the new one when it
+  // is restarted.
+  ASSERT_THAT(first.Restart(false), IsOk());
+  SumApi first_api(&first);
+  SAPI_ASSERT_OK_AND_ASSIGN(result, first_api.sum(2, 3));
+  EXPECT_THAT(result, Eq(5));
+  EXPECT_THAT(registry.pids(), ElementsAre(pids[0]));
+}
+
+}  // namespace
+}  // namespace sapi
@@ -23,21 +23,86 @@
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 #include "sandboxed_api/call.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/util/raw_logging.h"
 #include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/util/tracepoint.h"
 
 namespace sapi {
 
+absl::Status RPCChannel::SendRequest(uint32_t tag, size_t length,
+                                     const void* value) {
+  const bool send_frees = !pending_frees_.empty();
+  if (send_frees) {
+    if (!comms_->SendTLV(comms::kMsgFreeBatch,
+                         pending_frees_.size() * sizeof(uintptr_t),
+                         pending_frees_.data())) {
+      return absl::UnavailableError("Sending TLV value failed");
+    }
+    pending_frees_.clear();
+  }
+  if (!comms_->SendTLV(tag, length, value)) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+  if (send_frees) {
+    // Requests are served in order, so the reply for the frees comes first.
+    SAPI_RETURN_IF_ERROR(Return(v::Type::kVoid).status());
+  }
+  return absl::OkStatus();
+}
+
+absl::Status RPCChannel::FlushFreesLocked() {
+  if (pending_frees_.empty()) {
+    return absl::OkStatus();
+  }
+  const bool sent = comms_->SendTLV(comms::kMsgFreeBatch,
+                                    pending_frees_.size() * sizeof(uintptr_t),
+                                    pending_frees_.data());
+  pending_frees_.clear();
+  if (!sent) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+  return Return(v::Type::kVoid).status();
+}
+
 absl::Status RPCChannel::Call(const FuncCall& call, uint32_t tag, FuncRet* ret,
                               v::Type exp_type) {
   absl::MutexLock lock(&mutex_);
-  if (!comms_->SendTLV(tag, sizeof(call), &call)) {
-    return absl::UnavailableError("Sending TLV value failed");
+  SAPI_TRACEPOINT(sapi, call_entry, call.func, sizeof(call), call.argc);
+  absl::Status status = SendRequest(tag, sizeof(call), &call);
+  absl::StatusOr<FuncRet> fret;
+  if (status.ok()) {
+    fret = Return(exp_type);
+    status = fret.status();
+  }
+  SAPI_TRACEPOINT(sapi, call_return, call.func, call.ret_size,
+                  static_cast<int>(status.ok()));
+  SAPI_RETURN_IF_ERROR(status);
+  *ret = *fret;
+  return absl::OkStatus();
+}
+
+absl::Status RPCChannel::CallScalar(absl::Span<const uint8_t> msg,
+                                    FuncRet* ret, v::Type exp_type) {
+  absl::MutexLock lock(&mutex_);
+  // The function name follows the arguments and is not NUL-terminated.
+  const auto& call = *reinterpret_cast<const ScalarCall*>(msg.data());
+  const uint8_t* func = msg.data() + msg.size() - call.func_len;
+  SAPI_TRACEPOINT(sapi, scalar_call_entry, func, call.func_len, msg.size(),
+                  call.argc);
+  absl::Status status =
+      SendRequest(comms::kMsgCallScalar, msg.size(), msg.data());
+  absl::StatusOr<FuncRet> fret;
+  if (status.ok()) {
+    fret = Return(exp_type);
+    status = fret.status();
   }
-  SAPI_ASSIGN_OR_RETURN(auto fret, Return(exp_type));
-  *ret = fret;
+  SAPI_TRACEPOINT(sapi, scalar_call_return, func, call.func_len,
+                  call.ret_size, static_cast<int>(status.ok()));
+  SAPI_RETURN_IF_ERROR(status);
+  *ret = *fret;
   return absl::OkStatus();
 }
 
@@ -72,9 +137,7 @@ absl::StatusOr<FuncRet> RPCChannel::Return(v::Type exp_type) {
 
 absl::Status RPCChannel::Allocate(size_t size, void** addr) {
   absl::MutexLock lock(&mutex_);
-  if (!comms_->SendTLV(comms::kMsgAllocate, sizeof(size), &size)) {
-    return absl::UnavailableError("Sending TLV value failed");
-  }
+  SAPI_RETURN_IF_ERROR(SendRequest(comms::kMsgAllocate, sizeof(size), &size));
 
   SAPI_ASSIGN_OR_RETURN(auto fret, Return(v::Type::kPointer));
   *addr = reinterpret_cast<void*>(fret.int_val);
@@ -89,10 +152,8 @@ absl::Status RPCChannel::Reallocate(void* old_addr, size_t size,
       .size = size,
   };
 
-  if (!comms_->SendTLV(comms::kMsgReallocate, sizeof(comms::ReallocRequest),
-                       &req)) {
-    return absl::UnavailableError("Sending TLV value failed");
-  }
+  SAPI_RETURN_IF_ERROR(
+      SendRequest(comms::kMsgReallocate, sizeof(comms::ReallocRequest), &req));
 
   auto fret_or = Return(v::Type::kPointer);
   if (!fret_or.ok()) {
@@ -108,9 +169,7 @@ absl::Status RPCChannel::Reallocate(void* old_addr, size_t size,
 absl::Status RPCChannel::Free(void* addr) {
   absl::MutexLock lock(&mutex_);
   uintptr_t remote = reinterpret_cast<uintptr_t>(addr);
-  if (!comms_->SendTLV(comms::kMsgFree, sizeof(remote), &remote)) {
-    return absl::UnavailableError("Sending TLV value failed");
-  }
+  SAPI_RETURN_IF_ERROR(SendRequest(comms::kMsgFree, sizeof(remote), &remote));
 
   SAPI_ASSIGN_OR_RETURN(auto fret, Return(v::Type::kVoid));
   if (!fret.success) {
@@ -119,11 +178,25 @@ absl::Status RPCChannel::Free(void* addr) {
   return absl::OkStatus();
 }
 
-absl::Status RPCChannel::Symbol(const char* symname, void** addr) {
+void RPCChannel::FreeDeferred(void* addr) {
   absl::MutexLock lock(&mutex_);
-  if (!comms_->SendTLV(comms::kMsgSymbol, strlen(symname) + 1, symname)) {
-    return absl::UnavailableError("Sending TLV value failed");
+  pending_frees_.push_back(reinterpret_cast<uintptr_t>(addr));
+  if (pending_frees_.size() >= kMaxPendingFrees) {
+    if (absl::Status status = FlushFreesLocked(); !status.ok()) {
+      VLOG(1) << "Flushing deferred frees failed: " << status;
+    }
   }
+}
+
+absl::Status RPCChannel::FlushFrees() {
+  absl::MutexLock lock(&mutex_);
+  return FlushFreesLocked();
+}
+
+absl::Status RPCChannel::Symbol(const char* symname, void** addr) {
+  absl::MutexLock lock(&mutex_);
+  SAPI_RETURN_IF_ERROR(
+      SendRequest(comms::kMsgSymbol, strlen(symname) + 1, symname));
 
   SAPI_ASSIGN_OR_RETURN(auto fret, Return(v::Type::kPointer));
   *addr = reinterpret_cast<void*>(fret.int_val);
@@ -155,9 +228,7 @@ absl::Status RPCChannel::Exit() {
 
 absl::Status RPCChannel::SendFD(int local_fd, int* remote_fd) {
   absl::MutexLock lock(&mutex_);
-  if (!comms_->SendTLV(comms::kMsgSendFd, 0, nullptr)) {
-    return absl::UnavailableError("Sending TLV value failed");
-  }
+  SAPI_RETURN_IF_ERROR(SendRequest(comms::kMsgSendFd, 0, nullptr));
   if (!comms_->SendFD(local_fd)) {
     return absl::UnavailableError("Sending FD failed");
   }
@@ -172,9 +243,8 @@ absl::Status RPCChannel::SendFD(int local_fd, int* remote_fd) {
 
 absl::Status RPCChannel::RecvFD(int remote_fd, int* local_fd) {
   absl::MutexLock lock(&mutex_);
-  if (!comms_->SendTLV(comms::kMsgRecvFd, sizeof(remote_fd), &remote_fd)) {
-    return absl::UnavailableError("Sending TLV value failed");
-  }
+  SAPI_RETURN_IF_ERROR(
+      SendRequest(comms::kMsgRecvFd, sizeof(remote_fd), &remote_fd));
 
   if (!comms_->RecvFD(local_fd)) {
     return absl::UnavailableError("Receving FD failed");
@@ -189,9 +259,8 @@ absl::Status RPCChannel::RecvFD(int remote_fd, int* local_fd) {
 
 absl::Status RPCChannel::Close(int remote_fd) {
   absl::MutexLock lock(&mutex_);
-  if (!comms_->SendTLV(comms::kMsgClose, sizeof(remote_fd), &remote_fd)) {
-    return absl::UnavailableError("Sending TLV value failed");
-  }
+  SAPI_RETURN_IF_ERROR(
+      SendRequest(comms::kMsgClose, sizeof(remote_fd), &remote_fd));
 
   SAPI_ASSIGN_OR_RETURN(auto fret, Return(v::Type::kVoid));
   if (!fret.success) {
@@ -202,9 +271,7 @@ absl::Status RPCChannel::Close(int remote_fd) {
 
 absl::StatusOr<size_t> RPCChannel::Strlen(void* str) {
   absl::MutexLock lock(&mutex_);
-  if (!comms_->SendTLV(comms::kMsgStrlen, sizeof(str), &str)) {
-    return absl::UnavailableError("Sending TLV value failed");
-  }
+  SAPI_RETURN_IF_ERROR(SendRequest(comms::kMsgStrlen, sizeof(str), &str));
 
   SAPI_ASSIGN_OR_RETURN(auto fret, Return(v::Type::kInt));
   if (!fret.success) {
@@ -17,10 +17,13 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
+#include "absl/base/thread_annotations.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 #include "sandboxed_api/call.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/var_type.h"
@@ -37,6 +40,11 @@ class RPCChannel {
   absl::Status Call(const FuncCall& call, uint32_t tag, FuncRet* ret,
                     v::Type exp_type);
 
+  // Calls a function, using a ScalarCall message (including the trailing
+  // arguments and function name).
+  absl::Status CallScalar(absl::Span<const uint8_t> msg, FuncRet* ret,
+                          v::Type exp_type);
+
   // Allocates memory.
   absl::Status Allocate(size_t size, void** addr);
 
@@ -46,6 +54,15 @@ class RPCChannel {
   // Frees memory.
   absl::Status Free(void* addr);
 
+  // Queues memory to be freed. Queued frees are sent in a single message ahead
+  // of the next request, without waiting for an extra round trip, or on their
+  // own once kMaxPendingFrees have accumulated. Frees still queued when the
+  // sandboxee exits are dropped along with its address space.
+  void FreeDeferred(void* addr);
+
+  // Sends all queued frees now.
+  absl::Status FlushFrees();
+
   // Returns address of a symbol.
   absl::Status Symbol(const char* symname, void** addr);
 
@@ -67,11 +84,22 @@ class RPCChannel {
   sandbox2::Comms* comms() const { return comms_; }
 
  private:
+  static constexpr size_t kMaxPendingFrees = 256;
+
+  // Sends a request, preceded by the queued frees, if any. The reply for the
+  // frees is consumed before returning, the one for the request is not.
+  absl::Status SendRequest(uint32_t tag, size_t length, const void* value)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Sends the queued frees and waits for the reply.
+  absl::Status FlushFreesLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   // Receives the result after a call.
   absl::StatusOr<FuncRet> Return(v::Type exp_type);
 
   sandbox2::Comms* comms_;  // Owned by sandbox2;
   absl::Mutex mutex_;
+  std::vector<uintptr_t> pending_frees_ ABSL_GUARDED_BY(mutex_);
 };
 
 }  // namespace sapi
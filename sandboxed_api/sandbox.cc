@@ -19,6 +19,8 @@
 #include <sys/uio.h>
 #include <syscall.h>
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdio>
 #include <initializer_list>
 #include <memory>
@@ -33,13 +35,19 @@
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/call.h"
 #include "sandboxed_api/config.h"
 #include "sandboxed_api/embed_file.h"
+#include "sandboxed_api/forkserver_registry.h"
 #include "sandboxed_api/rpcchannel.h"
 #include "sandboxed_api/sandbox2/executor.h"
 #include "sandboxed_api/sandbox2/policy.h"
 #include "sandboxed_api/sandbox2/policybuilder.h"
+#include "sandboxed_api/sandbox2/reaper.h"
+#include "sandboxed_api/sandbox2/result.h"
 #include "sandboxed_api/sandbox2/sandbox2.h"
 #include "sandboxed_api/sandbox2/util/bpf_helper.h"
 #include "sandboxed_api/util/fileops.h"
@@ -52,8 +60,8 @@ namespace sapi {
 
 Sandbox::~Sandbox() {
   Terminate();
-  // The forkserver will die automatically when the executor goes out of scope
-  // and closes the comms object.
+  // The forkserver dies once no other sandbox of the library uses it anymore,
+  // as its executor then goes out of scope and closes the comms object.
 }
 
 // A generic policy which should work with majority of typical libraries, which
@@ -122,56 +130,118 @@ void Sandbox::Terminate(bool attempt_graceful_exit) {
   }
 }
 
+void Sandbox::Kill() {
+  if (is_active()) {
+    s2_->Kill();
+  }
+}
+
+void Sandbox::TerminateAsync(bool attempt_graceful_exit,
+                             sandbox2::Reaper::DoneCallback done) {
+  if (!s2_ || s2_awaited_) {
+    if (done) {
+      done(result_);
+    }
+    return;
+  }
+
+  bool kill = true;
+  if (attempt_graceful_exit && is_active()) {
+    // Same limit as Exit(), but without waiting for the sandboxee to close the
+    // comms channel. If it does not exit in time, the monitor kills it.
+    s2_->set_walltime_limit(absl::Seconds(1));
+    kill = !comms_->SendTLV(comms::kMsgExit, 0, nullptr);
+  }
+
+  // The comms object is owned by the executor, which goes with s2_.
+  rpc_channel_.reset();
+  comms_ = nullptr;
+  pid_ = 0;
+  result_ = sandbox2::Result();
+  sandbox2::Reaper::Default().Reap(
+      std::move(s2_), kill,
+      [done = std::move(done)](const sandbox2::Result& result) {
+        if (result.final_status() == sandbox2::Result::OK &&
+            result.reason_code() == 0) {
+          VLOG(2) << "Sandbox2 finished with: " << result.ToString();
+        } else {
+          LOG(WARNING) << "Sandbox2 finished with: " << result.ToString();
+        }
+        if (done) {
+          done(result);
+        }
+      });
+}
+
 static std::string PathToSAPILib(const std::string& lib_path) {
   return file::IsAbsolutePath(lib_path) ? lib_path
                                         : GetDataDependencyFilePath(lib_path);
 }
 
+static absl::StatusOr<std::shared_ptr<ForkServerRegistry::ForkServer>>
+StartForkServer(const ForkServerRegistry::Key& key) {
+  std::unique_ptr<sandbox2::Executor> executor;
+  if (key.embed_lib_toc) {
+    int embed_lib_fd =
+        EmbedFile::instance()->GetDupFdForFileToc(key.embed_lib_toc);
+    if (embed_lib_fd == -1) {
+      PLOG(ERROR) << "Cannot create executable FD for TOC:'"
+                  << key.embed_lib_toc->name << "'";
+      return absl::UnavailableError("Could not create executable FD");
+    }
+    executor =
+        std::make_unique<sandbox2::Executor>(embed_lib_fd, key.args, key.envs);
+  } else {
+    executor =
+        std::make_unique<sandbox2::Executor>(key.lib_path, key.args, key.envs);
+  }
+
+  std::unique_ptr<sandbox2::ForkClient> fork_client =
+      executor->StartForkServer();
+  if (!fork_client) {
+    LOG(ERROR) << "Could not start forkserver";
+    return absl::UnavailableError("Could not start the forkserver");
+  }
+  return std::make_shared<ForkServerRegistry::ForkServer>(
+      std::move(executor), std::move(fork_client));
+}
+
 absl::Status Sandbox::Init() {
   // It's already initialized
   if (is_active()) {
     return absl::OkStatus();
   }
 
-  // Initialize the forkserver if it is not already running.
-  if (!fork_client_) {
+  // Get a forkserver for the library, shared with other sandboxes of it. Get a
+  // new one if the forkserver used so far has exited.
+  if (forkserver_ && !forkserver_->IsAlive()) {
+    forkserver_.reset();
+  }
+  if (!forkserver_) {
     // If FileToc was specified, it will be used over any paths to the SAPI
     // library.
-    std::string lib_path;
-    int embed_lib_fd = -1;
+    ForkServerRegistry::Key key;
     if (embed_lib_toc_ && !sapi::host_os::IsAndroid()) {
-      embed_lib_fd = EmbedFile::instance()->GetDupFdForFileToc(embed_lib_toc_);
-      if (embed_lib_fd == -1) {
-        PLOG(ERROR) << "Cannot create executable FD for TOC:'"
-                    << embed_lib_toc_->name << "'";
-        return absl::UnavailableError("Could not create executable FD");
-      }
-      lib_path = embed_lib_toc_->name;
+      key.embed_lib_toc = embed_lib_toc_;
+      key.lib_path = embed_lib_toc_->name;
     } else {
-      lib_path = PathToSAPILib(GetLibPath());
-      if (lib_path.empty()) {
+      key.lib_path = PathToSAPILib(GetLibPath());
+      if (key.lib_path.empty()) {
         LOG(ERROR) << "SAPI library path is empty";
         return absl::FailedPreconditionError("No SAPI library path given");
       }
     }
-    std::vector<std::string> args = {lib_path};
+    key.args = {key.lib_path};
     // Additional arguments, if needed.
-    GetArgs(&args);
-    std::vector<std::string> envs{};
+    GetArgs(&key.args);
     // Additional envvars, if needed.
-    GetEnvs(&envs);
+    GetEnvs(&key.envs);
 
-    forkserver_executor_ =
-        (embed_lib_fd >= 0)
-            ? std::make_unique<sandbox2::Executor>(embed_lib_fd, args, envs)
-            : std::make_unique<sandbox2::Executor>(lib_path, args, envs);
-
-    fork_client_ = forkserver_executor_->StartForkServer();
-
-    if (!fork_client_) {
-      LOG(ERROR) << "Could not start forkserver";
-      return absl::UnavailableError("Could not start the forkserver");
-    }
+    SAPI_ASSIGN_OR_RETURN(
+        forkserver_,
+        ForkServerRegistry::Default().Get(key, [&key]() {
+          return StartForkServer(key);
+        }));
   }
 
     sandbox2::PolicyBuilder policy_builder;
@@ -179,7 +249,8 @@ absl::Status Sandbox::Init() {
   auto s2p = ModifyPolicy(&policy_builder);
 
   // Spawn new process from the forkserver.
-  auto executor = std::make_unique<sandbox2::Executor>(fork_client_.get());
+  auto executor =
+      std::make_unique<sandbox2::Executor>(forkserver_->client());
 
   executor
       // The client.cc code is capable of enabling sandboxing on its own.
@@ -206,6 +277,14 @@ absl::Status Sandbox::Init() {
 
   if (!res) {
     Terminate();
+    const sandbox2::Result& result = AwaitResult();
+    if (result.final_status() == sandbox2::Result::SETUP_ERROR &&
+        result.reason_code() == sandbox2::Result::FAILED_ADMISSION) {
+      // Let callers tell an overloaded host apart from a broken sandbox, so
+      // that they can shed load.
+      return absl::ResourceExhaustedError(
+          "Sandbox spawn rejected by admission control");
+    }
     return absl::UnavailableError("Could not start the sandbox");
   }
   return absl::OkStatus();
@@ -373,6 +452,22 @@ absl::Status Sandbox::Call(const std::string& func, v::Callable* ret,
   return absl::OkStatus();
 }
 
+absl::Status Sandbox::CallScalarImpl(absl::Span<const uint8_t> msg,
+                                     FuncRet* ret) {
+  if (!is_active()) {
+    return absl::UnavailableError("Sandbox not active");
+  }
+  const auto& call = *reinterpret_cast<const ScalarCall*>(msg.data());
+  VLOG(1) << "CALL ENTRY: '"
+          << absl::string_view(
+                 reinterpret_cast<const char*>(msg.end() - call.func_len),
+                 call.func_len)
+          << "' with " << call.argc << " scalar argument(s)";
+  SAPI_RETURN_IF_ERROR(rpc_channel()->CallScalar(msg, ret, call.ret_type));
+  VLOG(1) << "CALL EXIT: Type: " << call.ret_type;
+  return absl::OkStatus();
+}
+
 absl::Status Sandbox::Symbol(const char* symname, void** addr) {
   if (!is_active()) {
     return absl::UnavailableError("Sandbox not active");
@@ -458,6 +553,59 @@ void Sandbox::Exit() const {
   }
 }
 
+absl::Status TransferBetween(Sandbox* from, const v::RemotePtr& src,
+                             Sandbox* to, const v::RemotePtr& dst, size_t size,
+                             size_t chunk_size) {
+  if (!from->is_active() || !to->is_active()) {
+    return absl::UnavailableError("Sandbox not active");
+  }
+  if (chunk_size == 0) {
+    return absl::InvalidArgumentError("Chunk size must be positive");
+  }
+
+  auto* src_addr = reinterpret_cast<uint8_t*>(src.GetValue());
+  auto* dst_addr = reinterpret_cast<uint8_t*>(dst.GetValue());
+  std::vector<uint8_t> buffer(std::min(size, chunk_size));
+  for (size_t offset = 0; offset < size; offset += buffer.size()) {
+    const size_t len = std::min(buffer.size(), size - offset);
+    struct iovec local = {
+        .iov_base = buffer.data(),
+        .iov_len = len,
+    };
+    struct iovec remote = {
+        .iov_base = src_addr + offset,
+        .iov_len = len,
+    };
+    ssize_t ret = process_vm_readv(from->pid(), &local, 1, &remote, 1, 0);
+    if (ret == -1) {
+      PLOG(WARNING) << "process_vm_readv(pid: " << from->pid()
+                    << " raddr: " << remote.iov_base << " size: " << len << ")";
+      return absl::UnavailableError("process_vm_readv failed");
+    }
+    if (ret != static_cast<ssize_t>(len)) {
+      LOG(WARNING) << "process_vm_readv(pid: " << from->pid()
+                   << " raddr: " << remote.iov_base << " size: " << len
+                   << ") transferred " << ret << " bytes";
+      return absl::UnavailableError("process_vm_readv succeeded partially");
+    }
+
+    remote.iov_base = dst_addr + offset;
+    ret = process_vm_writev(to->pid(), &local, 1, &remote, 1, 0);
+    if (ret == -1) {
+      PLOG(WARNING) << "process_vm_writev(pid: " << to->pid()
+                    << " raddr: " << remote.iov_base << " size: " << len << ")";
+      return absl::UnavailableError("process_vm_writev failed");
+    }
+    if (ret != static_cast<ssize_t>(len)) {
+      LOG(WARNING) << "process_vm_writev(pid: " << to->pid()
+                   << " raddr: " << remote.iov_base << " size: " << len
+                   << ") transferred " << ret << " bytes";
+      return absl::UnavailableError("process_vm_writev: partial success");
+    }
+  }
+  return absl::OkStatus();
+}
+
 std::unique_ptr<sandbox2::Policy> Sandbox::ModifyPolicy(
     sandbox2::PolicyBuilder* builder) {
   return builder->BuildOrDie();
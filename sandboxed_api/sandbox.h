@@ -15,10 +15,15 @@
 #ifndef SANDBOXED_API_SANDBOX_H_
 #define SANDBOXED_API_SANDBOX_H_
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <ctime>
 #include <initializer_list>
 #include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "sandboxed_api/file_toc.h"
@@ -27,13 +32,18 @@
 #include "absl/log/log.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/call.h"
 #include "sandboxed_api/config.h"
+#include "sandboxed_api/forkserver_registry.h"
 #include "sandboxed_api/rpcchannel.h"
 #include "sandboxed_api/sandbox2/client.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/sandbox2/policy.h"
 #include "sandboxed_api/sandbox2/policybuilder.h"
+#include "sandboxed_api/sandbox2/reaper.h"
 #include "sandboxed_api/sandbox2/sandbox2.h"
 #include "sandboxed_api/vars.h"
 
@@ -51,7 +61,8 @@ class Sandbox {
 
   virtual ~Sandbox();
 
-  // Initializes a new sandboxing session.
+  // Initializes a new sandboxing session. Fails with ResourceExhaustedError if
+  // sandbox2::SpawnGovernor did not admit the spawn of the sandboxee.
   absl::Status Init();
 
   // Returns whether the current sandboxing session is active.
@@ -60,6 +71,20 @@ class Sandbox {
   // Terminates the current sandboxing session (if it exists).
   void Terminate(bool attempt_graceful_exit = true);
 
+  // Like Terminate(), but does not wait for the sandboxee to exit. The session
+  // is handed to sandbox2::Reaper::Default(), which kills it (or gives it one
+  // second to exit gracefully) and invokes done with the result. Init() can be
+  // called right away to start a new session. Unlike Terminate(), this must not
+  // be called concurrently with other methods of this object.
+  void TerminateAsync(bool attempt_graceful_exit = true,
+                      sandbox2::Reaper::DoneCallback done = nullptr);
+
+  // Requests the sandboxee to be killed and returns right away. Calls in
+  // progress on other threads fail once it is gone. Unlike the other methods,
+  // this can be called while another thread uses the sandbox, but not
+  // concurrently with Init(), Restart() or Terminate().
+  void Kill();
+
   // Restarts the sandbox.
   absl::Status Restart(bool attempt_graceful_exit) {
     Terminate(attempt_graceful_exit);
@@ -88,6 +113,58 @@ class Sandbox {
   absl::Status Call(const std::string& func, v::Callable* ret,
                     std::initializer_list<v::Callable*> args);
 
+  // Makes a call to a function that only takes and returns register-sized
+  // values (integers, enums and floating-point numbers). As the argument types
+  // are known at compile-time, no v::Var wrappers are needed and only the used
+  // part of the call message is sent. Returns absl::Status if R is void and
+  // absl::StatusOr<R> otherwise.
+  template <typename R, typename... Args>
+  std::conditional_t<std::is_void_v<R>, absl::Status, absl::StatusOr<R>>
+  CallScalar(absl::string_view func, Args... args) {
+    static_assert(sizeof...(Args) <= FuncCall::kArgsMax,
+                  "Too many arguments to sapi::Sandbox::CallScalar()");
+    constexpr size_t kNameOffset =
+        sizeof(ScalarCall) + sizeof...(Args) * sizeof(ScalarCall::Arg);
+    alignas(ScalarCall::Arg) uint8_t msg[kNameOffset + FuncCall::kFuncNameMax];
+
+    auto* call = reinterpret_cast<ScalarCall*>(msg);
+    if constexpr (std::is_void_v<R>) {
+      call->ret_type = v::Type::kVoid;
+      call->ret_size = 0;
+    } else {
+      static_assert(internal::ScalarCallType<R>() != v::Type::kVoid,
+                    "Unsupported return type for sapi::Sandbox::CallScalar()");
+      call->ret_type = internal::ScalarCallType<R>();
+      call->ret_size = sizeof(R);
+    }
+    call->argc = sizeof...(Args);
+    // Leave room for the NUL terminator added by the sandboxee.
+    call->func_len =
+        std::min<size_t>(func.size(), FuncCall::kFuncNameMax - 1);
+    [[maybe_unused]] auto* arg =
+        reinterpret_cast<ScalarCall::Arg*>(msg + sizeof(ScalarCall));
+    (internal::PackScalarCallArg(args, *arg++), ...);
+    memcpy(msg + kNameOffset, func.data(), call->func_len);
+
+    FuncRet fret;
+    if (absl::Status status = CallScalarImpl(
+            absl::MakeConstSpan(msg, kNameOffset + call->func_len), &fret);
+        !status.ok()) {
+      return status;
+    }
+    if constexpr (std::is_void_v<R>) {
+      return absl::OkStatus();
+    } else {
+      R value;
+      if constexpr (std::is_floating_point_v<R>) {
+        memcpy(&value, &fret.float_val, sizeof(R));
+      } else {
+        memcpy(&value, &fret.int_val, sizeof(R));
+      }
+      return value;
+    }
+  }
+
   // Allocates memory in the sandboxee, automatic_free indicates whether the
   // memory should be freed on the remote side when the 'var' goes out of scope.
   absl::Status Allocate(v::Var* var, bool automatic_free = false);
@@ -150,9 +227,11 @@ class Sandbox {
   // Exits the sandboxee.
   void Exit() const;
 
-  // The client to the library forkserver.
-  std::unique_ptr<sandbox2::ForkClient> fork_client_;
-  std::unique_ptr<sandbox2::Executor> forkserver_executor_;
+  // Sends a call message assembled by CallScalar() and receives the result.
+  absl::Status CallScalarImpl(absl::Span<const uint8_t> msg, FuncRet* ret);
+
+  // The library forkserver, shared with other sandboxes of the same library.
+  std::shared_ptr<ForkServerRegistry::ForkServer> forkserver_;
 
   // The main sandbox2::Sandbox2 object.
   std::unique_ptr<sandbox2::Sandbox2> s2_;
@@ -176,6 +255,20 @@ class Sandbox {
   const FileToc* embed_lib_toc_;
 };
 
+// Default size of the host buffer used by TransferBetween().
+inline constexpr size_t kTransferBetweenChunkSize = size_t{1} << 20;  // 1 MiB
+
+// Copies size bytes from src in the sandboxee of from to dst in the sandboxee
+// of to, e.g. to hand the output of a decompressor to a parser. Unlike a
+// TransferFromSandboxee() and TransferToSandboxee() pair, the buffer is not
+// staged on the host as a whole: each chunk of up to chunk_size bytes is read
+// into one reused host buffer with process_vm_readv() and written out with
+// process_vm_writev(). Both remote buffers must be allocated and, if from and
+// to are the same sandbox, must not overlap.
+absl::Status TransferBetween(Sandbox* from, const v::RemotePtr& src,
+                             Sandbox* to, const v::RemotePtr& dst, size_t size,
+                             size_t chunk_size = kTransferBetweenChunkSize);
+
 }  // namespace sapi
 
 #endif  // SANDBOXED_API_SANDBOX_H_
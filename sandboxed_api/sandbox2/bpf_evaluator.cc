@@ -0,0 +1,174 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/bpf_evaluator.h"
+
+#include <linux/bpf_common.h>
+// IWYU pragma: no_include <asm/int-ll64.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+
+namespace sandbox2 {
+namespace bpf {
+namespace {
+
+absl::StatusOr<uint32_t> Alu(int op, uint32_t a, uint32_t operand) {
+  switch (op) {
+    case BPF_ADD:
+      return a + operand;
+    case BPF_SUB:
+      return a - operand;
+    case BPF_MUL:
+      return a * operand;
+    case BPF_DIV:
+      if (operand == 0) {
+        return absl::InvalidArgumentError("division by zero");
+      }
+      return a / operand;
+    case BPF_AND:
+      return a & operand;
+    case BPF_OR:
+      return a | operand;
+    case BPF_XOR:
+      return a ^ operand;
+    case BPF_LSH:
+      return operand >= 32 ? 0 : a << operand;
+    case BPF_RSH:
+      return operand >= 32 ? 0 : a >> operand;
+    default:
+      return absl::InvalidArgumentError(absl::StrCat("unknown op ", op));
+  }
+}
+
+absl::StatusOr<bool> Compare(int op, uint32_t a, uint32_t operand) {
+  switch (op) {
+    case BPF_JEQ:
+      return a == operand;
+    case BPF_JGT:
+      return a > operand;
+    case BPF_JGE:
+      return a >= operand;
+    case BPF_JSET:
+      return (a & operand) != 0;
+    default:
+      return absl::InvalidArgumentError(absl::StrCat("unknown cmp ", op));
+  }
+}
+
+}  // namespace
+
+absl::StatusOr<uint32_t> Evaluate(absl::Span<const sock_filter> prog,
+                                  const struct seccomp_data& data) {
+  uint32_t a = 0;
+  uint32_t x = 0;
+  uint32_t mem[BPF_MEMWORDS] = {};
+  for (size_t pc = 0; pc < prog.size(); ++pc) {
+    const sock_filter& inst = prog[pc];
+    switch (inst.code) {
+      case BPF_LD | BPF_W | BPF_ABS:
+        if ((inst.k & 3) != 0 || inst.k >= sizeof(data)) {
+          return absl::InvalidArgumentError(
+              absl::StrCat("invalid load at ", pc, ": 0x", absl::Hex(inst.k)));
+        }
+        memcpy(&a, reinterpret_cast<const char*>(&data) + inst.k, sizeof(a));
+        break;
+      case BPF_LD | BPF_W | BPF_LEN:
+        a = sizeof(data);
+        break;
+      case BPF_LDX | BPF_W | BPF_LEN:
+        x = sizeof(data);
+        break;
+      case BPF_LD | BPF_IMM:
+        a = inst.k;
+        break;
+      case BPF_LDX | BPF_IMM:
+        x = inst.k;
+        break;
+      case BPF_MISC | BPF_TAX:
+        x = a;
+        break;
+      case BPF_MISC | BPF_TXA:
+        a = x;
+        break;
+      case BPF_LD | BPF_MEM:
+      case BPF_LDX | BPF_MEM:
+      case BPF_ST:
+      case BPF_STX:
+        if (inst.k >= BPF_MEMWORDS) {
+          return absl::InvalidArgumentError(
+              absl::StrCat("invalid memory slot at ", pc, ": ", inst.k));
+        }
+        if (inst.code == (BPF_LD | BPF_MEM)) {
+          a = mem[inst.k];
+        } else if (inst.code == (BPF_LDX | BPF_MEM)) {
+          x = mem[inst.k];
+        } else if (inst.code == BPF_ST) {
+          mem[inst.k] = a;
+        } else {
+          mem[inst.k] = x;
+        }
+        break;
+      case BPF_RET | BPF_K:
+        return inst.k;
+      case BPF_RET | BPF_A:
+        return a;
+      case BPF_ALU | BPF_NEG:
+        a = -a;
+        break;
+      case BPF_JMP | BPF_JA:
+        pc += inst.k;
+        break;
+      default:
+        switch (BPF_CLASS(inst.code)) {
+          case BPF_ALU: {
+            absl::StatusOr<uint32_t> result = Alu(
+                BPF_OP(inst.code), a, BPF_SRC(inst.code) == BPF_X ? x : inst.k);
+            if (!result.ok()) {
+              return absl::InvalidArgumentError(
+                  absl::StrCat(result.status().message(), " at ", pc));
+            }
+            a = *result;
+            break;
+          }
+          case BPF_JMP: {
+            absl::StatusOr<bool> taken =
+                Compare(BPF_OP(inst.code), a,
+                        BPF_SRC(inst.code) == BPF_X ? x : inst.k);
+            if (!taken.ok()) {
+              return absl::InvalidArgumentError(
+                  absl::StrCat(taken.status().message(), " at ", pc));
+            }
+            pc += *taken ? inst.jt : inst.jf;
+            break;
+          }
+          default:
+            return absl::InvalidArgumentError(
+                absl::StrCat("invalid instruction ", inst.code, " at ", pc));
+        }
+    }
+  }
+  return absl::InvalidArgumentError("program ended without a return");
+}
+
+}  // namespace bpf
+}  // namespace sandbox2
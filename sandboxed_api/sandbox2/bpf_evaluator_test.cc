@@ -0,0 +1,129 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/bpf_evaluator.h"
+
+#include <linux/audit.h>
+#include <linux/bpf_common.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <syscall.h>
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "sandboxed_api/sandbox2/util/bpf_helper.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sandbox2 {
+namespace bpf {
+namespace {
+
+using ::sapi::StatusIs;
+using ::testing::Eq;
+
+seccomp_data MakeData(int nr, uint64_t arg0 = 0) {
+  seccomp_data data = {};
+  data.nr = nr;
+  data.args[0] = arg0;
+  return data;
+}
+
+TEST(EvaluateTest, SimpleReturn) {
+  std::vector<sock_filter> prog = {ALLOW};
+  SAPI_ASSERT_OK_AND_ASSIGN(uint32_t action,
+                            Evaluate(prog, MakeData(__NR_read)));
+  EXPECT_THAT(action, Eq(SECCOMP_RET_ALLOW));
+}
+
+TEST(EvaluateTest, SyscallDispatch) {
+  std::vector<sock_filter> prog = {
+      LOAD_SYSCALL_NR,
+      SYSCALL(__NR_read, ALLOW),
+      SYSCALL(__NR_personality, TRACE(7)),
+      KILL,
+  };
+  SAPI_ASSERT_OK_AND_ASSIGN(uint32_t read_action,
+                            Evaluate(prog, MakeData(__NR_read)));
+  EXPECT_THAT(read_action, Eq(SECCOMP_RET_ALLOW));
+  SAPI_ASSERT_OK_AND_ASSIGN(uint32_t personality_action,
+                            Evaluate(prog, MakeData(__NR_personality)));
+  EXPECT_THAT(personality_action, Eq(SECCOMP_RET_TRACE | 7));
+  SAPI_ASSERT_OK_AND_ASSIGN(uint32_t write_action,
+                            Evaluate(prog, MakeData(__NR_write)));
+  EXPECT_THAT(write_action, Eq(SECCOMP_RET_KILL));
+}
+
+TEST(EvaluateTest, ArgumentChecks) {
+  std::vector<sock_filter> prog = {
+      LOAD_SYSCALL_NR,
+      JNE32(__NR_personality, KILL),
+      ARG_32(0),
+      JEQ32(1, ALLOW),
+      JA32(0x10, ERRNO(1)),
+      KILL,
+  };
+  SAPI_ASSERT_OK_AND_ASSIGN(uint32_t equal_action,
+                            Evaluate(prog, MakeData(__NR_personality, 1)));
+  EXPECT_THAT(equal_action, Eq(SECCOMP_RET_ALLOW));
+  SAPI_ASSERT_OK_AND_ASSIGN(uint32_t flag_action,
+                            Evaluate(prog, MakeData(__NR_personality, 0x11)));
+  EXPECT_THAT(flag_action, Eq(SECCOMP_RET_ERRNO | 1));
+  SAPI_ASSERT_OK_AND_ASSIGN(uint32_t other_action,
+                            Evaluate(prog, MakeData(__NR_personality, 2)));
+  EXPECT_THAT(other_action, Eq(SECCOMP_RET_KILL));
+}
+
+TEST(EvaluateTest, MemoryAndAlu) {
+  std::vector<sock_filter> prog = {
+      BPF_STMT(BPF_LD | BPF_IMM, 6),
+      BPF_STMT(BPF_ST, 3),
+      BPF_STMT(BPF_LDX | BPF_MEM, 3),
+      BPF_STMT(BPF_ALU | BPF_MUL | BPF_X, 0),
+      BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 4),
+      BPF_STMT(BPF_RET | BPF_A, 0),
+  };
+  SAPI_ASSERT_OK_AND_ASSIGN(uint32_t result,
+                            Evaluate(prog, MakeData(__NR_read)));
+  EXPECT_THAT(result, Eq(40));
+}
+
+TEST(EvaluateTest, InvalidPrograms) {
+  EXPECT_THAT(Evaluate({}, MakeData(__NR_read)),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  std::vector<sock_filter> misaligned = {
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 1),
+      ALLOW,
+  };
+  EXPECT_THAT(Evaluate(misaligned, MakeData(__NR_read)),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  std::vector<sock_filter> out_of_bounds = {
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, sizeof(seccomp_data)),
+      ALLOW,
+  };
+  EXPECT_THAT(Evaluate(out_of_bounds, MakeData(__NR_read)),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  std::vector<sock_filter> div_by_zero = {
+      BPF_STMT(BPF_ALU | BPF_DIV | BPF_K, 0),
+      ALLOW,
+  };
+  EXPECT_THAT(Evaluate(div_by_zero, MakeData(__NR_read)),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+}  // namespace
+}  // namespace bpf
+}  // namespace sandbox2
@@ -51,6 +51,7 @@
 #include "sandboxed_api/sandbox2/syscall.h"
 #include "sandboxed_api/sandbox2/util/bpf_helper.h"
 #include "sandboxed_api/util/raw_logging.h"
+#include "sandboxed_api/util/tracepoint.h"
 
 #ifndef SECCOMP_FILTER_FLAG_NEW_LISTENER
 #define SECCOMP_FILTER_FLAG_NEW_LISTENER (1UL << 3)
@@ -332,6 +333,8 @@ void Client::ApplyPolicyAndBecomeTracee() {
                    "invalid confirmation from executor");
     InitSeccompRegular(prog);
   }
+  SAPI_TRACEPOINT(sandbox2, policy_installed, prog.len,
+                  ret == kSandbox2ClientUnotify);
 }
 
 int Client::GetMappedFD(const std::string& name) {
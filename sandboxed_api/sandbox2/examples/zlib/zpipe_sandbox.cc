@@ -13,13 +13,17 @@
 // limitations under the License.
 
 #include <fcntl.h>
+#include <linux/futex.h>
 #include <syscall.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <cerrno>
+#include <cstdint>
 #include <cstdlib>
 #include <memory>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
 #include <utility>
 #include <vector>
 
@@ -30,20 +34,26 @@
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/base/log_severity.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "sandboxed_api/sandbox2/executor.h"
 #include "sandboxed_api/sandbox2/limits.h"
 #include "sandboxed_api/sandbox2/policy.h"
 #include "sandboxed_api/sandbox2/policybuilder.h"
 #include "sandboxed_api/sandbox2/result.h"
 #include "sandboxed_api/sandbox2/sandbox2.h"
+#include "sandboxed_api/sandbox2/stream_channel.h"
 #include "sandboxed_api/sandbox2/util/bpf_helper.h"
 #include "sandboxed_api/util/runfiles.h"
 
 ABSL_FLAG(std::string, input, "", "Input file");
 ABSL_FLAG(std::string, output, "", "Output file");
 ABSL_FLAG(bool, decompress, false, "Decompress instead of compress.");
+ABSL_FLAG(bool, stream, false,
+          "Stream data through shared memory instead of file descriptors.");
 
 namespace {
 
@@ -69,6 +79,113 @@ std::unique_ptr<sandbox2::Policy> GetPolicy() {
       .BuildOrDie();
 }
 
+std::unique_ptr<sandbox2::Policy> GetStreamPolicy() {
+  return sandbox2::PolicyBuilder()
+      // Allow write on STDERR.
+      .AddPolicyOnSyscall(__NR_write, {ARG_32(0), JEQ32(2, ALLOW)})
+      // Required to map and wait on the stream channels.
+      .AllowMmap()
+      .AllowFutexOp(FUTEX_WAIT)
+      .AllowFutexOp(FUTEX_WAKE)
+      .AllowSyscall(__NR_close)
+      .AllowStat()
+      .AllowStaticStartup()
+      .AllowSystemMalloc()
+      .AllowExit()
+      .BuildOrDie();
+}
+
+constexpr size_t kStreamCapacity = 1 << 20;
+constexpr size_t kStreamChunk = 64 << 10;
+
+// Runs the zpipe_stream sandboxee, feeding it fd_in and writing its output to
+// fd_out.
+int RunStreaming(int fd_in, int fd_out) {
+  const std::string path = sapi::internal::GetSapiDataDependencyFilePath(
+      "sandbox2/examples/zlib/zpipe_stream");
+  std::vector<std::string> args = {path};
+  if (absl::GetFlag(FLAGS_decompress)) {
+    args.push_back("-d");
+  }
+  auto executor = std::make_unique<sandbox2::Executor>(
+      path, args, std::vector<std::string>{});
+  executor->limits()
+      ->set_rlimit_cpu(60)
+      .set_walltime_limit(absl::Seconds(5));
+
+  auto in = sandbox2::StreamChannel::Create(kStreamCapacity);
+  auto out = sandbox2::StreamChannel::Create(kStreamCapacity);
+  CHECK_OK(in.status());
+  CHECK_OK(out.status());
+  executor->ipc()->MapDupedFd((*in)->fd(), 3);
+  executor->ipc()->MapDupedFd((*out)->fd(), 4);
+
+  sandbox2::Sandbox2 s2(std::move(executor), GetStreamPolicy());
+  if (!s2.RunAsync()) {
+    LOG(ERROR) << "Could not start sandboxee: " << s2.AwaitResult().ToString();
+    return 2;
+  }
+
+  // Feed the input on a separate thread, so that neither side stalls on a full
+  // ring. A read error kills the sandboxee, so that a truncated input is not
+  // taken for a complete one.
+  std::atomic<bool> input_failed = false;
+  std::thread feeder([fd_in, &in, &s2, &input_failed] {
+    std::vector<uint8_t> buf(kStreamChunk);
+    for (;;) {
+      ssize_t len = read(fd_in, buf.data(), buf.size());
+      if (len == -1 && errno == EINTR) {
+        continue;
+      }
+      if (len == -1) {
+        PLOG(ERROR) << "Reading input failed";
+        input_failed = true;
+        s2.Kill();
+        break;
+      }
+      if (len == 0) {
+        break;
+      }
+      if (!(*in)->Write(absl::MakeConstSpan(buf.data(), len),
+                        absl::Now() + absl::Seconds(5))
+               .ok()) {
+        break;
+      }
+    }
+    (*in)->CloseWrite();
+  });
+  std::vector<uint8_t> buf(kStreamChunk);
+  for (;;) {
+    absl::StatusOr<size_t> len = (*out)->Read(absl::MakeSpan(buf),
+                                              absl::Now() + absl::Seconds(5));
+    if (!len.ok()) {
+      LOG(ERROR) << "Reading output failed: " << len.status();
+      s2.Kill();
+      break;
+    }
+    if (*len == 0) {
+      break;
+    }
+    CHECK_EQ(write(fd_out, buf.data(), *len), static_cast<ssize_t>(*len));
+  }
+  feeder.join();
+
+  auto result = s2.AwaitResult();
+  if (input_failed) {
+    return 1;
+  }
+  if (result.final_status() != sandbox2::Result::OK) {
+    LOG(ERROR) << "Sandbox error: " << result.ToString();
+    return 2;
+  }
+  if (auto code = result.reason_code(); code) {
+    LOG(ERROR) << "Sandboxee exited with non-zero: " << code;
+    return 3;
+  }
+  LOG(INFO) << "Sandboxee finished: " << result.ToString();
+  return EXIT_SUCCESS;
+}
+
 }  // namespace
 
 int main(int argc, char* argv[]) {
@@ -86,6 +203,18 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
+  if (absl::GetFlag(FLAGS_stream)) {
+    int fd_in = open(absl::GetFlag(FLAGS_input).c_str(), O_RDONLY);
+    int fd_out = open(absl::GetFlag(FLAGS_output).c_str(),
+                      O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    CHECK_GE(fd_in, 0);
+    CHECK_GE(fd_out, 0);
+    const int ret = RunStreaming(fd_in, fd_out);
+    close(fd_in);
+    close(fd_out);
+    return ret;
+  }
+
   // Note: In your own code, use sapi::GetDataDependencyFilePath() instead.
   const std::string path = sapi::internal::GetSapiDataDependencyFilePath(
       "sandbox2/examples/zlib/zpipe");
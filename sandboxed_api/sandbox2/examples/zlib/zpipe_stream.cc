@@ -0,0 +1,110 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Variant of zpipe that streams its input and output through
+// sandbox2::StreamChannel rings instead of stdin/stdout. The input channel is
+// expected on fd 3, the output channel on fd 4.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox2/stream_channel.h"
+#include "zlib.h"
+
+namespace {
+
+constexpr int kInputFd = 3;
+constexpr int kOutputFd = 4;
+constexpr size_t kChunk = 64 << 10;
+
+// Runs deflate or inflate from in to out until EOF on in. Returns a zlib
+// status code.
+int Process(bool decompress, sandbox2::StreamChannel& in,
+            sandbox2::StreamChannel& out) {
+  z_stream strm = {};
+  int ret = decompress ? inflateInit(&strm)
+                       : deflateInit(&strm, Z_DEFAULT_COMPRESSION);
+  if (ret != Z_OK) {
+    return ret;
+  }
+  static uint8_t in_buf[kChunk];
+  static uint8_t out_buf[kChunk];
+  bool eof = false;
+  do {
+    absl::StatusOr<size_t> read = in.Read(absl::MakeSpan(in_buf));
+    if (!read.ok()) {
+      ret = Z_ERRNO;
+      break;
+    }
+    eof = *read == 0;
+    strm.avail_in = *read;
+    strm.next_in = in_buf;
+    do {
+      strm.avail_out = kChunk;
+      strm.next_out = out_buf;
+      ret = decompress ? inflate(&strm, Z_NO_FLUSH)
+                       : deflate(&strm, eof ? Z_FINISH : Z_NO_FLUSH);
+      if (ret == Z_STREAM_ERROR || ret == Z_NEED_DICT || ret == Z_DATA_ERROR ||
+          ret == Z_MEM_ERROR) {
+        break;
+      }
+      if (!out.Write(absl::MakeConstSpan(out_buf, kChunk - strm.avail_out))
+               .ok()) {
+        ret = Z_ERRNO;
+        break;
+      }
+    } while (strm.avail_out == 0);
+    // Z_BUF_ERROR only means that no progress was possible without more input.
+  } while ((ret == Z_OK || ret == Z_BUF_ERROR) && !eof);
+  if (decompress) {
+    inflateEnd(&strm);
+  } else {
+    deflateEnd(&strm);
+  }
+  out.CloseWrite();
+  if (ret == Z_STREAM_END) {
+    return Z_OK;
+  }
+  // Input ended before the end of the compressed stream.
+  return ret == Z_OK || ret == Z_BUF_ERROR ? Z_DATA_ERROR : ret;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const bool decompress = argc == 2 && strcmp(argv[1], "-d") == 0;
+  if (argc > 2 || (argc == 2 && !decompress)) {
+    fputs("zpipe_stream usage: zpipe_stream [-d]\n", stderr);
+    return 1;
+  }
+  absl::StatusOr<std::unique_ptr<sandbox2::StreamChannel>> in =
+      sandbox2::StreamChannel::CreateFromFd(kInputFd);
+  absl::StatusOr<std::unique_ptr<sandbox2::StreamChannel>> out =
+      sandbox2::StreamChannel::CreateFromFd(kOutputFd);
+  if (!in.ok() || !out.ok()) {
+    fputs("zpipe_stream: could not map stream channels\n", stderr);
+    return 1;
+  }
+  const int ret = Process(decompress, **in, **out);
+  if (ret != Z_OK) {
+    fprintf(stderr, "zpipe_stream: zlib error %d\n", ret);
+    return 1;
+  }
+  return 0;
+}
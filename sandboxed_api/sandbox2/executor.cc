@@ -168,7 +168,8 @@ absl::StatusOr<SandboxeeProcess> Executor::StartSubProcess(int32_t clone_flags,
   client_comms_fd_.Close();
   exec_fd_.Close();
 
-  VLOG(1) << "StartSubProcess returned with: " << process.main_pid;
+  VLOG(1) << "StartSubProcess returned with: " << process.main_pid
+          << ", fork latency: " << process.fork_latency;
   return process;
 }
 
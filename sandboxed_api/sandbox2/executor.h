@@ -27,12 +27,14 @@
 #include "absl/log/log.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "sandboxed_api/sandbox2/fork_client.h"
 #include "sandboxed_api/sandbox2/forkserver.pb.h"
 #include "sandboxed_api/sandbox2/ipc.h"
 #include "sandboxed_api/sandbox2/limits.h"
 #include "sandboxed_api/sandbox2/namespace.h"
+#include "sandboxed_api/sandbox2/spawn_governor.h"
 #include "sandboxed_api/util/fileops.h"
 
 namespace sandbox2 {
@@ -97,6 +99,19 @@ class Executor final {
     return *this;
   }
 
+  // Priority and deadline of the sandboxee spawn for admission control by
+  // SpawnGovernor::Default(). If the spawn is not admitted by the deadline,
+  // the sandbox fails with Result::FAILED_ADMISSION.
+  Executor& set_spawn_priority(SpawnGovernor::Priority value) {
+    spawn_priority_ = value;
+    return *this;
+  }
+
+  Executor& set_spawn_deadline(absl::Time value) {
+    spawn_deadline_ = value;
+    return *this;
+  }
+
   int libunwind_recursion_depth() { return libunwind_recursion_depth_; }
 
  private:
@@ -106,10 +121,13 @@ class Executor final {
 
   // Internal constructor for executing libunwind on the given pid
   // enable_sandboxing_pre_execve=false as we are not going to execve.
+  // Stack traces are collected while a failed sandboxee is torn down, so their
+  // sandboxes are spawned ahead of new sandboxees.
   explicit Executor(pid_t libunwind_sbox_for_pid, int libunwind_recursion_depth)
       : libunwind_sbox_for_pid_(libunwind_sbox_for_pid),
         libunwind_recursion_depth_(libunwind_recursion_depth),
-        enable_sandboxing_pre_execve_(false) {
+        enable_sandboxing_pre_execve_(false),
+        spawn_priority_(SpawnGovernor::Priority::kHigh) {
     CHECK_GE(libunwind_sbox_for_pid_, 0);
     SetUpServerSideCommsFd();
   }
@@ -163,6 +181,9 @@ class Executor final {
 
   IPC ipc_;        // Used for communication with the sandboxee
   Limits limits_;  // Defines server- and client-side limits
+
+  SpawnGovernor::Priority spawn_priority_ = SpawnGovernor::Priority::kNormal;
+  absl::Time spawn_deadline_ = absl::InfiniteFuture();
 };
 
 }  // namespace sandbox2
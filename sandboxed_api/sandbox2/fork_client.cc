@@ -14,11 +14,15 @@
 
 #include "sandboxed_api/sandbox2/fork_client.h"
 
+#include <poll.h>
 #include <sys/types.h>
 
+#include <cstdint>
+
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/sandbox2/forkserver.pb.h"
 #include "sandboxed_api/util/fileops.h"
@@ -67,6 +71,13 @@ SandboxeeProcess ForkClient::SendRequest(const ForkRequest& request,
     return process;
   }
   process.main_pid = static_cast<pid_t>(pid);
+
+  int64_t fork_latency_ns;
+  if (!comms_->RecvInt64(&fork_latency_ns)) {
+    LOG(ERROR) << "Receiving fork latency from the ForkServer failed";
+    return process;
+  }
+  process.fork_latency = absl::Nanoseconds(fork_latency_ns);
   if (request.monitor_type() == FORKSERVER_MONITOR_UNOTIFY) {
     int fd = -1;
     if (!comms_->RecvFD(&fd)) {
@@ -78,4 +89,15 @@ SandboxeeProcess ForkClient::SendRequest(const ForkRequest& request,
   return process;
 }
 
+bool ForkClient::IsAlive() {
+  absl::MutexLock l(&comms_mutex_);
+  if (!comms_->IsConnected()) {
+    return false;
+  }
+  // The ForkServer only writes in response to a request, so a channel that is
+  // readable or hung up between requests means that it went away.
+  pollfd pfd = {comms_->GetConnectionFD(), POLLIN, 0};
+  return poll(&pfd, 1, 0) == 0;
+}
+
 }  // namespace sandbox2
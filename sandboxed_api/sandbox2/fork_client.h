@@ -19,6 +19,7 @@
 
 #include "absl/base/thread_annotations.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "sandboxed_api/util/fileops.h"
 
 namespace sandbox2 {
@@ -33,6 +34,8 @@ struct SandboxeeProcess {
   pid_t init_pid = -1;
   pid_t main_pid = -1;
   sapi::file_util::fileops::FDCloser status_fd;
+  // Time the forkserver spent forking the sandboxee.
+  absl::Duration fork_latency = absl::ZeroDuration();
 };
 
 class ForkClient {
@@ -45,6 +48,9 @@ class ForkClient {
   SandboxeeProcess SendRequest(const ForkRequest& request, int exec_fd,
                                int comms_fd);
 
+  // Returns whether the ForkServer can still take requests. Thread-safe.
+  bool IsAlive();
+
   pid_t pid() { return pid_; }
 
  private:
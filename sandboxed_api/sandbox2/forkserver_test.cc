@@ -25,6 +25,8 @@
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox2/fork_client.h"
 #include "sandboxed_api/sandbox2/forkserver.pb.h"
 #include "sandboxed_api/sandbox2/global_forkclient.h"
 #include "sandboxed_api/sandbox2/ipc.h"
@@ -78,6 +80,21 @@ TEST(ForkserverTest, SimpleFork) {
   ASSERT_NE(TestSingleRequest(FORKSERVER_FORK, -1), -1);
 }
 
+TEST(ForkserverTest, ReportsForkLatency) {
+  ForkRequest fork_req;
+  fork_req.set_mode(FORKSERVER_FORK);
+  int sv[2];
+  PCHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != -1);
+  IPC ipc;
+  IpcPeer{&ipc}.SetUpServerSideComms(sv[1]);
+  SandboxeeProcess process = GlobalForkClient::SendRequest(fork_req, -1, sv[0]);
+  ASSERT_NE(process.main_pid, -1);
+  waitpid(process.main_pid, nullptr, 0);
+  close(sv[0]);
+  EXPECT_GT(process.fork_latency, absl::ZeroDuration());
+  EXPECT_LT(process.fork_latency, absl::Seconds(10));
+}
+
 TEST(ForkserverTest, SimpleForkNoZombie) {
   // Make sure that we don't create zombies.
   pid_t child = TestSingleRequest(FORKSERVER_FORK, -1);
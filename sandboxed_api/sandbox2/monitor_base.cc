@@ -43,6 +43,7 @@
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "sandboxed_api/sandbox2/client.h"
 #include "sandboxed_api/sandbox2/comms.h"
@@ -53,13 +54,16 @@
 #include "sandboxed_api/sandbox2/network_proxy/server.h"
 #include "sandboxed_api/sandbox2/policy.h"
 #include "sandboxed_api/sandbox2/result.h"
+#include "sandboxed_api/sandbox2/spawn_governor.h"
 #include "sandboxed_api/sandbox2/stack_trace.h"
 #include "sandboxed_api/sandbox2/syscall.h"
 #include "sandboxed_api/sandbox2/util.h"
 #include "sandboxed_api/util/file_helpers.h"
 #include "sandboxed_api/util/raw_logging.h"
+#include "sandboxed_api/util/status_macros.h"
 #include "sandboxed_api/util/strerror.h"
 #include "sandboxed_api/util/temp_file.h"
+#include "sandboxed_api/util/tracepoint.h"
 
 ABSL_FLAG(bool, sandbox2_report_on_sandboxee_signal, true,
           "Report sandbox2 sandboxee deaths caused by signals");
@@ -67,6 +71,10 @@ ABSL_FLAG(bool, sandbox2_report_on_sandboxee_signal, true,
 ABSL_FLAG(bool, sandbox2_report_on_sandboxee_timeout, true,
           "Report sandbox2 sandboxee timeouts");
 
+ABSL_FLAG(bool, sandbox2_deferred_stack_traces, false,
+          "Only snapshot the sandboxee's stack when it terminates, and unwind "
+          "it when the stack trace is first requested from the result");
+
 ABSL_DECLARE_FLAG(bool, sandbox2_danger_danger_permit_all);
 ABSL_DECLARE_FLAG(std::string, sandbox2_danger_danger_permit_all_and_log);
 
@@ -165,12 +173,33 @@ void MonitorBase::OnDone() {
     return;
   }
 
+  SAPI_TRACEPOINT(sandbox2, sandbox_exit, process_.main_pid,
+                  static_cast<int>(result_.final_status()),
+                  result_.reason_code());
   notify_->EventFinished(result_);
   ipc_->InternalCleanupFdMap();
   done_notification_.Notify();
 }
 
 void MonitorBase::Launch() {
+  absl::Cleanup monitor_done = [this] { OnDone(); };
+
+  // Held until the sandboxee is set up, so that the number of concurrent
+  // spawns stays within the limit of the governor. Released before the monitor
+  // starts, as the governor limits spawns, not running sandboxees.
+  const absl::Time admission_start = absl::Now();
+  absl::StatusOr<SpawnGovernor::Permit> permit =
+      SpawnGovernor::Default().Acquire(executor_->spawn_priority_,
+                                       executor_->spawn_deadline_);
+  SAPI_TRACEPOINT(sandbox2, spawn_admission,
+                  static_cast<int>(executor_->spawn_priority_),
+                  absl::ToInt64Nanoseconds(absl::Now() - admission_start),
+                  permit.ok());
+  if (!permit.ok()) {
+    LOG(WARNING) << "Sandboxee spawn not admitted: " << permit.status();
+    SetExitStatusCode(Result::SETUP_ERROR, Result::FAILED_ADMISSION);
+    return;
+  }
 
   absl::Cleanup process_cleanup = [this] {
     if (process_.init_pid > 0) {
@@ -179,7 +208,6 @@ void MonitorBase::Launch() {
       kill(process_.main_pid, SIGKILL);
     }
   };
-  absl::Cleanup monitor_done = [this] { OnDone(); };
 
   const Namespace* ns = policy_->GetNamespaceOrNull();
   if (SAPI_VLOG_IS_ON(1) && ns != nullptr) {
@@ -214,6 +242,7 @@ void MonitorBase::Launch() {
   }
 
   process_ = *std::move(process);
+  result_.SetForkLatency(process_.fork_latency);
 
   if (process_.main_pid <= 0 || (should_have_init && process_.init_pid <= 0)) {
     SetExitStatusCode(Result::SETUP_ERROR, Result::FAILED_SUBPROCESS);
@@ -245,6 +274,7 @@ void MonitorBase::Launch() {
     return;
   }
   std::move(process_cleanup).Cancel();
+  permit->Release();
 
   RunInternal();
   std::move(monitor_done).Cancel();
@@ -462,4 +492,37 @@ absl::StatusOr<std::vector<std::string>> MonitorBase::GetAndLogStackTrace(
 
   return stack_trace;
 }
+
+absl::Status MonitorBase::StoreStackTrace(const Regs* regs) {
+  if (absl::GetFlag(FLAGS_sandbox2_deferred_stack_traces)) {
+    absl::StatusOr<std::unique_ptr<StackSnapshot>> snapshot =
+        CaptureStackSnapshot(regs, policy_->GetNamespaceOrNull(),
+                             uses_custom_forkserver_,
+                             executor_->libunwind_recursion_depth() + 1);
+    if (snapshot.ok()) {
+      std::shared_ptr<StackSnapshot> shared_snapshot = *std::move(snapshot);
+      result_.set_stack_trace_fn(
+          [shared_snapshot]() -> std::vector<std::string> {
+            absl::StatusOr<std::vector<std::string>> stack_trace =
+                sandbox2::GetStackTrace(*shared_snapshot);
+            if (!stack_trace.ok()) {
+              LOG(ERROR) << "Could not unwind stack snapshot: "
+                         << stack_trace.status();
+              return {};
+            }
+            return *std::move(stack_trace);
+          });
+      return absl::OkStatus();
+    }
+    // Snapshots need the sandboxed unwinder, otherwise unwind right away.
+    if (!absl::IsFailedPrecondition(snapshot.status())) {
+      return snapshot.status();
+    }
+  }
+  SAPI_ASSIGN_OR_RETURN(std::vector<std::string> stack_trace,
+                        GetAndLogStackTrace(regs));
+  result_.set_stack_trace(std::move(stack_trace));
+  return absl::OkStatus();
+}
+
 }  // namespace sandbox2
@@ -28,6 +28,7 @@
 #include <string>
 #include <vector>
 
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/synchronization/notification.h"
 #include "absl/time/time.h"
@@ -97,6 +98,11 @@ class MonitorBase {
   absl::StatusOr<std::vector<std::string>> GetAndLogStackTrace(
       const Regs* regs);
 
+  // Stores the stack trace in the result. With
+  // --sandbox2_deferred_stack_traces only a snapshot of the stack is taken,
+  // and unwinding happens once the stack trace is requested.
+  absl::Status StoreStackTrace(const Regs* regs);
+
   // Internal objects, owned by the Sandbox2 object.
   Executor* executor_;
   Notify* notify_;
@@ -66,6 +66,7 @@
 #include "sandboxed_api/sandbox2/util.h"
 #include "sandboxed_api/util/raw_logging.h"
 #include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/util/tracepoint.h"
 
 ABSL_FLAG(bool, sandbox2_log_all_stack_traces, false,
           "If set, sandbox2 monitor will log stack traces of all monitored "
@@ -186,6 +187,18 @@ void StopProcess(pid_t pid, int signo) {
   }
 }
 
+void SetPtraceOptions(pid_t pid, intptr_t options) {
+  if (ptrace(PTRACE_SETOPTIONS, pid, 0, options) == -1) {
+    if (errno == ESRCH) {
+      LOG(WARNING) << "Process " << pid
+                   << " died while trying to PTRACE_SETOPTIONS it";
+    } else {
+      PLOG(ERROR) << "ptrace(PTRACE_SETOPTIONS, pid=" << pid << ", options="
+                  << absl::StrCat("0x", absl::Hex(options)) << ")";
+    }
+  }
+}
+
 void CompleteSyscall(pid_t pid, int signo) {
   if (ptrace(PTRACE_SYSCALL, pid, 0, signo) == -1) {
     if (errno == ESRCH) {
@@ -219,6 +232,22 @@ bool PtraceMonitor::IsActivelyMonitoring() {
 
 void PtraceMonitor::SetActivelyMonitoring() { wait_for_execve_ = false; }
 
+intptr_t PtraceMonitor::PtraceOptions() {
+  // New tasks need to be auto-attached, so that SECCOMP_RET_TRACE works and
+  // seccomp kills (reported via the exit event) are seen for all of them.
+  // PTRACE_O_TRACEVFORKDONE is never requested, as the monitor has nothing to
+  // do on it. Exec events are only needed to notice the execve() which enables
+  // sandboxing; auto-attached tasks inherit the options of their parent.
+  intptr_t options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK |
+                     PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE |
+                     PTRACE_O_TRACEEXIT | PTRACE_O_TRACESECCOMP |
+                     PTRACE_O_EXITKILL;
+  if (!IsActivelyMonitoring()) {
+    options |= PTRACE_O_TRACEEXEC;
+  }
+  return options;
+}
+
 void PtraceMonitor::SetAdditionalResultInfo(std::unique_ptr<Regs> regs) {
   pid_t pid = regs->pid();
   result_.SetRegs(std::move(regs));
@@ -229,13 +258,9 @@ void PtraceMonitor::SetAdditionalResultInfo(std::unique_ptr<Regs> regs) {
     return;
   }
 
-  absl::StatusOr<std::vector<std::string>> stack_trace =
-      GetAndLogStackTrace(result_.GetRegs());
-  if (!stack_trace.ok()) {
-    LOG(ERROR) << "Could not obtain stack trace: " << stack_trace.status();
-    return;
+  if (absl::Status status = StoreStackTrace(result_.GetRegs()); !status.ok()) {
+    LOG(ERROR) << "Could not obtain stack trace: " << status;
   }
-  result_.set_stack_trace(*stack_trace);
 }
 
 bool PtraceMonitor::KillSandboxee() {
@@ -383,6 +408,7 @@ void PtraceMonitor::Run() {
     }
 
     VLOG(3) << "waitpid() returned with PID: " << ret << ", status: " << status;
+    SAPI_TRACEPOINT(sandbox2, monitor_event, ret, status);
 
     if (WIFEXITED(status)) {
       VLOG(1) << "PID: " << ret
@@ -562,13 +588,10 @@ bool PtraceMonitor::InitPtraceAttach() {
   absl::Time deadline = absl::Now() + absl::Seconds(2);
 
   // In some situations we allow ptrace to try again when it fails.
+  const intptr_t options = PtraceOptions();
   while (!tasks.empty()) {
     absl::flat_hash_set<int> tasks_left;
     for (int task : tasks) {
-      constexpr intptr_t options =
-          PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK |
-          PTRACE_O_TRACEVFORKDONE | PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC |
-          PTRACE_O_TRACEEXIT | PTRACE_O_TRACESECCOMP | PTRACE_O_EXITKILL;
       int ret = ptrace(PTRACE_SEIZE, task, 0, options);
       if (ret != 0) {
         if (errno == EPERM) {
@@ -669,6 +692,11 @@ void PtraceMonitor::ActionProcessSyscall(Regs* regs, const Syscall& syscall) {
     return;
   }
   if (trace_response == Notify::TraceAction::kInspectAfterReturn) {
+    // A successful execve() does not produce a syscall-exit-stop, only an exec
+    // event, which is not requested once sandboxing is enabled.
+    if (syscall.nr() == __NR_execve || syscall.nr() == __NR_execveat) {
+      SetPtraceOptions(regs->pid(), PtraceOptions() | PTRACE_O_TRACEEXEC);
+    }
     // Note that a process might die without an exit-stop before the syscall is
     // completed (eg. a thread calls execve() and the thread group leader dies),
     // so the entry is removed when the process exits.
@@ -693,6 +721,8 @@ void PtraceMonitor::ActionProcessSyscall(Regs* regs, const Syscall& syscall) {
 
 void PtraceMonitor::ActionProcessSyscallViolation(
     Regs* regs, const Syscall& syscall, ViolationType violation_type) {
+  SAPI_TRACEPOINT(sandbox2, violation, syscall.pid(), syscall.nr(),
+                  static_cast<int>(violation_type));
   LogSyscallViolation(syscall);
   notify_->EventSyscallViolation(syscall, violation_type);
   SetExitStatusCode(Result::VIOLATION, syscall.nr());
@@ -806,6 +836,8 @@ void PtraceMonitor::EventPtraceExec(pid_t pid, int event_msg) {
     VLOG(1) << "PTRACE_EVENT_EXEC seen from PID: " << event_msg
             << ". SANDBOX ENABLED!";
     SetActivelyMonitoring();
+    // Stop receiving exec events from now on.
+    SetPtraceOptions(pid, PtraceOptions());
   } else {
     // ptrace doesn't issue syscall-exit-stops for successful execve/execveat
     // system calls. Check if the monitor wanted to inspect the syscall's return
@@ -822,6 +854,7 @@ void PtraceMonitor::EventPtraceExec(pid_t pid, int event_msg) {
       notify_->EventSyscallReturn(index->second, 0);
       syscalls_in_progress_.erase(index);
     }
+    SetPtraceOptions(pid, PtraceOptions());
   }
   ContinueProcess(pid, 0);
 }
@@ -86,6 +86,10 @@ class PtraceMonitor : public MonitorBase {
   bool IsActivelyMonitoring();
   void SetActivelyMonitoring();
 
+  // Returns the minimal set of ptrace options for the current monitoring
+  // state.
+  intptr_t PtraceOptions();
+
   // Process with given PID changed state to a stopped state.
   void StateProcessStopped(pid_t pid, int status);
 
@@ -1,6 +1,7 @@
 #include "sandboxed_api/sandbox2/monitor_unotify.h"
 
 #include <linux/audit.h>
+#include <linux/filter.h>
 #include <linux/seccomp.h>
 #include <poll.h>
 #include <sys/eventfd.h>
@@ -37,6 +38,7 @@
 #include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "sandboxed_api/config.h"
+#include "sandboxed_api/sandbox2/bpf_evaluator.h"
 #include "sandboxed_api/sandbox2/client.h"
 #include "sandboxed_api/sandbox2/executor.h"
 #include "sandboxed_api/sandbox2/forkserver.pb.h"
@@ -44,9 +46,11 @@
 #include "sandboxed_api/sandbox2/notify.h"
 #include "sandboxed_api/sandbox2/policy.h"
 #include "sandboxed_api/sandbox2/result.h"
+#include "sandboxed_api/sandbox2/syscall.h"
 #include "sandboxed_api/util/fileops.h"
 #include "sandboxed_api/util/status_macros.h"
 #include "sandboxed_api/util/raw_logging.h"
+#include "sandboxed_api/util/tracepoint.h"
 
 #ifndef SECCOMP_GET_NOTIF_SIZES
 #define SECCOMP_GET_NOTIF_SIZES 3
@@ -67,6 +71,15 @@ struct seccomp_notif_sizes {
 
 /* Flags for seccomp notification fd ioctl. */
 #define SECCOMP_IOCTL_NOTIF_RECV SECCOMP_IOWR(0, struct seccomp_notif)
+#define SECCOMP_IOCTL_NOTIF_SEND SECCOMP_IOWR(1, struct seccomp_notif_resp)
+#endif
+
+#ifndef SECCOMP_USER_NOTIF_FLAG_CONTINUE
+#define SECCOMP_USER_NOTIF_FLAG_CONTINUE (1UL << 0)
+#endif
+
+#ifndef SECCOMP_RET_ACTION_FULL
+#define SECCOMP_RET_ACTION_FULL 0xffff0000U
 #endif
 
 namespace sandbox2 {
@@ -185,14 +198,70 @@ void UnotifyMonitor::HandleUnotify() {
                   {req_->data.args[0], req_->data.args[1], req_->data.args[2],
                    req_->data.args[3], req_->data.args[4], req_->data.args[5]},
                   req_->pid, 0, req_->data.instruction_pointer);
+  SAPI_TRACEPOINT(sandbox2, monitor_event, req_->pid, req_->data.nr);
+  if (syscall.arch() == Syscall::GetHostArch() &&
+      IsTracedSyscall(req_->data)) {
+    HandleTracedSyscall(syscall);
+    return;
+  }
+  HandleViolation(syscall);
+}
+
+bool UnotifyMonitor::IsTracedSyscall(const struct seccomp_data& data) {
+  absl::StatusOr<uint32_t> action =
+      bpf::Evaluate(policy_without_user_notif_, data);
+  if (!action.ok()) {
+    LOG(ERROR) << "Evaluating policy failed: " << action.status();
+    return false;
+  }
+  return (*action & SECCOMP_RET_ACTION_FULL) == SECCOMP_RET_TRACE;
+}
+
+void UnotifyMonitor::HandleTracedSyscall(const Syscall& syscall) {
+  // Notify can decide whether we want to allow this syscall. See
+  // PtraceMonitor::ActionProcessSyscall().
+  switch (notify_->EventSyscallTrace(syscall)) {
+    case Notify::TraceAction::kAllow:
+      AllowSyscallViaUnotify();
+      return;
+    case Notify::TraceAction::kInspectAfterReturn:
+      // There is no syscall-exit notification in seccomp_unotify.
+      LOG_FIRST_N(WARNING, 1)
+          << "EventSyscallReturn is not supported by the unotify monitor, "
+             "allowing syscall without inspecting its return value";
+      AllowSyscallViaUnotify();
+      return;
+    case Notify::TraceAction::kDeny:
+      HandleViolation(syscall);
+      return;
+  }
+}
+
+void UnotifyMonitor::AllowSyscallViaUnotify() {
+  memset(resp_.get(), 0, resp_size_);
+  resp_->id = req_->id;
+  resp_->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+  if (ioctl(seccomp_notify_fd_.get(), SECCOMP_IOCTL_NOTIF_SEND, resp_.get()) !=
+      0) {
+    if (errno == ENOENT) {
+      VLOG(1) << "Unotify send failed with ENOENT";
+    } else {
+      PLOG(ERROR) << "Unotify send failed";
+      SetExitStatusCode(Result::INTERNAL_ERROR, Result::FAILED_NOTIFY);
+    }
+  }
+}
+
+void UnotifyMonitor::HandleViolation(const Syscall& syscall) {
   ViolationType violation_type = syscall.arch() == Syscall::GetHostArch()
                                      ? kSyscallViolation
                                      : kArchitectureSwitchViolation;
+  SAPI_TRACEPOINT(sandbox2, violation, syscall.pid(), syscall.nr(),
+                  static_cast<int>(violation_type));
   LogSyscallViolation(syscall);
   notify_->EventSyscallViolation(syscall, violation_type);
   MaybeGetStackTrace(req_->pid, Result::VIOLATION);
   SetExitStatusCode(Result::VIOLATION, syscall.nr());
-  notify_->EventSyscallViolation(syscall, violation_type);
   result_.SetSyscall(std::make_unique<Syscall>(syscall));
   KillSandboxee();
 }
@@ -340,6 +409,10 @@ bool UnotifyMonitor::InitSetupUnotify() {
   }
   req_size_ = sizes.seccomp_notif;
   req_.reset(static_cast<seccomp_notif*>(malloc(req_size_)));
+  resp_size_ = sizes.seccomp_notif_resp;
+  resp_.reset(static_cast<seccomp_notif_resp*>(malloc(resp_size_)));
+  policy_without_user_notif_ =
+      policy_->GetPolicyWithoutUserNotif(/*user_notif=*/true);
   return true;
 }
 
@@ -392,17 +465,14 @@ void UnotifyMonitor::Join() {
 
 void UnotifyMonitor::MaybeGetStackTrace(pid_t pid, Result::StatusEnum status) {
   if (ShouldCollectStackTrace(status)) {
-    auto stack = GetStackTrace(pid);
-    if (stack.ok()) {
-      result_.set_stack_trace(*stack);
-    } else {
-      LOG(ERROR) << "Getting stack trace: " << stack.status();
+    if (absl::Status collect_status = AttachAndCollectStackTrace(pid);
+        !collect_status.ok()) {
+      LOG(ERROR) << "Getting stack trace: " << collect_status;
     }
   }
 }
 
-absl::StatusOr<std::vector<std::string>> UnotifyMonitor::GetStackTrace(
-    pid_t pid) {
+absl::Status UnotifyMonitor::AttachAndCollectStackTrace(pid_t pid) {
   if (ptrace(PTRACE_ATTACH, pid, 0, 0) != 0) {
     return absl::ErrnoToStatus(errno,
                                absl::StrCat("could not attach to pid = ", pid));
@@ -432,7 +502,7 @@ absl::StatusOr<std::vector<std::string>> UnotifyMonitor::GetStackTrace(
     SetExitStatusCode(Result::INTERNAL_ERROR, Result::FAILED_FETCH);
     return status;
   }
-  return GetAndLogStackTrace(&regs);
+  return StoreStackTrace(&regs);
 }
 
 }  // namespace sandbox2
@@ -1,6 +1,7 @@
 #ifndef SANDBOXED_API_SANDBOX2_MONITOR_UNOTIFY_H_
 #define SANDBOXED_API_SANDBOX2_MONITOR_UNOTIFY_H_
 
+#include <linux/filter.h>
 #include <linux/seccomp.h>
 #include <sys/sysinfo.h>
 #include <sys/types.h>
@@ -24,6 +25,7 @@
 #include "sandboxed_api/sandbox2/notify.h"
 #include "sandboxed_api/sandbox2/policy.h"
 #include "sandboxed_api/sandbox2/result.h"
+#include "sandboxed_api/sandbox2/syscall.h"
 #include "sandboxed_api/util/fileops.h"
 #include "sandboxed_api/util/raw_logging.h"
 
@@ -36,6 +38,13 @@ struct seccomp_notif {
   __u32 flags;
   struct seccomp_data data;
 };
+
+struct seccomp_notif_resp {
+  __u64 id;
+  __s64 val;
+  __s32 error;
+  __u32 flags;
+};
 #endif
 
 class UnotifyMonitor : public MonitorBase {
@@ -80,10 +89,17 @@ class UnotifyMonitor : public MonitorBase {
   void KillInit();
 
   void HandleUnotify();
+  // Returns true if the policy asked for the syscall to be traced, false if
+  // it is a violation.
+  bool IsTracedSyscall(const struct seccomp_data& data);
+  void HandleTracedSyscall(const Syscall& syscall);
+  void HandleViolation(const Syscall& syscall);
+  // Lets the syscall of the current notification continue in the kernel.
+  void AllowSyscallViaUnotify();
   void SetExitStatusFromStatusPipe();
 
   void MaybeGetStackTrace(pid_t pid, Result::StatusEnum status);
-  absl::StatusOr<std::vector<std::string>> GetStackTrace(pid_t pid);
+  absl::Status AttachAndCollectStackTrace(pid_t pid);
 
   // Notifies monitor about a state change
   void NotifyMonitor();
@@ -113,6 +129,12 @@ class UnotifyMonitor : public MonitorBase {
 
   size_t req_size_;
   std::unique_ptr<seccomp_notif, decltype(std::free)*> req_{nullptr, std::free};
+  size_t resp_size_;
+  std::unique_ptr<seccomp_notif_resp, decltype(std::free)*> resp_{nullptr,
+                                                                   std::free};
+  // The policy as it would have been installed without seccomp_unotify, used
+  // to decide whether a notification is for a traced syscall.
+  std::vector<sock_filter> policy_without_user_notif_;
 };
 
 }  // namespace sandbox2
@@ -20,6 +20,7 @@
 #include <sys/statvfs.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstddef>
 #include <cstdint>
@@ -37,6 +38,7 @@
 #include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "absl/strings/strip.h"
+#include "absl/types/span.h"
 #include "sandboxed_api/config.h"
 #include "sandboxed_api/sandbox2/mount_tree.pb.h"
 #include "sandboxed_api/sandbox2/util/minielf.h"
@@ -237,8 +239,11 @@ absl::Status Mounts::Remove(absl::string_view path) {
   return absl::OkStatus();
 }
 
-absl::Status Mounts::Insert(absl::string_view path,
-                            const MountTree::Node& new_node) {
+namespace {
+
+// Checks that the path is a valid inside path for a new node, and returns it
+// in its canonical form.
+absl::StatusOr<std::string> FixInsidePath(absl::string_view path) {
   // Some sandboxes allow the inside/outside paths to be partially
   // user-controlled with some sanitization.
   // Since we're handling C++ strings and later convert them to C style
@@ -249,10 +254,21 @@ absl::Status Mounts::Insert(absl::string_view path,
     return absl::InvalidArgumentError(
         absl::StrCat("Inside path contains a null byte: ", path));
   }
-  switch (new_node.node_case()) {
+  std::string fixed_path = sapi::file::CleanPath(path);
+  if (!sapi::file::IsAbsolutePath(fixed_path)) {
+    return absl::InvalidArgumentError("Only absolute paths are supported");
+  }
+  if (fixed_path == "/") {
+    return absl::InvalidArgumentError("The root already exists");
+  }
+  return fixed_path;
+}
+
+absl::Status ValidateNode(const MountTree::Node& node) {
+  switch (node.node_case()) {
     case MountTree::Node::kFileNode:
     case MountTree::Node::kDirNode: {
-      auto outside_path = GetOutsidePath(new_node);
+      auto outside_path = GetOutsidePath(node);
       if (outside_path.empty()) {
         return absl::InvalidArgumentError("Outside path cannot be empty");
       }
@@ -268,53 +284,44 @@ absl::Status Mounts::Insert(absl::string_view path,
     case MountTree::Node::NODE_NOT_SET:
       break;
   }
+  return absl::OkStatus();
+}
 
-  std::string fixed_path = sapi::file::CleanPath(path);
-  if (!sapi::file::IsAbsolutePath(fixed_path)) {
-    return absl::InvalidArgumentError("Only absolute paths are supported");
-  }
-
-  if (fixed_path == "/") {
-    return absl::InvalidArgumentError("The root already exists");
-  }
-
-  std::vector<absl::string_view> parts =
-      absl::StrSplit(absl::StripPrefix(fixed_path, "/"), '/');
-  std::string final_part(parts.back());
-  parts.pop_back();
-
-  MountTree* curtree = &mount_tree_;
-  for (absl::string_view part : parts) {
-    curtree = &(curtree->mutable_entries()
-                    ->insert({std::string(part), MountTree()})
-                    .first->second);
-    if (curtree->has_node() && curtree->node().has_file_node()) {
-      return absl::FailedPreconditionError(
-          absl::StrCat("Cannot insert ", path,
-                       " since a file is mounted as a parent directory"));
-    }
+// Returns the subtree for the directory `part` in `tree`, creating it if
+// necessary.
+absl::StatusOr<MountTree*> GetOrCreateDirectory(MountTree* tree,
+                                                absl::string_view part,
+                                                absl::string_view path) {
+  tree = &(tree->mutable_entries()
+               ->insert({std::string(part), MountTree()})
+               .first->second);
+  if (tree->has_node() && tree->node().has_file_node()) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Cannot insert ", path,
+                     " since a file is mounted as a parent directory"));
   }
+  return tree;
+}
 
-  curtree = &(curtree->mutable_entries()
-                  ->insert({final_part, MountTree()})
-                  .first->second);
-
-  if (curtree->has_node()) {
-    if (internal::IsEquivalentNode(curtree->node(), new_node)) {
+// Sets the node of `tree`, merging it with an already existing node.
+absl::Status SetNode(absl::string_view path, const MountTree::Node& new_node,
+                     MountTree* tree) {
+  if (tree->has_node()) {
+    if (internal::IsEquivalentNode(tree->node(), new_node)) {
       SAPI_RAW_LOG(INFO, "Inserting %s with the same value twice",
                    std::string(path).c_str());
       return absl::OkStatus();
     }
-    if (internal::HasSameTarget(curtree->node(), new_node)) {
-      if (!internal::IsWritable(curtree->node()) &&
+    if (internal::HasSameTarget(tree->node(), new_node)) {
+      if (!internal::IsWritable(tree->node()) &&
           internal::IsWritable(new_node)) {
         SAPI_RAW_LOG(INFO,
                      "Chaning %s to writable, was insterted read-only before",
                      std::string(path).c_str());
-        *curtree->mutable_node() = new_node;
+        *tree->mutable_node() = new_node;
         return absl::OkStatus();
       }
-      if (internal::IsWritable(curtree->node()) &&
+      if (internal::IsWritable(tree->node()) &&
           !internal::IsWritable(new_node)) {
         SAPI_RAW_LOG(INFO,
                      "Inserting %s read-only is a nop, as it was insterted "
@@ -325,15 +332,115 @@ absl::Status Mounts::Insert(absl::string_view path,
     }
     return absl::FailedPreconditionError(absl::StrCat(
         "Inserting ", path, " twice with conflicting values ",
-        curtree->node().DebugString(), " vs. ", new_node.DebugString()));
+        tree->node().DebugString(), " vs. ", new_node.DebugString()));
   }
 
-  if (new_node.has_file_node() && !curtree->entries().empty()) {
+  if (new_node.has_file_node() && !tree->entries().empty()) {
     return absl::FailedPreconditionError(
         absl::StrCat("Trying to mount file over existing directory at ", path));
   }
 
-  *curtree->mutable_node() = new_node;
+  *tree->mutable_node() = new_node;
+  return absl::OkStatus();
+}
+
+// Orders paths component-wise, so that all entries of a directory are
+// adjacent ("/a/b" < "/a/c" < "/a-b").
+bool PathComponentsLess(absl::string_view a, absl::string_view b) {
+  const size_t len = std::min(a.size(), b.size());
+  for (size_t i = 0; i < len; ++i) {
+    if (a[i] == b[i]) {
+      continue;
+    }
+    if (a[i] == '/' || b[i] == '/') {
+      return a[i] == '/';
+    }
+    return static_cast<unsigned char>(a[i]) < static_cast<unsigned char>(b[i]);
+  }
+  return a.size() < b.size();
+}
+
+}  // namespace
+
+absl::Status Mounts::Insert(absl::string_view path,
+                            const MountTree::Node& new_node) {
+  SAPI_ASSIGN_OR_RETURN(std::string fixed_path, FixInsidePath(path));
+  SAPI_RETURN_IF_ERROR(ValidateNode(new_node));
+
+  std::vector<absl::string_view> parts =
+      absl::StrSplit(absl::StripPrefix(fixed_path, "/"), '/');
+  std::string final_part(parts.back());
+  parts.pop_back();
+
+  MountTree* curtree = &mount_tree_;
+  for (absl::string_view part : parts) {
+    SAPI_ASSIGN_OR_RETURN(curtree, GetOrCreateDirectory(curtree, part, path));
+  }
+
+  curtree = &(curtree->mutable_entries()
+                  ->insert({final_part, MountTree()})
+                  .first->second);
+  return SetNode(path, new_node, curtree);
+}
+
+absl::Status Mounts::AddFiles(absl::Span<const std::string> paths,
+                              bool is_ro) {
+  std::vector<std::string> fixed_paths;
+  fixed_paths.reserve(paths.size());
+  for (const std::string& path : paths) {
+    std::string fixed_path = sapi::file::CleanPath(path);
+    if (!sapi::file::IsAbsolutePath(fixed_path)) {
+      return absl::InvalidArgumentError("Only absolute paths are supported");
+    }
+    fixed_paths.push_back(std::move(fixed_path));
+  }
+  return InsertFiles(std::move(fixed_paths), is_ro);
+}
+
+absl::Status Mounts::InsertFiles(std::vector<std::string> paths, bool is_ro) {
+  std::sort(paths.begin(), paths.end(), PathComponentsLess);
+  paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+  // The directories of the previously inserted path, directories[i] holds the
+  // subtree for its first i components. Consecutive paths mostly share their
+  // parents, so only the differing suffix needs to be looked up.
+  std::vector<absl::string_view> prev_parts;
+  std::vector<MountTree*> directories = {&mount_tree_};
+  MountTree::Node node;
+  for (const std::string& path : paths) {
+    if (PathContainsNullByte(path)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Inside path contains a null byte: ", path));
+    }
+    if (path == "/") {
+      return absl::InvalidArgumentError("The root already exists");
+    }
+    std::vector<absl::string_view> parts =
+        absl::StrSplit(absl::StripPrefix(path, "/"), '/');
+    const size_t num_dirs = parts.size() - 1;
+    size_t common = 0;
+    while (common < num_dirs && common + 1 < prev_parts.size() &&
+           parts[common] == prev_parts[common]) {
+      ++common;
+    }
+    directories.resize(common + 1);
+    for (size_t i = common; i < num_dirs; ++i) {
+      SAPI_ASSIGN_OR_RETURN(
+          MountTree * dir,
+          GetOrCreateDirectory(directories.back(), parts[i], path));
+      directories.push_back(dir);
+    }
+
+    MountTree* tree = &(directories.back()
+                            ->mutable_entries()
+                            ->insert({std::string(parts.back()), MountTree()})
+                            .first->second);
+    auto* file_node = node.mutable_file_node();
+    file_node->set_outside(path);
+    file_node->set_writable(!is_ro);
+    SAPI_RETURN_IF_ERROR(SetNode(path, node, tree));
+    prev_parts = std::move(parts);
+  }
   return absl::OkStatus();
 }
 
@@ -341,7 +448,10 @@ absl::Status Mounts::AddFileAt(absl::string_view outside,
                                absl::string_view inside, bool is_ro) {
   MountTree::Node node;
   auto* file_node = node.mutable_file_node();
-  file_node->set_outside(std::string(outside));
+  // Normalized like the paths passed to AddFiles(), so that both give the same
+  // tree.
+  file_node->set_outside(outside.empty() ? std::string()
+                                         : sapi::file::CleanPath(outside));
   file_node->set_writable(!is_ro);
   return Insert(inside, node);
 }
@@ -23,6 +23,7 @@
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "sandboxed_api/sandbox2/mount_tree.pb.h"
 
 namespace sandbox2 {
@@ -57,6 +58,13 @@ class Mounts {
   absl::Status AddFileAt(absl::string_view outside, absl::string_view inside,
                          bool is_ro = true);
 
+  // Adds many files at once, each mounted at its own path. The paths are
+  // sorted and deduplicated first, so that the tree is built in a single pass
+  // with each parent directory looked up only once. Returns on the first
+  // error, in which case the files inserted so far are kept, like with
+  // repeated AddFile() calls.
+  absl::Status AddFiles(absl::Span<const std::string> paths, bool is_ro = true);
+
   absl::Status AddDirectory(absl::string_view path, bool is_ro = true) {
     return AddDirectoryAt(path, path, is_ro);
   }
@@ -98,9 +106,15 @@ class Mounts {
 
  private:
   friend class MountTreeTest;
+  friend class PolicyBuilder;
 
   absl::Status Insert(absl::string_view path, const MountTree::Node& node);
 
+  // Inserts files at paths that are already absolute and normalized, see
+  // AddFiles(). PolicyBuilder validates its paths itself and calls this
+  // directly, so that each path is normalized only once.
+  absl::Status InsertFiles(std::vector<std::string> paths, bool is_ro);
+
   MountTree mount_tree_;
 };
 
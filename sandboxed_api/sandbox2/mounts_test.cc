@@ -20,8 +20,10 @@
 #include <string>
 #include <vector>
 
+#include "benchmark/benchmark.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "absl/log/check.h"
 #include "absl/status/status.h"
 #include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
@@ -42,6 +44,7 @@ using ::sapi::IsOk;
 using ::sapi::StatusIs;
 using ::testing::Eq;
 using ::testing::StrEq;
+using ::testing::UnorderedElementsAre;
 using ::testing::UnorderedElementsAreArray;
 
 constexpr size_t kTmpfsSize = 1024;
@@ -77,6 +80,41 @@ TEST(MountTreeTest, TestAddFile) {
   EXPECT_THAT(mounts.AddFileAt("/a", "/f"), IsOk());
 }
 
+TEST(MountTreeTest, TestAddFiles) {
+  const std::vector<std::string> paths = {
+      "/c/dd/e", "/c/e", "/a", "/c/d", "/b", "/c//e", "/c/d-e/f", "/c/d/../e",
+  };
+  Mounts bulk;
+  ASSERT_THAT(bulk.AddFiles(paths), IsOk());
+
+  Mounts single;
+  for (const std::string& path : paths) {
+    ASSERT_THAT(single.AddFile(path), IsOk());
+  }
+  std::vector<std::string> bulk_outside, bulk_inside;
+  bulk.RecursivelyListMounts(&bulk_outside, &bulk_inside);
+  std::vector<std::string> single_outside, single_inside;
+  single.RecursivelyListMounts(&single_outside, &single_inside);
+  EXPECT_THAT(bulk_outside, UnorderedElementsAreArray(single_outside));
+  EXPECT_THAT(bulk_inside, UnorderedElementsAreArray(single_inside));
+  // Aliases of the same path are mounted once, from the normalized path.
+  EXPECT_THAT(single_outside, UnorderedElementsAre("/a", "/b", "/c/d", "/c/e",
+                                                   "/c/dd/e", "/c/d-e/f"));
+}
+
+TEST(MountTreeTest, TestAddFilesErrors) {
+  Mounts mounts;
+  EXPECT_THAT(mounts.AddFiles({"/a", "b"}),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(mounts.AddFiles({"/a", "/"}),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(mounts.AddFiles({"/a/b", "/a"}),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+  ASSERT_THAT(mounts.AddDirectory("/d"), IsOk());
+  EXPECT_THAT(mounts.AddFiles({"/c", "/d"}),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
 TEST(MountTreeTest, TestAddDir) {
   Mounts mounts;
 
@@ -477,5 +515,39 @@ TEST(MountsResolvePathTest, Dirs) {
               StatusIs(absl::StatusCode::kNotFound));
 }
 
+// Generates paths spread over a directory hierarchy, similar to a data set.
+std::vector<std::string> GenerateFilePaths(int num_paths) {
+  std::vector<std::string> paths;
+  paths.reserve(num_paths);
+  for (int i = 0; i < num_paths; ++i) {
+    paths.push_back(absl::StrCat("/data/set", i % 7, "/shard", i % 101,
+                                 "/file", i));
+  }
+  return paths;
+}
+
+// Compares inserting files one by one against inserting them in bulk. The
+// first argument selects AddFiles(), the second one the number of files.
+void BenchmarkAddFiles(benchmark::State& state) {
+  const bool bulk = state.range(0) != 0;
+  const std::vector<std::string> paths = GenerateFilePaths(state.range(1));
+  for (auto _ : state) {
+    Mounts mounts;
+    if (bulk) {
+      CHECK_OK(mounts.AddFiles(paths));
+    } else {
+      for (const std::string& path : paths) {
+        CHECK_OK(mounts.AddFile(path));
+      }
+    }
+    benchmark::DoNotOptimize(mounts);
+  }
+  state.SetItemsProcessed(state.iterations() * paths.size());
+}
+BENCHMARK(BenchmarkAddFiles)
+    ->ArgNames({"bulk", "files"})
+    ->Args({0, 10000})
+    ->Args({1, 10000});
+
 }  // namespace
 }  // namespace sandbox2
@@ -22,9 +22,11 @@
 #include <utility>
 #include <vector>
 
+#include "benchmark/benchmark.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/log/log.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
 #include "absl/strings/string_view.h"
 #include "sandboxed_api/sandbox2/comms.h"
@@ -34,19 +36,25 @@
 #include "sandboxed_api/sandbox2/sandbox2.h"
 #include "sandboxed_api/sandbox2/syscall.h"
 #include "sandboxed_api/testing.h"
+#include "sandboxed_api/util/status_matchers.h"
 
 namespace sandbox2 {
 namespace {
 
 using ::sapi::CreateDefaultPermissiveTestPolicy;
 using ::sapi::GetTestSourcePath;
+using ::sapi::IsOk;
 using ::testing::Eq;
 
 // Allow typical syscalls and call SECCOMP_RET_TRACE for personality syscall,
 // chosen because unlikely to be called by a regular program.
-std::unique_ptr<Policy> NotifyTestcasePolicy(absl::string_view path) {
-  return CreateDefaultPermissiveTestPolicy(path)
-      .AddPolicyOnSyscall(__NR_personality, {SANDBOX2_TRACE})
+std::unique_ptr<Policy> NotifyTestcasePolicy(absl::string_view path,
+                                             bool unotify_monitor = false) {
+  PolicyBuilder builder = CreateDefaultPermissiveTestPolicy(path);
+  if (unotify_monitor) {
+    builder.CollectStacktracesOnSignal(false);
+  }
+  return builder.AddPolicyOnSyscall(__NR_personality, {SANDBOX2_TRACE})
       .BuildOrDie();
 }
 
@@ -85,13 +93,19 @@ class PidCommsNotify : public Notify {
   }
 };
 
+// Parameterized on whether to use the unotify monitor.
+class NotifyTest : public ::testing::TestWithParam<bool> {};
+
 // Test EventSyscallTrap on personality syscall and allow it.
-TEST(NotifyTest, AllowPersonality) {
+TEST_P(NotifyTest, AllowPersonality) {
   const std::string path = GetTestSourcePath("sandbox2/testcases/personality");
   std::vector<std::string> args = {path};
   Sandbox2 s2(std::make_unique<Executor>(path, args),
-              NotifyTestcasePolicy(path),
+              NotifyTestcasePolicy(path, GetParam()),
               std::make_unique<PersonalityNotify>(/*allow=*/true));
+  if (GetParam()) {
+    ASSERT_THAT(s2.EnableUnotifyMonitor(), IsOk());
+  }
   auto result = s2.Run();
 
   ASSERT_THAT(result.final_status(), Eq(Result::OK));
@@ -99,12 +113,15 @@ TEST(NotifyTest, AllowPersonality) {
 }
 
 // Test EventSyscallTrap on personality syscall and disallow it.
-TEST(NotifyTest, DisallowPersonality) {
+TEST_P(NotifyTest, DisallowPersonality) {
   const std::string path = GetTestSourcePath("sandbox2/testcases/personality");
   std::vector<std::string> args = {path};
   Sandbox2 s2(std::make_unique<Executor>(path, args),
-              NotifyTestcasePolicy(path),
+              NotifyTestcasePolicy(path, GetParam()),
               std::make_unique<PersonalityNotify>(/*allow=*/false));
+  if (GetParam()) {
+    ASSERT_THAT(s2.EnableUnotifyMonitor(), IsOk());
+  }
   auto result = s2.Run();
 
   ASSERT_THAT(result.final_status(), Eq(Result::VIOLATION));
@@ -112,7 +129,7 @@ TEST(NotifyTest, DisallowPersonality) {
 }
 
 // Test EventStarted by exchanging data after started but before sandboxed.
-TEST(NotifyTest, PrintPidAndComms) {
+TEST(NotifyStartedTest, PrintPidAndComms) {
   const std::string path = GetTestSourcePath("sandbox2/testcases/pidcomms");
   std::vector<std::string> args = {path};
   auto executor = std::make_unique<Executor>(path, args);
@@ -126,5 +143,34 @@ TEST(NotifyTest, PrintPidAndComms) {
   EXPECT_THAT(result.reason_code(), Eq(33));
 }
 
+INSTANTIATE_TEST_SUITE_P(Notify, NotifyTest, ::testing::Values(false, true),
+                         [](const ::testing::TestParamInfo<bool>& info) {
+                           return info.param ? "UnotifyMonitor"
+                                             : "PtraceMonitor";
+                         });
+
+// Measures throughput of syscalls decided on by EventSyscallTrace. The first
+// argument selects the unotify monitor, the second the number of syscalls.
+void BenchmarkTracedSyscalls(benchmark::State& state) {
+  const bool unotify_monitor = state.range(0) != 0;
+  const int64_t num_syscalls = state.range(1);
+  const std::string path = GetTestSourcePath("sandbox2/testcases/personality");
+  std::vector<std::string> args = {path, absl::StrCat(num_syscalls)};
+  for (auto _ : state) {
+    Sandbox2 s2(std::make_unique<Executor>(path, args),
+                NotifyTestcasePolicy(path, unotify_monitor),
+                std::make_unique<PersonalityNotify>(/*allow=*/true));
+    if (unotify_monitor) {
+      ASSERT_THAT(s2.EnableUnotifyMonitor(), IsOk());
+    }
+    auto result = s2.Run();
+    ASSERT_THAT(result.final_status(), Eq(Result::OK));
+  }
+  state.SetItemsProcessed(state.iterations() * num_syscalls);
+}
+BENCHMARK(BenchmarkTracedSyscalls)
+    ->ArgNames({"unotify", "syscalls"})
+    ->ArgsProduct({{0, 1}, {1000, 100000}});
+
 }  // namespace
 }  // namespace sandbox2
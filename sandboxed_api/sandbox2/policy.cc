@@ -67,6 +67,26 @@ std::vector<sock_filter> Policy::GetPolicy(bool user_notif) const {
     return GetTrackingPolicy();
   }
 
+  auto policy = GetPolicyWithoutUserNotif(user_notif);
+
+  // In seccomp_unotify mode replace all KILLs and TRACEs with unotify. The
+  // monitor decides on traced syscalls by evaluating the original policy.
+  if (user_notif) {
+    for (sock_filter& filter : policy) {
+      if (filter.code == BPF_RET + BPF_K &&
+          (filter.k == SECCOMP_RET_KILL ||
+           (filter.k & SECCOMP_RET_ACTION) == SECCOMP_RET_TRACE)) {
+        filter = DO_USER_NOTIF;
+      }
+    }
+  }
+
+  VLOG(2) << "Final policy:\n" << bpf::Disasm(policy);
+  return policy;
+}
+
+std::vector<sock_filter> Policy::GetPolicyWithoutUserNotif(
+    bool user_notif) const {
   // Now we can start building the policy.
   // 1. Start with the default policy (e.g. syscall architecture checks).
   auto policy = GetDefaultPolicy(user_notif);
@@ -80,17 +100,6 @@ std::vector<sock_filter> Policy::GetPolicy(bool user_notif) const {
 
   // 3. Finish with default KILL action.
   policy.push_back(KILL);
-
-  // In seccomp_unotify mode replace all KILLS with unotify
-  if (user_notif) {
-    for (sock_filter& filter : policy) {
-      if (filter.code == BPF_RET + BPF_K && filter.k == SECCOMP_RET_KILL) {
-        filter = DO_USER_NOTIF;
-      }
-    }
-  }
-
-  VLOG(2) << "Final policy:\n" << bpf::Disasm(policy);
   return policy;
 }
 
@@ -89,10 +89,17 @@ class Policy final {
  private:
   friend class PolicyBuilder;
   friend class MonitorBase;
+  friend class UnotifyMonitor;
 
   // Private constructor only called by the PolicyBuilder.
   Policy() = default;
 
+  // Returns the final policy (see GetPolicy()) before SECCOMP_RET_KILL and
+  // SECCOMP_RET_TRACE actions are replaced with SECCOMP_RET_USER_NOTIF in
+  // seccomp_unotify mode. The unotify monitor evaluates it to tell traced
+  // syscalls apart from violations.
+  std::vector<sock_filter> GetPolicyWithoutUserNotif(bool user_notif) const;
+
   // The Namespace object, defines ways of putting sandboxee into namespaces.
   std::optional<Namespace> namespace_;
 
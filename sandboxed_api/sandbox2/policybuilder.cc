@@ -1357,6 +1357,43 @@ PolicyBuilder& PolicyBuilder::AddFileAtIfNamespaced(absl::string_view outside,
   return *this;
 }
 
+PolicyBuilder& PolicyBuilder::AddFiles(absl::Span<const std::string> paths,
+                                       bool is_ro) {
+  EnableNamespaces();  // NOLINT(clang-diagnostic-deprecated-declarations)
+
+  std::vector<std::string> valid_paths;
+  valid_paths.reserve(paths.size());
+  for (const std::string& path : paths) {
+    auto valid_path = ValidateAbsolutePath(path);
+    if (!valid_path.ok()) {
+      SetError(valid_path.status());
+      return *this;
+    }
+    if (absl::StartsWith(*valid_path, "/proc/self") &&
+        *valid_path != "/proc/self/cpuset") {
+      SetError(absl::InvalidArgumentError(
+          absl::StrCat("Cannot add /proc/self mounts, you need to mount the "
+                       "whole /proc instead. You tried to mount ",
+                       path)));
+      return *this;
+    }
+    if (!is_ro && IsOnReadOnlyDev(*valid_path)) {
+      SetError(absl::FailedPreconditionError(
+          absl::StrCat("Cannot add ", path,
+                       " as read-write as it's on a read-only device")));
+      return *this;
+    }
+    valid_paths.push_back(*std::move(valid_path));
+  }
+
+  if (auto status = mounts_.InsertFiles(std::move(valid_paths), is_ro);
+      !status.ok()) {
+    SetError(absl::InternalError(
+        absl::StrCat("Could not add files: ", status.message())));
+  }
+  return *this;
+}
+
 PolicyBuilder& PolicyBuilder::AddLibrariesForBinary(
     absl::string_view path, absl::string_view ld_library_path) {
   EnableNamespaces();  // NOLINT(clang-diagnostic-deprecated-declarations)
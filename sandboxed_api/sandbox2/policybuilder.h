@@ -612,6 +612,14 @@ class PolicyBuilder final {
   PolicyBuilder& AddFileAt(absl::string_view outside, absl::string_view inside,
                            bool is_ro = true);
 
+  // Adds bind-mounts for many files, each at its own path. Prefer this over
+  // repeated AddFile() calls when mapping thousands of files, as the mount
+  // tree is built in a single pass.
+  //
+  // Calling this function will enable use of namespaces.
+  PolicyBuilder& AddFiles(absl::Span<const std::string> paths,
+                          bool is_ro = true);
+
   // Best-effort function that adds the libraries and linker required by a
   // binary.
   //
@@ -163,6 +163,12 @@ TEST(PolicyBuilderTest, CanBypassPtrace) {
   EXPECT_THAT(builder.TryBuild(), Not(IsOk()));
 }
 
+TEST(PolicyBuilderTest, AddFilesRejectsProcSelf) {
+  PolicyBuilder builder;
+  builder.AddFiles({"/etc/hostname", "/proc/self/status"});
+  EXPECT_THAT(builder.TryBuild(), StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
 TEST(PolicyBuilderTest, AddPolicyOnSyscallsNoEmptyList) {
   PolicyBuilder builder;
   builder.AddPolicyOnSyscalls({}, {ALLOW});
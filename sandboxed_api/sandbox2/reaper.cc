@@ -0,0 +1,98 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/reaper.h"
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/synchronization/mutex.h"
+#include "sandboxed_api/sandbox2/result.h"
+#include "sandboxed_api/sandbox2/sandbox2.h"
+
+namespace sandbox2 {
+
+Reaper::Reaper() : thread_(&Reaper::Run, this) {}
+
+Reaper::~Reaper() {
+  {
+    absl::MutexLock lock(&mutex_);
+    shutdown_ = true;
+  }
+  thread_.join();
+}
+
+Reaper& Reaper::Default() {
+  static Reaper* reaper = new Reaper();
+  return *reaper;
+}
+
+void Reaper::Reap(std::unique_ptr<Sandbox2> sandbox, bool kill,
+                  DoneCallback done) {
+  absl::MutexLock lock(&mutex_);
+  queue_.push_back({std::move(sandbox), kill, std::move(done)});
+  ++pending_;
+}
+
+void Reaper::Flush() {
+  absl::MutexLock lock(&mutex_);
+  mutex_.Await(absl::Condition(
+      +[](size_t* pending) { return *pending == 0; }, &pending_));
+}
+
+size_t Reaper::pending() const {
+  absl::MutexLock lock(&mutex_);
+  return pending_;
+}
+
+void Reaper::Run() {
+  for (;;) {
+    std::vector<Entry> batch;
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.Await(absl::Condition(
+          +[](Reaper* r) ABSL_EXCLUSIVE_LOCKS_REQUIRED(r->mutex_) {
+            return !r->queue_.empty() || r->shutdown_;
+          },
+          this));
+      if (queue_.empty()) {
+        return;
+      }
+      std::swap(batch, queue_);
+    }
+    // Killing only notifies the monitor, so issue all requests before waiting
+    // for any of the sandboxes.
+    for (Entry& entry : batch) {
+      if (entry.kill && !entry.sandbox->IsTerminated()) {
+        entry.sandbox->Kill();
+      }
+    }
+    for (Entry& entry : batch) {
+      Result result = entry.sandbox->AwaitResult();
+      VLOG(2) << "Reaped sandbox: " << result.ToString();
+      // Joins the monitor, so destroy the sandbox before reporting it done.
+      entry.sandbox.reset();
+      if (entry.done) {
+        entry.done(result);
+      }
+    }
+    absl::MutexLock lock(&mutex_);
+    pending_ -= batch.size();
+  }
+}
+
+}  // namespace sandbox2
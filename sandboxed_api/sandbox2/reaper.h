@@ -0,0 +1,89 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The sandbox2::Reaper class tears down sandboxes in the background.
+
+#ifndef SANDBOXED_API_SANDBOX2_REAPER_H_
+#define SANDBOXED_API_SANDBOX2_REAPER_H_
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "sandboxed_api/sandbox2/result.h"
+#include "sandboxed_api/sandbox2/sandbox2.h"
+
+namespace sandbox2 {
+
+// Reaper takes ownership of running sandboxes, terminates them and collects
+// their results on a background thread, so that callers do not block for the
+// duration of the exit and reap.
+//
+// Sandboxes are processed in batches: the kill requests for all sandboxes
+// handed over since the last batch are issued first, then the results are
+// collected. Tearing down many sandboxes therefore takes about as long as the
+// slowest of them, not the sum.
+class Reaper final {
+ public:
+  // Invoked on the reaper thread with the final result of a sandbox. Must not
+  // block for long, as it delays the processing of other sandboxes.
+  using DoneCallback = std::function<void(const Result&)>;
+
+  Reaper();
+  Reaper(const Reaper&) = delete;
+  Reaper& operator=(const Reaper&) = delete;
+
+  // Reaps all remaining sandboxes before returning.
+  ~Reaper();
+
+  // Returns the process-wide reaper instance.
+  static Reaper& Default();
+
+  // Hands over a launched sandbox. If kill is true, the sandboxee is killed,
+  // otherwise the reaper only waits for it to finish (e.g. after a graceful
+  // exit has been requested and a walltime limit was set). done, if set, is
+  // invoked with the result once the sandbox has been reaped.
+  void Reap(std::unique_ptr<Sandbox2> sandbox, bool kill = true,
+            DoneCallback done = nullptr);
+
+  // Blocks until all sandboxes handed over so far have been reaped.
+  void Flush();
+
+  // Returns the number of sandboxes that have not been reaped yet.
+  size_t pending() const;
+
+ private:
+  struct Entry {
+    std::unique_ptr<Sandbox2> sandbox;
+    bool kill;
+    DoneCallback done;
+  };
+
+  void Run();
+
+  mutable absl::Mutex mutex_;
+  std::vector<Entry> queue_ ABSL_GUARDED_BY(mutex_);
+  // Sandboxes in queue_ plus the ones of the batch being processed.
+  size_t pending_ ABSL_GUARDED_BY(mutex_) = 0;
+  bool shutdown_ ABSL_GUARDED_BY(mutex_) = false;
+  std::thread thread_;
+};
+
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_REAPER_H_
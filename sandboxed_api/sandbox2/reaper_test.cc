@@ -0,0 +1,119 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/reaper.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox2/executor.h"
+#include "sandboxed_api/sandbox2/policy.h"
+#include "sandboxed_api/sandbox2/result.h"
+#include "sandboxed_api/sandbox2/sandbox2.h"
+#include "sandboxed_api/testing.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sandbox2 {
+namespace {
+
+using ::sapi::CreateDefaultPermissiveTestPolicy;
+using ::sapi::GetTestSourcePath;
+using ::testing::Eq;
+using ::testing::Lt;
+
+std::unique_ptr<Sandbox2> StartSleeper() {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/sleep");
+  std::vector<std::string> args = {path};
+  auto sandbox = std::make_unique<Sandbox2>(
+      std::make_unique<Executor>(path, args),
+      CreateDefaultPermissiveTestPolicy(path).BuildOrDie());
+  EXPECT_TRUE(sandbox->RunAsync());
+  return sandbox;
+}
+
+TEST(ReaperTest, KillsAndReportsResult) {
+  Reaper reaper;
+  Result result;
+  reaper.Reap(StartSleeper(), /*kill=*/true,
+              [&result](const Result& r) { result = r; });
+  reaper.Flush();
+  EXPECT_THAT(reaper.pending(), Eq(0));
+  EXPECT_THAT(result.final_status(), Eq(Result::EXTERNAL_KILL));
+}
+
+TEST(ReaperTest, WaitsWithoutKilling) {
+  Reaper reaper;
+  std::unique_ptr<Sandbox2> sandbox = StartSleeper();
+  sandbox->set_walltime_limit(absl::Milliseconds(100));
+  Result result;
+  reaper.Reap(std::move(sandbox), /*kill=*/false,
+              [&result](const Result& r) { result = r; });
+  reaper.Flush();
+  EXPECT_THAT(result.final_status(), Eq(Result::TIMEOUT));
+}
+
+// The sleeper runs for 10 seconds, so reaping sequentially without killing
+// first would take far longer than the bound below.
+TEST(ReaperTest, ReapsBatchConcurrently) {
+  constexpr int kNumSandboxes = 20;
+  std::vector<std::unique_ptr<Sandbox2>> sandboxes;
+  for (int i = 0; i < kNumSandboxes; ++i) {
+    sandboxes.push_back(StartSleeper());
+  }
+  Reaper reaper;
+  std::atomic<int> killed = 0;
+  const absl::Time start = absl::Now();
+  for (auto& sandbox : sandboxes) {
+    reaper.Reap(std::move(sandbox), /*kill=*/true, [&killed](const Result& r) {
+      if (r.final_status() == Result::EXTERNAL_KILL) {
+        ++killed;
+      }
+    });
+  }
+  reaper.Flush();
+  EXPECT_THAT(absl::Now() - start, Lt(absl::Seconds(5)));
+  EXPECT_THAT(killed.load(), Eq(kNumSandboxes));
+}
+
+// Measures the time the caller spends handing sandboxes over to the reaper
+// versus tearing them down synchronously. The argument selects the reaper.
+void BenchmarkTeardown(benchmark::State& state) {
+  const bool use_reaper = state.range(0) != 0;
+  Reaper reaper;
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::unique_ptr<Sandbox2> sandbox = StartSleeper();
+    state.ResumeTiming();
+    if (use_reaper) {
+      reaper.Reap(std::move(sandbox));
+    } else {
+      sandbox->Kill();
+      sandbox->AwaitResult().IgnoreResult();
+      sandbox.reset();
+    }
+  }
+  reaper.Flush();
+}
+BENCHMARK(BenchmarkTeardown)->ArgName("reaper")->Arg(0)->Arg(1);
+
+}  // namespace
+}  // namespace sandbox2
@@ -19,11 +19,14 @@
 #include <sys/resource.h>
 
 #include <cstdlib>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "absl/base/call_once.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
@@ -37,6 +40,7 @@ Result& Result::operator=(const Result& other) {
   final_status_ = other.final_status_;
   reason_code_ = other.reason_code_;
   stack_trace_ = other.stack_trace_;
+  deferred_stack_trace_ = other.deferred_stack_trace_;
   if (other.regs_) {
     regs_ = std::make_unique<Regs>(*other.regs_);
   } else {
@@ -51,11 +55,31 @@ Result& Result::operator=(const Result& other) {
   proc_maps_ = other.proc_maps_;
   rusage_monitor_ = other.rusage_monitor_;
   rusage_sandboxee_ = other.rusage_sandboxee_;
+  fork_latency_ = other.fork_latency_;
   return *this;
 }
 
+void Result::set_stack_trace_fn(
+    std::function<std::vector<std::string>()> fn) {
+  stack_trace_.clear();
+  deferred_stack_trace_ = std::make_shared<DeferredStackTrace>();
+  deferred_stack_trace_->fn = std::move(fn);
+}
+
+const std::vector<std::string>& Result::stack_trace() const {
+  if (!deferred_stack_trace_) {
+    return stack_trace_;
+  }
+  DeferredStackTrace& deferred = *deferred_stack_trace_;
+  absl::call_once(deferred.once, [&deferred] {
+    deferred.value = deferred.fn();
+    deferred.fn = nullptr;
+  });
+  return deferred.value;
+}
+
 std::string Result::GetStackTrace() const {
-  return absl::StrJoin(stack_trace_, " ");
+  return absl::StrJoin(stack_trace(), " ");
 }
 
 absl::Status Result::ToStatus() const {
@@ -209,6 +233,8 @@ std::string Result::ReasonCodeEnumToString(ReasonCodeEnum value) {
       return "VIOLATION_ARCH";
     case sandbox2::Result::VIOLATION_NETWORK:
       return "VIOLATION_NETWORK";
+    case sandbox2::Result::FAILED_ADMISSION:
+      return "FAILED_ADMISSION";
   }
   return absl::StrCat("UNKNOWN: ", value);
 }
@@ -21,13 +21,16 @@
 #include <sys/resource.h>
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "absl/base/call_once.h"
 #include "absl/status/status.h"
+#include "absl/time/time.h"
 #include "sandboxed_api/config.h"
 #include "sandboxed_api/sandbox2/regs.h"
 #include "sandboxed_api/sandbox2/syscall.h"
@@ -90,6 +93,10 @@ class Result {
     VIOLATION_ARCH,
     VIOLATION_NETWORK = 0x10000000,  // TODO(eternalred): temporary value, needs
                                      // to be big until it's fixed
+
+    // Codes used by status=`SETUP_ERROR`, added after the ones above so that
+    // their values stay unchanged:
+    FAILED_ADMISSION = 0x10000001,
   };
 
   Result() = default;
@@ -116,8 +123,14 @@ class Result {
   // zombie.
   void set_stack_trace(std::vector<std::string> value) {
     stack_trace_ = std::move(value);
+    deferred_stack_trace_.reset();
   }
 
+  // Sets a function producing the stack trace, which is run on the first call
+  // to stack_trace(). Used to unwind from a snapshot after the sandboxee was
+  // torn down, keeping the unwinding off the monitor's critical path.
+  void set_stack_trace_fn(std::function<std::vector<std::string>()> fn);
+
   void SetRegs(std::unique_ptr<Regs> regs) { regs_ = std::move(regs); }
 
   void SetSyscall(std::unique_ptr<Syscall> syscall) {
@@ -142,7 +155,7 @@ class Result {
     return syscall_ ? syscall_->arch() : sapi::cpu::kUnknown;
   }
 
-  const std::vector<std::string>& stack_trace() const { return stack_trace_; }
+  const std::vector<std::string>& stack_trace() const;
 
   // Returns the stack trace as a space-delimited string.
   std::string GetStackTrace() const;
@@ -183,6 +196,14 @@ class Result {
 
   void SetRUsageSandboxee(rusage usage) { rusage_sandboxee_ = usage; }
 
+  // Time the forkserver spent forking the sandboxee, zero if it was not
+  // started.
+  absl::Duration GetForkLatency() const { return fork_latency_; }
+
+  void SetForkLatency(absl::Duration fork_latency) {
+    fork_latency_ = fork_latency;
+  }
+
  private:
   // Final execution status - see 'StatusEnum' for details.
   StatusEnum final_status_ = UNSET;
@@ -195,6 +216,14 @@ class Result {
   // Might contain stack-trace of the process, especially if it failed with
   // syscall violation, or was terminated by a signal.
   std::vector<std::string> stack_trace_;
+  // Stack trace computed on first access. Shared between copies, so that the
+  // unwinding is only done once.
+  struct DeferredStackTrace {
+    absl::once_flag once;
+    std::function<std::vector<std::string>()> fn;
+    std::vector<std::string> value;
+  };
+  std::shared_ptr<DeferredStackTrace> deferred_stack_trace_;
   // Might contain the register values of the process, similar to the stack.
   // trace
   std::unique_ptr<Regs> regs_;
@@ -211,6 +240,8 @@ class Result {
   rusage rusage_monitor_;
   // Final resource usage for the sandboxee process, only for unotify monitor.
   std::optional<rusage> rusage_sandboxee_;
+  // Time the forkserver spent forking the sandboxee.
+  absl::Duration fork_latency_ = absl::ZeroDuration();
 };
 
 }  // namespace sandbox2
@@ -109,6 +109,10 @@ class Sandbox2 final {
     return executor_ != nullptr ? executor_->ipc()->comms() : nullptr;
   }
 
+  // Uses seccomp user notifications instead of ptrace to monitor the
+  // sandboxee. Traced syscalls are reported via Notify::EventSyscallTrace()
+  // and allowed with SECCOMP_USER_NOTIF_FLAG_CONTINUE (Linux 5.5 or later).
+  // Notify::TraceAction::kInspectAfterReturn is treated like kAllow.
   absl::Status EnableUnotifyMonitor();
 
  private:
@@ -25,6 +25,7 @@
 #include <utility>
 #include <vector>
 
+#include "benchmark/benchmark.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/status/status.h"
@@ -195,6 +196,22 @@ TEST_P(Sandbox2Test, SandboxeeNotKilledWhenStartingThreadFinishes) {
   EXPECT_EQ(result.final_status(), Result::OK);
 }
 
+// Tests that the time spent forking the sandboxee is reported.
+TEST_P(Sandbox2Test, ReportsForkLatency) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/minimal");
+  auto executor =
+      std::make_unique<Executor>(path, std::vector<std::string>{path});
+
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            CreateDefaultTestPolicy(path).TryBuild());
+  Sandbox2 sandbox(std::move(executor), std::move(policy));
+  ASSERT_THAT(SetUpSandbox(&sandbox), IsOk());
+  Result result = sandbox.Run();
+  ASSERT_EQ(result.final_status(), Result::OK);
+  EXPECT_GT(result.GetForkLatency(), absl::ZeroDuration());
+  EXPECT_LT(result.GetForkLatency(), absl::Seconds(10));
+}
+
 TEST(StarvationTest, MonitorIsNotStarvedByTheSandboxee) {
   const std::string path = GetTestSourcePath("sandbox2/testcases/starve");
 
@@ -215,11 +232,46 @@ TEST(StarvationTest, MonitorIsNotStarvedByTheSandboxee) {
   EXPECT_THAT(elapsed, Lt(absl::Seconds(10)));
 }
 
+// Tests that a sandboxee creating many threads runs to completion.
+TEST_P(Sandbox2Test, SpawnThreads) {
+  const std::string path =
+      GetTestSourcePath("sandbox2/testcases/spawn_threads");
+  std::vector<std::string> args = {path, "100"};
+  auto executor = std::make_unique<Executor>(path, args);
+
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            CreateDefaultTestPolicy(path).TryBuild());
+  Sandbox2 sandbox(std::move(executor), std::move(policy));
+  ASSERT_THAT(SetUpSandbox(&sandbox), IsOk());
+  auto result = sandbox.Run();
+
+  EXPECT_THAT(result.final_status(), Eq(Result::OK));
+  EXPECT_THAT(result.reason_code(), Eq(EXIT_SUCCESS));
+}
+
 INSTANTIATE_TEST_SUITE_P(Sandbox2, Sandbox2Test, ::testing::Values(false, true),
                          [](const ::testing::TestParamInfo<bool>& info) {
                            return info.param ? "UnotifyMonitor"
                                              : "PtraceMonitor";
                          });
 
+// Measures thread creation throughput under the ptrace monitor, where every
+// new thread is auto-attached.
+void BenchmarkThreadCreation(benchmark::State& state) {
+  const std::string path =
+      GetTestSourcePath("sandbox2/testcases/spawn_threads");
+  const int64_t num_threads = state.range(0);
+  std::vector<std::string> args = {path, absl::StrCat(num_threads)};
+  for (auto _ : state) {
+    SAPI_ASSERT_OK_AND_ASSIGN(
+        auto policy, CreateDefaultPermissiveTestPolicy(path).TryBuild());
+    Sandbox2 sandbox(std::make_unique<Executor>(path, args), std::move(policy));
+    auto result = sandbox.Run();
+    ASSERT_THAT(result.final_status(), Eq(Result::OK));
+  }
+  state.SetItemsProcessed(state.iterations() * num_threads);
+}
+BENCHMARK(BenchmarkThreadCreation)->Arg(100)->Arg(1000);
+
 }  // namespace
 }  // namespace sandbox2
@@ -0,0 +1,169 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/spawn_governor.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+
+#include "absl/flags/flag.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+ABSL_FLAG(int, sandbox2_max_concurrent_spawns, 0,
+          "Maximum number of sandboxees being set up at the same time, 0 for "
+          "no limit");
+
+namespace sandbox2 {
+
+SpawnGovernor::Permit& SpawnGovernor::Permit::operator=(Permit&& other) {
+  if (this != &other) {
+    Release();
+    governor_ = std::exchange(other.governor_, nullptr);
+    admitted_ = other.admitted_;
+  }
+  return *this;
+}
+
+void SpawnGovernor::Permit::Release() {
+  if (governor_ != nullptr) {
+    std::exchange(governor_, nullptr)->Release(absl::Now() - admitted_);
+  }
+}
+
+SpawnGovernor::SpawnGovernor(const Options& options) : options_(options) {}
+
+SpawnGovernor& SpawnGovernor::Default() {
+  static SpawnGovernor* governor = [] {
+    Options options;
+    options.max_concurrent_spawns =
+        absl::GetFlag(FLAGS_sandbox2_max_concurrent_spawns);
+    return new SpawnGovernor(options);
+  }();
+  return *governor;
+}
+
+void SpawnGovernor::SetOptions(const Options& options) {
+  absl::MutexLock lock(&mutex_);
+  options_ = options;
+  AdmitWaitersLocked();
+}
+
+absl::StatusOr<SpawnGovernor::Permit> SpawnGovernor::Acquire(
+    Priority priority, absl::Time deadline) {
+  absl::MutexLock lock(&mutex_);
+  const absl::Time now = absl::Now();
+  if (deadline < now) {
+    ++stats_.rejected;
+    return absl::DeadlineExceededError("Spawn deadline already passed");
+  }
+  if (HasCapacity() && WaitersAhead(priority) == 0) {
+    ++stats_.in_progress;
+    ++stats_.admitted;
+    return Permit(this, now);
+  }
+  if (stats_.queued >= options_.max_queue_length) {
+    ++stats_.rejected;
+    return absl::ResourceExhaustedError(absl::StrCat(
+        "Spawn queue is full with ", stats_.queued, " waiting requests"));
+  }
+  if (const absl::Duration wait = EstimatedWaitLocked(priority);
+      now + wait > deadline) {
+    ++stats_.rejected;
+    return absl::ResourceExhaustedError(
+        absl::StrCat("Estimated spawn wait of ", absl::FormatDuration(wait),
+                     " exceeds the deadline"));
+  }
+
+  Waiter waiter;
+  Queue& queue = queues_[static_cast<int>(priority)];
+  auto it = queue.insert(queue.end(), &waiter);
+  ++stats_.queued;
+  mutex_.AwaitWithDeadline(absl::Condition(&waiter.admitted), deadline);
+  if (!waiter.admitted) {
+    queue.erase(it);
+    --stats_.queued;
+    ++stats_.timed_out;
+    return absl::DeadlineExceededError(
+        "Spawn was not admitted before the deadline");
+  }
+  // AdmitWaitersLocked() already dequeued the waiter and counted it.
+  return Permit(this, absl::Now());
+}
+
+absl::Duration SpawnGovernor::EstimatedWait(Priority priority) const {
+  absl::MutexLock lock(&mutex_);
+  return EstimatedWaitLocked(priority);
+}
+
+SpawnGovernor::Stats SpawnGovernor::GetStats() const {
+  absl::MutexLock lock(&mutex_);
+  return stats_;
+}
+
+bool SpawnGovernor::HasCapacity() const {
+  return options_.max_concurrent_spawns <= 0 ||
+         stats_.in_progress < options_.max_concurrent_spawns;
+}
+
+int SpawnGovernor::WaitersAhead(Priority priority) const {
+  int ahead = 0;
+  for (size_t i = static_cast<size_t>(priority); i < queues_.size(); ++i) {
+    ahead += queues_[i].size();
+  }
+  return ahead;
+}
+
+absl::Duration SpawnGovernor::EstimatedWaitLocked(Priority priority) const {
+  const int ahead = WaitersAhead(priority);
+  if (HasCapacity() && ahead == 0) {
+    return absl::ZeroDuration();
+  }
+  // With the limit reached, one spawn completes every latency / limit on
+  // average, and the request is admitted after all waiters ahead of it plus
+  // one more spawn have completed.
+  return stats_.average_latency * (ahead + 1) /
+         std::max(options_.max_concurrent_spawns, 1);
+}
+
+void SpawnGovernor::AdmitWaitersLocked() {
+  for (auto queue = queues_.rbegin(); queue != queues_.rend(); ++queue) {
+    while (!queue->empty() && HasCapacity()) {
+      queue->front()->admitted = true;
+      queue->pop_front();
+      --stats_.queued;
+      ++stats_.in_progress;
+      ++stats_.admitted;
+    }
+  }
+}
+
+void SpawnGovernor::Release(absl::Duration latency) {
+  absl::MutexLock lock(&mutex_);
+  --stats_.in_progress;
+  if (stats_.average_latency == absl::ZeroDuration()) {
+    stats_.average_latency = latency;
+  } else {
+    stats_.average_latency += (latency - stats_.average_latency) *
+                              options_.latency_smoothing;
+  }
+  AdmitWaitersLocked();
+}
+
+}  // namespace sandbox2
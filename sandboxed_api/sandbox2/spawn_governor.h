@@ -0,0 +1,143 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The sandbox2::SpawnGovernor class limits the number of concurrent sandboxee
+// spawns.
+
+#ifndef SANDBOXED_API_SANDBOX2_SPAWN_GOVERNOR_H_
+#define SANDBOXED_API_SANDBOX2_SPAWN_GOVERNOR_H_
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace sandbox2 {
+
+// SpawnGovernor admits sandboxee spawns up to a concurrency limit and queues
+// the rest, ordered by priority and then by arrival. When many threads start
+// sandboxes at once, this keeps the forkserver, namespace creation in the
+// kernel and monitor set-up from being saturated, which would otherwise make
+// every spawn slow.
+//
+// Requests carry a deadline. Requests that cannot be admitted in time fail
+// instead of piling up: right away if the queue is full or the wait estimated
+// from the measured spawn latency exceeds the deadline, and otherwise once the
+// deadline passes in the queue.
+//
+// Sandbox2 acquires a permit from Default() for the set-up phase of every
+// sandboxee, using the priority and deadline set on its Executor. A rejected
+// spawn ends with Result::SETUP_ERROR and Result::FAILED_ADMISSION.
+class SpawnGovernor final {
+ public:
+  enum class Priority { kLow = 0, kNormal, kHigh };
+
+  struct Options {
+    // Maximum number of spawns in progress, 0 for no limit.
+    int max_concurrent_spawns = 0;
+    // Maximum number of requests waiting for admission.
+    int max_queue_length = 1024;
+    // Weight of a new measurement in the moving average of spawn latency.
+    double latency_smoothing = 0.2;
+  };
+
+  struct Stats {
+    int in_progress = 0;
+    int queued = 0;
+    int64_t admitted = 0;
+    int64_t rejected = 0;
+    int64_t timed_out = 0;
+    // Moving average of the time from admission to release, zero if no spawn
+    // completed yet.
+    absl::Duration average_latency;
+  };
+
+  // Admission to spawn one sandboxee. Releasing the permit, explicitly or on
+  // destruction, records the spawn latency and admits the next request.
+  class Permit {
+   public:
+    Permit(Permit&& other) { *this = std::move(other); }
+    Permit& operator=(Permit&& other);
+    ~Permit() { Release(); }
+
+    void Release();
+
+   private:
+    friend class SpawnGovernor;
+
+    Permit(SpawnGovernor* governor, absl::Time admitted)
+        : governor_(governor), admitted_(admitted) {}
+
+    SpawnGovernor* governor_ = nullptr;
+    absl::Time admitted_;
+  };
+
+  SpawnGovernor() : SpawnGovernor(Options()) {}
+  explicit SpawnGovernor(const Options& options);
+  SpawnGovernor(const SpawnGovernor&) = delete;
+  SpawnGovernor& operator=(const SpawnGovernor&) = delete;
+
+  // Returns the process-wide governor used by Sandbox2. The concurrency limit
+  // is initially taken from --sandbox2_max_concurrent_spawns.
+  static SpawnGovernor& Default();
+
+  // Changes the options. Raising the limit admits waiting requests.
+  void SetOptions(const Options& options);
+
+  // Blocks until the request is admitted. Fails with ResourceExhaustedError if
+  // the queue is full or the request is not expected to be admitted by the
+  // deadline, and with DeadlineExceededError if the deadline passes while
+  // waiting.
+  absl::StatusOr<Permit> Acquire(Priority priority = Priority::kNormal,
+                                 absl::Time deadline = absl::InfiniteFuture());
+
+  // Returns the estimated time until a new request with the given priority
+  // would be admitted. Callers can use this to shed load before even trying
+  // to spawn.
+  absl::Duration EstimatedWait(Priority priority = Priority::kNormal) const;
+
+  Stats GetStats() const;
+
+ private:
+  struct Waiter {
+    bool admitted = false;
+  };
+  using Queue = std::list<Waiter*>;
+
+  bool HasCapacity() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Returns the number of waiters that would be admitted before a new request
+  // with the given priority.
+  int WaitersAhead(Priority priority) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  absl::Duration EstimatedWaitLocked(Priority priority) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Admits waiters in priority order while there is capacity.
+  void AdmitWaitersLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void Release(absl::Duration latency);
+
+  mutable absl::Mutex mutex_;
+  Options options_ ABSL_GUARDED_BY(mutex_);
+  // Indexed by Priority.
+  std::array<Queue, 3> queues_ ABSL_GUARDED_BY(mutex_);
+  Stats stats_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_SPAWN_GOVERNOR_H_
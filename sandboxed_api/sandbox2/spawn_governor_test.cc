@@ -0,0 +1,231 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/spawn_governor.h"
+
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/cleanup/cleanup.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox2/executor.h"
+#include "sandboxed_api/sandbox2/result.h"
+#include "sandboxed_api/sandbox2/sandbox2.h"
+#include "sandboxed_api/testing.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sandbox2 {
+namespace {
+
+using ::sapi::CreateDefaultPermissiveTestPolicy;
+using ::sapi::GetTestSourcePath;
+using ::sapi::IsOk;
+using ::sapi::StatusIs;
+using ::testing::Contains;
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::Gt;
+using ::testing::StartsWith;
+
+using Priority = SpawnGovernor::Priority;
+
+SpawnGovernor::Options LimitTo(int max_concurrent_spawns) {
+  SpawnGovernor::Options options;
+  options.max_concurrent_spawns = max_concurrent_spawns;
+  return options;
+}
+
+void WaitForQueued(const SpawnGovernor& governor, int queued) {
+  while (governor.GetStats().queued != queued) {
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+}
+
+TEST(SpawnGovernorTest, UnlimitedByDefault) {
+  SpawnGovernor governor;
+  std::vector<SpawnGovernor::Permit> permits;
+  for (int i = 0; i < 100; ++i) {
+    SAPI_ASSERT_OK_AND_ASSIGN(SpawnGovernor::Permit permit,
+                              governor.Acquire());
+    permits.push_back(std::move(permit));
+  }
+  EXPECT_THAT(governor.GetStats().in_progress, Eq(100));
+  permits.clear();
+  EXPECT_THAT(governor.GetStats().in_progress, Eq(0));
+  EXPECT_THAT(governor.GetStats().admitted, Eq(100));
+}
+
+TEST(SpawnGovernorTest, TimesOutAtLimit) {
+  SpawnGovernor governor(LimitTo(2));
+  SAPI_ASSERT_OK_AND_ASSIGN(SpawnGovernor::Permit first, governor.Acquire());
+  SAPI_ASSERT_OK_AND_ASSIGN(SpawnGovernor::Permit second, governor.Acquire());
+  EXPECT_THAT(governor.Acquire(Priority::kNormal,
+                               absl::Now() + absl::Milliseconds(50))
+                  .status(),
+              StatusIs(absl::StatusCode::kDeadlineExceeded));
+  SpawnGovernor::Stats stats = governor.GetStats();
+  EXPECT_THAT(stats.in_progress, Eq(2));
+  EXPECT_THAT(stats.queued, Eq(0));
+  EXPECT_THAT(stats.timed_out, Eq(1));
+}
+
+TEST(SpawnGovernorTest, RejectsWhenQueueIsFull) {
+  SpawnGovernor::Options options = LimitTo(1);
+  options.max_queue_length = 0;
+  SpawnGovernor governor(options);
+  SAPI_ASSERT_OK_AND_ASSIGN(SpawnGovernor::Permit permit, governor.Acquire());
+  EXPECT_THAT(governor.Acquire().status(),
+              StatusIs(absl::StatusCode::kResourceExhausted));
+  EXPECT_THAT(governor.Acquire(Priority::kHigh, absl::InfinitePast()).status(),
+              StatusIs(absl::StatusCode::kDeadlineExceeded));
+  EXPECT_THAT(governor.GetStats().rejected, Eq(2));
+}
+
+TEST(SpawnGovernorTest, ReleaseAdmitsWaiter) {
+  SpawnGovernor governor(LimitTo(1));
+  SAPI_ASSERT_OK_AND_ASSIGN(SpawnGovernor::Permit permit, governor.Acquire());
+  std::thread waiter([&governor] {
+    EXPECT_THAT(governor.Acquire().status(), IsOk());
+  });
+  WaitForQueued(governor, 1);
+  permit.Release();
+  waiter.join();
+  EXPECT_THAT(governor.GetStats().admitted, Eq(2));
+  EXPECT_THAT(governor.GetStats().in_progress, Eq(0));
+}
+
+TEST(SpawnGovernorTest, AdmitsByPriority) {
+  SpawnGovernor governor(LimitTo(1));
+  SAPI_ASSERT_OK_AND_ASSIGN(SpawnGovernor::Permit permit, governor.Acquire());
+
+  absl::Mutex mutex;
+  std::vector<Priority> order;
+  auto acquire = [&governor, &mutex, &order](Priority priority) {
+    absl::StatusOr<SpawnGovernor::Permit> permit = governor.Acquire(priority);
+    ASSERT_THAT(permit.status(), IsOk());
+    absl::MutexLock lock(&mutex);
+    order.push_back(priority);
+  };
+  std::thread low(acquire, Priority::kLow);
+  WaitForQueued(governor, 1);
+  std::thread normal(acquire, Priority::kNormal);
+  WaitForQueued(governor, 2);
+  std::thread high(acquire, Priority::kHigh);
+  WaitForQueued(governor, 3);
+
+  permit.Release();
+  low.join();
+  normal.join();
+  high.join();
+  EXPECT_THAT(order,
+              ElementsAre(Priority::kHigh, Priority::kNormal, Priority::kLow));
+}
+
+TEST(SpawnGovernorTest, RaisingLimitAdmitsWaiters) {
+  SpawnGovernor governor(LimitTo(1));
+  SAPI_ASSERT_OK_AND_ASSIGN(SpawnGovernor::Permit permit, governor.Acquire());
+  std::thread waiter([&governor] {
+    EXPECT_THAT(governor.Acquire().status(), IsOk());
+  });
+  WaitForQueued(governor, 1);
+  governor.SetOptions(LimitTo(2));
+  waiter.join();
+}
+
+TEST(SpawnGovernorTest, RejectsEarlyBasedOnLatency) {
+  SpawnGovernor governor(LimitTo(1));
+  {
+    SAPI_ASSERT_OK_AND_ASSIGN(SpawnGovernor::Permit permit,
+                              governor.Acquire());
+    absl::SleepFor(absl::Milliseconds(200));
+  }
+  EXPECT_THAT(governor.GetStats().average_latency,
+              Gt(absl::Milliseconds(100)));
+  EXPECT_THAT(governor.EstimatedWait(), Eq(absl::ZeroDuration()));
+
+  SAPI_ASSERT_OK_AND_ASSIGN(SpawnGovernor::Permit permit, governor.Acquire());
+  EXPECT_THAT(governor.EstimatedWait(), Gt(absl::Milliseconds(100)));
+  EXPECT_THAT(governor.Acquire(Priority::kNormal,
+                               absl::Now() + absl::Milliseconds(10))
+                  .status(),
+              StatusIs(absl::StatusCode::kResourceExhausted));
+  // Rejected without waiting for the deadline.
+  EXPECT_THAT(governor.GetStats().timed_out, Eq(0));
+  EXPECT_THAT(governor.GetStats().rejected, Eq(1));
+}
+
+TEST(SpawnGovernorTest, SandboxFailsWithoutAdmission) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/minimal");
+  auto executor =
+      std::make_unique<Executor>(path, std::vector<std::string>{path});
+  executor->set_spawn_deadline(absl::InfinitePast());
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            CreateDefaultPermissiveTestPolicy(path).TryBuild());
+  Sandbox2 sandbox(std::move(executor), std::move(policy));
+  EXPECT_FALSE(sandbox.RunAsync());
+  Result result = sandbox.AwaitResult();
+  EXPECT_THAT(result.final_status(), Eq(Result::SETUP_ERROR));
+  EXPECT_THAT(result.reason_code(), Eq(Result::FAILED_ADMISSION));
+}
+
+TEST(SpawnGovernorTest, LimitsSpawnsNotRunningSandboxes) {
+  SpawnGovernor::Default().SetOptions(LimitTo(1));
+  absl::Cleanup restore = [] {
+    SpawnGovernor::Default().SetOptions(SpawnGovernor::Options());
+  };
+
+  // More sandboxees than the limit are running at the same time.
+  const std::string sleep = GetTestSourcePath("sandbox2/testcases/sleep");
+  std::vector<std::unique_ptr<Sandbox2>> sleepers;
+  for (int i = 0; i < 3; ++i) {
+    SAPI_ASSERT_OK_AND_ASSIGN(
+        auto policy, CreateDefaultPermissiveTestPolicy(sleep).TryBuild());
+    sleepers.push_back(std::make_unique<Sandbox2>(
+        std::make_unique<Executor>(sleep, std::vector<std::string>{sleep}),
+        std::move(policy)));
+    ASSERT_TRUE(sleepers.back()->RunAsync());
+  }
+  EXPECT_THAT(SpawnGovernor::Default().GetStats().in_progress, Eq(0));
+
+  // The stack trace sandbox is admitted while the others are still running.
+  const std::string symbolize =
+      GetTestSourcePath("sandbox2/testcases/symbolize");
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      auto policy, CreateDefaultPermissiveTestPolicy(symbolize).TryBuild());
+  Sandbox2 violating(
+      std::make_unique<Executor>(
+          symbolize, std::vector<std::string>{symbolize, "2", "1"}),
+      std::move(policy));
+  Result result = violating.Run();
+  EXPECT_THAT(result.final_status(), Eq(Result::VIOLATION));
+  EXPECT_THAT(result.stack_trace(), Contains(StartsWith("ViolatePolicy")));
+
+  for (auto& sandbox : sleepers) {
+    sandbox->Kill();
+    EXPECT_THAT(sandbox->AwaitResult().final_status(),
+                Eq(Result::EXTERNAL_KILL));
+  }
+}
+
+}  // namespace
+}  // namespace sandbox2
@@ -21,7 +21,12 @@
 #include <syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -49,6 +54,7 @@
 #include "sandboxed_api/sandbox2/result.h"
 #include "sandboxed_api/sandbox2/unwind/unwind.h"
 #include "sandboxed_api/sandbox2/unwind/unwind.pb.h"
+#include "sandboxed_api/sandbox2/util.h"
 #include "sandboxed_api/util/fileops.h"
 #include "sandboxed_api/util/path.h"
 #include "sandboxed_api/util/raw_logging.h"
@@ -94,16 +100,34 @@ class StackTracePeer {
   static absl::StatusOr<std::unique_ptr<Policy>> GetPolicy(
       pid_t target_pid, const std::string& maps_file,
       const std::string& app_path, const std::string& exe_path,
-      const Namespace* ns, bool uses_custom_forkserver);
+      const Mounts* mounts, bool uses_custom_forkserver);
 
-  static absl::StatusOr<std::vector<std::string>> LaunchLibunwindSandbox(
+  // Captures the state needed for unwinding. If stack_size is unset, the
+  // unwinder reads the live process memory instead of a copy of the stack.
+  static absl::StatusOr<std::unique_ptr<StackSnapshot>> CaptureSnapshot(
       const Regs* regs, const Namespace* ns, bool uses_custom_forkserver,
-      int recursion_depth);
+      int recursion_depth, std::optional<size_t> stack_size);
+
+  static absl::StatusOr<std::vector<std::string>> LaunchLibunwindSandbox(
+      const StackSnapshot& snapshot);
+
+ private:
+  static uintptr_t GetStackPointer(const Regs& regs);
+
+  // Copies up to stack_size bytes from the top of the stack into a memfd, at
+  // the same offsets as their addresses.
+  static absl::Status CopyStack(StackSnapshot& snapshot, size_t stack_size);
 };
 
+StackSnapshot::~StackSnapshot() {
+  if (!temp_dir_.empty()) {
+    file_util::fileops::DeleteRecursively(temp_dir_);
+  }
+}
+
 absl::StatusOr<std::unique_ptr<Policy>> StackTracePeer::GetPolicy(
     pid_t target_pid, const std::string& maps_file, const std::string& app_path,
-    const std::string& exe_path, const Namespace* ns,
+    const std::string& exe_path, const Mounts* mounts,
     bool uses_custom_forkserver) {
   PolicyBuilder builder;
   if (uses_custom_forkserver) {
@@ -127,11 +151,11 @@ absl::StatusOr<std::unique_ptr<Policy>> StackTracePeer::GetPolicy(
     }
   } else {
     // Use the mounttree of the original executable.
-    CHECK(ns != nullptr);
-    Mounts mounts = ns->mounts();
-    mounts.Remove("/proc").IgnoreError();
-    mounts.Remove(app_path).IgnoreError();
-    builder.SetMounts(std::move(mounts));
+    CHECK(mounts != nullptr);
+    Mounts unwind_mounts = *mounts;
+    unwind_mounts.Remove("/proc").IgnoreError();
+    unwind_mounts.Remove(app_path).IgnoreError();
+    builder.SetMounts(std::move(unwind_mounts));
   }
   builder.AllowOpen()
       .AllowRead()
@@ -185,21 +209,80 @@ namespace internal {
 SandboxPeer::SpawnFn SandboxPeer::spawn_fn_ = nullptr;
 }  // namespace internal
 
-absl::StatusOr<std::vector<std::string>> StackTracePeer::LaunchLibunwindSandbox(
-    const Regs* regs, const Namespace* ns, bool uses_custom_forkserver,
-    int recursion_depth) {
-  const pid_t pid = regs->pid();
+uintptr_t StackTracePeer::GetStackPointer(const Regs& regs) {
+#if defined(SAPI_X86_64)
+  return regs.user_regs_.rsp;
+#elif defined(SAPI_PPC64_LE)
+  return regs.user_regs_.gpr[1];
+#elif defined(SAPI_ARM64)
+  return regs.user_regs_.sp;
+#elif defined(SAPI_ARM)
+  return regs.user_regs_.regs[13];
+#endif
+}
+
+absl::Status StackTracePeer::CopyStack(StackSnapshot& snapshot,
+                                       size_t stack_size) {
+  // Also copy the area below the stack pointer, which leaf functions may use
+  // (e.g. the x86-64 red zone).
+  constexpr uintptr_t kBelowStackPointer = 512;
+  constexpr size_t kPageSize = 4096;
 
-  sapi::file_util::fileops::FDCloser memory_fd(
+  const pid_t pid = snapshot.regs_.pid();
+  sapi::file_util::fileops::FDCloser process_memory(
       open(absl::StrCat("/proc/", pid, "/mem").c_str(), O_RDONLY));
-  if (memory_fd.get() == -1) {
+  if (process_memory.get() == -1) {
     return absl::InternalError("Opening sandboxee process memory failed");
   }
-  // Tell executor to use this special internal mode. Using `new` to access a
-  // non-public constructor.
-  auto executor = absl::WrapUnique(new Executor(pid, recursion_depth));
+  int memfd;
+  if (!util::CreateMemFd(&memfd, "stack_snapshot")) {
+    return absl::InternalError("Could not create memfd for the stack");
+  }
+  snapshot.memory_fd_ = sapi::file_util::fileops::FDCloser(memfd);
+
+  const uintptr_t sp = GetStackPointer(snapshot.regs_);
+  uintptr_t addr = sp > kBelowStackPointer ? sp - kBelowStackPointer : 0;
+  const uintptr_t end = sp + stack_size;
+  char page[kPageSize];
+  // Read page by page, the stack ends at the first unmapped address.
+  while (addr < end) {
+    const size_t len = std::min<size_t>(kPageSize - addr % kPageSize,
+                                        end - addr);
+    const ssize_t read = pread(process_memory.get(), page, len, addr);
+    if (read <= 0) {
+      break;
+    }
+    if (pwrite(memfd, page, read, addr) != read) {
+      return absl::ErrnoToStatus(errno, "Could not copy stack to memfd");
+    }
+    snapshot.stack_size_ += read;
+    addr += read;
+  }
+  return absl::OkStatus();
+}
 
-  executor->limits()->set_rlimit_cpu(10).set_walltime_limit(absl::Seconds(5));
+absl::StatusOr<std::unique_ptr<StackSnapshot>> StackTracePeer::CaptureSnapshot(
+    const Regs* regs, const Namespace* ns, bool uses_custom_forkserver,
+    int recursion_depth, std::optional<size_t> stack_size) {
+  const pid_t pid = regs->pid();
+  // Using `new` to access a non-public constructor.
+  auto snapshot = absl::WrapUnique(new StackSnapshot(*regs));
+  snapshot->uses_custom_forkserver_ = uses_custom_forkserver;
+  snapshot->recursion_depth_ = recursion_depth;
+  if (!uses_custom_forkserver) {
+    CHECK(ns != nullptr);
+    snapshot->mounts_ = ns->mounts();
+  }
+
+  if (stack_size.has_value()) {
+    SAPI_RETURN_IF_ERROR(CopyStack(*snapshot, *stack_size));
+  } else {
+    snapshot->memory_fd_ = sapi::file_util::fileops::FDCloser(
+        open(absl::StrCat("/proc/", pid, "/mem").c_str(), O_RDONLY));
+    if (snapshot->memory_fd_.get() == -1) {
+      return absl::InternalError("Opening sandboxee process memory failed");
+    }
+  }
 
   // Temporary directory used to provide files from /proc to the unwind sandbox.
   char unwind_temp_directory_template[] = "/tmp/.sandbox2_unwind_XXXXXX";
@@ -208,20 +291,14 @@ absl::StatusOr<std::vector<std::string>> StackTracePeer::LaunchLibunwindSandbox(
     return absl::InternalError(
         "Could not create temporary directory for unwinding");
   }
-  struct UnwindTempDirectoryCleanup {
-    ~UnwindTempDirectoryCleanup() {
-      file_util::fileops::DeleteRecursively(capture);
-    }
-    char* capture;
-  } cleanup{unwind_temp_directory};
+  snapshot->temp_dir_ = unwind_temp_directory;
 
   // Copy over important files from the /proc directory as we can't mount them.
-  const std::string unwind_temp_maps_path =
-      file::JoinPath(unwind_temp_directory, "maps");
+  snapshot->maps_path_ = file::JoinPath(unwind_temp_directory, "maps");
 
   if (!file_util::fileops::CopyFile(
           file::JoinPath("/proc", absl::StrCat(pid), "maps"),
-          unwind_temp_maps_path, 0400)) {
+          snapshot->maps_path_, 0400)) {
     return absl::InternalError("Could not copy maps file");
   }
 
@@ -229,13 +306,13 @@ absl::StatusOr<std::vector<std::string>> StackTracePeer::LaunchLibunwindSandbox(
   // app_path contains the path like it is also in /proc/pid/maps. It is
   // relative to the sandboxee's mount namespace. If it is not existing
   // (anymore) it will have a ' (deleted)' suffix.
-  std::string app_path;
+  std::string& app_path = snapshot->app_path_;
   std::string proc_pid_exe = file::JoinPath("/proc", absl::StrCat(pid), "exe");
   if (!file_util::fileops::ReadLinkAbsolute(proc_pid_exe, &app_path)) {
     return absl::InternalError("Could not obtain absolute path to the binary");
   }
 
-  std::string exe_path;
+  std::string& exe_path = snapshot->exe_path_;
   if (IsSameFile(app_path, proc_pid_exe)) {
     exe_path = app_path;
   } else {
@@ -256,13 +333,28 @@ absl::StatusOr<std::vector<std::string>> StackTracePeer::LaunchLibunwindSandbox(
   }
 
   VLOG(1) << "Resolved binary: " << app_path << " / " << exe_path;
+  return snapshot;
+}
+
+absl::StatusOr<std::vector<std::string>> StackTracePeer::LaunchLibunwindSandbox(
+    const StackSnapshot& snapshot) {
+  const pid_t pid = snapshot.regs_.pid();
+
+  // Tell executor to use this special internal mode. Using `new` to access a
+  // non-public constructor.
+  auto executor =
+      absl::WrapUnique(new Executor(pid, snapshot.recursion_depth_));
+
+  executor->limits()->set_rlimit_cpu(10).set_walltime_limit(absl::Seconds(5));
 
   // Add mappings for the binary (as they might not have been added due to the
   // forkserver).
   SAPI_ASSIGN_OR_RETURN(
       std::unique_ptr<Policy> policy,
-      StackTracePeer::GetPolicy(pid, unwind_temp_maps_path, app_path, exe_path,
-                                ns, uses_custom_forkserver));
+      StackTracePeer::GetPolicy(
+          pid, snapshot.maps_path_, snapshot.app_path_, snapshot.exe_path_,
+          snapshot.mounts_.has_value() ? &*snapshot.mounts_ : nullptr,
+          snapshot.uses_custom_forkserver_));
 
   VLOG(1) << "Running libunwind sandbox";
   auto sandbox =
@@ -271,8 +363,8 @@ absl::StatusOr<std::vector<std::string>> StackTracePeer::LaunchLibunwindSandbox(
 
   UnwindSetup msg;
   msg.set_pid(pid);
-  msg.set_regs(reinterpret_cast<const char*>(&regs->user_regs_),
-               sizeof(regs->user_regs_));
+  msg.set_regs(reinterpret_cast<const char*>(&snapshot.regs_.user_regs_),
+               sizeof(snapshot.regs_.user_regs_));
   msg.set_default_max_frames(kDefaultMaxFrames);
 
   absl::Cleanup kill_sandbox = [&sandbox]() {
@@ -284,7 +376,7 @@ absl::StatusOr<std::vector<std::string>> StackTracePeer::LaunchLibunwindSandbox(
   if (!comms->SendProtoBuf(msg)) {
     return absl::InternalError("Sending libunwind setup message failed");
   }
-  if (!comms->SendFD(memory_fd.get())) {
+  if (!comms->SendFD(snapshot.memory_fd_.get())) {
     return absl::InternalError("Sending sandboxee's memory fd failed");
   }
   absl::Status status;
@@ -337,8 +429,36 @@ absl::StatusOr<std::vector<std::string>> GetStackTrace(
     return UnsafeGetStackTrace(regs->pid());
   }
 
-  return StackTracePeer::LaunchLibunwindSandbox(
-      regs, ns, uses_custom_forkserver, recursion_depth);
+  SAPI_ASSIGN_OR_RETURN(
+      std::unique_ptr<StackSnapshot> snapshot,
+      StackTracePeer::CaptureSnapshot(regs, ns, uses_custom_forkserver,
+                                      recursion_depth, std::nullopt));
+  return StackTracePeer::LaunchLibunwindSandbox(*snapshot);
+}
+
+absl::StatusOr<std::unique_ptr<StackSnapshot>> CaptureStackSnapshot(
+    const Regs* regs, const Namespace* ns, bool uses_custom_forkserver,
+    int recursion_depth, size_t stack_size) {
+  if (absl::GetFlag(FLAGS_sandbox_disable_all_stack_traces)) {
+    return absl::UnavailableError("Stacktraces disabled");
+  }
+  if (!regs) {
+    return absl::InvalidArgumentError(
+        "Could not obtain stack snapshot, regs == nullptr");
+  }
+  // The non-sandboxed libunwind only works on the live process.
+  if (!absl::GetFlag(FLAGS_sandbox_libunwind_crash_handler) ||
+      sapi::sanitizers::IsAny()) {
+    return absl::FailedPreconditionError(
+        "Stack snapshots require the sandboxed libunwind");
+  }
+  return StackTracePeer::CaptureSnapshot(regs, ns, uses_custom_forkserver,
+                                         recursion_depth, stack_size);
+}
+
+absl::StatusOr<std::vector<std::string>> GetStackTrace(
+    const StackSnapshot& snapshot) {
+  return StackTracePeer::LaunchLibunwindSandbox(snapshot);
 }
 
 std::vector<std::string> CompactStackTrace(
@@ -21,6 +21,7 @@
 
 #include <cstddef>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -29,14 +30,17 @@
 #include "absl/status/statusor.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/sandbox2/executor.h"
+#include "sandboxed_api/sandbox2/mounts.h"
 #include "sandboxed_api/sandbox2/namespace.h"
 #include "sandboxed_api/sandbox2/policy.h"
 #include "sandboxed_api/sandbox2/regs.h"
 #include "sandboxed_api/sandbox2/result.h"
+#include "sandboxed_api/util/fileops.h"
 
 namespace sandbox2 {
 
 class Sandbox2;
+class StackTracePeer;
 class StackTraceTestPeer;
 
 namespace internal {
@@ -73,6 +77,56 @@ absl::StatusOr<std::vector<std::string>> GetStackTrace(
     const Regs* regs, const Namespace* ns, bool uses_custom_forkserver,
     int recursion_depth);
 
+// Default number of bytes at the top of the stack kept in a StackSnapshot.
+constexpr size_t kDefaultSnapshotStackSize = 128 << 10;
+
+// State of a stopped process that is needed to unwind its stack: registers,
+// the top of the stack and the memory mappings. Unlike GetStackTrace(), which
+// keeps the process stopped while a libunwind sandbox is started, taking a
+// snapshot only copies a few pages, so the process can be resumed or killed
+// right away.
+class StackSnapshot {
+ public:
+  StackSnapshot(const StackSnapshot&) = delete;
+  StackSnapshot& operator=(const StackSnapshot&) = delete;
+  ~StackSnapshot();
+
+  // Number of stack bytes captured, starting just below the stack pointer.
+  size_t stack_size() const { return stack_size_; }
+
+ private:
+  friend class StackTracePeer;
+
+  explicit StackSnapshot(const Regs& regs) : regs_(regs) {}
+
+  Regs regs_;
+  // Memory of the process, read at the process' addresses by the unwinder.
+  // Either /proc/pid/mem or a sparse memfd holding only the captured stack.
+  sapi::file_util::fileops::FDCloser memory_fd_;
+  // Holds copies of the files from /proc the unwinder needs.
+  std::string temp_dir_;
+  std::string maps_path_;
+  std::string app_path_;
+  std::string exe_path_;
+  // Mounts of the sandboxee, unset with a custom forkserver.
+  std::optional<Mounts> mounts_;
+  bool uses_custom_forkserver_ = false;
+  int recursion_depth_ = 0;
+  size_t stack_size_ = 0;
+};
+
+// Captures a StackSnapshot of the stopped process, keeping at most stack_size
+// bytes of its stack.
+absl::StatusOr<std::unique_ptr<StackSnapshot>> CaptureStackSnapshot(
+    const Regs* regs, const Namespace* ns, bool uses_custom_forkserver,
+    int recursion_depth, size_t stack_size = kDefaultSnapshotStackSize);
+
+// Returns the stack trace of a snapshot, one line per frame. The process does
+// not need to exist anymore. Frames outside of the captured part of the stack
+// are missing from the result.
+absl::StatusOr<std::vector<std::string>> GetStackTrace(
+    const StackSnapshot& snapshot);
+
 // Returns a stack trace that collapses duplicate stack frames and annotates
 // them with a repetition count.
 // Example:
@@ -44,6 +44,7 @@
 #include "sandboxed_api/util/status_matchers.h"
 
 ABSL_DECLARE_FLAG(bool, sandbox_libunwind_crash_handler);
+ABSL_DECLARE_FLAG(bool, sandbox2_deferred_stack_traces);
 
 namespace sandbox2 {
 
@@ -175,6 +176,14 @@ TEST_P(StackTraceTest, SymbolizationWorksSandboxedLibunwind) {
   SymbolizationWorksCommon(GetParam());
 }
 
+TEST_P(StackTraceTest, SymbolizationWorksDeferred) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_sandbox_libunwind_crash_handler, true);
+  absl::SetFlag(&FLAGS_sandbox2_deferred_stack_traces, true);
+
+  SymbolizationWorksCommon(GetParam());
+}
+
 TEST(StackTraceTest, SymbolizationWorksSandboxedLibunwindProcDirMounted) {
   absl::FlagSaver fs;
   absl::SetFlag(&FLAGS_sandbox_libunwind_crash_handler, true);
@@ -0,0 +1,220 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/stream_channel.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox2/buffer.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace sandbox2 {
+
+// Control block at the start of the shared mapping. The writer and reader
+// fields live on separate cache lines. Positions count bytes since the start of
+// the stream and are reduced modulo the capacity to index the ring.
+struct StreamChannel::Header {
+  // Written by the writer.
+  alignas(64) std::atomic<uint64_t> head;
+  // Futex word, bumped by the writer when new data or EOF is published.
+  std::atomic<uint32_t> data_seq;
+  std::atomic<uint32_t> reader_waiting;
+  std::atomic<uint32_t> closed;
+
+  // Written by the reader.
+  alignas(64) std::atomic<uint64_t> tail;
+  // Futex word, bumped by the reader when space is freed.
+  std::atomic<uint32_t> space_seq;
+  std::atomic<uint32_t> writer_waiting;
+};
+
+namespace {
+
+// The ring starts on its own page.
+constexpr size_t kHeaderSize = 4096;
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+// Upper bound for a single futex wait, so that a wedged peer does not make a
+// waiter with a deadline oversleep.
+constexpr absl::Duration kMaxWaitSlice = absl::Seconds(1);
+
+long Futex(std::atomic<uint32_t>* word, int op, uint32_t val,  // NOLINT
+           const timespec* timeout) {
+  // Not FUTEX_PRIVATE_FLAG, as the word is shared across processes.
+  return syscall(__NR_futex, reinterpret_cast<uint32_t*>(word), op, val,
+                 timeout, nullptr, 0);
+}
+
+// Wakes the other side if it announced that it is waiting.
+void WakeIfWaiting(std::atomic<uint32_t>* seq, std::atomic<uint32_t>* waiting) {
+  if (waiting->load() != 0) {
+    seq->fetch_add(1);
+    Futex(seq, FUTEX_WAKE, 1, nullptr);
+  }
+}
+
+// Waits until ready() returns true, the deadline passes or an error occurs.
+template <typename ReadyFn>
+absl::Status WaitUntil(std::atomic<uint32_t>* seq,
+                       std::atomic<uint32_t>* waiting, absl::Time deadline,
+                       ReadyFn ready) {
+  for (;;) {
+    waiting->store(1);
+    const uint32_t seen = seq->load();
+    if (ready()) {
+      waiting->store(0);
+      return absl::OkStatus();
+    }
+    const absl::Duration remaining = deadline - absl::Now();
+    if (remaining <= absl::ZeroDuration()) {
+      waiting->store(0);
+      return absl::DeadlineExceededError("waiting for stream channel peer");
+    }
+    const timespec ts = absl::ToTimespec(std::min(remaining, kMaxWaitSlice));
+    if (Futex(seq, FUTEX_WAIT, seen, &ts) == -1 && errno != EAGAIN &&
+        errno != EINTR && errno != ETIMEDOUT) {
+      waiting->store(0);
+      return absl::ErrnoToStatus(errno, "futex(FUTEX_WAIT) failed");
+    }
+    waiting->store(0);
+  }
+}
+
+}  // namespace
+
+StreamChannel::StreamChannel(std::unique_ptr<Buffer> buffer)
+    : buffer_(std::move(buffer)),
+      capacity_(buffer_->size() - kHeaderSize) {
+  static_assert(sizeof(Header) <= kHeaderSize);
+}
+
+absl::StatusOr<std::unique_ptr<StreamChannel>> StreamChannel::Create(
+    size_t capacity) {
+  if (capacity == 0) {
+    return absl::InvalidArgumentError("capacity must not be zero");
+  }
+  // The memfd is zero-filled, which is the initial state of the header.
+  SAPI_ASSIGN_OR_RETURN(std::unique_ptr<Buffer> buffer,
+                        Buffer::CreateWithSize(kHeaderSize + capacity));
+  // Using `new` to access a non-public constructor.
+  return absl::WrapUnique(new StreamChannel(std::move(buffer)));
+}
+
+absl::StatusOr<std::unique_ptr<StreamChannel>> StreamChannel::CreateFromFd(
+    int fd) {
+  SAPI_ASSIGN_OR_RETURN(std::unique_ptr<Buffer> buffer,
+                        Buffer::CreateFromFd(fd));
+  if (buffer->size() <= kHeaderSize) {
+    return absl::InvalidArgumentError("buffer too small for a stream channel");
+  }
+  return absl::WrapUnique(new StreamChannel(std::move(buffer)));
+}
+
+StreamChannel::Header* StreamChannel::header() const {
+  return reinterpret_cast<Header*>(buffer_->data());
+}
+
+uint8_t* StreamChannel::ring() const { return buffer_->data() + kHeaderSize; }
+
+absl::Status StreamChannel::Write(absl::Span<const uint8_t> data,
+                                  absl::Time deadline) {
+  Header* hdr = header();
+  // Only the writer advances head, so its value can be trusted here as long as
+  // it is consistent with tail.
+  uint64_t head = hdr->head.load(std::memory_order_relaxed);
+  while (!data.empty()) {
+    const uint64_t used = head - hdr->tail.load(std::memory_order_acquire);
+    if (used > capacity_) {
+      return absl::DataLossError("stream channel indices corrupted");
+    }
+    if (used == capacity_) {
+      SAPI_RETURN_IF_ERROR(WaitUntil(
+          &hdr->space_seq, &hdr->writer_waiting, deadline, [hdr, head, this] {
+            return head - hdr->tail.load(std::memory_order_acquire) !=
+                   capacity_;
+          }));
+      continue;
+    }
+    const size_t len = std::min<size_t>(capacity_ - used, data.size());
+    const size_t offset = head % capacity_;
+    const size_t first = std::min(len, capacity_ - offset);
+    memcpy(ring() + offset, data.data(), first);
+    memcpy(ring(), data.data() + first, len - first);
+    head += len;
+    data.remove_prefix(len);
+    hdr->head.store(head);
+    WakeIfWaiting(&hdr->data_seq, &hdr->reader_waiting);
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<size_t> StreamChannel::Read(absl::Span<uint8_t> data,
+                                           absl::Time deadline) {
+  if (data.empty()) {
+    return 0;
+  }
+  Header* hdr = header();
+  const uint64_t tail = hdr->tail.load(std::memory_order_relaxed);
+  uint64_t available = hdr->head.load(std::memory_order_acquire) - tail;
+  if (available == 0) {
+    SAPI_RETURN_IF_ERROR(WaitUntil(
+        &hdr->data_seq, &hdr->reader_waiting, deadline, [hdr, tail] {
+          return hdr->head.load(std::memory_order_acquire) != tail ||
+                 hdr->closed.load(std::memory_order_acquire) != 0;
+        }));
+    // Re-read head: closed is only set after the final head was published.
+    available = hdr->head.load(std::memory_order_acquire) - tail;
+    if (available == 0) {
+      return 0;  // EOF
+    }
+  }
+  if (available > capacity_) {
+    return absl::DataLossError("stream channel indices corrupted");
+  }
+  const size_t len = std::min<size_t>(available, data.size());
+  const size_t offset = tail % capacity_;
+  const size_t first = std::min(len, capacity_ - offset);
+  memcpy(data.data(), ring() + offset, first);
+  memcpy(data.data() + first, ring(), len - first);
+  hdr->tail.store(tail + len);
+  WakeIfWaiting(&hdr->space_seq, &hdr->writer_waiting);
+  return len;
+}
+
+void StreamChannel::CloseWrite() {
+  Header* hdr = header();
+  hdr->closed.store(1);
+  WakeIfWaiting(&hdr->data_seq, &hdr->reader_waiting);
+}
+
+}  // namespace sandbox2
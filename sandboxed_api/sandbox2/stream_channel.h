@@ -0,0 +1,100 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The sandbox2::StreamChannel class streams bytes in one direction between the
+// executor and the sandboxee through a ring buffer in shared memory.
+
+#ifndef SANDBOXED_API_SANDBOX2_STREAM_CHANNEL_H_
+#define SANDBOXED_API_SANDBOX2_STREAM_CHANNEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox2/buffer.h"
+
+namespace sandbox2 {
+
+// StreamChannel is a single-producer/single-consumer byte ring on top of a
+// sandbox2::Buffer. One side writes, the other side reads. Syscalls are only
+// made when a side has to wait for the other, i.e. when the ring is empty
+// (reader) or full (writer). Waiting uses a futex in the shared mapping, so the
+// sandboxee policy needs to allow mmap() of the fd as well as the FUTEX_WAIT
+// and FUTEX_WAKE futex operations.
+//
+// Typical use in the executor:
+//   SAPI_ASSIGN_OR_RETURN(auto channel, StreamChannel::Create(1 << 20));
+//   executor->ipc()->MapDupedFd(channel->fd(), 3);
+//   ... channel->Write(data) ...
+//   channel->CloseWrite();
+//
+// And in the sandboxee:
+//   SAPI_ASSIGN_OR_RETURN(auto channel, StreamChannel::CreateFromFd(3));
+//   ... channel->Read(buf) until it returns 0 ...
+//
+// As with Buffer, the executor must distrust the content of the ring. All
+// indices read from shared memory are validated before use.
+class StreamChannel final {
+ public:
+  StreamChannel(const StreamChannel&) = delete;
+  StreamChannel& operator=(const StreamChannel&) = delete;
+
+  // Creates a new channel whose ring holds up to capacity bytes.
+  static absl::StatusOr<std::unique_ptr<StreamChannel>> Create(
+      size_t capacity);
+
+  // Maps the channel backed by the specified file descriptor, as created by
+  // Create() on the other side. Takes ownership of the descriptor.
+  static absl::StatusOr<std::unique_ptr<StreamChannel>> CreateFromFd(int fd);
+
+  // Writes all of data, waiting for free space in the ring as needed. Returns
+  // a DeadlineExceeded error if the reader did not make room in time.
+  absl::Status Write(absl::Span<const uint8_t> data,
+                     absl::Time deadline = absl::InfiniteFuture());
+
+  // Reads up to data.size() bytes, waiting until at least one byte is
+  // available. Returns the number of bytes read, or 0 once the writer closed
+  // the channel and all data has been consumed.
+  absl::StatusOr<size_t> Read(absl::Span<uint8_t> data,
+                              absl::Time deadline = absl::InfiniteFuture());
+
+  // Marks the end of the stream. Pending data can still be read.
+  void CloseWrite();
+
+  // Gets the file descriptor backing the channel.
+  int fd() const { return buffer_->fd(); }
+
+  // Gets the number of bytes the ring can hold.
+  size_t capacity() const { return capacity_; }
+
+ private:
+  struct Header;
+
+  explicit StreamChannel(std::unique_ptr<Buffer> buffer);
+
+  Header* header() const;
+  uint8_t* ring() const;
+
+  std::unique_ptr<Buffer> buffer_;
+  // Derived from the size of the local mapping, never from shared memory.
+  size_t capacity_ = 0;
+};
+
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_STREAM_CHANNEL_H_
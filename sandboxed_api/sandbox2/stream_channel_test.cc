@@ -0,0 +1,195 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/stream_channel.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox2/buffer.h"
+#include "sandboxed_api/sandbox2/comms.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sandbox2 {
+namespace {
+
+using ::sapi::IsOk;
+using ::sapi::StatusIs;
+using ::testing::Eq;
+using ::testing::Ge;
+
+std::vector<uint8_t> MakePattern(size_t size) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = static_cast<uint8_t>(i * 7 + i / 251);
+  }
+  return data;
+}
+
+TEST(StreamChannelTest, RejectsZeroCapacity) {
+  EXPECT_THAT(StreamChannel::Create(0),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(StreamChannelTest, ReadsBackWrittenData) {
+  SAPI_ASSERT_OK_AND_ASSIGN(auto channel, StreamChannel::Create(4096));
+  EXPECT_THAT(channel->capacity(), Eq(4096));
+  std::vector<uint8_t> data = MakePattern(1000);
+  ASSERT_THAT(channel->Write(data), IsOk());
+  channel->CloseWrite();
+
+  std::vector<uint8_t> out(2000);
+  SAPI_ASSERT_OK_AND_ASSIGN(size_t read, channel->Read(absl::MakeSpan(out)));
+  ASSERT_THAT(read, Eq(data.size()));
+  out.resize(read);
+  EXPECT_THAT(out, Eq(data));
+  SAPI_ASSERT_OK_AND_ASSIGN(size_t eof, channel->Read(absl::MakeSpan(out)));
+  EXPECT_THAT(eof, Eq(0));
+}
+
+// Streams more data than fits the ring through a second mapping of the same
+// fd, in chunk sizes that do not divide the capacity.
+TEST(StreamChannelTest, StreamsAcrossMappingsWithWraparound) {
+  constexpr size_t kCapacity = 4099;
+  constexpr size_t kTotal = 1 << 20;
+  SAPI_ASSERT_OK_AND_ASSIGN(auto writer, StreamChannel::Create(kCapacity));
+  SAPI_ASSERT_OK_AND_ASSIGN(auto reader,
+                            StreamChannel::CreateFromFd(dup(writer->fd())));
+  ASSERT_THAT(reader->capacity(), Eq(kCapacity));
+
+  const std::vector<uint8_t> data = MakePattern(kTotal);
+  std::thread producer([&writer, &data] {
+    absl::Span<const uint8_t> remaining(data);
+    while (!remaining.empty()) {
+      const size_t len = std::min<size_t>(remaining.size(), 1237);
+      ASSERT_THAT(writer->Write(remaining.subspan(0, len)), IsOk());
+      remaining.remove_prefix(len);
+    }
+    writer->CloseWrite();
+  });
+
+  std::vector<uint8_t> received;
+  std::vector<uint8_t> chunk(977);
+  for (;;) {
+    SAPI_ASSERT_OK_AND_ASSIGN(size_t read,
+                              reader->Read(absl::MakeSpan(chunk)));
+    if (read == 0) {
+      break;
+    }
+    received.insert(received.end(), chunk.begin(), chunk.begin() + read);
+  }
+  producer.join();
+  EXPECT_THAT(received, Eq(data));
+}
+
+TEST(StreamChannelTest, ReadTimesOutWithoutWriter) {
+  SAPI_ASSERT_OK_AND_ASSIGN(auto channel, StreamChannel::Create(4096));
+  std::vector<uint8_t> out(16);
+  const absl::Time start = absl::Now();
+  EXPECT_THAT(channel->Read(absl::MakeSpan(out),
+                            absl::Now() + absl::Milliseconds(50)),
+              StatusIs(absl::StatusCode::kDeadlineExceeded));
+  EXPECT_THAT(absl::Now() - start, Ge(absl::Milliseconds(50)));
+}
+
+TEST(StreamChannelTest, WriteTimesOutWhenFull) {
+  SAPI_ASSERT_OK_AND_ASSIGN(auto channel, StreamChannel::Create(4096));
+  std::vector<uint8_t> data = MakePattern(4096 + 1);
+  EXPECT_THAT(channel->Write(data, absl::Now() + absl::Milliseconds(50)),
+              StatusIs(absl::StatusCode::kDeadlineExceeded));
+}
+
+TEST(StreamChannelTest, DetectsCorruptedIndices) {
+  SAPI_ASSERT_OK_AND_ASSIGN(auto channel, StreamChannel::Create(4096));
+  SAPI_ASSERT_OK_AND_ASSIGN(auto buffer,
+                            Buffer::CreateFromFd(dup(channel->fd())));
+  // Simulate a peer moving the write position far past the read position.
+  auto* head = reinterpret_cast<uint64_t*>(buffer->data());
+  *head = 1 << 20;
+  std::vector<uint8_t> out(16);
+  EXPECT_THAT(channel->Read(absl::MakeSpan(out)),
+              StatusIs(absl::StatusCode::kDataLoss));
+}
+
+constexpr size_t kBenchmarkBytes = 64 << 20;
+
+// Measures throughput of a StreamChannel between two threads. The argument is
+// the chunk size used for each Write() and Read().
+void BenchmarkStreamChannel(benchmark::State& state) {
+  const size_t chunk_size = state.range(0);
+  const std::vector<uint8_t> data = MakePattern(chunk_size);
+  std::vector<uint8_t> out(chunk_size);
+  for (auto _ : state) {
+    SAPI_ASSERT_OK_AND_ASSIGN(auto writer, StreamChannel::Create(1 << 20));
+    SAPI_ASSERT_OK_AND_ASSIGN(auto reader,
+                              StreamChannel::CreateFromFd(dup(writer->fd())));
+    std::thread producer([&writer, &data] {
+      for (size_t sent = 0; sent < kBenchmarkBytes; sent += data.size()) {
+        ASSERT_THAT(writer->Write(data), IsOk());
+      }
+      writer->CloseWrite();
+    });
+    for (;;) {
+      SAPI_ASSERT_OK_AND_ASSIGN(size_t read,
+                                reader->Read(absl::MakeSpan(out)));
+      if (read == 0) {
+        break;
+      }
+    }
+    producer.join();
+  }
+  state.SetBytesProcessed(state.iterations() * kBenchmarkBytes);
+}
+BENCHMARK(BenchmarkStreamChannel)->Arg(4 << 10)->Arg(64 << 10);
+
+// Same as above, but sending length-prefixed chunks over Comms.
+void BenchmarkComms(benchmark::State& state) {
+  const size_t chunk_size = state.range(0);
+  const std::vector<uint8_t> data = MakePattern(chunk_size);
+  for (auto _ : state) {
+    int sv[2];
+    ASSERT_THAT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), Eq(0));
+    Comms writer(sv[0]);
+    Comms reader(sv[1]);
+    std::thread producer([&writer, &data] {
+      for (size_t sent = 0; sent < kBenchmarkBytes; sent += data.size()) {
+        ASSERT_TRUE(writer.SendBytes(data));
+      }
+      writer.Terminate();
+    });
+    std::vector<uint8_t> out;
+    while (reader.RecvBytes(&out)) {
+    }
+    producer.join();
+  }
+  state.SetBytesProcessed(state.iterations() * kBenchmarkBytes);
+}
+BENCHMARK(BenchmarkComms)->Arg(4 << 10)->Arg(64 << 10);
+
+}  // namespace
+}  // namespace sandbox2
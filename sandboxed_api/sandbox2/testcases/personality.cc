@@ -14,14 +14,19 @@
 
 // A binary that calls the unusual personality syscall with arguments.
 // It is to test seccomp trace, notify API and checking of arguments.
+// An optional argument specifies how often the syscall is repeated.
 
 #include <syscall.h>
 #include <unistd.h>
 
 #include <cstdint>
+#include <cstdlib>
 
 int main(int argc, char* argv[]) {
-  syscall(__NR_personality, uintptr_t{1}, uintptr_t{2}, uintptr_t{3},
-          uintptr_t{4}, uintptr_t{5}, uintptr_t{6});
+  const int count = argc > 1 ? atoi(argv[1]) : 1;
+  for (int i = 0; i < count; ++i) {
+    syscall(__NR_personality, uintptr_t{1}, uintptr_t{2}, uintptr_t{3},
+            uintptr_t{4}, uintptr_t{5}, uintptr_t{6});
+  }
   return 22;
 }
@@ -0,0 +1,39 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A binary that creates and joins the number of threads given as its first
+// argument, one after another. Used to measure thread creation overhead.
+
+#include <pthread.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+void* Nop(void*) { return nullptr; }
+
+int main(int argc, char* argv[]) {
+  const int count = argc > 1 ? atoi(argv[1]) : 1;
+  for (int i = 0; i < count; ++i) {
+    pthread_t thread;
+    if (pthread_create(&thread, nullptr, Nop, nullptr) != 0) {
+      fprintf(stderr, "pthread_create: error\n");
+      return EXIT_FAILURE;
+    }
+    if (pthread_join(thread, nullptr) != 0) {
+      fprintf(stderr, "pthread_join: error\n");
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
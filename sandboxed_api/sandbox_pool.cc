@@ -0,0 +1,206 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox_pool.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+#include "absl/functional/function_ref.h"
+#include "absl/log/log.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace sapi {
+
+bool SandboxPool::Request::Finished() const {
+  return winner >= 0 || AllDone();
+}
+
+bool SandboxPool::Request::AllDone() const {
+  return std::all_of(attempts.begin(), attempts.begin() + started,
+                     [](const Attempt& attempt) { return attempt.done; });
+}
+
+absl::StatusOr<std::unique_ptr<SandboxPool>> SandboxPool::Create(
+    Factory factory, const Options& options) {
+  if (options.size < 1) {
+    return absl::InvalidArgumentError("Pool size must be at least 1");
+  }
+  // Using `new` to access a non-public constructor.
+  auto pool = absl::WrapUnique(new SandboxPool(options));
+  for (int i = 0; i < options.size; ++i) {
+    auto slot = std::make_unique<Slot>();
+    slot->sandbox = factory();
+    SAPI_RETURN_IF_ERROR(slot->sandbox->Init());
+    pool->slots_.push_back(std::move(slot));
+  }
+  for (const std::unique_ptr<Slot>& slot : pool->slots_) {
+    slot->thread = std::thread(&SandboxPool::RunSlot, pool.get(), slot.get());
+  }
+  return pool;
+}
+
+SandboxPool::~SandboxPool() {
+  {
+    absl::MutexLock lock(&mutex_);
+    for (const std::unique_ptr<Slot>& slot : slots_) {
+      slot->stop = true;
+    }
+  }
+  for (const std::unique_ptr<Slot>& slot : slots_) {
+    if (slot->thread.joinable()) {
+      slot->thread.join();
+    }
+  }
+}
+
+absl::Status SandboxPool::Call(absl::FunctionRef<absl::Status(Sandbox*)> f,
+                               absl::Time deadline) {
+  std::array<absl::Status, kMaxAttempts> results;
+  SAPI_ASSIGN_OR_RETURN(int winner,
+                        Run(
+                            [&f, &results](Sandbox* sandbox, int attempt) {
+                              return results[attempt] = f(sandbox);
+                            },
+                            deadline));
+  return results[winner];
+}
+
+SandboxPool::Stats SandboxPool::GetStats() const {
+  absl::MutexLock lock(&mutex_);
+  return stats_;
+}
+
+absl::StatusOr<int> SandboxPool::Run(
+    absl::FunctionRef<absl::Status(Sandbox*, int)> f, absl::Time deadline) {
+  Request request(f);
+  absl::MutexLock lock(&mutex_);
+  ++stats_.calls;
+  if (!mutex_.AwaitWithDeadline(
+          absl::Condition(this, &SandboxPool::HasIdleSlot), deadline)) {
+    ++stats_.deadline_exceeded;
+    return absl::DeadlineExceededError(
+        "No sandbox became idle before the deadline");
+  }
+  StartAttempt(&request);
+
+  const absl::Condition finished(&request, &Request::Finished);
+  if (options_.hedge_delay < absl::InfiniteDuration()) {
+    const absl::Time hedge_time =
+        std::min(absl::Now() + options_.hedge_delay, deadline);
+    // Hedging is skipped if no other sandbox is idle right now, as waiting for
+    // one would only add load to an already busy pool.
+    if (!mutex_.AwaitWithDeadline(finished, hedge_time) &&
+        hedge_time < deadline && HasIdleSlot()) {
+      StartAttempt(&request);
+      ++stats_.hedged;
+    }
+  }
+  const bool in_time = mutex_.AwaitWithDeadline(finished, deadline);
+
+  // Cancel the attempts still running. Their slots only restart the
+  // sandboxes after marking the attempts done, so the sandboxes cannot be
+  // replaced while they are killed here.
+  for (int i = 0; i < request.started; ++i) {
+    Attempt& attempt = request.attempts[i];
+    if (!attempt.done) {
+      attempt.cancelled = true;
+      attempt.slot->sandbox->Kill();
+      ++stats_.cancelled;
+    }
+  }
+  mutex_.Await(absl::Condition(&request, &Request::AllDone));
+
+  if (!in_time) {
+    ++stats_.deadline_exceeded;
+    return absl::DeadlineExceededError(
+        "Sandbox call did not finish before the deadline");
+  }
+  if (request.winner > 0) {
+    ++stats_.hedge_wins;
+  }
+  return request.winner >= 0 ? request.winner : request.first_done;
+}
+
+bool SandboxPool::HasIdleSlot() const {
+  return std::any_of(slots_.begin(), slots_.end(),
+                     [](const std::unique_ptr<Slot>& slot) {
+                       return slot->idle && !slot->stop;
+                     });
+}
+
+void SandboxPool::StartAttempt(Request* request) {
+  auto slot = std::find_if(slots_.begin(), slots_.end(),
+                           [](const std::unique_ptr<Slot>& slot) {
+                             return slot->idle && !slot->stop;
+                           });
+  Slot* s = slot->get();
+  s->idle = false;
+  s->request = request;
+  s->attempt = request->started;
+  request->attempts[request->started++].slot = s;
+}
+
+void SandboxPool::RunSlot(Slot* slot) {
+  auto has_work = [](Slot* slot) {
+    return slot->request != nullptr || slot->stop;
+  };
+  absl::MutexLock lock(&mutex_);
+  while (true) {
+    mutex_.Await(absl::Condition(+has_work, slot));
+    if (slot->request == nullptr) {
+      return;
+    }
+    Request* request = slot->request;
+    const int index = slot->attempt;
+
+    mutex_.Unlock();
+    absl::Status status = request->f(slot->sandbox.get(), index);
+    mutex_.Lock();
+
+    Attempt& attempt = request->attempts[index];
+    const bool restart = attempt.cancelled || !slot->sandbox->is_active();
+    attempt.done = true;
+    if (request->first_done < 0) {
+      request->first_done = index;
+    }
+    if (status.ok() && request->winner < 0) {
+      request->winner = index;
+    }
+    // The request may be gone once the attempt is marked done.
+    slot->request = nullptr;
+    slot->attempt = -1;
+
+    if (restart) {
+      ++stats_.restarts;
+      mutex_.Unlock();
+      if (absl::Status restarted = slot->sandbox->Restart(false);
+          !restarted.ok()) {
+        LOG(WARNING) << "Restarting pooled sandbox failed: " << restarted;
+      }
+      mutex_.Lock();
+    }
+    slot->idle = true;
+  }
+}
+
+}  // namespace sapi
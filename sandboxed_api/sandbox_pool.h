@@ -0,0 +1,182 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_SANDBOX_POOL_H_
+#define SANDBOXED_API_SANDBOX_POOL_H_
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace sapi {
+
+// SandboxPool runs calls on a fixed set of identical sandboxes with per-call
+// deadlines, so that a slow or wedged sandboxee only delays its caller until
+// the deadline, not until a walltime limit of the whole sandbox.
+//
+// Calls can also be hedged: if a call has not finished after
+// Options::hedge_delay, it is issued a second time to another idle sandbox.
+// The first attempt to succeed wins, and the other one is cancelled by killing
+// its sandboxee. Sandboxes whose sandboxee was killed or died are restarted
+// before they are reused.
+//
+// As the function of a hedged call may run twice on different sandboxes, it
+// must not have side effects outside of the sandbox it is given. Call() only
+// returns once no attempt is running anymore.
+//
+// Example:
+//
+//   SandboxPool::Options options;
+//   options.size = 4;
+//   options.hedge_delay = absl::Milliseconds(5);
+//   SAPI_ASSIGN_OR_RETURN(
+//       std::unique_ptr<SandboxPool> pool,
+//       SandboxPool::Create([] { return std::make_unique<ZlibSandbox>(); },
+//                           options));
+//   SAPI_ASSIGN_OR_RETURN(
+//       int crc, pool->Call<int>(
+//                    [&](Sandbox* sandbox) -> absl::StatusOr<int> {
+//                      ZlibApi api(sandbox);
+//                      return api.crc32(0, nullptr, 0);
+//                    },
+//                    absl::Now() + absl::Milliseconds(50)));
+class SandboxPool {
+ public:
+  using Factory = std::function<std::unique_ptr<Sandbox>()>;
+
+  struct Options {
+    // Number of sandboxes.
+    int size = 2;
+    // Time after which a call that has not finished is also issued to another
+    // idle sandbox. absl::InfiniteDuration() disables hedging.
+    absl::Duration hedge_delay = absl::InfiniteDuration();
+  };
+
+  struct Stats {
+    int64_t calls = 0;
+    // Calls issued to a second sandbox.
+    int64_t hedged = 0;
+    // Hedged calls won by the second attempt.
+    int64_t hedge_wins = 0;
+    // Attempts cancelled because the other one won or the deadline passed.
+    int64_t cancelled = 0;
+    int64_t deadline_exceeded = 0;
+    int64_t restarts = 0;
+  };
+
+  // Creates and initializes options.size sandboxes with factory.
+  static absl::StatusOr<std::unique_ptr<SandboxPool>> Create(
+      Factory factory, const Options& options);
+  static absl::StatusOr<std::unique_ptr<SandboxPool>> Create(Factory factory) {
+    return Create(std::move(factory), Options());
+  }
+
+  SandboxPool(const SandboxPool&) = delete;
+  SandboxPool& operator=(const SandboxPool&) = delete;
+
+  ~SandboxPool();
+
+  // Runs f on an idle sandbox and returns the result of the first attempt that
+  // succeeds, or the first error if all attempts failed. Fails with
+  // DeadlineExceededError if no sandbox became idle or no attempt finished
+  // before the deadline. Thread-safe.
+  absl::Status Call(absl::FunctionRef<absl::Status(Sandbox*)> f,
+                    absl::Time deadline = absl::InfiniteFuture());
+
+  template <typename T>
+  absl::StatusOr<T> Call(absl::FunctionRef<absl::StatusOr<T>(Sandbox*)> f,
+                         absl::Time deadline = absl::InfiniteFuture()) {
+    std::array<std::optional<absl::StatusOr<T>>, kMaxAttempts> results;
+    SAPI_ASSIGN_OR_RETURN(
+        int winner, Run(
+                        [&f, &results](Sandbox* sandbox, int attempt) {
+                          return results[attempt].emplace(f(sandbox)).status();
+                        },
+                        deadline));
+    return *std::move(results[winner]);
+  }
+
+  Stats GetStats() const;
+
+ private:
+  static constexpr int kMaxAttempts = 2;
+
+  struct Request;
+
+  struct Slot {
+    std::unique_ptr<Sandbox> sandbox;
+    std::thread thread;
+    // Set while the slot runs an attempt of a request.
+    Request* request = nullptr;
+    int attempt = -1;
+    bool idle = true;
+    bool stop = false;
+  };
+
+  struct Attempt {
+    Slot* slot = nullptr;
+    bool done = false;
+    bool cancelled = false;
+  };
+
+  struct Request {
+    explicit Request(absl::FunctionRef<absl::Status(Sandbox*, int)> f)
+        : f(f) {}
+
+    // Whether an attempt succeeded or all attempts failed.
+    bool Finished() const;
+    bool AllDone() const;
+
+    absl::FunctionRef<absl::Status(Sandbox*, int)> f;
+    std::array<Attempt, kMaxAttempts> attempts;
+    int started = 0;
+    // Index of the first attempt that succeeded, or failed if none did.
+    int winner = -1;
+    int first_done = -1;
+  };
+
+  explicit SandboxPool(const Options& options) : options_(options) {}
+
+  // Runs the attempts of a call and returns the index of the one whose result
+  // counts.
+  absl::StatusOr<int> Run(absl::FunctionRef<absl::Status(Sandbox*, int)> f,
+                          absl::Time deadline);
+
+  bool HasIdleSlot() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void StartAttempt(Request* request) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void RunSlot(Slot* slot);
+
+  const Options options_;
+  mutable absl::Mutex mutex_;
+  std::vector<std::unique_ptr<Slot>> slots_;
+  Stats stats_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_SANDBOX_POOL_H_
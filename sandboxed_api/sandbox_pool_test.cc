@@ -0,0 +1,156 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox_pool.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/examples/sum/sum-sapi.sapi.h"
+#include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/testing.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sapi {
+namespace {
+
+using ::sapi::IsOk;
+using ::sapi::StatusIs;
+using ::testing::Eq;
+using ::testing::Lt;
+
+absl::StatusOr<std::unique_ptr<SandboxPool>> CreatePool(
+    int size, absl::Duration hedge_delay = absl::InfiniteDuration()) {
+  SandboxPool::Options options;
+  options.size = size;
+  options.hedge_delay = hedge_delay;
+  return SandboxPool::Create([] { return std::make_unique<SumSandbox>(); },
+                             options);
+}
+
+absl::StatusOr<int> Sum(Sandbox* sandbox) {
+  SumApi api(sandbox);
+  return api.sum(1, 2);
+}
+
+TEST(SandboxPoolTest, RejectsEmptyPool) {
+  EXPECT_THAT(CreatePool(0).status(),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(SandboxPoolTest, ConcurrentCalls) {
+  SKIP_SANITIZERS_AND_COVERAGE;
+  SAPI_ASSERT_OK_AND_ASSIGN(std::unique_ptr<SandboxPool> pool, CreatePool(2));
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&pool] {
+      for (int j = 0; j < 10; ++j) {
+        absl::StatusOr<int> result = pool->Call<int>(Sum);
+        ASSERT_THAT(result.status(), IsOk());
+        EXPECT_THAT(*result, Eq(3));
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  SandboxPool::Stats stats = pool->GetStats();
+  EXPECT_THAT(stats.calls, Eq(40));
+  EXPECT_THAT(stats.hedged, Eq(0));
+  EXPECT_THAT(stats.restarts, Eq(0));
+}
+
+TEST(SandboxPoolTest, DeadlineKillsSlowCall) {
+  SKIP_SANITIZERS_AND_COVERAGE;
+  SAPI_ASSERT_OK_AND_ASSIGN(std::unique_ptr<SandboxPool> pool, CreatePool(1));
+  const absl::Time start = absl::Now();
+  EXPECT_THAT(pool->Call(
+                  [](Sandbox* sandbox) {
+                    SumApi api(sandbox);
+                    return api.sleep_for_sec(10);
+                  },
+                  absl::Now() + absl::Milliseconds(200)),
+              StatusIs(absl::StatusCode::kDeadlineExceeded));
+  EXPECT_THAT(absl::Now() - start, Lt(absl::Seconds(5)));
+
+  // The sandbox was restarted and can be used again.
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, pool->Call<int>(Sum));
+  EXPECT_THAT(result, Eq(3));
+  SandboxPool::Stats stats = pool->GetStats();
+  EXPECT_THAT(stats.deadline_exceeded, Eq(1));
+  EXPECT_THAT(stats.cancelled, Eq(1));
+  EXPECT_THAT(stats.restarts, Eq(1));
+}
+
+TEST(SandboxPoolTest, HedgedCallWinsOverSlowCall) {
+  SKIP_SANITIZERS_AND_COVERAGE;
+  SAPI_ASSERT_OK_AND_ASSIGN(std::unique_ptr<SandboxPool> pool,
+                            CreatePool(2, absl::Milliseconds(100)));
+  std::atomic<int> attempts = 0;
+  const absl::Time start = absl::Now();
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      int result, pool->Call<int>([&attempts](Sandbox* sandbox)
+                                      -> absl::StatusOr<int> {
+        SumApi api(sandbox);
+        // Only the first attempt is slow.
+        if (attempts++ == 0) {
+          SAPI_RETURN_IF_ERROR(api.sleep_for_sec(10));
+        }
+        return api.sum(1, 2);
+      }));
+  EXPECT_THAT(result, Eq(3));
+  EXPECT_THAT(absl::Now() - start, Lt(absl::Seconds(5)));
+  SandboxPool::Stats stats = pool->GetStats();
+  EXPECT_THAT(stats.hedged, Eq(1));
+  EXPECT_THAT(stats.hedge_wins, Eq(1));
+  EXPECT_THAT(stats.cancelled, Eq(1));
+}
+
+TEST(SandboxPoolTest, ReturnsFirstErrorIfAllAttemptsFail) {
+  SKIP_SANITIZERS_AND_COVERAGE;
+  SAPI_ASSERT_OK_AND_ASSIGN(std::unique_ptr<SandboxPool> pool, CreatePool(1));
+  EXPECT_THAT(pool->Call([](Sandbox*) {
+                return absl::InvalidArgumentError("Bad input");
+              }),
+              StatusIs(absl::StatusCode::kInvalidArgument, "Bad input"));
+  EXPECT_THAT(pool->GetStats().restarts, Eq(0));
+}
+
+// Measures the overhead of a pool call over a direct call. The argument is the
+// hedge delay in microseconds, 0 to disable hedging.
+void BenchmarkPoolCallOverhead(benchmark::State& state) {
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<SandboxPool> pool,
+      CreatePool(2, state.range(0) > 0 ? absl::Microseconds(state.range(0))
+                                       : absl::InfiniteDuration()));
+  for (auto _ : state) {
+    ASSERT_THAT(pool->Call<int>(Sum).status(), IsOk());
+  }
+  state.counters["hedged"] =
+      benchmark::Counter(static_cast<double>(pool->GetStats().hedged),
+                         benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BenchmarkPoolCallOverhead)->ArgName("hedge_us")->Arg(0)->Arg(500);
+
+}  // namespace
+}  // namespace sapi
@@ -14,21 +14,29 @@
 
 #include <fcntl.h>
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <thread>  // NOLINT(build/c++11)
+#include <vector>
 
 #include "benchmark/benchmark.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/synchronization/notification.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "sandboxed_api/examples/stringop/stringop-sapi.sapi.h"
 #include "sandboxed_api/examples/stringop/stringop_params.pb.h"
+#ifdef SAPI_TEST_STATIC_PIE_SUM
+#include "sandboxed_api/examples/sum/sum-static-pie-sapi.sapi.h"
+#else
 #include "sandboxed_api/examples/sum/sum-sapi.sapi.h"
+#endif
 #include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/sandbox2/result.h"
 #include "sandboxed_api/testing.h"
 #include "sandboxed_api/transaction.h"
 #include "sandboxed_api/util/status_matchers.h"
@@ -42,6 +50,12 @@ using ::testing::Eq;
 using ::testing::Gt;
 using ::testing::HasSubstr;
 
+#ifdef SAPI_TEST_STATIC_PIE_SUM
+// Runs all sum tests against the sandboxee linked as a static PIE.
+using SumApi = ::sapi::static_pie::SumApi;
+using SumSandbox = ::sapi::static_pie::SumSandbox;
+#endif
+
 // Functions that will be used during the benchmarks:
 
 // Function causing no load in the sandboxee.
@@ -97,6 +111,17 @@ void BenchmarkSandboxRestartForkserverOverheadForced(benchmark::State& state) {
 }
 BENCHMARK(BenchmarkSandboxRestartForkserverOverheadForced);
 
+// Starts a sum sandbox and makes one call, to compare the startup of the
+// dynamically linked and the static PIE sandboxee.
+void BenchmarkSumSandboxStartup(benchmark::State& state) {
+  for (auto _ : state) {
+    SumSandbox sandbox;
+    ASSERT_THAT(sandbox.Init(), IsOk());
+    ASSERT_THAT(sandbox.CallScalar<int>("sum", 1, 2), IsOk());
+  }
+}
+BENCHMARK(BenchmarkSumSandboxStartup);
+
 // Reuse the sandbox. Used to measure the overhead of the call invocation.
 void BenchmarkCallOverhead(benchmark::State& state) {
   BasicTransaction st(std::make_unique<StringopSandbox>());
@@ -106,6 +131,41 @@ void BenchmarkCallOverhead(benchmark::State& state) {
 }
 BENCHMARK(BenchmarkCallOverhead);
 
+// Compares a generic Call() to CallScalar() for a function taking two ints.
+// The argument selects CallScalar().
+void BenchmarkScalarCallOverhead(benchmark::State& state) {
+  const bool use_scalar = state.range(0) != 0;
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  for (auto _ : state) {
+    if (use_scalar) {
+      ASSERT_THAT(sandbox.CallScalar<int>("sum", 1, 2), IsOk());
+    } else {
+      v::Int ret;
+      v::Int a(1);
+      v::Int b(2);
+      ASSERT_THAT(sandbox.Call("sum", &ret, &a, &b), IsOk());
+    }
+  }
+}
+BENCHMARK(BenchmarkScalarCallOverhead)->ArgName("scalar")->Arg(0)->Arg(1);
+
+// Allocates and destroys a batch of automatically freed variables followed by a
+// call, as a typical request handler would. The argument is the batch size.
+void BenchmarkAutomaticFree(benchmark::State& state) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+  for (auto _ : state) {
+    for (int i = 0; i < state.range(0); ++i) {
+      v::Array<uint8_t> buffer(64);
+      ASSERT_THAT(sandbox.Allocate(&buffer, /*automatic_free=*/true), IsOk());
+    }
+    ASSERT_THAT(api.sum(1, 2), IsOk());
+  }
+}
+BENCHMARK(BenchmarkAutomaticFree)->Arg(1)->Arg(16)->Arg(1024);
+
 // Make use of protobufs.
 void BenchmarkProtobufHandling(benchmark::State& state) {
   BasicTransaction st(std::make_unique<StringopSandbox>());
@@ -141,6 +201,37 @@ void BenchmarkIntDataSynchronization(benchmark::State& state) {
 }
 BENCHMARK(BenchmarkIntDataSynchronization);
 
+// Hands a buffer from one sandbox to another. The first argument is the buffer
+// size, the second whether to use TransferBetween() instead of copying the
+// buffer to the host and back.
+void BenchmarkSandboxToSandboxHandoff(benchmark::State& state) {
+  SumSandbox from;
+  ASSERT_THAT(from.Init(), IsOk());
+  SumSandbox to;
+  ASSERT_THAT(to.Init(), IsOk());
+  v::Array<uint8_t> src(state.range(0));
+  ASSERT_THAT(from.Allocate(&src, /*automatic_free=*/true), IsOk());
+  // Shares the host buffer of src for the staged handoff.
+  v::Array<uint8_t> dst(src.GetData(), src.GetSize());
+  ASSERT_THAT(to.Allocate(&dst, /*automatic_free=*/true), IsOk());
+
+  for (auto _ : state) {
+    if (state.range(1)) {
+      ASSERT_THAT(TransferBetween(&from, v::RemotePtr(src.GetRemote()), &to,
+                                  v::RemotePtr(dst.GetRemote()),
+                                  state.range(0)),
+                  IsOk());
+    } else {
+      ASSERT_THAT(from.TransferFromSandboxee(&src), IsOk());
+      ASSERT_THAT(to.TransferToSandboxee(&dst), IsOk());
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BenchmarkSandboxToSandboxHandoff)
+    ->ArgNames({"size", "direct"})
+    ->ArgsProduct({{64 << 10, 16 << 20}, {0, 1}});
+
 // Test whether stack trace generation works.
 TEST(SapiTest, HasStackTraces) {
   SKIP_SANITIZERS_AND_COVERAGE;
@@ -284,5 +375,107 @@ TEST(SandboxTest, NoRaceInConcurrentTerminate) {
   EXPECT_THAT(result.final_status(), Eq(sandbox2::Result::EXTERNAL_KILL));
 }
 
+TEST(SandboxTest, TerminateAsyncAllowsImmediateRestart) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  absl::Notification reaped;
+  sandbox2::Result result;
+  sandbox.TerminateAsync(/*attempt_graceful_exit=*/false,
+                         [&reaped, &result](const sandbox2::Result& r) {
+                           result = r;
+                           reaped.Notify();
+                         });
+  EXPECT_FALSE(sandbox.is_active());
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum, api.sum(1, 2));
+  EXPECT_THAT(sum, Eq(3));
+  reaped.WaitForNotification();
+  EXPECT_THAT(result.final_status(), Eq(sandbox2::Result::EXTERNAL_KILL));
+}
+
+TEST(SandboxTest, DeferredFreeIsAppliedBeforeNextRequest) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  void* freed_remote;
+  {
+    v::Array<uint8_t> buffer(64);
+    ASSERT_THAT(sandbox.Allocate(&buffer, /*automatic_free=*/true), IsOk());
+    freed_remote = buffer.GetRemote();
+  }
+  // The queued free is sent ahead of the allocation, so the sandboxee's malloc
+  // hands out the same block again.
+  v::Array<uint8_t> buffer(64);
+  ASSERT_THAT(sandbox.Allocate(&buffer, /*automatic_free=*/true), IsOk());
+  EXPECT_THAT(buffer.GetRemote(), Eq(freed_remote));
+
+  // More frees than are queued at most.
+  for (int i = 0; i < 1000; ++i) {
+    v::Array<uint8_t> temp(64);
+    ASSERT_THAT(sandbox.Allocate(&temp, /*automatic_free=*/true), IsOk());
+  }
+  SumApi api(&sandbox);
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum, api.sum(1, 2));
+  EXPECT_THAT(sum, Eq(3));
+  EXPECT_THAT(sandbox.rpc_channel()->FlushFrees(), IsOk());
+}
+
+TEST(SandboxTest, TransferBetweenSandboxes) {
+  SumSandbox from;
+  ASSERT_THAT(from.Init(), IsOk());
+  SumSandbox to;
+  ASSERT_THAT(to.Init(), IsOk());
+
+  // Not a multiple of the chunk size, so that the last chunk is short.
+  constexpr size_t kSize = 10000;
+  std::vector<uint8_t> data(kSize);
+  for (size_t i = 0; i < kSize; ++i) {
+    data[i] = i % 251;
+  }
+  v::Array<uint8_t> src(data.data(), data.size());
+  ASSERT_THAT(from.Allocate(&src, /*automatic_free=*/true), IsOk());
+  ASSERT_THAT(from.TransferToSandboxee(&src), IsOk());
+  v::Array<uint8_t> dst(kSize);
+  ASSERT_THAT(to.Allocate(&dst, /*automatic_free=*/true), IsOk());
+
+  ASSERT_THAT(TransferBetween(&from, v::RemotePtr(src.GetRemote()), &to,
+                              v::RemotePtr(dst.GetRemote()), kSize,
+                              /*chunk_size=*/4096),
+              IsOk());
+  ASSERT_THAT(to.TransferFromSandboxee(&dst), IsOk());
+  EXPECT_THAT(std::vector<uint8_t>(dst.GetData(), dst.GetData() + kSize),
+              Eq(data));
+}
+
+TEST(SandboxTest, TransferBetweenFailsForInactiveSandbox) {
+  SumSandbox from;
+  ASSERT_THAT(from.Init(), IsOk());
+  v::Array<uint8_t> src(64);
+  ASSERT_THAT(from.Allocate(&src, /*automatic_free=*/true), IsOk());
+  SumSandbox to;
+  EXPECT_THAT(TransferBetween(&from, v::RemotePtr(src.GetRemote()), &to,
+                              v::RemotePtr(nullptr), src.GetSize()),
+              StatusIs(absl::StatusCode::kUnavailable));
+}
+
+TEST(SandboxTest, CallScalar) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum, sandbox.CallScalar<int>("sum", 1, 2));
+  EXPECT_THAT(sum, Eq(3));
+  SAPI_ASSERT_OK_AND_ASSIGN(int diff, sandbox.CallScalar<int>("sub", 1, 2));
+  EXPECT_THAT(diff, Eq(-1));
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      long double sumf,
+      sandbox.CallScalar<long double>("addf", 0.5f, 1.25, 2.0L));
+  EXPECT_THAT(sumf, Eq(3.75L));
+  SAPI_ASSERT_OK_AND_ASSIGN(double prod,
+                            sandbox.CallScalar<double>("muld", 1.5, 3.0f));
+  EXPECT_THAT(prod, Eq(4.5));
+  EXPECT_THAT(sandbox.CallScalar<void>("sleep_for_sec", 0), IsOk());
+  EXPECT_THAT(sandbox.CallScalar<int>("no_such_function", 1).status(),
+              StatusIs(absl::StatusCode::kUnavailable));
+}
+
 }  // namespace
 }  // namespace sapi
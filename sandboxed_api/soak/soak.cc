@@ -0,0 +1,495 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/soak/soak.h"
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/strip.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/examples/stringop/stringop-sapi.sapi.h"
+#include "sandboxed_api/examples/sum/sum-sapi.sapi.h"
+#include "sandboxed_api/sandbox2/result.h"
+#include "sandboxed_api/sandbox2/sanitizer.h"
+#include "sandboxed_api/sandbox2/util.h"
+#include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/vars.h"
+
+namespace sapi::soak {
+namespace {
+
+// Latency histogram with a fixed memory footprint, so that the harness itself
+// does not grow over a long run. Buckets cover powers of two, split into
+// kSubBuckets linear sub-buckets each, which bounds the relative error to
+// 1/kSubBuckets.
+class LatencyHistogram {
+ public:
+  void Add(absl::Duration latency) {
+    int64_t ns = std::max<int64_t>(absl::ToInt64Nanoseconds(latency), 0);
+    ++buckets_[BucketFor(ns)];
+    ++count_;
+    max_ns_ = std::max(max_ns_, ns);
+  }
+
+  void Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < buckets_.size(); ++i) {
+      buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    max_ns_ = std::max(max_ns_, other.max_ns_);
+  }
+
+  // Returns the lower bound of the bucket holding the given percentile.
+  absl::Duration Percentile(double percentile) const {
+    if (count_ == 0) {
+      return absl::ZeroDuration();
+    }
+    const int64_t rank =
+        std::max<int64_t>(1, static_cast<int64_t>(percentile / 100 * count_));
+    int64_t seen = 0;
+    for (size_t i = 0; i < buckets_.size(); ++i) {
+      seen += buckets_[i];
+      if (seen >= rank) {
+        return absl::Nanoseconds(LowerBound(i));
+      }
+    }
+    return Max();
+  }
+
+  absl::Duration Max() const { return absl::Nanoseconds(max_ns_); }
+
+ private:
+  static constexpr int kSubBucketBits = 3;
+  static constexpr int kSubBuckets = 1 << kSubBucketBits;
+
+  static size_t BucketFor(int64_t ns) {
+    if (ns < kSubBuckets) {
+      return ns;
+    }
+    const int exponent = 63 - __builtin_clzll(ns);
+    const int sub = (ns >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+    return (exponent - kSubBucketBits + 1) * kSubBuckets + sub;
+  }
+
+  static int64_t LowerBound(size_t bucket) {
+    if (bucket < kSubBuckets) {
+      return bucket;
+    }
+    const int exponent = bucket / kSubBuckets + kSubBucketBits - 1;
+    const int64_t sub = bucket % kSubBuckets;
+    return (int64_t{1} << exponent) + (sub << (exponent - kSubBucketBits));
+  }
+
+  std::array<int64_t, (64 - kSubBucketBits + 1) * kSubBuckets> buckets_ = {};
+  int64_t count_ = 0;
+  int64_t max_ns_ = 0;
+};
+
+// Returns the resident set size of pid in kB, or -1.
+int64_t GetRssKb(pid_t pid) {
+  // The value is given as e.g. "1234 kB".
+  std::string rss = sandbox2::util::GetProcStatusLine(pid, "VmRSS");
+  int64_t kb;
+  if (!absl::SimpleAtoi(absl::StripSuffix(rss, " kB"), &kb)) {
+    return -1;
+  }
+  return kb;
+}
+
+// Returns the number of open file descriptors of pid, or -1.
+int GetFdCount(pid_t pid) {
+  std::vector<std::string> entries;
+  std::string error;
+  if (!file_util::fileops::ListDirectoryEntries(
+          absl::StrCat("/proc/", pid, "/fd"), &entries, &error)) {
+    return -1;
+  }
+  return entries.size();
+}
+
+}  // namespace
+
+class Harness::Worker {
+ public:
+  Worker(const Options& options, uint64_t seed)
+      : rng_(seed),
+        operations_(MakeDistribution(options.mix)),
+        sum_api_(&sum_),
+        stringop_api_(&stringop_),
+        transfer_data_(std::max<size_t>(options.transfer_size / sizeof(int),
+                                        1),
+                       1) {}
+
+  absl::Status Init() {
+    SAPI_RETURN_IF_ERROR(sum_.Init());
+    SAPI_RETURN_IF_ERROR(stringop_.Init());
+    sum_pid_ = sum_.pid();
+    stringop_pid_ = stringop_.pid();
+    return absl::OkStatus();
+  }
+
+  void Run(const std::atomic<bool>& done) {
+    while (!done.load(std::memory_order_relaxed)) {
+      const absl::Time start = absl::Now();
+      absl::Status status = RunOperation(operations_(rng_));
+      const absl::Duration latency = absl::Now() - start;
+
+      absl::MutexLock lock(&mutex_);
+      histogram_.Add(latency);
+      ++operation_count_;
+      if (!status.ok()) {
+        ++error_count_;
+        LOG(WARNING) << "Soak operation failed: " << status;
+      }
+    }
+  }
+
+  // Adds the latencies and counts recorded since the last call to the
+  // arguments and resets them.
+  void TakeStats(LatencyHistogram& histogram, int64_t& operations,
+                 int64_t& errors) {
+    absl::MutexLock lock(&mutex_);
+    histogram.Merge(histogram_);
+    operations += operation_count_;
+    errors += error_count_;
+    histogram_ = LatencyHistogram();
+    operation_count_ = 0;
+    error_count_ = 0;
+  }
+
+  pid_t sum_pid() const { return sum_pid_; }
+  pid_t stringop_pid() const { return stringop_pid_; }
+
+ private:
+  enum Operation { kCall, kTransfer, kString, kRestart, kViolation };
+
+  // Picks operations with the probabilities given by their weights, in the
+  // order of the Operation enum.
+  static std::discrete_distribution<int> MakeDistribution(
+      const OperationMix& mix) {
+    const std::vector<int> weights = {mix.call, mix.transfer, mix.string,
+                                      mix.restart, mix.violation};
+    return std::discrete_distribution<int>(weights.begin(), weights.end());
+  }
+
+  absl::Status RunOperation(int operation) {
+    switch (operation) {
+      case kCall:
+        return Call();
+      case kTransfer:
+        return Transfer();
+      case kString:
+        return ReverseString();
+      case kRestart:
+        return Restart();
+      case kViolation:
+        return Violate();
+    }
+    return absl::InternalError("Unknown operation");
+  }
+
+  absl::Status Call() {
+    const int a = rng_() % 1000;
+    const int b = rng_() % 1000;
+    SAPI_ASSIGN_OR_RETURN(int sum, sum_api_.sum(a, b));
+    if (sum != a + b) {
+      return absl::DataLossError(absl::StrCat("sum() returned ", sum));
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status Transfer() {
+    sapi::v::Array<int> array(transfer_data_.data(), transfer_data_.size());
+    SAPI_ASSIGN_OR_RETURN(
+        int sum, sum_api_.sumarr(array.PtrBefore(), transfer_data_.size()));
+    if (sum != static_cast<int>(transfer_data_.size())) {
+      return absl::DataLossError(absl::StrCat("sumarr() returned ", sum));
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status ReverseString() {
+    sapi::v::LenVal param("0123456789", 10);
+    SAPI_ASSIGN_OR_RETURN(int ret,
+                          stringop_api_.reverse_string(param.PtrBoth()));
+    absl::string_view data(reinterpret_cast<const char*>(param.GetData()),
+                           param.GetDataSize());
+    if (ret != 1 || data != "9876543210") {
+      return absl::DataLossError(
+          absl::StrCat("reverse_string() returned '", data, "'"));
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status Restart() {
+    SAPI_RETURN_IF_ERROR(sum_.Restart(/*attempt_graceful_exit=*/false));
+    sum_pid_ = sum_.pid();
+    return absl::OkStatus();
+  }
+
+  absl::Status Violate() {
+    if (sum_api_.violate().ok()) {
+      return absl::FailedPreconditionError("violate() succeeded");
+    }
+    if (const auto& result = sum_.AwaitResult();
+        result.final_status() != sandbox2::Result::VIOLATION) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Unexpected result after violate(): ",
+                       result.ToString()));
+    }
+    return Restart();
+  }
+
+  std::mt19937_64 rng_;
+  std::discrete_distribution<int> operations_;
+  SumSandbox sum_;
+  SumApi sum_api_;
+  StringopSandbox stringop_;
+  StringopApi stringop_api_;
+  std::vector<int> transfer_data_;
+  std::atomic<pid_t> sum_pid_ = -1;
+  std::atomic<pid_t> stringop_pid_ = -1;
+
+  absl::Mutex mutex_;
+  LatencyHistogram histogram_ ABSL_GUARDED_BY(mutex_);
+  int64_t operation_count_ ABSL_GUARDED_BY(mutex_) = 0;
+  int64_t error_count_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+std::string Sample::ToString() const {
+  return absl::StrFormat(
+      "t=%s ops=%d errors=%d ops/s=%.1f p50=%s p90=%s p99=%s max=%s "
+      "host_rss=%dkB sandboxee_rss=%dkB host_fds=%d sandboxee_fds=%d "
+      "host_threads=%d sandboxee_threads=%d",
+      absl::FormatDuration(elapsed), operations, errors, operations_per_sec,
+      absl::FormatDuration(p50), absl::FormatDuration(p90),
+      absl::FormatDuration(p99), absl::FormatDuration(max), host_rss_kb,
+      sandboxee_rss_kb, host_fds, sandboxee_fds, host_threads,
+      sandboxee_threads);
+}
+
+absl::Status CheckDrift(const Thresholds& thresholds, int warmup_samples,
+                        absl::Span<const Sample> samples) {
+  int64_t errors = 0;
+  for (const Sample& sample : samples) {
+    errors += sample.errors;
+  }
+  if (thresholds.max_errors >= 0 && errors > thresholds.max_errors) {
+    return absl::FailedPreconditionError(
+        absl::StrCat(errors, " operations failed"));
+  }
+  if (warmup_samples < 0 ||
+      samples.size() <= static_cast<size_t>(warmup_samples)) {
+    return absl::OkStatus();
+  }
+
+  const Sample& base = samples[warmup_samples];
+  auto check_growth = [&base](absl::string_view what, int64_t baseline,
+                              int64_t value, int64_t max_growth,
+                              const Sample& sample) -> absl::Status {
+    if (max_growth < 0 || baseline < 0 || value < 0 ||
+        value - baseline <= max_growth) {
+      return absl::OkStatus();
+    }
+    return absl::FailedPreconditionError(absl::StrCat(
+        what, " grew from ", baseline, " to ", value, " between t=",
+        absl::FormatDuration(base.elapsed), " and t=",
+        absl::FormatDuration(sample.elapsed)));
+  };
+  for (const Sample& sample : samples.subspan(warmup_samples + 1)) {
+    SAPI_RETURN_IF_ERROR(check_growth("Host RSS (kB)", base.host_rss_kb,
+                                      sample.host_rss_kb,
+                                      thresholds.max_host_rss_growth_kb,
+                                      sample));
+    SAPI_RETURN_IF_ERROR(check_growth(
+        "Sandboxee RSS (kB)", base.sandboxee_rss_kb, sample.sandboxee_rss_kb,
+        thresholds.max_sandboxee_rss_growth_kb, sample));
+    SAPI_RETURN_IF_ERROR(check_growth("Host fds", base.host_fds,
+                                      sample.host_fds,
+                                      thresholds.max_host_fd_growth, sample));
+    SAPI_RETURN_IF_ERROR(check_growth(
+        "Sandboxee fds", base.sandboxee_fds, sample.sandboxee_fds,
+        thresholds.max_sandboxee_fd_growth, sample));
+    SAPI_RETURN_IF_ERROR(check_growth(
+        "Host threads", base.host_threads, sample.host_threads,
+        thresholds.max_host_thread_growth, sample));
+    SAPI_RETURN_IF_ERROR(check_growth(
+        "Sandboxee threads", base.sandboxee_threads, sample.sandboxee_threads,
+        thresholds.max_sandboxee_thread_growth, sample));
+
+    if (thresholds.max_throughput_drop >= 0 && base.operations_per_sec > 0 &&
+        sample.operations_per_sec <
+            base.operations_per_sec * (1 - thresholds.max_throughput_drop)) {
+      return absl::FailedPreconditionError(absl::StrFormat(
+          "Throughput dropped from %.1f to %.1f ops/s at t=%s",
+          base.operations_per_sec, sample.operations_per_sec,
+          absl::FormatDuration(sample.elapsed)));
+    }
+    if (thresholds.max_p99_growth >= 0 && base.p99 > absl::ZeroDuration() &&
+        sample.p99 > base.p99 * thresholds.max_p99_growth) {
+      return absl::FailedPreconditionError(absl::StrCat(
+          "p99 latency grew from ", absl::FormatDuration(base.p99), " to ",
+          absl::FormatDuration(sample.p99), " at t=",
+          absl::FormatDuration(sample.elapsed)));
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::unique_ptr<Harness>> Harness::Create(
+    const Options& options) {
+  if (options.threads <= 0 || options.sample_interval <= absl::ZeroDuration()) {
+    return absl::InvalidArgumentError(
+        "Thread count and sample interval must be positive");
+  }
+  const OperationMix& mix = options.mix;
+  if (std::min({mix.call, mix.transfer, mix.string, mix.restart,
+                mix.violation}) < 0 ||
+      mix.call + mix.transfer + mix.string + mix.restart + mix.violation ==
+          0) {
+    return absl::InvalidArgumentError(
+        "Operation weights must be non-negative and not all zero");
+  }
+
+  // Using `new` to access a non-public constructor.
+  auto harness = absl::WrapUnique(new Harness(options));
+  for (int i = 0; i < options.threads; ++i) {
+    auto worker =
+        std::make_unique<Worker>(harness->options_, options.seed + i);
+    SAPI_RETURN_IF_ERROR(worker->Init());
+    harness->workers_.push_back(std::move(worker));
+  }
+  return harness;
+}
+
+Harness::Harness(const Options& options) : options_(options) {}
+
+Harness::~Harness() = default;
+
+absl::StatusOr<std::vector<Sample>> Harness::Run(
+    const SampleCallback& on_sample) {
+  workers_done_ = false;
+  std::vector<std::thread> threads;
+  threads.reserve(workers_.size());
+  for (auto& worker : workers_) {
+    threads.emplace_back([this, &worker] { worker->Run(workers_done_); });
+  }
+
+  std::vector<Sample> samples;
+  const absl::Time start = absl::Now();
+  const absl::Time deadline = start + options_.duration;
+  absl::Time last_sample = start;
+  for (bool stop = false; !stop;) {
+    const absl::Time next_sample =
+        std::min(last_sample + options_.sample_interval, deadline);
+    {
+      absl::MutexLock lock(&stop_mutex_);
+      stop_mutex_.AwaitWithDeadline(absl::Condition(&stop_), next_sample);
+      stop = stop_;
+    }
+    const absl::Time now = absl::Now();
+    stop = stop || now >= deadline;
+    samples.push_back(TakeSample(now - start, now - last_sample));
+    last_sample = now;
+    if (on_sample) {
+      on_sample(samples.back());
+    }
+  }
+
+  workers_done_ = true;
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return samples;
+}
+
+void Harness::Stop() {
+  absl::MutexLock lock(&stop_mutex_);
+  stop_ = true;
+}
+
+Sample Harness::TakeSample(absl::Duration elapsed, absl::Duration interval) {
+  Sample sample;
+  sample.elapsed = elapsed;
+
+  LatencyHistogram histogram;
+  for (auto& worker : workers_) {
+    worker->TakeStats(histogram, sample.operations, sample.errors);
+  }
+  if (interval > absl::ZeroDuration()) {
+    sample.operations_per_sec =
+        sample.operations / absl::ToDoubleSeconds(interval);
+  }
+  sample.p50 = histogram.Percentile(50);
+  sample.p90 = histogram.Percentile(90);
+  sample.p99 = histogram.Percentile(99);
+  sample.max = histogram.Max();
+
+  const pid_t host_pid = getpid();
+  sample.host_rss_kb = GetRssKb(host_pid);
+  sample.host_fds = GetFdCount(host_pid);
+  sample.host_threads = sandbox2::sanitizer::GetNumberOfThreads(host_pid);
+
+  // A sandboxee that is restarting right now cannot be measured, in which
+  // case the totals are left unknown rather than being too low.
+  sample.sandboxee_rss_kb = 0;
+  sample.sandboxee_fds = 0;
+  sample.sandboxee_threads = 0;
+  for (auto& worker : workers_) {
+    for (pid_t pid : {worker->sum_pid(), worker->stringop_pid()}) {
+      const int64_t rss_kb = GetRssKb(pid);
+      const int fds = GetFdCount(pid);
+      const int threads = sandbox2::sanitizer::GetNumberOfThreads(pid);
+      if (rss_kb < 0 || sample.sandboxee_rss_kb < 0) {
+        sample.sandboxee_rss_kb = -1;
+      } else {
+        sample.sandboxee_rss_kb += rss_kb;
+      }
+      if (fds < 0 || sample.sandboxee_fds < 0) {
+        sample.sandboxee_fds = -1;
+      } else {
+        sample.sandboxee_fds += fds;
+      }
+      if (threads < 0 || sample.sandboxee_threads < 0) {
+        sample.sandboxee_threads = -1;
+      } else {
+        sample.sandboxee_threads += threads;
+      }
+    }
+  }
+  return sample;
+}
+
+}  // namespace sapi::soak
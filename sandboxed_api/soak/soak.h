@@ -0,0 +1,151 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Long-running soak and throughput harness for SAPI sandboxes.
+//
+// Runs a configurable mix of calls, transfers, restarts and policy violations
+// against the sum and stringop example libraries from a number of threads,
+// and periodically records throughput, latency percentiles and resource
+// usage of the host and of the sandboxees. Leaks and slowdowns that only show
+// up after many operations become visible as drift between an early baseline
+// sample and the later ones, which CheckDrift() compares against thresholds.
+
+#ifndef SANDBOXED_API_SOAK_SOAK_H_
+#define SANDBOXED_API_SOAK_SOAK_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+
+namespace sapi::soak {
+
+// Relative weights of the operations the workers pick from.
+struct OperationMix {
+  // sum() on two integers.
+  int call = 60;
+  // sumarr() on an array of Options::transfer_size bytes, which is copied to
+  // the sandboxee before the call.
+  int transfer = 20;
+  // reverse_string() in the stringop sandbox, copying data both ways.
+  int string = 10;
+  // Restart of the worker's sum sandbox.
+  int restart = 5;
+  // Call of violate(), followed by a restart.
+  int violation = 5;
+};
+
+// Limits for the drift between the baseline sample and any later sample.
+// Negative values disable a check.
+struct Thresholds {
+  int64_t max_host_rss_growth_kb = 64 << 10;
+  int64_t max_sandboxee_rss_growth_kb = 64 << 10;
+  int max_host_fd_growth = 16;
+  int max_sandboxee_fd_growth = 16;
+  int max_host_thread_growth = 8;
+  int max_sandboxee_thread_growth = 8;
+  // Maximum relative drop of calls per second, e.g. 0.5 for 50%.
+  double max_throughput_drop = 0.5;
+  // Maximum factor by which the 99th latency percentile may grow.
+  double max_p99_growth = 4.0;
+  // Operations that failed unexpectedly, in total.
+  int64_t max_errors = 0;
+};
+
+struct Options {
+  int threads = 4;
+  absl::Duration duration = absl::Hours(1);
+  absl::Duration sample_interval = absl::Seconds(30);
+  // Number of samples to skip before taking the baseline, to let caches,
+  // allocators and forkservers warm up.
+  int warmup_samples = 1;
+  size_t transfer_size = 64 << 10;
+  uint64_t seed = 1;
+  OperationMix mix;
+  Thresholds thresholds;
+};
+
+// Measurements over one sample interval. Resource counts are -1 if they
+// could not be read.
+struct Sample {
+  absl::Duration elapsed;
+  int64_t operations = 0;
+  int64_t errors = 0;
+  double operations_per_sec = 0;
+  absl::Duration p50;
+  absl::Duration p90;
+  absl::Duration p99;
+  absl::Duration max;
+  int64_t host_rss_kb = -1;
+  // Summed over the sandboxees of all workers.
+  int64_t sandboxee_rss_kb = -1;
+  int host_fds = -1;
+  int sandboxee_fds = -1;
+  int host_threads = -1;
+  int sandboxee_threads = -1;
+
+  std::string ToString() const;
+};
+
+// Compares samples[warmup_samples] with all later samples. Returns
+// FailedPrecondition describing the first threshold exceeded.
+absl::Status CheckDrift(const Thresholds& thresholds, int warmup_samples,
+                        absl::Span<const Sample> samples);
+
+class Harness {
+ public:
+  using SampleCallback = std::function<void(const Sample&)>;
+
+  static absl::StatusOr<std::unique_ptr<Harness>> Create(
+      const Options& options);
+
+  ~Harness();
+
+  // Runs for the configured duration or until Stop() is called, invoking
+  // on_sample for each sample taken, and returns all samples. Failed
+  // operations are counted in the samples; drift is left to CheckDrift().
+  absl::StatusOr<std::vector<Sample>> Run(
+      const SampleCallback& on_sample = nullptr);
+
+  // Makes Run() take a last sample and return. Thread-safe.
+  void Stop();
+
+ private:
+  class Worker;
+
+  explicit Harness(const Options& options);
+
+  // Takes the latencies recorded since the last call and the counters, and
+  // reads the resource usage.
+  Sample TakeSample(absl::Duration elapsed, absl::Duration interval);
+
+  Options options_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  absl::Mutex stop_mutex_;
+  bool stop_ ABSL_GUARDED_BY(stop_mutex_) = false;
+  std::atomic<bool> workers_done_ = false;
+};
+
+}  // namespace sapi::soak
+
+#endif  // SANDBOXED_API_SOAK_SOAK_H_
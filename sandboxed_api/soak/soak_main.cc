@@ -0,0 +1,133 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs the soak harness and exits with a non-zero status if the samples drift
+// beyond the thresholds. Example:
+//
+//   sapi_soak --threads=8 --duration=6h --sample_interval=1m
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "absl/base/log_severity.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/log/globals.h"
+#include "absl/log/initialize.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/soak/soak.h"
+
+ABSL_FLAG(int, threads, 4, "Number of worker threads");
+ABSL_FLAG(absl::Duration, duration, absl::Hours(1), "Total run time");
+ABSL_FLAG(absl::Duration, sample_interval, absl::Seconds(30),
+          "Time between samples");
+ABSL_FLAG(int, warmup_samples, 1,
+          "Samples to skip before taking the baseline for drift checks");
+ABSL_FLAG(uint64_t, transfer_size, 64 << 10,
+          "Bytes copied to the sandboxee by each transfer operation");
+ABSL_FLAG(uint64_t, seed, 1, "Seed for picking operations");
+
+ABSL_FLAG(int, call_weight, 60, "Relative weight of plain calls");
+ABSL_FLAG(int, transfer_weight, 20, "Relative weight of array transfers");
+ABSL_FLAG(int, string_weight, 10, "Relative weight of string round trips");
+ABSL_FLAG(int, restart_weight, 5, "Relative weight of sandbox restarts");
+ABSL_FLAG(int, violation_weight, 5,
+          "Relative weight of policy violations (followed by a restart)");
+
+ABSL_FLAG(int64_t, max_host_rss_growth_kb, 64 << 10,
+          "Maximum growth of the host RSS, negative to disable");
+ABSL_FLAG(int64_t, max_sandboxee_rss_growth_kb, 64 << 10,
+          "Maximum growth of the summed sandboxee RSS, negative to disable");
+ABSL_FLAG(int, max_host_fd_growth, 16,
+          "Maximum growth of open host fds, negative to disable");
+ABSL_FLAG(int, max_sandboxee_fd_growth, 16,
+          "Maximum growth of open sandboxee fds, negative to disable");
+ABSL_FLAG(int, max_host_thread_growth, 8,
+          "Maximum growth of host threads, negative to disable");
+ABSL_FLAG(int, max_sandboxee_thread_growth, 8,
+          "Maximum growth of the summed sandboxee threads, negative to "
+          "disable");
+ABSL_FLAG(double, max_throughput_drop, 0.5,
+          "Maximum relative drop of operations per second, negative to "
+          "disable");
+ABSL_FLAG(double, max_p99_growth, 4.0,
+          "Maximum factor of p99 latency growth, negative to disable");
+ABSL_FLAG(int64_t, max_errors, 0,
+          "Maximum number of failed operations, negative to disable");
+
+int main(int argc, char* argv[]) {
+  absl::SetStderrThreshold(absl::LogSeverityAtLeast::kInfo);
+  absl::ParseCommandLine(argc, argv);
+  absl::InitializeLog();
+
+  sapi::soak::Options options;
+  options.threads = absl::GetFlag(FLAGS_threads);
+  options.duration = absl::GetFlag(FLAGS_duration);
+  options.sample_interval = absl::GetFlag(FLAGS_sample_interval);
+  options.warmup_samples = absl::GetFlag(FLAGS_warmup_samples);
+  options.transfer_size = absl::GetFlag(FLAGS_transfer_size);
+  options.seed = absl::GetFlag(FLAGS_seed);
+
+  sapi::soak::OperationMix& mix = options.mix;
+  mix.call = absl::GetFlag(FLAGS_call_weight);
+  mix.transfer = absl::GetFlag(FLAGS_transfer_weight);
+  mix.string = absl::GetFlag(FLAGS_string_weight);
+  mix.restart = absl::GetFlag(FLAGS_restart_weight);
+  mix.violation = absl::GetFlag(FLAGS_violation_weight);
+
+  sapi::soak::Thresholds& thresholds = options.thresholds;
+  thresholds.max_host_rss_growth_kb =
+      absl::GetFlag(FLAGS_max_host_rss_growth_kb);
+  thresholds.max_sandboxee_rss_growth_kb =
+      absl::GetFlag(FLAGS_max_sandboxee_rss_growth_kb);
+  thresholds.max_host_fd_growth = absl::GetFlag(FLAGS_max_host_fd_growth);
+  thresholds.max_sandboxee_fd_growth =
+      absl::GetFlag(FLAGS_max_sandboxee_fd_growth);
+  thresholds.max_host_thread_growth =
+      absl::GetFlag(FLAGS_max_host_thread_growth);
+  thresholds.max_sandboxee_thread_growth =
+      absl::GetFlag(FLAGS_max_sandboxee_thread_growth);
+  thresholds.max_throughput_drop = absl::GetFlag(FLAGS_max_throughput_drop);
+  thresholds.max_p99_growth = absl::GetFlag(FLAGS_max_p99_growth);
+  thresholds.max_errors = absl::GetFlag(FLAGS_max_errors);
+
+  absl::StatusOr<std::unique_ptr<sapi::soak::Harness>> harness =
+      sapi::soak::Harness::Create(options);
+  if (!harness.ok()) {
+    LOG(ERROR) << "Setting up the harness failed: " << harness.status();
+    return EXIT_FAILURE;
+  }
+  absl::StatusOr<std::vector<sapi::soak::Sample>> samples =
+      (*harness)->Run([](const sapi::soak::Sample& sample) {
+        LOG(INFO) << sample.ToString();
+      });
+  if (!samples.ok()) {
+    LOG(ERROR) << "Soak run failed: " << samples.status();
+    return EXIT_FAILURE;
+  }
+  if (absl::Status status = sapi::soak::CheckDrift(
+          thresholds, options.warmup_samples, *samples);
+      !status.ok()) {
+    LOG(ERROR) << "Drift check failed: " << status;
+    return EXIT_FAILURE;
+  }
+  LOG(INFO) << "No drift beyond thresholds in " << samples->size()
+            << " samples";
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,161 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/soak/soak.h"
+
+#include <memory>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/testing.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sapi::soak {
+namespace {
+
+using ::sapi::IsOk;
+using ::sapi::StatusIs;
+using ::testing::AnyOf;
+using ::testing::Each;
+using ::testing::Eq;
+using ::testing::Field;
+using ::testing::Ge;
+using ::testing::Gt;
+using ::testing::HasSubstr;
+using ::testing::SizeIs;
+
+Sample MakeSample(absl::Duration elapsed) {
+  Sample sample;
+  sample.elapsed = elapsed;
+  sample.operations = 1000;
+  sample.operations_per_sec = 100;
+  sample.p99 = absl::Milliseconds(2);
+  sample.host_rss_kb = 10000;
+  sample.sandboxee_rss_kb = 20000;
+  sample.host_fds = 10;
+  sample.sandboxee_fds = 20;
+  sample.host_threads = 5;
+  sample.sandboxee_threads = 4;
+  return sample;
+}
+
+TEST(CheckDriftTest, AcceptsStableSamples) {
+  std::vector<Sample> samples = {MakeSample(absl::Seconds(1)),
+                                 MakeSample(absl::Seconds(2)),
+                                 MakeSample(absl::Seconds(3))};
+  samples[2].host_rss_kb += 100;
+  samples[2].operations_per_sec = 90;
+  EXPECT_THAT(CheckDrift(Thresholds(), 1, samples), IsOk());
+}
+
+TEST(CheckDriftTest, IgnoresWarmup) {
+  std::vector<Sample> samples = {MakeSample(absl::Seconds(1)),
+                                 MakeSample(absl::Seconds(2))};
+  samples[0].host_fds = 3;
+  samples[0].operations_per_sec = 1000;
+  EXPECT_THAT(CheckDrift(Thresholds(), 1, samples), IsOk());
+}
+
+TEST(CheckDriftTest, DetectsLeaks) {
+  std::vector<Sample> samples = {MakeSample(absl::Seconds(1)),
+                                 MakeSample(absl::Seconds(2))};
+  samples[1].sandboxee_fds += 100;
+  absl::Status status = CheckDrift(Thresholds(), 0, samples);
+  EXPECT_THAT(status, StatusIs(absl::StatusCode::kFailedPrecondition));
+  EXPECT_THAT(status.message(), HasSubstr("Sandboxee fds"));
+
+  Thresholds thresholds;
+  thresholds.max_sandboxee_fd_growth = -1;
+  EXPECT_THAT(CheckDrift(thresholds, 0, samples), IsOk());
+
+  samples[1].sandboxee_threads += 10;
+  status = CheckDrift(thresholds, 0, samples);
+  EXPECT_THAT(status, StatusIs(absl::StatusCode::kFailedPrecondition));
+  EXPECT_THAT(status.message(), HasSubstr("Sandboxee threads"));
+}
+
+TEST(CheckDriftTest, SkipsUnknownValues) {
+  std::vector<Sample> samples = {MakeSample(absl::Seconds(1)),
+                                 MakeSample(absl::Seconds(2))};
+  samples[1].sandboxee_rss_kb = -1;
+  EXPECT_THAT(CheckDrift(Thresholds(), 0, samples), IsOk());
+}
+
+TEST(CheckDriftTest, DetectsSlowdowns) {
+  std::vector<Sample> samples = {MakeSample(absl::Seconds(1)),
+                                 MakeSample(absl::Seconds(2))};
+  samples[1].operations_per_sec = 10;
+  absl::Status status = CheckDrift(Thresholds(), 0, samples);
+  EXPECT_THAT(status, StatusIs(absl::StatusCode::kFailedPrecondition));
+  EXPECT_THAT(status.message(), HasSubstr("Throughput"));
+
+  samples[1] = MakeSample(absl::Seconds(2));
+  samples[1].p99 = absl::Milliseconds(20);
+  status = CheckDrift(Thresholds(), 0, samples);
+  EXPECT_THAT(status, StatusIs(absl::StatusCode::kFailedPrecondition));
+  EXPECT_THAT(status.message(), HasSubstr("p99"));
+}
+
+TEST(CheckDriftTest, DetectsErrors) {
+  std::vector<Sample> samples = {MakeSample(absl::Seconds(1))};
+  samples[0].errors = 1;
+  EXPECT_THAT(CheckDrift(Thresholds(), 1, samples),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
+TEST(HarnessTest, RejectsInvalidOptions) {
+  Options options;
+  options.threads = 0;
+  EXPECT_THAT(Harness::Create(options).status(),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+
+  options = Options();
+  options.mix = {0, 0, 0, 0, 0};
+  EXPECT_THAT(Harness::Create(options).status(),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(HarnessTest, ShortRun) {
+  SKIP_SANITIZERS_AND_COVERAGE;
+
+  Options options;
+  options.threads = 2;
+  options.duration = absl::Seconds(3);
+  options.sample_interval = absl::Seconds(1);
+  SAPI_ASSERT_OK_AND_ASSIGN(std::unique_ptr<Harness> harness,
+                            Harness::Create(options));
+
+  int callbacks = 0;
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::vector<Sample> samples,
+      harness->Run([&callbacks](const Sample&) { ++callbacks; }));
+  EXPECT_THAT(samples, SizeIs(callbacks));
+  ASSERT_THAT(samples, SizeIs(Ge(3)));
+  EXPECT_THAT(samples, Each(Field(&Sample::operations, Gt(0))));
+  EXPECT_THAT(samples, Each(Field(&Sample::errors, 0)));
+  EXPECT_THAT(samples, Each(Field(&Sample::host_rss_kb, Gt(0))));
+  EXPECT_THAT(samples, Each(Field(&Sample::host_fds, Gt(0))));
+  EXPECT_THAT(samples, Each(Field(&Sample::host_threads, Gt(2))));
+  // Unknown if a sandboxee was restarting, at least one thread for each of
+  // the four sandboxees otherwise.
+  EXPECT_THAT(samples, Each(Field(&Sample::sandboxee_threads,
+                                  AnyOf(Eq(-1), Ge(4)))));
+  EXPECT_THAT(samples.back().p99, Ge(samples.back().p50));
+}
+
+}  // namespace
+}  // namespace sapi::soak
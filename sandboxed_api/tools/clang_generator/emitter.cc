@@ -20,6 +20,7 @@
 #include <utility>
 #include <vector>
 
+#include "absl/algorithm/container.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/container/node_hash_set.h"
 #include "absl/random/random.h"
@@ -60,12 +61,14 @@ constexpr absl::string_view kHeaderProlog =
 #ifndef %1$s
 #define %1$s
 
+#include <algorithm>
 #include <cstdint>
 #include <type_traits>
 
 #include "absl/base/macros.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "sandboxed_api/sandbox.h"
 #include "sandboxed_api/util/status_macros.h"
 #include "sandboxed_api/vars.h"
@@ -313,6 +316,16 @@ absl::StatusOr<std::string> PrintFunctionPrototypeComment(
   return out;
 }
 
+// Returns whether values of the given type can be passed to and returned from
+// sapi::Sandbox::CallScalar().
+bool IsScalarCallType(const clang::ASTContext& context, clang::QualType qual) {
+  if (qual->isRealFloatingType()) {
+    return true;
+  }
+  return qual->isIntegralOrEnumerationType() &&
+         context.getTypeSize(qual) <= context.getTypeSize(context.VoidPtrTy);
+}
+
 absl::StatusOr<std::string> EmitFunction(const clang::FunctionDecl* decl) {
   const clang::QualType return_type = decl->getDeclaredReturnType();
   if (return_type->isRecordType()) {
@@ -363,6 +376,26 @@ absl::StatusOr<std::string> EmitFunction(const clang::FunctionDecl* decl) {
   }
 
   absl::StrAppend(&out, ") {\n");
+
+  // Functions that only take and return scalars use the compile-time
+  // specialized call path, which does not need v::Var wrappers.
+  if ((returns_void || IsScalarCallType(context, return_type)) &&
+      absl::c_all_of(params, [&context](const ParameterInfo& param) {
+        return IsScalarCallType(context, param.qual);
+      })) {
+    absl::StrAppend(
+        &out, "return sandbox_->CallScalar<",
+        returns_void ? "void"
+                     : MapQualTypeParameterForCxx(
+                           context, return_type.getUnqualifiedType()),
+        ">(\"", function_name, "\"");
+    for (const auto& [qual, name] : params) {
+      absl::StrAppend(&out, ", ", name);
+    }
+    absl::StrAppend(&out, ");\n}\n");
+    return out;
+  }
+
   absl::StrAppend(&out, MapQualType(context, return_type), " v_ret_;\n");
   for (const auto& [qual, name] : params) {
     if (!IsPointerOrReference(qual)) {
@@ -381,6 +414,199 @@ absl::StatusOr<std::string> EmitFunction(const clang::FunctionDecl* decl) {
   return out;
 }
 
+// Returns the element type of a buffer parameter, for use with absl::Span<>
+// and sapi::v::Array<>. Untyped buffers are transferred as bytes.
+std::string GetBufferElementType(const clang::ASTContext& context,
+                                 clang::QualType qual) {
+  const clang::QualType pointee = qual->getPointeeType();
+  std::string type =
+      pointee->isVoidType()
+          ? "uint8_t"
+          : MapQualTypeParameterForCxx(context, pointee.getUnqualifiedType());
+  return pointee.isConstQualified() ? absl::StrCat("const ", type) : type;
+}
+
+// Emits an overload of a function that takes its buffer parameters as spans
+// instead of v::Ptr objects. The length parameters are derived from the spans
+// and the transfer direction from the constness of the buffers: const buffers
+// are only copied to the sandboxee, and output buffers with a parameter for
+// the number of elements written only copy back that many elements. Returns an
+// empty string if the function has no buffer parameters.
+absl::StatusOr<std::string> EmitBufferOverload(
+    const clang::FunctionDecl* decl, const GeneratorOptions& options) {
+  std::vector<BufferParam> buffers;
+  if (auto it = options.buffer_annotations.find(ToStringView(decl->getName()));
+      it != options.buffer_annotations.end()) {
+    SAPI_ASSIGN_OR_RETURN(buffers, GetBufferParams(decl, it->second));
+  } else if (options.detect_buffers) {
+    SAPI_ASSIGN_OR_RETURN(buffers, GetBufferParams(decl, {}));
+  }
+  if (buffers.empty()) {
+    return "";
+  }
+
+  const clang::ASTContext& context = decl->getASTContext();
+  const clang::QualType return_type = decl->getDeclaredReturnType();
+  const bool returns_void = return_type->isVoidType();
+  auto function_name = ToStringView(decl->getName());
+
+  enum class Role { kOther, kBuffer, kLength, kOutLength };
+  struct ParameterInfo {
+    clang::QualType qual;
+    std::string name;
+    Role role = Role::kOther;
+    // The buffer a buffer, length or output length parameter belongs to.
+    const BufferParam* buffer = nullptr;
+  };
+  std::vector<ParameterInfo> params(decl->getNumParams());
+  for (int i = 0; i < decl->getNumParams(); ++i) {
+    params[i].qual = decl->getParamDecl(i)->getType();
+    params[i].name = GetParamName(decl->getParamDecl(i), i);
+  }
+  for (const BufferParam& buffer : buffers) {
+    params[buffer.buffer].role = Role::kBuffer;
+    params[buffer.buffer].buffer = &buffer;
+    if (buffer.length >= 0) {
+      params[buffer.length].role = Role::kLength;
+      params[buffer.length].buffer = &buffer;
+    }
+    if (buffer.out_length >= 0) {
+      params[buffer.out_length].role = Role::kOutLength;
+      params[buffer.out_length].buffer = &buffer;
+    }
+  }
+  auto buffer_name = [&params](const ParameterInfo& param) {
+    return params[param.buffer->buffer].name;
+  };
+  auto buffer_size = [&context, &buffer_name](const ParameterInfo& param,
+                                               clang::QualType size_type) {
+    return absl::StrCat("static_cast<",
+                        MapQualTypeParameterForCxx(
+                            context, size_type.getUnqualifiedType()),
+                        ">(", buffer_name(param), ".size())");
+  };
+
+  std::string out = absl::StrCat(
+      "\n// Overload of ", function_name,
+      "() that takes buffers as spans and only transfers the elements in "
+      "use.\n",
+      MapQualTypeReturn(context, return_type), " ", function_name, "(");
+  std::string print_separator;
+  for (const ParameterInfo& param : params) {
+    if (param.role == Role::kLength) {
+      continue;
+    }
+    absl::StrAppend(&out, print_separator);
+    print_separator = ", ";
+    switch (param.role) {
+      case Role::kBuffer:
+        absl::StrAppend(&out, "::absl::Span<",
+                        GetBufferElementType(context, param.qual), "> ");
+        break;
+      case Role::kOutLength:
+        absl::StrAppend(
+            &out,
+            MapQualTypeParameterForCxx(context,
+                                       param.qual->getPointeeType()),
+            "* ");
+        break;
+      default:
+        absl::StrAppend(&out, MapQualTypeParameter(context, param.qual), " ");
+        break;
+    }
+    absl::StrAppend(&out, param.name);
+  }
+  absl::StrAppend(&out, ") {\n");
+
+  absl::StrAppend(&out, MapQualType(context, return_type), " v_ret_;\n");
+  for (const ParameterInfo& param : params) {
+    switch (param.role) {
+      case Role::kBuffer:
+        absl::StrAppend(&out, "::sapi::v::Array<",
+                        GetBufferElementType(context, param.qual), "> v_",
+                        param.name, "(", param.name, ".data(), ", param.name,
+                        ".size());\n");
+        if (param.buffer->out_length >= 0) {
+          // Allocated up front, so that the call does not transfer it.
+          absl::StrAppend(&out, "SAPI_RETURN_IF_ERROR(sandbox_->Allocate(&v_",
+                          param.name, ", /*automatic_free=*/true));\n");
+        }
+        break;
+      case Role::kLength:
+        absl::StrAppend(&out, MapQualType(context, param.qual), " v_",
+                        param.name, "(", buffer_size(param, param.qual),
+                        ");\n");
+        break;
+      case Role::kOutLength: {
+        const clang::QualType pointee = param.qual->getPointeeType();
+        absl::StrAppend(&out, MapQualType(context, pointee), " v_", param.name);
+        if (param.buffer->length < 0) {
+          // Also passes the capacity of the buffer.
+          absl::StrAppend(&out, "(", buffer_size(param, pointee), ")");
+        }
+        absl::StrAppend(&out, ";\n");
+        break;
+      }
+      default:
+        if (!IsPointerOrReference(param.qual)) {
+          absl::StrAppend(&out, MapQualType(context, param.qual), " v_",
+                          param.name, "(", param.name, ");\n");
+        }
+        break;
+    }
+  }
+
+  absl::StrAppend(&out, "\nSAPI_RETURN_IF_ERROR(sandbox_->Call(\"",
+                  function_name, "\", &v_ret_");
+  for (const ParameterInfo& param : params) {
+    absl::StrAppend(&out, ", ");
+    switch (param.role) {
+      case Role::kBuffer:
+        absl::StrAppend(
+            &out, "v_", param.name,
+            param.qual->getPointeeType().isConstQualified() ? ".PtrBefore()"
+            : param.buffer->out_length >= 0                 ? ".PtrNone()"
+                                                            : ".PtrBoth()");
+        break;
+      case Role::kOutLength:
+        absl::StrAppend(
+            &out, "v_", param.name,
+            param.buffer->length < 0 ? ".PtrBoth()" : ".PtrAfter()");
+        break;
+      default:
+        absl::StrAppend(&out, IsPointerOrReference(param.qual) ? "" : "&v_",
+                        param.name);
+        break;
+    }
+  }
+  absl::StrAppend(&out, "));\n");
+
+  for (const ParameterInfo& param : params) {
+    if (param.role != Role::kOutLength) {
+      continue;
+    }
+    // Copies back the written elements, but never more than fit. Parameter
+    // names always end in an underscore, so "v_used_elements" cannot shadow
+    // the variable of a parameter.
+    const ParameterInfo& buffer = params[param.buffer->buffer];
+    absl::StrAppend(&out, "*", param.name, " = v_", param.name,
+                    ".GetValue();\nif (v_", param.name,
+                    ".GetValue() > 0) {\n::sapi::v::Array<",
+                    GetBufferElementType(context, buffer.qual),
+                    "> v_used_elements(", buffer.name,
+                    ".data(), ::std::min<size_t>(v_", param.name,
+                    ".GetValue(), ", buffer.name, ".size()));\n");
+    absl::StrAppend(&out, "v_used_elements.SetRemote(v_", buffer.name,
+                    ".GetRemote());\n"
+                    "SAPI_RETURN_IF_ERROR(sandbox_->TransferFromSandboxee("
+                    "&v_used_elements));\n}\n");
+  }
+  absl::StrAppend(&out, "return ",
+                  (returns_void ? "::absl::OkStatus()" : "v_ret_.GetValue()"),
+                  ";\n}\n");
+  return out;
+}
+
 absl::StatusOr<std::string> EmitHeader(
     const std::vector<std::string>& function_definitions,
     const std::vector<const RenderedType*>& rendered_types,
@@ -514,10 +740,13 @@ void Emitter::AddTypeDeclarations(
   }
 }
 
-absl::Status Emitter::AddFunction(clang::FunctionDecl* decl) {
+absl::Status Emitter::AddFunction(clang::FunctionDecl* decl,
+                                  const GeneratorOptions& options) {
   if (rendered_functions_.insert(decl->getQualifiedNameAsString()).second) {
     SAPI_ASSIGN_OR_RETURN(std::string function, EmitFunction(decl));
-    rendered_functions_ordered_.push_back(function);
+    SAPI_ASSIGN_OR_RETURN(std::string overload,
+                          EmitBufferOverload(decl, options));
+    rendered_functions_ordered_.push_back(absl::StrCat(function, overload));
   }
   return absl::OkStatus();
 }
@@ -69,7 +69,11 @@ class Emitter {
   // including the correct headers in the emitted header.
   void AddTypeDeclarations(const std::vector<clang::TypeDecl*>& type_decls);
 
-  absl::Status AddFunction(clang::FunctionDecl* decl);
+  // Adds the wrapper for a function. If it has buffer parameters, see
+  // GeneratorOptions::buffer_annotations, an overload that takes them as spans
+  // is added as well.
+  absl::Status AddFunction(clang::FunctionDecl* decl,
+                           const GeneratorOptions& options);
 
   // Outputs a formatted header for a list of functions and their related types.
   absl::StatusOr<std::string> EmitHeader(const GeneratorOptions& options);
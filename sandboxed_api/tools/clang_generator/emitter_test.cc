@@ -21,6 +21,7 @@
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
@@ -32,8 +33,10 @@ namespace sapi {
 namespace {
 
 using ::testing::ElementsAre;
+using ::testing::HasSubstr;
 using ::testing::IsEmpty;
 using ::testing::MatchesRegex;
+using ::testing::Not;
 using ::testing::SizeIs;
 using ::testing::StrEq;
 using ::testing::StrNe;
@@ -297,6 +300,25 @@ TEST_F(EmitterTest, TypedefStructByValueSkipsFunction) {
   EXPECT_THAT(emitter.GetRenderedFunctions(), IsEmpty());
 }
 
+TEST_F(EmitterTest, ScalarFunctionsUseCallScalar) {
+  EmitterForTesting emitter;
+  ASSERT_THAT(
+      RunFrontendAction(
+          R"(enum E { kA, kB };
+             extern "C" double Scale(int a, float b, E e);
+             extern "C" void Reset(unsigned long seed);
+             extern "C" int Fill(int* data, int size);)",
+          std::make_unique<GeneratorAction>(emitter, GeneratorOptions())),
+      IsOk());
+  ASSERT_THAT(emitter.GetRenderedFunctions(), SizeIs(3));
+  EXPECT_THAT(emitter.GetRenderedFunctions()[0],
+              HasSubstr(R"(sandbox_->CallScalar<double>("Scale", a, b, e))"));
+  EXPECT_THAT(emitter.GetRenderedFunctions()[1],
+              HasSubstr(R"(sandbox_->CallScalar<void>("Reset", seed))"));
+  EXPECT_THAT(emitter.GetRenderedFunctions()[2],
+              Not(HasSubstr("CallScalar")));
+}
+
 TEST_F(EmitterTest, CollectTypedefPointerType) {
   EmitterForTesting emitter;
   EXPECT_THAT(
@@ -381,6 +403,150 @@ TEST_F(EmitterTest, SkipAbseilInternals) {
   EXPECT_THAT(UglifyAll(emitter.SpellingsForNS("")), IsEmpty());
 }
 
+TEST_F(EmitterTest, BufferParametersGetSpanOverload) {
+  EmitterForTesting emitter;
+  ASSERT_THAT(
+      RunFrontendAction(
+          R"(extern "C" int Compress(const unsigned char* in,
+                                     unsigned long in_len,
+                                     unsigned char* out,
+                                     unsigned long out_cap,
+                                     unsigned long* out_len);
+             extern "C" void Fill(void* data, int size);
+             extern "C" void SetFlags(int* flags, int mode);)",
+          std::make_unique<GeneratorAction>(emitter, GeneratorOptions())),
+      IsOk());
+  ASSERT_THAT(emitter.GetRenderedFunctions(), SizeIs(3));
+
+  const std::string& compress = emitter.GetRenderedFunctions()[0];
+  EXPECT_THAT(compress,
+              HasSubstr("Compress(::absl::Span<const unsigned char> in_, "
+                        "::absl::Span<unsigned char> out_, "
+                        "unsigned long* out_len_)"));
+  EXPECT_THAT(compress, HasSubstr("v_in_.PtrBefore(), &v_in_len_, "
+                                  "v_out_.PtrNone(), &v_out_cap_, "
+                                  "v_out_len_.PtrAfter()"));
+  EXPECT_THAT(compress, HasSubstr("::std::min<size_t>(v_out_len_.GetValue(), "
+                                  "out_.size())"));
+  EXPECT_THAT(compress,
+              HasSubstr("TransferFromSandboxee(&v_used_elements)"));
+
+  // Untyped buffers are passed as bytes, in both directions.
+  EXPECT_THAT(emitter.GetRenderedFunctions()[1],
+              HasSubstr("Fill(::absl::Span<uint8_t> data_)"));
+  EXPECT_THAT(emitter.GetRenderedFunctions()[1],
+              HasSubstr("v_data_.PtrBoth(), &v_size_"));
+
+  // "mode" is not the length of "flags".
+  EXPECT_THAT(emitter.GetRenderedFunctions()[2], Not(HasSubstr("Span")));
+}
+
+TEST_F(EmitterTest, BufferNamedUsedIsNotShadowed) {
+  EmitterForTesting emitter;
+  ASSERT_THAT(
+      RunFrontendAction(
+          R"(extern "C" void Drain(unsigned char* used,
+                                  unsigned long used_cap,
+                                  unsigned long* used_len);)",
+          std::make_unique<GeneratorAction>(emitter, GeneratorOptions())),
+      IsOk());
+  ASSERT_THAT(emitter.GetRenderedFunctions(), SizeIs(1));
+
+  const std::string& drain = emitter.GetRenderedFunctions()[0];
+  EXPECT_THAT(drain, HasSubstr("Drain(::absl::Span<unsigned char> used_, "
+                               "unsigned long* used_len_)"));
+  EXPECT_THAT(drain, HasSubstr("v_used_elements.SetRemote("
+                               "v_used_.GetRemote())"));
+}
+
+TEST_F(EmitterTest, BufferLengthNamesMatchWholeWords) {
+  EmitterForTesting emitter;
+  ASSERT_THAT(
+      RunFrontendAction(
+          R"(extern "C" void Tag(int* values, int enum_kind);
+             extern "C" void Quote(char* text, int escape);
+             extern "C" void Match(const char* pattern, int capture);
+             extern "C" void Debit(double* amounts, long account);
+             extern "C" void Copy(const char* src, int numBytes);
+             extern "C" void Read(char* buf, unsigned buflen);)",
+          std::make_unique<GeneratorAction>(emitter, GeneratorOptions())),
+      IsOk());
+  ASSERT_THAT(emitter.GetRenderedFunctions(), SizeIs(6));
+
+  // Length words inside other words do not count.
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_THAT(emitter.GetRenderedFunctions()[i], Not(HasSubstr("Span")));
+  }
+  EXPECT_THAT(emitter.GetRenderedFunctions()[4],
+              HasSubstr("Copy(::absl::Span<const char> src_)"));
+  EXPECT_THAT(emitter.GetRenderedFunctions()[5],
+              HasSubstr("Read(::absl::Span<char> buf_)"));
+}
+
+TEST_F(EmitterTest, BufferDetectionCanBeDisabled) {
+  GeneratorOptions options;
+  options.set_detect_buffers(false);
+
+  EmitterForTesting emitter;
+  ASSERT_THAT(
+      RunFrontendAction(R"(extern "C" void Fill(int* data, int size);)",
+                        std::make_unique<GeneratorAction>(emitter, options)),
+      IsOk());
+  ASSERT_THAT(emitter.GetRenderedFunctions(), SizeIs(1));
+  EXPECT_THAT(emitter.GetRenderedFunctions()[0], Not(HasSubstr("Span")));
+}
+
+TEST_F(EmitterTest, AnnotatedBufferParameters) {
+  GeneratorOptions options;
+  SAPI_ASSERT_OK_AND_ASSIGN(options.buffer_annotations,
+                            ParseBufferAnnotations(R"(
+                              # Capacity is passed in dest_len
+                              Uncompress:dest::dest_len
+                              Uncompress:source:source_len)"));
+
+  EmitterForTesting emitter;
+  ASSERT_THAT(
+      RunFrontendAction(
+          R"(extern "C" int Uncompress(unsigned char* dest,
+                                       unsigned long* dest_len,
+                                       const unsigned char* source,
+                                       unsigned long source_len);)",
+          std::make_unique<GeneratorAction>(emitter, options)),
+      IsOk());
+  ASSERT_THAT(emitter.GetRenderedFunctions(), SizeIs(1));
+  EXPECT_THAT(emitter.GetRenderedFunctions()[0],
+              HasSubstr("Uncompress(::absl::Span<unsigned char> dest_, "
+                        "unsigned long* dest_len_, "
+                        "::absl::Span<const unsigned char> source_)"));
+  EXPECT_THAT(
+      emitter.GetRenderedFunctions()[0],
+      HasSubstr("v_dest_len_(static_cast<unsigned long>(dest_.size()))"));
+  EXPECT_THAT(emitter.GetRenderedFunctions()[0],
+              HasSubstr("v_dest_.PtrNone(), v_dest_len_.PtrBoth(), "
+                        "v_source_.PtrBefore(), &v_source_len_"));
+}
+
+TEST_F(EmitterTest, MismatchedAnnotationFails) {
+  GeneratorOptions options;
+  SAPI_ASSERT_OK_AND_ASSIGN(options.buffer_annotations,
+                            ParseBufferAnnotations("Fill:data:length"));
+
+  EmitterForTesting emitter;
+  EXPECT_THAT(
+      RunFrontendAction(R"(extern "C" void Fill(int* data, int size);)",
+                        std::make_unique<GeneratorAction>(emitter, options)),
+      Not(IsOk()));
+}
+
+TEST(ParseBufferAnnotations, RejectsMalformedLines) {
+  EXPECT_THAT(ParseBufferAnnotations("Fill:data").status(),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParseBufferAnnotations("Fill:data:").status(),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParseBufferAnnotations("Fill:data:size:written:extra").status(),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
 TEST(IncludeGuard, CreatesRandomizedGuardForEmptyFilename) {
   // Copybara will transform the string. This is intentional.
   constexpr absl::string_view kGeneratedHeaderPrefix =
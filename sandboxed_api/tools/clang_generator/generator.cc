@@ -20,10 +20,14 @@
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
 #include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "absl/strings/strip.h"
 #include "clang/AST/ASTContext.h"
@@ -55,6 +59,34 @@ std::string GetOutputFilename(absl::string_view source_file) {
   return ReplaceFileExtension(source_file, ".sapi.h");
 }
 
+absl::StatusOr<absl::flat_hash_map<std::string, std::vector<BufferAnnotation>>>
+ParseBufferAnnotations(absl::string_view contents) {
+  absl::flat_hash_map<std::string, std::vector<BufferAnnotation>> result;
+  int line_number = 0;
+  for (absl::string_view line : absl::StrSplit(contents, '\n')) {
+    ++line_number;
+    line = absl::StripAsciiWhitespace(line);
+    if (line.empty() || absl::StartsWith(line, "#")) {
+      continue;
+    }
+    std::vector<absl::string_view> fields = absl::StrSplit(line, ':');
+    if (fields.size() < 3 || fields.size() > 4 || fields[0].empty() ||
+        fields[1].empty() || (fields[2].empty() && fields.size() == 3)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("invalid buffer annotation in line ", line_number,
+                       ": '", line, "'"));
+    }
+    BufferAnnotation& annotation =
+        result[std::string(fields[0])].emplace_back();
+    annotation.buffer = std::string(fields[1]);
+    annotation.length = std::string(fields[2]);
+    if (fields.size() == 4) {
+      annotation.out_length = std::string(fields[3]);
+    }
+  }
+  return result;
+}
+
 bool GeneratorASTVisitor::VisitTypeDecl(clang::TypeDecl* decl) {
   collector_.RecordOrderedDecl(decl);
   return true;
@@ -121,7 +153,7 @@ void GeneratorASTConsumer::HandleTranslationUnit(clang::ASTContext& context) {
   // TODO(cblichmann): Move below to emit all functions after traversing TUs.
   emitter_.AddTypeDeclarations(visitor_.collector().GetTypeDeclarations());
   for (clang::FunctionDecl* func : visitor_.functions()) {
-    absl::Status status = emitter_.AddFunction(func);
+    absl::Status status = emitter_.AddFunction(func, options_);
     if (!status.ok()) {
       clang::SourceLocation loc =
           GetDiagnosticLocationFromStatus(status).value_or(func->getBeginLoc());
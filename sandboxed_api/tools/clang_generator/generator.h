@@ -20,7 +20,9 @@
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/Decl.h"
@@ -55,12 +57,25 @@ struct GeneratorOptions {
     return *this;
   }
 
+  GeneratorOptions& set_detect_buffers(bool value) {
+    detect_buffers = value;
+    return *this;
+  }
+
   bool has_namespace() const { return !namespace_name.empty(); }
 
   absl::flat_hash_set<std::string> function_names;
   absl::flat_hash_set<std::string> in_files;
   bool limit_scan_depth = false;
 
+  // Buffer parameters by function name. For each buffer parameter that is
+  // passed with its length, an overload taking an absl::Span<> is emitted,
+  // which only transfers the elements in use. Functions that are not listed
+  // here use heuristics to find buffer parameters if detect_buffers is set.
+  absl::flat_hash_map<std::string, std::vector<BufferAnnotation>>
+      buffer_annotations;
+  bool detect_buffers = true;
+
   // Output options
   std::string work_dir;
   std::string name;            // Name of the Sandboxed API
@@ -97,7 +112,10 @@ class GeneratorASTConsumer : public clang::ASTConsumer {
  public:
   GeneratorASTConsumer(std::string in_file, Emitter& emitter,
                        const GeneratorOptions& options)
-      : in_file_(std::move(in_file)), visitor_(options), emitter_(emitter) {}
+      : in_file_(std::move(in_file)),
+        visitor_(options),
+        emitter_(emitter),
+        options_(options) {}
 
  private:
   void HandleTranslationUnit(clang::ASTContext& context) override;
@@ -105,6 +123,7 @@ class GeneratorASTConsumer : public clang::ASTConsumer {
   std::string in_file_;
   GeneratorASTVisitor visitor_;
   Emitter& emitter_;
+  const GeneratorOptions& options_;
 };
 
 class GeneratorAction : public clang::ASTFrontendAction {
@@ -159,6 +178,17 @@ class GeneratorFactory : public clang::tooling::FrontendActionFactory {
 
 std::string GetOutputFilename(absl::string_view source_file);
 
+// Parses buffer annotations for GeneratorOptions::buffer_annotations. Each
+// non-empty line that does not start with '#' has the form
+//   function:buffer:length[:out_length]
+// where the names refer to the parameters of the function. The length can be
+// left empty if out_length also passes the capacity of the buffer, like for
+// zlib's uncompress():
+//   uncompress:dest::destLen
+//   uncompress:source:sourceLen
+absl::StatusOr<absl::flat_hash_map<std::string, std::vector<BufferAnnotation>>>
+ParseBufferAnnotations(absl::string_view contents);
+
 inline absl::string_view ToStringView(llvm::StringRef ref) {
   return absl::string_view(ref.data(), ref.size());
 }
@@ -46,6 +46,16 @@ static auto* g_extra_help = new llvm::cl::extrahelp(
     "Report bugs to <https://github.com/google/sandboxed-api/issues>\n");
 
 // Command line options
+static auto* g_sapi_annotations = new llvm::cl::opt<std::string>(
+    "sapi_annotations",
+    llvm::cl::desc("File with buffer annotations of function parameters, one "
+                   "'function:buffer:length[:out_length]' per line"),
+    llvm::cl::cat(*g_tool_category));
+static auto* g_sapi_detect_buffers = new llvm::cl::opt<bool>(
+    "sapi_detect_buffers", llvm::cl::init(true),
+    llvm::cl::desc("Whether to detect buffer parameters of functions without "
+                   "annotations by their names and types"),
+    llvm::cl::cat(*g_tool_category));
 static auto* g_sapi_embed_dir = new llvm::cl::opt<std::string>(
     "sapi_embed_dir", llvm::cl::desc("Directory with embedded includes"),
     llvm::cl::cat(*g_tool_category));
@@ -99,6 +109,7 @@ GeneratorOptions GeneratorOptionsFromFlags(
             : sapi::file::JoinPath(options.work_dir, input));
   }
   options.set_limit_scan_depth(*g_sapi_limit_scan_depth);
+  options.set_detect_buffers(*g_sapi_detect_buffers);
   options.name = *g_sapi_name;
   options.namespace_name = *g_sapi_ns;
   options.out_file =
@@ -127,6 +138,13 @@ absl::Status GeneratorMain(int argc, char* argv[]) {
   }
 
   auto options = sapi::GeneratorOptionsFromFlags(sources);
+  if (!g_sapi_annotations->empty()) {
+    std::string annotations;
+    SAPI_RETURN_IF_ERROR(sapi::file::GetContents(
+        *g_sapi_annotations, &annotations, sapi::file::Defaults()));
+    SAPI_ASSIGN_OR_RETURN(options.buffer_annotations,
+                          ParseBufferAnnotations(annotations));
+  }
   sapi::Emitter emitter;
 
   std::unique_ptr<clang::tooling::CompilationDatabase> db =
@@ -18,11 +18,18 @@
 #include <vector>
 
 #include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Decl.h"
 #include "clang/AST/QualTypeNames.h"
 #include "clang/AST/Type.h"
+#include "sandboxed_api/tools/clang_generator/diagnostics.h"
+#include "sandboxed_api/util/status_macros.h"
 
 namespace sapi {
 namespace {
@@ -339,4 +346,155 @@ std::string MapQualTypeReturn(const clang::ASTContext& context,
       ">");
 }
 
+namespace {
+
+// Returns whether the parameter points to data that can be transferred as an
+// array.
+bool IsBufferPointer(clang::QualType qual) {
+  if (!qual->isPointerType()) {
+    return false;
+  }
+  clang::QualType pointee = qual->getPointeeType();
+  return pointee->isVoidType() || pointee->isArithmeticType() ||
+         pointee->isEnumeralType();
+}
+
+bool IsLengthType(clang::QualType qual) {
+  return qual->isIntegerType() && !qual->isBooleanType() &&
+         !qual->isEnumeralType();
+}
+
+bool IsOutLengthPointer(clang::QualType qual) {
+  return qual->isPointerType() && IsLengthType(qual->getPointeeType()) &&
+         !qual->getPointeeType().isConstQualified();
+}
+
+// Splits an identifier into lower case words, at underscores and where a
+// capitalized word starts. For example, "out_bufLen" becomes "out", "buf" and
+// "len".
+std::vector<std::string> SplitIntoWords(absl::string_view name) {
+  std::vector<std::string> words;
+  std::string word;
+  for (size_t i = 0; i < name.size(); ++i) {
+    const char c = name[i];
+    const bool starts_word = c == '_' || (absl::ascii_isupper(c) && i > 0 &&
+                                          absl::ascii_islower(name[i - 1]));
+    if (starts_word && !word.empty()) {
+      words.push_back(std::move(word));
+      word.clear();
+    }
+    if (c != '_') {
+      word.push_back(absl::ascii_tolower(c));
+    }
+  }
+  if (!word.empty()) {
+    words.push_back(std::move(word));
+  }
+  return words;
+}
+
+// Only whole words of the name count, so that names like "enum_kind",
+// "escape" or "account" are not taken for lengths. Words like "buflen" or
+// "bufsize" are matched by their suffix.
+bool HasLengthName(const clang::ParmVarDecl* param) {
+  static const auto* kLengthWords = new absl::flat_hash_set<std::string>({
+      "n", "len", "length", "size", "sz", "count", "cnt", "cap", "capacity",
+      "num", "nbytes", "nmemb", "nelem", "nelems",
+  });
+  for (const std::string& word : SplitIntoWords(param->getName().str())) {
+    if (kLengthWords->contains(word) || absl::EndsWith(word, "len") ||
+        absl::EndsWith(word, "size")) {
+      return true;
+    }
+  }
+  return false;
+}
+
+absl::StatusOr<int> FindParam(const clang::FunctionDecl* decl,
+                              absl::string_view name) {
+  for (int i = 0; i < decl->getNumParams(); ++i) {
+    if (decl->getParamDecl(i)->getName().str() == name) {
+      return i;
+    }
+  }
+  return MakeStatusWithDiagnostic(
+      decl->getBeginLoc(), absl::StatusCode::kInvalidArgument,
+      absl::StrCat("annotated parameter '", name, "' not found"));
+}
+
+absl::StatusOr<BufferParam> ResolveAnnotation(
+    const clang::FunctionDecl* decl, const BufferAnnotation& annotation) {
+  auto error = [decl](absl::string_view name, absl::string_view what) {
+    return MakeStatusWithDiagnostic(
+        decl->getBeginLoc(), absl::StatusCode::kInvalidArgument,
+        absl::StrCat("annotated parameter '", name, "' is not ", what));
+  };
+  BufferParam result;
+  SAPI_ASSIGN_OR_RETURN(result.buffer, FindParam(decl, annotation.buffer));
+  const clang::QualType buffer = decl->getParamDecl(result.buffer)->getType();
+  if (!IsBufferPointer(buffer)) {
+    return error(annotation.buffer, "a pointer to scalars");
+  }
+  if (!annotation.length.empty()) {
+    SAPI_ASSIGN_OR_RETURN(result.length, FindParam(decl, annotation.length));
+    if (!IsLengthType(decl->getParamDecl(result.length)->getType())) {
+      return error(annotation.length, "an integer");
+    }
+  }
+  if (!annotation.out_length.empty()) {
+    if (buffer->getPointeeType().isConstQualified()) {
+      return error(annotation.buffer, "an output buffer");
+    }
+    SAPI_ASSIGN_OR_RETURN(result.out_length,
+                          FindParam(decl, annotation.out_length));
+    if (!IsOutLengthPointer(decl->getParamDecl(result.out_length)->getType())) {
+      return error(annotation.out_length, "a pointer to an integer");
+    }
+  }
+  if (result.length < 0 && result.out_length < 0) {
+    return error(annotation.buffer, "annotated with a length");
+  }
+  return result;
+}
+
+}  // namespace
+
+absl::StatusOr<std::vector<BufferParam>> GetBufferParams(
+    const clang::FunctionDecl* decl,
+    const std::vector<BufferAnnotation>& annotations) {
+  std::vector<BufferParam> result;
+  if (!annotations.empty()) {
+    for (const BufferAnnotation& annotation : annotations) {
+      SAPI_ASSIGN_OR_RETURN(BufferParam param,
+                            ResolveAnnotation(decl, annotation));
+      result.push_back(param);
+    }
+    return result;
+  }
+
+  const int num_params = decl->getNumParams();
+  auto is_length = [decl, num_params](int i) {
+    return i < num_params && IsLengthType(decl->getParamDecl(i)->getType()) &&
+           HasLengthName(decl->getParamDecl(i));
+  };
+  auto is_out_length = [decl, num_params](int i) {
+    return i < num_params &&
+           IsOutLengthPointer(decl->getParamDecl(i)->getType()) &&
+           HasLengthName(decl->getParamDecl(i));
+  };
+  for (int i = 0; i < num_params; ++i) {
+    const clang::QualType qual = decl->getParamDecl(i)->getType();
+    if (!IsBufferPointer(qual) || !is_length(i + 1)) {
+      continue;
+    }
+    BufferParam& param = result.emplace_back();
+    param.buffer = i;
+    param.length = ++i;
+    if (!qual->getPointeeType().isConstQualified() && is_out_length(i + 1)) {
+      param.out_length = ++i;
+    }
+  }
+  return result;
+}
+
 }  // namespace sapi
@@ -19,6 +19,7 @@
 #include <vector>
 
 #include "absl/container/flat_hash_set.h"
+#include "absl/status/statusor.h"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Decl.h"
 #include "clang/AST/Type.h"
@@ -96,6 +97,40 @@ std::string MapQualTypeParameter(const clang::ASTContext& context,
 std::string MapQualTypeReturn(const clang::ASTContext& context,
                               clang::QualType qual);
 
+// A buffer parameter of a function that is passed together with its length,
+// like in
+//   int Compress(const uint8_t* in, size_t in_len,
+//                uint8_t* out, size_t out_cap, size_t* out_len);
+// Members are parameter indices, -1 if not present.
+struct BufferParam {
+  int buffer = -1;
+  // Number of elements in the buffer. For output buffers, this is the capacity.
+  int length = -1;
+  // Points to the number of elements the function wrote to an output buffer.
+  // If there is no length parameter, it also holds the capacity on input.
+  int out_length = -1;
+};
+
+// A buffer parameter given by parameter names, as read from an annotations
+// file. Unset names are empty.
+struct BufferAnnotation {
+  std::string buffer;
+  std::string length;
+  std::string out_length;
+};
+
+// Returns the buffer parameters of a function. If annotations is non-empty,
+// only the annotated parameters are returned. Otherwise, a pointer to scalars
+// or void directly followed by an integer parameter whose name suggests a
+// length (like "len", "size" or "count") is considered a buffer. If the
+// pointee is non-const and a pointer to an integer with such a name follows
+// as well, that parameter receives the number of elements written.
+// Fails with an InvalidArgumentError if an annotation does not match the
+// function.
+absl::StatusOr<std::vector<BufferParam>> GetBufferParams(
+    const clang::FunctionDecl* decl,
+    const std::vector<BufferAnnotation>& annotations);
+
 }  // namespace sapi
 
 #endif  // SANDBOXED_API_TOOLS_CLANG_GENERATOR_TYPES_H_
@@ -0,0 +1,75 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Static tracepoints (USDT probes) for tools like bpftrace and perf.
+//
+// A probe compiles to a single nop plus a note in the .note.stapsdt section
+// describing where its arguments live. It costs nothing unless a tracer
+// attaches to it, and no rebuild is needed to do so. For example:
+//
+//   bpftrace -e 'usdt:./binary:sapi:call_entry { @[str(arg0)] = count(); }'
+//   perf probe -x ./binary sdt_sandbox2:fork_done
+//
+// Probes are compiled in when <sys/sdt.h> (systemtap-sdt-dev) is available and
+// SAPI_DISABLE_TRACEPOINTS is not defined. Otherwise they expand to nothing
+// and their arguments are not evaluated. Arguments must be integers or
+// pointers, at most 12 of them.
+//
+// Providers and probes (strings are NUL-terminated unless a length follows):
+//   sandbox2:spawn_admission(priority, queue_wait_ns, admitted)
+//   sandbox2:forkserver_request(mode, clone_flags)
+//   sandbox2:fork_done(sandboxee_pid, init_pid, fork_latency_ns)
+//   sandbox2:namespaces_ready(clone_flags)
+//   sandbox2:policy_installed(filter_length, unotify)
+//   sandbox2:monitor_event(pid, status_or_syscall_nr)
+//   sandbox2:violation(pid, syscall_nr, violation_type)
+//   sandbox2:sandbox_exit(pid, final_status, reason_code)
+//   sapi:call_entry(func_name, request_size, argc)
+//   sapi:call_return(func_name, ret_size, ok)
+//   sapi:scalar_call_entry(func_name, func_name_len, request_size, argc)
+//   sapi:scalar_call_return(func_name, func_name_len, ret_size, ok)
+//   sapi:transfer_to_sandboxee(pid, remote_addr, size, transferred)
+//   sapi:transfer_from_sandboxee(pid, remote_addr, size, transferred)
+
+#ifndef SANDBOXED_API_UTIL_TRACEPOINT_H_
+#define SANDBOXED_API_UTIL_TRACEPOINT_H_
+
+#if !defined(SAPI_DISABLE_TRACEPOINTS) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SAPI_HAVE_TRACEPOINTS 1
+#endif
+#endif
+
+#ifdef SAPI_HAVE_TRACEPOINTS
+#define SAPI_TRACEPOINT(provider, name, ...) \
+  STAP_PROBEV(provider, name, ##__VA_ARGS__)
+#else
+// Keeps values only computed for a probe from being reported as unused.
+#define SAPI_TRACEPOINT(provider, name, ...)                    \
+  do {                                                          \
+    if (false) {                                                \
+      ::sapi::tracepoint_internal::IgnoreArgs(__VA_ARGS__);     \
+    }                                                           \
+  } while (0)
+
+namespace sapi::tracepoint_internal {
+
+template <typename... Args>
+inline void IgnoreArgs(const Args&...) {}
+
+}  // namespace sapi::tracepoint_internal
+#endif
+
+#endif  // SANDBOXED_API_UTIL_TRACEPOINT_H_
@@ -17,7 +17,6 @@
 #include "sandboxed_api/var_abstract.h"
 
 #include <sys/types.h>
-#include <sys/uio.h>
 
 #include <memory>
 #include <string>
@@ -28,13 +27,16 @@
 #include "sandboxed_api/rpcchannel.h"
 #include "sandboxed_api/util/raw_logging.h"
 #include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/util/tracepoint.h"
 #include "sandboxed_api/var_ptr.h"
+#include "sandboxed_api/vm_transfer.h"
 
 namespace sapi::v {
 
 Var::~Var() {
   if (free_rpc_channel_ && GetRemote()) {
-    this->Free(free_rpc_channel_).IgnoreError();
+    // Sent along with the next request, avoids a round trip per variable.
+    free_rpc_channel_->FreeDeferred(GetRemote());
   }
 }
 
@@ -103,16 +105,11 @@ absl::Status Var::TransferToSandboxee(RPCChannel* rpc_channel, pid_t pid) {
         absl::StrCat("Object: ", GetType(), " has no remote object set"));
   }
 
-  struct iovec local = {
-      .iov_base = GetLocal(),
-      .iov_len = GetSize(),
-  };
-  struct iovec remote = {
-      .iov_base = GetRemote(),
-      .iov_len = GetSize(),
-  };
-
-  ssize_t ret = process_vm_writev(pid, &local, 1, &remote, 1, 0);
+  ssize_t ret =
+      internal::TransferVm(pid, /*write=*/true, GetLocal(), GetRemote(),
+                           GetSize());
+  SAPI_TRACEPOINT(sapi, transfer_to_sandboxee, pid, GetRemote(), GetSize(),
+                  ret);
   if (ret == -1) {
     PLOG(WARNING) << "process_vm_writev(pid: " << pid
                   << " laddr: " << GetLocal() << " raddr: " << GetRemote()
@@ -139,16 +136,11 @@ absl::Status Var::TransferFromSandboxee(RPCChannel* rpc_channel, pid_t pid) {
         absl::StrCat("Object: ", GetType(), " has no local storage set"));
   }
 
-  struct iovec local = {
-      .iov_base = GetLocal(),
-      .iov_len = GetSize(),
-  };
-  struct iovec remote = {
-      .iov_base = GetRemote(),
-      .iov_len = GetSize(),
-  };
-
-  ssize_t ret = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+  ssize_t ret =
+      internal::TransferVm(pid, /*write=*/false, GetLocal(), GetRemote(),
+                           GetSize());
+  SAPI_TRACEPOINT(sapi, transfer_from_sandboxee, pid, GetRemote(), GetSize(),
+                  ret);
   if (ret == -1) {
     PLOG(WARNING) << "process_vm_readv(pid: " << pid << " laddr: " << GetLocal()
                   << " raddr: " << GetRemote() << " size: " << GetSize() << ")";
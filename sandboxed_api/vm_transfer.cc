@@ -0,0 +1,226 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/vm_transfer.h"
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace sapi {
+namespace {
+
+ABSL_CONST_INIT absl::Mutex g_options_mutex(absl::kConstInit);
+VmTransferOptions& Options() ABSL_EXCLUSIVE_LOCKS_REQUIRED(g_options_mutex) {
+  static auto* options = new VmTransferOptions();
+  return *options;
+}
+
+// Threads that help with split transfers. They are started on first use and
+// never exit.
+class TransferThreads {
+ public:
+  static TransferThreads& Get() {
+    static auto* threads = new TransferThreads();
+    return *threads;
+  }
+
+  // Runs task on count threads of the pool, starting more threads if needed.
+  void Schedule(int count, const std::function<void()>& task) {
+    absl::MutexLock lock(&mutex_);
+    for (; threads_ < count; ++threads_) {
+      std::thread(&TransferThreads::Work, this).detach();
+    }
+    for (int i = 0; i < count; ++i) {
+      tasks_.push_back(task);
+    }
+  }
+
+ private:
+  bool HasTask() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return !tasks_.empty();
+  }
+
+  void Work() {
+    while (true) {
+      std::function<void()> task;
+      {
+        absl::MutexLock lock(&mutex_,
+                             absl::Condition(this, &TransferThreads::HasTask));
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+  absl::Mutex mutex_;
+  int threads_ ABSL_GUARDED_BY(mutex_) = 0;
+  std::deque<std::function<void()>> tasks_ ABSL_GUARDED_BY(mutex_);
+};
+
+// A transfer split into chunks. Chunks are claimed by the calling thread and
+// the pool threads alike. Pool threads may only get to it after all chunks are
+// done, so it is shared with them.
+class SplitTransfer {
+ public:
+  SplitTransfer(pid_t pid, bool write, void* local, void* remote, size_t size,
+                size_t chunk_size)
+      : pid_(pid),
+        write_(write),
+        local_(static_cast<uint8_t*>(local)),
+        remote_(static_cast<uint8_t*>(remote)),
+        size_(size),
+        chunk_size_(chunk_size),
+        // Align the chunks to the remote address, so that each of them pins
+        // whole pages of the sandboxee only once.
+        first_chunk_size_(std::min(
+            size,
+            chunk_size - reinterpret_cast<uintptr_t>(remote) % chunk_size)),
+        chunks_(1 + (size - first_chunk_size_ + chunk_size - 1) / chunk_size) {
+  }
+
+  // Copies chunks until none are left.
+  void Run() {
+    for (size_t i; (i = next_.fetch_add(1)) < chunks_;) {
+      const size_t offset =
+          i == 0 ? 0 : first_chunk_size_ + (i - 1) * chunk_size_;
+      const size_t len =
+          i == 0 ? first_chunk_size_ : std::min(chunk_size_, size_ - offset);
+      ssize_t ret = -1;
+      int error = 0;
+      if (!failed_.load(std::memory_order_relaxed)) {
+        struct iovec local = {
+            .iov_base = local_ + offset,
+            .iov_len = len,
+        };
+        struct iovec remote = {
+            .iov_base = remote_ + offset,
+            .iov_len = len,
+        };
+        ret = write_ ? process_vm_writev(pid_, &local, 1, &remote, 1, 0)
+                     : process_vm_readv(pid_, &local, 1, &remote, 1, 0);
+        error = errno;
+      }
+      absl::MutexLock lock(&mutex_);
+      if (ret == -1) {
+        // Skip the remaining chunks, the transfer failed anyway.
+        failed_ = true;
+        if (error_ == 0) {
+          error_ = error;
+        }
+      } else {
+        transferred_ += ret;
+      }
+      ++done_;
+    }
+  }
+
+  // Waits for all chunks and returns the result like process_vm_readv().
+  ssize_t Await() {
+    absl::MutexLock lock(&mutex_,
+                         absl::Condition(this, &SplitTransfer::AllDone));
+    if (failed_) {
+      errno = error_;
+      return -1;
+    }
+    return transferred_;
+  }
+
+  size_t chunks() const { return chunks_; }
+
+ private:
+  bool AllDone() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return done_ == chunks_;
+  }
+
+  const pid_t pid_;
+  const bool write_;
+  uint8_t* const local_;
+  uint8_t* const remote_;
+  const size_t size_;
+  const size_t chunk_size_;
+  const size_t first_chunk_size_;
+  const size_t chunks_;
+  std::atomic<size_t> next_ = 0;
+  std::atomic<bool> failed_ = false;
+
+  absl::Mutex mutex_;
+  size_t done_ ABSL_GUARDED_BY(mutex_) = 0;
+  ssize_t transferred_ ABSL_GUARDED_BY(mutex_) = 0;
+  int error_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+}  // namespace
+
+void SetVmTransferOptions(const VmTransferOptions& options) {
+  absl::MutexLock lock(&g_options_mutex);
+  Options() = options;
+}
+
+VmTransferOptions GetVmTransferOptions() {
+  absl::MutexLock lock(&g_options_mutex);
+  return Options();
+}
+
+namespace internal {
+
+ssize_t TransferVm(pid_t pid, bool write, void* local, void* remote,
+                   size_t size) {
+  const VmTransferOptions options = GetVmTransferOptions();
+  if (options.threads <= 1 || size < options.parallel_threshold ||
+      size == 0) {
+    struct iovec local_iov = {
+        .iov_base = local,
+        .iov_len = size,
+    };
+    struct iovec remote_iov = {
+        .iov_base = remote,
+        .iov_len = size,
+    };
+    return write ? process_vm_writev(pid, &local_iov, 1, &remote_iov, 1, 0)
+                 : process_vm_readv(pid, &local_iov, 1, &remote_iov, 1, 0);
+  }
+
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t chunk_size =
+      std::max<size_t>(1, (options.chunk_size + page_size - 1) / page_size) *
+      page_size;
+  auto transfer = std::make_shared<SplitTransfer>(pid, write, local, remote,
+                                                  size, chunk_size);
+  const int helpers = static_cast<int>(
+      std::min<size_t>(options.threads - 1, transfer->chunks() - 1));
+  if (helpers > 0) {
+    TransferThreads::Get().Schedule(helpers, [transfer] { transfer->Run(); });
+  }
+  transfer->Run();
+  return transfer->Await();
+}
+
+}  // namespace internal
+}  // namespace sapi
@@ -0,0 +1,56 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_VM_TRANSFER_H_
+#define SANDBOXED_API_VM_TRANSFER_H_
+
+#include <sys/types.h>
+
+#include <cstddef>
+
+namespace sapi {
+
+// Controls how v::Var::TransferToSandboxee() and TransferFromSandboxee() copy
+// large variables. A single process_vm_writev()/process_vm_readv() call only
+// uses the memory bandwidth one core can drive, so transfers of at least
+// parallel_threshold bytes are split into chunks that a small internal thread
+// pool copies in parallel.
+struct VmTransferOptions {
+  // Transfers of at least this many bytes are split.
+  size_t parallel_threshold = size_t{64} << 20;  // 64 MiB
+  // Size of the chunks, rounded up to a multiple of the page size. Chunk
+  // boundaries are page-aligned in the sandboxee.
+  size_t chunk_size = size_t{8} << 20;  // 8 MiB
+  // Number of threads copying a transfer, including the calling one. 1
+  // disables splitting.
+  int threads = 4;
+};
+
+// Sets the options of all later transfers. Thread-safe.
+void SetVmTransferOptions(const VmTransferOptions& options);
+VmTransferOptions GetVmTransferOptions();
+
+namespace internal {
+
+// Like a process_vm_writev() (if write is true) or process_vm_readv() call
+// with a single local and remote iovec of size bytes each, but split as set by
+// SetVmTransferOptions(). Returns the number of bytes transferred, or -1 with
+// errno set if any chunk failed.
+ssize_t TransferVm(pid_t pid, bool write, void* local, void* remote,
+                   size_t size);
+
+}  // namespace internal
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_VM_TRANSFER_H_
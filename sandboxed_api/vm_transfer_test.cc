@@ -0,0 +1,135 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/vm_transfer.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "sandboxed_api/examples/sum/sum-sapi.sapi.h"
+#include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/testing.h"
+#include "sandboxed_api/util/status_matchers.h"
+#include "sandboxed_api/vars.h"
+
+namespace sapi {
+namespace {
+
+using ::sapi::IsOk;
+using ::testing::Eq;
+
+// Restores the default options after each test.
+class VmTransferTest : public ::testing::Test {
+ protected:
+  void TearDown() override { SetVmTransferOptions(VmTransferOptions()); }
+
+  static void SetSplit(size_t chunk_size, int threads) {
+    VmTransferOptions options;
+    options.parallel_threshold = 1;
+    options.chunk_size = chunk_size;
+    options.threads = threads;
+    SetVmTransferOptions(options);
+  }
+};
+
+std::vector<uint8_t> TestData(size_t size) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = i % 251;
+  }
+  return data;
+}
+
+// Transfers within the test process, so that no sandbox is needed.
+TEST_F(VmTransferTest, SplitsUnalignedTransfers) {
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  // Chunks are rounded up to a page, and the remote buffer does not start at
+  // a page boundary, so that the first and last chunks are short.
+  SetSplit(page_size + 1, 4);
+  const std::vector<uint8_t> data = TestData(10 * page_size + 123);
+  std::vector<uint8_t> remote(data.size() + 2 * page_size);
+  uint8_t* remote_data = remote.data() + 77;
+
+  EXPECT_THAT(internal::TransferVm(getpid(), /*write=*/true,
+                                   const_cast<uint8_t*>(data.data()),
+                                   remote_data, data.size()),
+              Eq(data.size()));
+  EXPECT_THAT(std::vector<uint8_t>(remote_data, remote_data + data.size()),
+              Eq(data));
+
+  std::vector<uint8_t> local(data.size());
+  EXPECT_THAT(internal::TransferVm(getpid(), /*write=*/false, local.data(),
+                                   remote_data, local.size()),
+              Eq(local.size()));
+  EXPECT_THAT(local, Eq(data));
+}
+
+TEST_F(VmTransferTest, FailsIfAnyChunkFails) {
+  SetSplit(1, 4);
+  std::vector<uint8_t> local(1 << 20);
+  errno = 0;
+  EXPECT_THAT(internal::TransferVm(getpid(), /*write=*/false, local.data(),
+                                   reinterpret_cast<void*>(16), local.size()),
+              Eq(-1));
+  EXPECT_THAT(errno, Eq(EFAULT));
+}
+
+TEST_F(VmTransferTest, TransfersArrays) {
+  SKIP_SANITIZERS_AND_COVERAGE;
+  SetSplit(4096, 3);
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  std::vector<uint8_t> data = TestData(1 << 20);
+  v::Array<uint8_t> array(data.data(), data.size());
+  ASSERT_THAT(sandbox.Allocate(&array, /*automatic_free=*/true), IsOk());
+  ASSERT_THAT(sandbox.TransferToSandboxee(&array), IsOk());
+
+  const std::vector<uint8_t> expected = data;
+  std::fill(data.begin(), data.end(), 0);
+  ASSERT_THAT(sandbox.TransferFromSandboxee(&array), IsOk());
+  EXPECT_THAT(data, Eq(expected));
+}
+
+// Measures the throughput of a large transfer to a sandboxee. The arguments
+// are the size in MiB and the number of threads.
+void BenchmarkSplitTransfer(benchmark::State& state) {
+  VmTransferOptions options;
+  options.threads = state.range(1);
+  SetVmTransferOptions(options);
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  const size_t size = static_cast<size_t>(state.range(0)) << 20;
+  v::Array<uint8_t> array(size);
+  ASSERT_THAT(sandbox.Allocate(&array, /*automatic_free=*/true), IsOk());
+  for (auto _ : state) {
+    ASSERT_THAT(sandbox.TransferToSandboxee(&array), IsOk());
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  SetVmTransferOptions(VmTransferOptions());
+}
+BENCHMARK(BenchmarkSplitTransfer)
+    ->ArgNames({"mib", "threads"})
+    ->ArgsProduct({{256, 1024}, {1, 2, 4, 8, 16}})
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace sapi